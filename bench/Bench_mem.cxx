@@ -0,0 +1,267 @@
+#define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include "bins/buddy_bin.hpp"
+#include "bins/slab_bin.hpp"
+#include "bins/static_bin.hpp"
+#include "bins/tlsf_bin.hpp"
+#include "mem_literals.hpp"
+#include "memops.hpp"
+#include "mmgr.hpp"
+#include "segment.hpp"
+#include <catch2/catch.hpp>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace libmem = shm_kernel::memory_manager;
+
+namespace {
+
+constexpr size_t CHUNK_SIZE  = 4_KB;
+constexpr size_t CHUNK_COUNT = 4096;
+
+struct churn_result
+{
+  size_t ops;
+  size_t failures;
+  size_t requested;
+  size_t reserved;
+};
+
+/**
+ * @brief random alloc/free churn with request sizes in [1, max_size], the
+ * same seed is replayed against every bin type.
+ */
+churn_result
+churn(libmem::static_bin& bin,
+      const size_t        ops,
+      const size_t        max_size = 8 * CHUNK_SIZE,
+      const uint32_t      seed     = 42)
+{
+  std::error_code                                      ec;
+  std::mt19937                                         rng(seed);
+  std::uniform_int_distribution<size_t>                size_dist(1, max_size);
+  std::vector<std::shared_ptr<libmem::static_segment>> live;
+  churn_result                                         rv{ ops, 0, 0, 0 };
+  for (size_t i = 0; i < ops; i++) {
+    if (!live.empty() && rng() % 3 == 0) {
+      auto idx = rng() % live.size();
+      bin.free(live[idx], ec);
+      live[idx] = live.back();
+      live.pop_back();
+      continue;
+    }
+    auto seg = bin.malloc(size_dist(rng), ec);
+    if (seg) {
+      live.push_back(seg);
+    } else {
+      rv.failures++;
+    }
+  }
+  for (const auto& seg : live) {
+    rv.requested += seg->size;
+  }
+  rv.reserved = (bin.chunk_count() - bin.chunk_left()) * bin.chunk_size();
+  for (const auto& seg : live) {
+    bin.free(seg, ec);
+  }
+  return rv;
+}
+
+/**
+ * @brief every thread stores, retrieves 4 times and deallocates a small
+ * cache segment, ops times. returns million ops per second.
+ */
+double
+cache_storm(libmem::mmgr& mm, const size_t threads, const size_t ops)
+{
+  std::vector<std::thread> workers;
+  const auto               __begin = std::chrono::steady_clock::now();
+  for (size_t t = 0; t < threads; t++) {
+    workers.emplace_back([&mm, ops] {
+      std::error_code       ec;
+      std::array<char, 256> payload{};
+      for (size_t i = 0; i < ops; i++) {
+        auto seg = mm.CACHE_STORE(payload.data(), payload.size(), ec);
+        for (int r = 0; r < 4; r++) {
+          mm.CACHE_RETRIEVE(seg->id, ec);
+        }
+        mm.CACHE_DEALLOC(seg->id, ec);
+      }
+    });
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  const std::chrono::duration<double> __elapsed =
+    std::chrono::steady_clock::now() - __begin;
+  return threads * ops * 6 / __elapsed.count() / 1e6;
+}
+
+void
+report(const char* name, const churn_result& rv)
+{
+  fmt::print("{:<8} failures: {:>6}/{} internal waste: {:.2f}%\n",
+             name,
+             rv.failures,
+             rv.ops,
+             rv.reserved == 0
+               ? 0.0
+               : 100.0 * (rv.reserved - rv.requested) / rv.reserved);
+}
+}
+
+TEST_CASE("static_bin vs buddy_bin fragmentation", "[bench][buddy_bin]")
+{
+  spdlog::set_level(spdlog::level::off);
+  std::atomic_size_t counter{ 0 };
+  libmem::static_bin statbin(0, counter, CHUNK_SIZE, CHUNK_COUNT, 0);
+  libmem::buddy_bin  buddy(0, counter, CHUNK_SIZE, CHUNK_COUNT, 0);
+  report("static", churn(statbin, 100000));
+  report("buddy", churn(buddy, 100000));
+}
+
+TEST_CASE("static_bin vs tlsf_bin variable-size payloads", "[bench][tlsf_bin]")
+{
+  spdlog::set_level(spdlog::level::off);
+  std::atomic_size_t counter{ 0 };
+  // same region, tlsf uses a fine 256 bytes granule
+  libmem::static_bin statbin(0, counter, CHUNK_SIZE, CHUNK_COUNT, 0);
+  libmem::tlsf_bin   tlsf(0, counter, 256, CHUNK_COUNT * CHUNK_SIZE / 256, 0);
+  report("static", churn(statbin, 100000));
+  report("tlsf", churn(tlsf, 100000));
+
+  BENCHMARK("static_bin churn 10k") { return churn(statbin, 10000).failures; };
+  BENCHMARK("tlsf_bin churn 10k") { return churn(tlsf, 10000).failures; };
+}
+
+TEST_CASE("static_bin vs buddy_bin throughput", "[bench][buddy_bin]")
+{
+  spdlog::set_level(spdlog::level::off);
+  std::atomic_size_t counter{ 0 };
+  libmem::static_bin statbin(0, counter, CHUNK_SIZE, CHUNK_COUNT, 0);
+  libmem::buddy_bin  buddy(0, counter, CHUNK_SIZE, CHUNK_COUNT, 0);
+
+  BENCHMARK("static_bin churn 10k") { return churn(statbin, 10000).failures; };
+  BENCHMARK("buddy_bin churn 10k") { return churn(buddy, 10000).failures; };
+}
+
+TEST_CASE("small objects in slab_bin vs static_bin", "[bench][slab_bin]")
+{
+  spdlog::set_level(spdlog::level::off);
+  std::atomic_size_t counter{ 0 };
+  // 1MB each, static bin with the smallest chunk that fits every object
+  libmem::slab_bin   slab(0, counter, SLAB_SIZE, 1_MB / SLAB_SIZE, 0);
+  libmem::static_bin statbin(0, counter, 512, 1_MB / 512, 0);
+  libmem::tlsf_bin   tlsf(0, counter, 32, 1_MB / 32, 0);
+  report("slab", churn(slab, 100000, 512));
+  report("static", churn(statbin, 100000, 512));
+  report("tlsf", churn(tlsf, 100000, 512));
+
+  BENCHMARK("slab_bin small churn 10k")
+  {
+    return churn(slab, 10000, 512).failures;
+  };
+  BENCHMARK("static_bin small churn 10k")
+  {
+    return churn(statbin, 10000, 512).failures;
+  };
+  BENCHMARK("tlsf_bin small churn 10k")
+  {
+    return churn(tlsf, 10000, 512).failures;
+  };
+}
+
+TEST_CASE("cache bin under concurrent CACHE_STORE/RETRIEVE", "[bench][cache_bin]")
+{
+  spdlog::set_level(spdlog::level::off);
+  const size_t threads = std::max(2u, std::thread::hardware_concurrency());
+  for (const size_t shards : { size_t(1), size_t(CACHE_SHARDS) }) {
+    libmem::mmgr_options opts;
+    opts.cache_shards = shards;
+    libmem::mmgr mm("bench_cache", { 1_KB }, { 8 }, opts);
+    fmt::print("{:>2} shards, {} threads: {:.2f} Mops/s\n",
+               shards,
+               threads,
+               cache_storm(mm, threads, 100000));
+  }
+}
+
+TEST_CASE("libc vs non-temporal copy kernels", "[bench][memops]")
+{
+  namespace memops = libmem::memops;
+  std::vector<char> src(64_MB, 0x11), dst(64_MB, 0x22);
+  for (const size_t n : { 64_KB, 1_MB, 8_MB, 64_MB }) {
+    for (auto kernel : { memops::COPY_KERNEL::LIBC,
+                         memops::COPY_KERNEL::SSE2,
+                         memops::COPY_KERNEL::AVX2 }) {
+      const size_t rounds = 512_MB / n;
+      auto         start  = std::chrono::steady_clock::now();
+      for (size_t i = 0; i < rounds; i++) {
+        memops::copy_with(kernel, dst.data(), src.data(), n);
+      }
+      const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+      fmt::print("{:>6} KB {:>4}: {:.2f} GB/s\n",
+                 n / 1_KB,
+                 memops::kernel_name(kernel),
+                 double(n) * rounds / elapsed.count() / 1e9);
+    }
+  }
+}
+
+TEST_CASE("parallel fill and copy vs thread count", "[bench][memops]")
+{
+  spdlog::set_level(spdlog::level::off);
+  const size_t      n = 512_MB;
+  std::vector<char> src(n, 0x5a);
+  for (const size_t threads : { 1, 2, 4, 8 }) {
+    libmem::mmgr_options opts;
+    opts.parallel_threads = threads;
+    libmem::mmgr mm("bench_parallel", { 1_KB }, { 8 }, opts);
+    // a fresh segment each time, so page faults are part of the cost
+    auto   seg   = mm.INSTANT_ALLOC(n);
+    auto   start = std::chrono::steady_clock::now();
+    mm.PARALLEL_FILL(seg->id, 0, 0, n);
+    const std::chrono::duration<double> fill =
+      std::chrono::steady_clock::now() - start;
+    start = std::chrono::steady_clock::now();
+    mm.PARALLEL_WRITE(seg->id, 0, src.data(), n);
+    const std::chrono::duration<double> copy =
+      std::chrono::steady_clock::now() - start;
+    fmt::print("{} threads: first-touch fill {:.2f} GB/s, copy {:.2f} GB/s\n",
+               threads,
+               n / fill.count() / 1e9,
+               n / copy.count() / 1e9);
+    mm.INSTANT_DEALLOC(seg->id);
+  }
+}
+
+TEST_CASE("STATIC_ALLOC with and without latency histograms", "[bench][latency]")
+{
+  spdlog::set_level(spdlog::level::off);
+  for (const bool timed : { false, true }) {
+    libmem::mmgr_options opts;
+    opts.latency_histograms = timed;
+    libmem::mmgr     mm("bench_latency", { 1_KB }, { 1024 }, opts);
+    constexpr size_t rounds = 1000000;
+    auto             start  = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < rounds; i++) {
+      mm.STATIC_DEALLOC(mm.STATIC_ALLOC(1_KB)->id);
+    }
+    const std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+    fmt::print("latency histograms {:>3}: {:.1f} ns per alloc+dealloc\n",
+               timed ? "on" : "off",
+               elapsed.count() / rounds);
+    if (const auto* latency = mm.LATENCY(libmem::MMGR_OP::STATIC_ALLOC)) {
+      const auto summary = latency->summary();
+      fmt::print("  STATIC_ALLOC p50 {} ns, p99 {} ns, p99.9 {} ns, max {} ns\n",
+                 summary.p50,
+                 summary.p99,
+                 summary.p999,
+                 summary.max);
+    }
+  }
+}
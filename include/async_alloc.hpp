@@ -0,0 +1,109 @@
+#pragma once
+
+#include "except.hpp"
+#include "mmgr.hpp"
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <coroutine>
+#include <type_traits>
+
+namespace shm_kernel::memory_manager {
+
+/**
+ * @brief co_await'able wrapper around ASYNC_STATIC_ALLOC and
+ * ASYNC_INSTANT_ALLOC. does not suspend when the allocation completes in
+ * place, otherwise the coroutine is resumed by the completion, on the
+ * ASYNC_EXECUTOR if one is set.
+ */
+template<typename Segment>
+class alloc_awaiter
+{
+private:
+  mmgr&                    mmgr_;
+  size_t                   size_;
+  std::chrono::nanoseconds timeout_;
+  std::error_code*         user_ec_;
+  std::shared_ptr<Segment> segment_;
+  std::error_code          ec_;
+
+public:
+  alloc_awaiter(mmgr&                          mm,
+                const size_t                   size,
+                const std::chrono::nanoseconds timeout,
+                std::error_code*               ec) noexcept
+    : mmgr_(mm)
+    , size_(size)
+    , timeout_(timeout)
+    , user_ec_(ec)
+  {}
+
+  bool await_ready() const noexcept { return false; }
+
+  bool await_suspend(std::coroutine_handle<> h) noexcept
+  {
+    auto __callback = [this, h](std::shared_ptr<Segment> seg,
+                                std::error_code          ec) {
+      this->segment_ = std::move(seg);
+      this->ec_      = ec;
+      h.resume();
+    };
+    bool __done;
+    if constexpr (std::is_same_v<Segment, static_segment>) {
+      __done = this->mmgr_.ASYNC_STATIC_ALLOC(
+        this->size_, this->timeout_, this->segment_, this->ec_, __callback);
+    } else {
+      __done = this->mmgr_.ASYNC_INSTANT_ALLOC(
+        this->size_, this->timeout_, this->segment_, this->ec_, __callback);
+    }
+    // may already be resumed elsewhere, don't touch this past here
+    return !__done;
+  }
+
+  std::shared_ptr<Segment> await_resume()
+  {
+    if (this->user_ec_) {
+      *this->user_ec_ = this->ec_;
+    } else if (this->ec_) {
+      throw MmgrExcept(this->ec_);
+    }
+    return std::move(this->segment_);
+  }
+};
+
+inline alloc_awaiter<static_segment>
+async_static_alloc(mmgr&                          mm,
+                   const size_t                   size,
+                   const std::chrono::nanoseconds timeout)
+{
+  return { mm, size, timeout, nullptr };
+}
+
+inline alloc_awaiter<static_segment>
+async_static_alloc(mmgr&                          mm,
+                   const size_t                   size,
+                   const std::chrono::nanoseconds timeout,
+                   std::error_code&               ec)
+{
+  return { mm, size, timeout, &ec };
+}
+
+inline alloc_awaiter<instant_segment>
+async_instant_alloc(mmgr&                          mm,
+                    const size_t                   size,
+                    const std::chrono::nanoseconds timeout)
+{
+  return { mm, size, timeout, nullptr };
+}
+
+inline alloc_awaiter<instant_segment>
+async_instant_alloc(mmgr&                          mm,
+                    const size_t                   size,
+                    const std::chrono::nanoseconds timeout,
+                    std::error_code&               ec)
+{
+  return { mm, size, timeout, &ec };
+}
+
+}
+
+#endif
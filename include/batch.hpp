@@ -1,9 +1,15 @@
 #pragma once
 
+#include "bins/buddy_bin.hpp"
 #include "bins/instant_bin.hpp"
+#include "checkpoint.hpp"
+#include "bins/slab_bin.hpp"
 #include "bins/static_bin.hpp"
+#include "bins/tlsf_bin.hpp"
 #include "config.hpp"
+#include "directory.hpp"
 #include "ec.hpp"
+#include "mapped_file.hpp"
 #include "segment.hpp"
 
 #include <atomic>
@@ -17,18 +23,48 @@
 #include <spdlog/spdlog.h>
 
 namespace shm_kernel::memory_manager {
+
+struct batch_options
+{
+  // if not empty, back the batch with a file in this directory instead of
+  // a POSIX shm object.
+  std::string backing_dir;
+  // allocator used by every static bin of the batch
+  BIN_TYPE bin_type{ BIN_TYPE::STATIC };
+  // if not 0, a slab bin of slab_count slabs is added after the static bins
+  // for objects up to SLAB_MAX_OBJECT bytes.
+  size_t slab_count{ 0 };
+  size_t slab_size{ SLAB_SIZE };
+};
+
+struct batch_stats
+{
+  size_t                 id;
+  size_t                 total_bytes;
+  // of the static bins, the slab bin is not counted
+  size_t                 used_bytes;
+  std::vector<bin_stats> bins;
+};
+
 class batch
 {
   friend class fmt::formatter<batch>;
 
 protected:
-  std::string_view    mmgr_name_;
+  // owned copy of the mmgr name
+  std::string         mmgr_name_;
   const size_t        id_;
   size_t              total_bytes_;
   std::atomic_size_t& segment_counter_ref_;
 
+  batch_options                options_;
   std::unique_ptr<ipc::shmhdl> handle_;
+  std::unique_ptr<mapped_file> file_;
+  batch_header*                header_{ nullptr };
+  // checkpoint that last wrote this batch's snapshot file, 0 for none
+  size_t                       snapshot_seq_{ 0 };
   std::vector<std::unique_ptr<static_bin>>   static_bins_;
+  static_bin*                                slab_bin_{ nullptr };
   std::shared_ptr<spdlog::logger>            _M_batch_logger;
 
   /**
@@ -38,6 +74,55 @@ protected:
    */
   void init_shm(const size_t& buffsz);
 
+  /**
+   * @brief write bin layout and an empty segment directory into the header
+   * of the mapped shm.
+   */
+  void init_header();
+
+  void sort_static_bins() noexcept;
+
+  static std::unique_ptr<static_bin> make_static_bin(
+    const BIN_TYPE                  type,
+    const size_t                    id,
+    std::atomic_size_t&             segment_counter,
+    const size_t                    chunk_size,
+    const size_t                    chunk_count,
+    const size_t                    base_pshift,
+    std::shared_ptr<spdlog::logger> logger);
+
+  /**
+   * @brief directory slot of a segment allocated in this batch
+   */
+  dir_entry& slot_of(const static_segment& segment) const noexcept;
+
+  std::shared_ptr<static_segment> commit_segment(
+    std::shared_ptr<static_segment> segment,
+    const bool                      zeroed = false) noexcept;
+
+  /**
+   * @brief claim the range in its bin, if zeroed clear the parts that were
+   * handed out before
+   */
+  void claim_range(const size_t bin_id,
+                   const size_t addr_pshift,
+                   const size_t nbytes,
+                   const bool   zeroed) noexcept;
+
+  /**
+   * @brief validate the header of a mapped batch object and rebuild the
+   * bins and bitmaps from it. exactly one of handle or file is set.
+   */
+  static std::shared_ptr<batch> rebuild(
+    std::string_view                mmgr_name,
+    const size_t&                   id,
+    std::atomic_size_t&             segment_counter,
+    const batch_options&            options,
+    std::unique_ptr<ipc::shmhdl>&&  handle,
+    std::unique_ptr<mapped_file>&&  file,
+    std::error_code&                ec,
+    std::shared_ptr<spdlog::logger> logger) noexcept;
+
   explicit batch(std::string_view    arena_name,
                  const size_t&       id,
                  std::atomic_size_t& segment_counter,
@@ -60,6 +145,14 @@ public:
                  const std::vector<size_t>& statbin_chunkcnt,
                  std::shared_ptr<spdlog::logger> = spdlog::default_logger());
 
+  explicit batch(std::string_view           arena_name,
+                 const size_t&              id,
+                 std::atomic_size_t&        segment_counter,
+                 const std::vector<size_t>& statbin_chunksz,
+                 const std::vector<size_t>& statbin_chunkcnt,
+                 const batch_options&       options,
+                 std::shared_ptr<spdlog::logger> = spdlog::default_logger());
+
   explicit batch(std::string_view    arena_name,
                  const size_t&       id,
                  std::atomic_size_t& segment_counter,
@@ -78,6 +171,96 @@ public:
 
   ~batch();
 
+  /**
+   * @brief attach to a `#batchN#statbin` object left by a previous mmgr with
+   * the same name, rebuilding bins from the persisted header. nullptr will be
+   * returned if the object doesn't exist or its header is incompatible.
+   *
+   * @param mmgr_name
+   * @param id
+   * @param segment_counter
+   * @param options
+   * @param ec
+   * @return std::shared_ptr<batch>
+   */
+  static std::shared_ptr<batch> reattach(
+    std::string_view                mmgr_name,
+    const size_t&                   id,
+    std::atomic_size_t&             segment_counter,
+    const batch_options&            options,
+    std::error_code&                ec,
+    std::shared_ptr<spdlog::logger> = spdlog::default_logger()) noexcept;
+
+  /**
+   * @brief create the batch object from a snapshot file written by
+   * checkpoints, then rebuild it like reattach does.
+   *
+   * @param snapshot path of the snapshot file
+   * @param sequence checkpoint that wrote it
+   * @return std::shared_ptr<batch>
+   */
+  static std::shared_ptr<batch> restore(
+    std::string_view                mmgr_name,
+    const size_t&                   id,
+    std::atomic_size_t&             segment_counter,
+    const batch_options&            options,
+    const std::string&              snapshot,
+    const size_t                    sequence,
+    std::error_code&                ec,
+    std::shared_ptr<spdlog::logger> = spdlog::default_logger()) noexcept;
+
+  /**
+   * @brief write-notify, the segment's chunks go into the next checkpoint
+   */
+  void mark_dirty(std::shared_ptr<static_segment> segment) noexcept;
+
+  /**
+   * @brief copy the header and collect dirty chunk ranges, dirty bits are
+   * reset.
+   */
+  checkpoint_delta collect_checkpoint();
+
+  /**
+   * @brief the delta was written as the snapshot file of checkpoint sequence,
+   * later deltas apply on top of it
+   */
+  void commit_checkpoint(const size_t sequence) noexcept;
+
+  /**
+   * @brief the delta could not be written, its ranges go into the next
+   * checkpoint again
+   */
+  void abort_checkpoint(const checkpoint_delta& delta) noexcept;
+
+  /**
+   * @brief live segments recorded in the segment directory
+   *
+   * @return std::vector<std::shared_ptr<static_segment>>
+   */
+  std::vector<std::shared_ptr<static_segment>> segments() const;
+
+  /**
+   * @brief madvise the pages of a segment allocated in this batch
+   */
+  int advise(std::shared_ptr<static_segment> segment,
+             const ACCESS_ADVICE             advice,
+             std::error_code&                ec) noexcept;
+
+  /**
+   * @brief write the pages of a segment back to the backing file. a no-op
+   * for shm-backed batches.
+   */
+  int flush(std::shared_ptr<static_segment> segment,
+            const bool                      async,
+            std::error_code&                ec) noexcept;
+
+  /**
+   * @brief write the whole batch back to the backing file.
+   */
+  int flush(const bool async, std::error_code& ec) noexcept;
+
+  bool is_file_backed() const noexcept;
+
   /**
    * @brief allocate a shared memory segment.
    *
@@ -87,6 +270,24 @@ public:
   std::shared_ptr<static_segment> allocate(const size_t     nbytes,
                                            std::error_code& ec) noexcept;
 
+  /**
+   * @brief allocate a segment whose addr_pshift is a multiple of alignment,
+   * the batch base is page aligned, so the address is too if alignment <=
+   * page size.
+   */
+  std::shared_ptr<static_segment> allocate(const size_t     nbytes,
+                                           const size_t     alignment,
+                                           std::error_code& ec) noexcept;
+
+  /**
+   * @brief if zeroed, the segment reads as zeros. only chunks handed out
+   * before are cleared, fresh ones are zero already.
+   */
+  std::shared_ptr<static_segment> allocate(const size_t     nbytes,
+                                           const size_t     alignment,
+                                           const bool       zeroed,
+                                           std::error_code& ec) noexcept;
+
   /**
    * @brief deallocate a shared memory segment
    *
@@ -96,11 +297,64 @@ public:
   int deallocate(std::shared_ptr<static_segment> segment,
                  std::error_code&                ec) noexcept;
 
+  /**
+   * @brief grow or shrink a segment without moving it, the segment's size
+   * and directory slot are updated on success.
+   */
+  int reallocate(std::shared_ptr<static_segment> segment,
+                 const size_t                    nbytes,
+                 std::error_code&                ec) noexcept;
+
+  /**
+   * @brief allocate a small object from the slab bin.
+   *
+   * @param nbytes <= SLAB_MAX_OBJECT
+   * @return std::shared_ptr<static_segment>
+   */
+  std::shared_ptr<static_segment> allocate_small(const size_t     nbytes,
+                                                 std::error_code& ec) noexcept;
+  std::shared_ptr<static_segment> allocate_small(const size_t     nbytes,
+                                                 const bool       zeroed,
+                                                 std::error_code& ec) noexcept;
+
+  bool has_slab_bin() const noexcept;
+
+  /**
+   * @brief whether compaction may relocate the segment, slab objects are
+   * never moved.
+   */
+  bool movable(const static_segment& segment) const noexcept;
+
+  /**
+   * @brief record a segment allocated in this batch under another id, used
+   * by compaction to hand the new location over to the moved segment.
+   */
+  void relabel(std::shared_ptr<static_segment> segment,
+               const size_t                    id) noexcept;
+
+  /**
+   * @brief hand the batch's shm object or file to keep_shm, a warm_restart
+   * mmgr calls it on its way out so the next one can reattach
+   */
+  void keep() noexcept;
+
   std::string_view mmgr_name() const noexcept;
   const size_t     id() const noexcept;
   const size_t     max_chunksz() const noexcept;
   const size_t     min_chunksz() const noexcept;
+  const size_t     max_request() const noexcept;
   const size_t     total_bytes() const noexcept;
+  /**
+   * @brief bytes of the chunks taken in the static bins, the slab bin is
+   * not counted
+   */
+  const size_t     used_bytes() const noexcept;
+  const size_t     next_segment_id() const noexcept;
+  /**
+   * @brief chunk usage of every bin, largest chunk size first
+   */
+  batch_stats      stats() const;
+  char*            base() const noexcept;
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace shm_kernel::memory_manager {
+
+class batch;
+
+/**
+ * @brief append-only list of batches. entries live in chunks of doubling
+ * size that are never moved or freed while the list lives, and a new entry
+ * is published by a release store of the size, so readers index and iterate
+ * without a lock while another thread appends.
+ */
+class batch_list
+{
+public:
+  static constexpr size_t FIRST_CHUNK = 8;
+  static constexpr size_t CHUNKS      = 32;
+
+  class const_iterator
+  {
+  private:
+    const batch_list* list_;
+    size_t            index_;
+
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type        = std::shared_ptr<batch>;
+    using difference_type   = std::ptrdiff_t;
+    using pointer           = const value_type*;
+    using reference         = const value_type&;
+
+    const_iterator(const batch_list* list, const size_t index) noexcept
+      : list_(list)
+      , index_(index)
+    {}
+
+    reference       operator*() const noexcept { return (*list_)[index_]; }
+    pointer         operator->() const noexcept { return &(*list_)[index_]; }
+    const_iterator& operator++() noexcept
+    {
+      index_++;
+      return *this;
+    }
+    bool operator==(const const_iterator& rhs) const noexcept
+    {
+      return index_ == rhs.index_;
+    }
+    bool operator!=(const const_iterator& rhs) const noexcept
+    {
+      return index_ != rhs.index_;
+    }
+  };
+
+private:
+  // chunk k holds FIRST_CHUNK << k entries
+  std::array<std::atomic<std::shared_ptr<batch>*>, CHUNKS> chunks_{};
+  std::atomic_size_t                                       size_{ 0 };
+  // appenders only
+  std::mutex                                               mtx_;
+
+  static std::pair<size_t, size_t> locate(const size_t index) noexcept;
+
+public:
+  batch_list() = default;
+  batch_list(const batch_list&) = delete;
+  batch_list& operator=(const batch_list&) = delete;
+  ~batch_list();
+
+  /**
+   * @brief append and publish batch, return its index. throws
+   * std::length_error once every chunk is full.
+   */
+  size_t push_back(std::shared_ptr<batch> batch);
+
+  /**
+   * @brief index must be below a size() seen by this thread
+   */
+  const std::shared_ptr<batch>& operator[](const size_t index) const noexcept;
+
+  const std::shared_ptr<batch>& back() const noexcept;
+
+  size_t size() const noexcept;
+  bool   empty() const noexcept;
+
+  /**
+   * @brief a range-for visits the batches published when it started
+   */
+  const_iterator begin() const noexcept;
+  const_iterator end() const noexcept;
+
+  std::vector<std::shared_ptr<batch>> snapshot() const;
+
+  /**
+   * @brief drop every batch. not safe against concurrent readers, only for
+   * aborting the startup.
+   */
+  void clear() noexcept;
+};
+
+}
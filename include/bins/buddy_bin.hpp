@@ -0,0 +1,87 @@
+#pragma once
+
+#include "static_bin.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace shm_kernel::memory_manager {
+
+/**
+ * @brief power-of-two buddy allocator over the same region a static_bin
+ * would manage. a request takes the smallest 2^k chunks block that fits,
+ * larger blocks are split on malloc and buddies are coalesced on free, both
+ * in O(log n) steps.
+ *
+ * the free list of each order is a bitmap, bit i of order k means the block
+ * of 2^k chunks starting at chunk (i << k) is free. a summary bitmap per
+ * order marks its non-empty words, so finding a free block reads one summary
+ * word for up to 2^18 blocks. chunks_ is kept in sync so directory replay,
+ * dirty tracking and checkpoints work unchanged.
+ */
+class buddy_bin : public static_bin
+{
+protected:
+  size_t                             max_order_;
+  std::vector<std::vector<uint64_t>> free_;
+  // bit w of order k is set when free_[k][w] != 0
+  std::vector<std::vector<uint64_t>> summary_;
+  std::vector<size_t>                free_count_;
+
+  static size_t order_of(const size_t chunks) noexcept;
+
+  bool test(const size_t order, const size_t idx) const noexcept;
+  void set(const size_t order, const size_t idx) noexcept;
+  void reset(const size_t order, const size_t idx) noexcept;
+
+  /**
+   * @brief index of a free block of the order, free_count_[order] must be > 0
+   */
+  size_t find_free(const size_t order) const noexcept;
+
+  void init_free_lists() noexcept;
+
+  /**
+   * @brief put a block back and coalesce it with its free buddies
+   */
+  void release(size_t chunk, size_t order) noexcept;
+
+  void mark(const size_t chunk, const size_t nchunks, const bool used) noexcept;
+
+public:
+  explicit buddy_bin(
+    const size_t        id,
+    std::atomic_size_t& segment_counter,
+    const size_t&       chunk_size,
+    const size_t&       chunk_count,
+    const size_t&       base_pshift,
+    std::shared_ptr<spdlog::logger> = spdlog::default_logger());
+
+  std::shared_ptr<static_segment> malloc(const size_t     nbytes,
+                                         std::error_code& ec) noexcept override;
+
+  int free(std::shared_ptr<static_segment> segment,
+           std::error_code&                ec) noexcept override;
+
+  int reserve(const size_t     addr_pshift,
+              const size_t     nbytes,
+              std::error_code& ec) noexcept override;
+
+  int resize(std::shared_ptr<static_segment> segment,
+             const size_t                    nbytes,
+             std::error_code&                ec) noexcept override;
+
+  void clear() noexcept override;
+
+  size_t max_request() const noexcept override;
+
+  BIN_TYPE type() const noexcept override;
+
+  const size_t max_order() const noexcept;
+
+  /**
+   * @brief chunks of the largest free block
+   */
+  const size_t largest_free() noexcept override;
+};
+}
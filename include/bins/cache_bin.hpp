@@ -5,32 +5,160 @@
 #include <condition_variable>
 #include <cstddef>
 #include <deque>
+#include <functional>
 #include <future>
+#include <list>
 #include <map>
 #include <memory>
 #include <memory_resource>
 #include <mutex>
 #include <spdlog/logger.h>
 #include <spdlog/spdlog.h>
+#include <system_error>
+#include <unordered_map>
 #include <utility>
+#include <vector>
 
+#include "config.hpp"
+#include "shm_resource.hpp"
 // #include "segment.hpp"
 
 namespace shm_kernel::memory_manager {
 
 constexpr uint32_t BUFF_AREA_COUNT = 8;
 
+/**
+ * @brief which unpinned segment goes first when the budget is exceeded
+ */
+enum class CACHE_POLICY
+{
+  // least recently stored or retrieved
+  LRU   = 0,
+  // second chance: a segment retrieved since the hand last passed is skipped
+  CLOCK = 1,
+};
+
+struct cache_stats
+{
+  size_t hits;
+  size_t misses;
+  size_t evictions;
+  // CACHE_SETs and reallocs served in the segment's current buffer
+  size_t in_place;
+  // capacity held, at least the sum of the segment sizes
+  size_t bytes;
+  size_t budget;
+  size_t segments;
+};
+
+/**
+ * @brief called after a segment was evicted, with its id and size
+ */
+using cache_evict_callback = std::function<void(size_t, size_t)>;
+
 class cache_segment;
 class cache_bin
 {
 
 protected:
-  std::atomic_size_t&                    segment_counter_ref_;
-  std::mutex                             mtx_;
-  std::pmr::unsynchronized_pool_resource pmr_pool_;
-  std::map<size_t /* segment id */, void* /* segment buffer */> data_map_;
-  std::string_view                                              mmgr_name_;
-  std::shared_ptr<spdlog::logger> _M_cachbin_logger;
+  struct cache_entry
+  {
+    void*  buffer;
+    size_t size;
+    // bytes allocated for buffer, updates up to it are written in place
+    size_t capacity;
+    size_t alignment;
+    size_t pins{ 0 };
+    // CLOCK reference bit
+    bool   referenced{ false };
+    // position in the shard's order
+    std::list<size_t>::iterator order;
+  };
+
+  /**
+   * @brief a segment lives in shard id % shard count, each shard has its
+   * own lock, pool and eviction order
+   */
+  struct cache_shard
+  {
+    mutable std::mutex                         mtx;
+    // shm regions behind pool in a shared cache bin, null otherwise
+    std::unique_ptr<shm_resource>              shm;
+    std::pmr::unsynchronized_pool_resource     pool;
+    std::unordered_map<size_t, cache_entry>    entries;
+    // LRU: most recently used first. CLOCK: the ring hand walks
+    std::list<size_t>                          order;
+    std::list<size_t>::iterator                hand{ order.end() };
+    size_t                                     bytes{ 0 };
+
+    explicit cache_shard(std::unique_ptr<shm_resource> upstream)
+      : shm(std::move(upstream))
+      , pool(shm ? shm.get() : std::pmr::get_default_resource())
+    {}
+  };
+
+  std::atomic_size_t&                       segment_counter_ref_;
+  std::atomic_size_t                        region_counter_{ 0 };
+  std::vector<std::unique_ptr<cache_shard>> shards_;
+  // budget of each shard, 0 for no limit
+  const size_t                              shard_budget_;
+  const CACHE_POLICY                        policy_;
+  std::atomic_size_t                        hits_{ 0 };
+  std::atomic_size_t                        misses_{ 0 };
+  std::atomic_size_t                        evictions_{ 0 };
+  std::atomic_size_t                        in_place_{ 0 };
+  cache_evict_callback                      on_evict_;
+  std::string_view                          mmgr_name_;
+  std::shared_ptr<spdlog::logger>           _M_cachbin_logger;
+
+  cache_shard& shard_of(const size_t segment_id) const noexcept;
+
+  void* pool_allocate(cache_shard& shard,
+                      const size_t nbytes,
+                      const size_t alignment) noexcept;
+
+  void insert(cache_shard& shard,
+              const size_t id,
+              void*        buffer,
+              const size_t nbytes,
+              const size_t alignment) noexcept;
+
+  void touch(cache_shard& shard, cache_entry& entry) noexcept;
+
+  std::pair<size_t, size_t> locate(const cache_shard& shard,
+                                   const void*        buffer) const noexcept;
+
+  /**
+   * @brief release the entry's buffer and forget it, shard lock held
+   */
+  void drop(cache_shard&                                      shard,
+            std::unordered_map<size_t, cache_entry>::iterator iter) noexcept;
+
+  /**
+   * @brief evict unpinned segments of the shard other than keep_id until
+   * nbytes more fit in its budget, shard lock held. the evicted (id, size)
+   * are appended to evicted, callbacks run once the lock is released.
+   */
+  int make_room(cache_shard&                            shard,
+                const size_t                            nbytes,
+                const size_t                            keep_id,
+                std::vector<std::pair<size_t, size_t>>& evicted,
+                std::error_code&                        ec) noexcept;
+
+  /**
+   * @brief make the entry's buffer hold nbytes, keeping its first preserve
+   * bytes. growth doubles the capacity when the budget allows it, shard
+   * lock held.
+   */
+  void* grow(cache_shard&                            shard,
+             const size_t                            id,
+             cache_entry&                            entry,
+             const size_t                            nbytes,
+             const size_t                            preserve,
+             std::vector<std::pair<size_t, size_t>>& evicted,
+             std::error_code&                        ec) noexcept;
+
+  void notify(const std::vector<std::pair<size_t, size_t>>& evicted) noexcept;
 
 public:
   explicit cache_bin(
@@ -38,16 +166,48 @@ public:
     std::string_view                memmgr_name,
     std::shared_ptr<spdlog::logger> logger = spdlog::default_logger());
 
+  /**
+   * @brief budget is the most bytes the cached buffers may take, 0 for no
+   * limit. beyond it unpinned segments are evicted by policy. the budget is
+   * split evenly between the shards, which evict independently. if shared
+   * is set, buffers live in shm regions consumers can attach.
+   */
+  explicit cache_bin(
+    std::atomic_size_t&             segment_counter,
+    std::string_view                memmgr_name,
+    const size_t                    budget,
+    const CACHE_POLICY              policy,
+    const size_t                    shards = CACHE_SHARDS,
+    const bool                      shared = false,
+    std::shared_ptr<spdlog::logger> logger = spdlog::default_logger());
+
   void set_logger(std::shared_ptr<spdlog::logger>);
 
+  /**
+   * @brief set it before the bin is shared between threads
+   */
+  void set_evict_callback(cache_evict_callback callback);
+
   std::shared_ptr<cache_segment> store(const void*      buffer,
                                        const size_t     size,
                                        std::error_code& ec) noexcept;
 
+  /**
+   * @brief alignment 0 means the pool default of alignof(max_align_t)
+   */
+  std::shared_ptr<cache_segment> store(const void*      buffer,
+                                       const size_t     size,
+                                       const size_t     alignment,
+                                       std::error_code& ec) noexcept;
+
   std::shared_ptr<cache_segment> malloc(const size_t     size,
                                         void**           ptr,
                                         std::error_code& ec) noexcept;
 
+  /**
+   * @brief counts a hit or a miss. the pointer stays valid until the
+   * segment is set, freed or evicted, pin it to rule out the latter.
+   */
   void* retrieve(const size_t segment_id, std::error_code& ec) noexcept;
 
   int free(std::shared_ptr<cache_segment> segment,
@@ -55,16 +215,45 @@ public:
 
   int free(std::shared_ptr<cache_segment> segment);
 
+  /**
+   * @brief contents up to the smaller of both sizes are kept
+   */
   void* realloc(std::shared_ptr<cache_segment> segment,
                 const size_t                   new_size,
                 std::error_code&               ec) noexcept;
 
+  /**
+   * @brief replace the contents with new_size bytes from new_buffer, which
+   * may point into the segment's own buffer. only the bytes up to the end
+   * of the old buffer are read from it when the segment grows.
+   */
   int set(const size_t     segment_id,
-          const size_t     origin_size,
           const void*      new_buffer,
           const size_t     new_size,
           std::error_code& ec) noexcept;
 
+  /**
+   * @brief pinned segments are never evicted, pins nest
+   */
+  int pin(const size_t segment_id, std::error_code& ec) noexcept;
+
+  int unpin(const size_t segment_id, std::error_code& ec) noexcept;
+
+  cache_stats stats() noexcept;
+
+  /**
+   * @brief shm region and offset of the segment's buffer, NO_REGION if the
+   * bin isn't shared or the segment isn't cached
+   */
+  std::pair<size_t, size_t> location(const size_t segment_id) const noexcept;
+
+  size_t region_count() const noexcept;
+
+  /**
+   * @brief true if the segment is still cached
+   */
+  bool contains(const size_t segment_id) const noexcept;
+
   void clear() noexcept;
 
   size_t segment_count() const noexcept;
@@ -6,9 +6,13 @@
 #include <spdlog/logger.h>
 #include <spdlog/spdlog.h>
 #include <string_view>
+#include <vector>
 
 #include <ipc/shmhdl.hpp>
 
+#include "directory.hpp"
+#include "mapped_file.hpp"
+
 
 namespace shm_kernel::memory_manager {
 
@@ -20,14 +24,44 @@ protected:
   std::mutex          mtx_;
   std::string_view    mmgr_name_;
   std::map<int, std::shared_ptr<ipc::shmhdl>> segments_;
+  // file-backed segments, used when backing_dir_ is not empty
+  std::map<size_t, std::shared_ptr<mapped_file>> files_;
+  // own mappings of resized or over-aligned shm segments, the ipc handle's
+  // mapping can't be mremap'ed
+  std::map<size_t, std::shared_ptr<mapped_file>> resized_;
+  std::string                                    backing_dir_;
+  // segment id -> directory slot
+  std::map<size_t, size_t>                    slots_;
+  std::unique_ptr<ipc::shmhdl>                dir_handle_;
+  instant_dir_header*                         dir_{ nullptr };
   std::shared_ptr<spdlog::logger>                           _M_instbin_logger;
 
+  void init_directory() noexcept;
+
+  bool reattach_directory() noexcept;
+
+  void record(const size_t segment_id, const size_t nbytes) noexcept;
+
+  void forget(const size_t segment_id) noexcept;
+
 public:
   explicit instant_bin(
     std::atomic_size_t& segment_counter,
     std::string_view    memmgr_name,
     std::shared_ptr<spdlog::logger> = spdlog::default_logger());
 
+  /**
+   * @brief if reattach is true, attach to the `#instbin#dir` object and the
+   * instant segments left by a previous mmgr with the same name. if
+   * backing_dir is not empty, segments are files in that directory.
+   */
+  explicit instant_bin(
+    std::atomic_size_t& segment_counter,
+    std::string_view    memmgr_name,
+    const bool          reattach,
+    std::string_view    backing_dir,
+    std::shared_ptr<spdlog::logger> = spdlog::default_logger());
+
   instant_bin() = delete;
 
   instant_bin(const instant_bin&) = delete;
@@ -35,11 +69,40 @@ public:
   std::shared_ptr<instant_segment> malloc(const size_t     nbytes,
                                           std::error_code& ec) noexcept;
 
+  /**
+   * @brief alignment beyond a page moves the segment's mapping in this
+   * process to an aligned address
+   */
+  std::shared_ptr<instant_segment> malloc(const size_t     nbytes,
+                                          const size_t     alignment,
+                                          std::error_code& ec) noexcept;
+
   int free(std::shared_ptr<instant_segment> segment,
            std::error_code&                 ec) noexcept;
 
+  /**
+   * @brief grow or shrink the segment's object with ftruncate + mremap,
+   * contents are kept without copying. the segment's size and directory
+   * generation are updated.
+   */
+  int resize(std::shared_ptr<instant_segment> segment,
+             const size_t                     nbytes,
+             std::error_code&                 ec) noexcept;
+
+  /**
+   * @brief times the segment has been resized, 0 if it isn't recorded in
+   * the directory
+   */
+  const size_t generation(const size_t seg_id) noexcept;
+
   void clear() noexcept;
 
+  /**
+   * @brief hand the segments and the directory to keep_shm instead of
+   * unlinking them, see batch::keep
+   */
+  void keep() noexcept;
+
   const size_t shmhdl_count() noexcept;
 
   const size_t size() noexcept;
@@ -47,5 +110,38 @@ public:
   std::shared_ptr<ipc::shmhdl> get_shmhdl(
     const size_t&    seg_id,
     std::error_code& ec) noexcept;
+
+  std::shared_ptr<mapped_file> get_file(const size_t&    seg_id,
+                                        std::error_code& ec) noexcept;
+
+  /**
+   * @brief mapping of a segment in the current process, whatever backs it
+   *
+   * @return std::pair<void*, size_t>
+   */
+  std::pair<void*, size_t> buffer(const size_t&    seg_id,
+                                  std::error_code& ec) noexcept;
+
+  int advise(std::shared_ptr<instant_segment> segment,
+             const ACCESS_ADVICE              advice,
+             std::error_code&                 ec) noexcept;
+
+  /**
+   * @brief write a file-backed segment back to disk, a no-op for shm.
+   */
+  int flush(std::shared_ptr<instant_segment> segment,
+            const bool                       async,
+            std::error_code&                 ec) noexcept;
+
+  int flush(const bool async, std::error_code& ec) noexcept;
+
+  /**
+   * @brief live segments recorded in the instant directory
+   *
+   * @return std::vector<std::shared_ptr<instant_segment>>
+   */
+  std::vector<std::shared_ptr<instant_segment>> segments() const;
+
+  const size_t next_segment_id() const noexcept;
 };
 }
\ No newline at end of file
@@ -0,0 +1,150 @@
+#pragma once
+
+#include "config.hpp"
+#include "static_bin.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+namespace shm_kernel::memory_manager {
+
+/**
+ * @brief small object bin. every chunk is a slab that, once used, serves a
+ * single power-of-two size class in [SLAB_MIN_OBJECT, SLAB_MAX_OBJECT] and
+ * tracks its objects in a free bitmap. a slab goes back to the bin as soon
+ * as its last object is freed.
+ *
+ * each thread owns an active slab per size class and claims objects in it
+ * with an atomic bitmap update, the bin lock is only taken to switch slabs
+ * and to free. an owned slab is not handed to other threads, it goes back
+ * to the bin when its owner switches away from it, frees its last object or
+ * exits.
+ */
+class slab_bin : public static_bin
+{
+public:
+  static constexpr size_t CLASS_COUNT = []() {
+    size_t __count = 0;
+    for (size_t sz = SLAB_MIN_OBJECT; sz <= SLAB_MAX_OBJECT; sz <<= 1) {
+      __count++;
+    }
+    return __count;
+  }();
+
+  /**
+   * @brief outlives the bin for the threads that own its slabs, bin is reset
+   * under mtx when the bin is destroyed
+   */
+  struct owner_link
+  {
+    std::mutex mtx;
+    slab_bin*  bin;
+  };
+
+protected:
+  static constexpr uint8_t NO_CLASS = 0xff;
+
+  // unique across bins, keys the per-thread active slabs
+  const size_t                                 uid_;
+  const size_t                                 words_per_slab_;
+  std::shared_ptr<owner_link>                  link_;
+  // bumped by clear(), active slabs of an older generation are dropped
+  std::atomic_size_t                           generation_{ 0 };
+  std::vector<uint8_t>                         class_;
+  // the slab is some thread's active slab
+  std::vector<bool>                            owned_;
+  std::unique_ptr<std::atomic_size_t[]>        live_;
+  // claimed by an owner since the last checkpoint, folded into dirty_
+  std::unique_ptr<std::atomic_bool[]>          touched_;
+  // bit set means the object is allocated
+  std::unique_ptr<std::atomic<uint64_t>[]>     objects_;
+  // slabs with a free object that no thread owns
+  std::array<std::set<size_t>, CLASS_COUNT>    partial_;
+
+  static size_t class_of(const size_t nbytes) noexcept;
+
+  size_t object_size(const size_t cls) const noexcept;
+  size_t object_count(const size_t cls) const noexcept;
+
+  /**
+   * @brief take ownership of a slab of the class with a free object, a fresh
+   * one is taken if needed. chunk_count() will be returned if the bin is
+   * exhausted. mtx_ must be held.
+   */
+  size_t acquire(const size_t cls) noexcept;
+
+  /**
+   * @brief give up ownership of a slab, mtx_ must be held
+   */
+  void retire(const size_t slab) noexcept;
+
+  /**
+   * @brief set the first free object bit of the slab, object_count() will be
+   * returned if it is full
+   */
+  size_t claim_object(const size_t slab, const size_t cls) noexcept;
+
+  /**
+   * @brief set an object bit, false if it was set already
+   */
+  bool take(const size_t slab, const size_t obj) noexcept;
+
+  void clear_slabs() noexcept;
+
+  std::shared_ptr<static_segment> make_segment(const size_t slab,
+                                               const size_t obj,
+                                               const size_t cls,
+                                               const size_t nbytes,
+                                               const size_t segment_id) const;
+
+public:
+  explicit slab_bin(
+    const size_t        id,
+    std::atomic_size_t& segment_counter,
+    const size_t&       slab_size,
+    const size_t&       slab_count,
+    const size_t&       base_pshift,
+    std::shared_ptr<spdlog::logger> = spdlog::default_logger());
+
+  ~slab_bin();
+
+  /**
+   * @brief give up the slabs of a thread that exits
+   */
+  void drop_owner(const std::array<size_t, CLASS_COUNT>& active,
+                  const size_t                           generation) noexcept;
+
+  std::shared_ptr<static_segment> malloc(const size_t     nbytes,
+                                         std::error_code& ec) noexcept override;
+
+  int free(std::shared_ptr<static_segment> segment,
+           std::error_code&                ec) noexcept override;
+
+  int reserve(const size_t     addr_pshift,
+              const size_t     nbytes,
+              std::error_code& ec) noexcept override;
+
+  /**
+   * @brief only succeeds while nbytes stays in the same size class
+   */
+  int resize(std::shared_ptr<static_segment> segment,
+             const size_t                    nbytes,
+             std::error_code&                ec) noexcept override;
+
+  void clear() noexcept override;
+
+  void collect_dirty(std::vector<std::pair<size_t, size_t>>& ranges,
+                     const bool all) noexcept override;
+
+  size_t max_request() const noexcept override;
+
+  size_t slot_size() const noexcept override;
+
+  BIN_TYPE type() const noexcept override;
+};
+}
@@ -11,6 +11,28 @@
 
 namespace shm_kernel::memory_manager {
 
+enum class BIN_TYPE
+{
+  STATIC = 0,
+  BUDDY  = 1,
+  TLSF   = 2,
+  SLAB   = 3,
+};
+
+/**
+ * @brief chunk usage of a bin, a slab bin counts slabs as chunks
+ */
+struct bin_stats
+{
+  size_t   id;
+  BIN_TYPE type;
+  size_t   chunk_size;
+  size_t   chunk_count;
+  size_t   free_chunks;
+  // chunks of the largest free run
+  size_t   largest_free;
+};
+
 class static_segment;
 class static_bin
 {
@@ -23,6 +45,11 @@ protected:
   const size_t                    chunk_count_;
   size_t                          chunk_left_;
   std::vector<bool>               chunks_;
+  // chunks written since the last checkpoint
+  std::vector<bool>               dirty_;
+  // chunks handed out at least once, the others still hold the zeros of a
+  // fresh mapping
+  std::vector<bool>               used_;
   std::shared_ptr<spdlog::logger> _M_statbin_logger;
 
   /**
@@ -44,8 +71,19 @@ public:
     const size_t&       base_pshift,
     std::shared_ptr<spdlog::logger> = spdlog::default_logger());
 
-  std::shared_ptr<static_segment> malloc(const size_t     nbytes,
-                                         std::error_code& ec) noexcept;
+  virtual ~static_bin() = default;
+
+  virtual std::shared_ptr<static_segment> malloc(const size_t     nbytes,
+                                                 std::error_code& ec) noexcept;
+
+  /**
+   * @brief malloc a segment whose addr_pshift is a multiple of alignment.
+   * if every slot is aligned it is plain malloc, otherwise the aligned slots
+   * are tried in order through reserve, so it works for every bin type.
+   */
+  std::shared_ptr<static_segment> malloc_aligned(const size_t     nbytes,
+                                                 const size_t     alignment,
+                                                 std::error_code& ec) noexcept;
 
   /**
    * @brief if free success, 0 will be returned.
@@ -55,10 +93,81 @@ public:
    * @param std::shared_ptr<base_segment>
    * @return int
    */
-  int free(std::shared_ptr<static_segment> segment,
-           std::error_code&                ec) noexcept;
+  virtual int free(std::shared_ptr<static_segment> segment,
+                   std::error_code&                ec) noexcept;
+
+  /**
+   * @brief mark [addr_pshift, addr_pshift + nbytes) as allocated without
+   * creating a segment. used to rebuild the bitmap from a persisted segment
+   * directory. -1 will be returned if the range is illegal or overlaps.
+   *
+   * @param addr_pshift
+   * @param nbytes
+   * @return int
+   */
+  virtual int reserve(const size_t     addr_pshift,
+                      const size_t     nbytes,
+                      std::error_code& ec) noexcept;
+
+  /**
+   * @brief grow or shrink a segment to nbytes without moving it. growing
+   * takes the free chunks right after the segment, shrinking releases its
+   * tail chunks. -1 will be returned if it can't be done in place, the
+   * segment itself is not modified.
+   */
+  virtual int resize(std::shared_ptr<static_segment> segment,
+                     const size_t                    nbytes,
+                     std::error_code&                ec) noexcept;
+
+  virtual void clear() noexcept;
+
+  /**
+   * @brief largest request this bin accepts
+   */
+  virtual size_t max_request() const noexcept;
+
+  /**
+   * @brief bytes covered by one slot of the batch segment directory, every
+   * segment of the bin starts on a multiple of it
+   */
+  virtual size_t slot_size() const noexcept;
+
+  virtual BIN_TYPE type() const noexcept;
 
-  void clear() noexcept;
+  /**
+   * @brief chunks of the longest run of free chunks
+   */
+  virtual const size_t largest_free() noexcept;
+
+  bin_stats stats() noexcept;
+
+  /**
+   * @brief write-notify, mark the chunks of [addr_pshift, addr_pshift +
+   * nbytes) as dirty for the next checkpoint.
+   */
+  void mark_dirty(const size_t addr_pshift, const size_t nbytes) noexcept;
+
+  /**
+   * @brief append dirty chunk runs as [pshift, pshift + nbytes) to ranges and
+   * reset the dirty bits. if all is true, every allocated chunk is
+   * collected as well.
+   */
+  virtual void collect_dirty(std::vector<std::pair<size_t, size_t>>& ranges,
+                             const bool                              all) noexcept;
+
+  /**
+   * @brief mark the chunks of [addr_pshift, addr_pshift + nbytes) as handed
+   * out. the parts of the range on chunks that were handed out before are
+   * appended to stale, the rest is known to be zero.
+   */
+  void claim(const size_t                            addr_pshift,
+             const size_t                            nbytes,
+             std::vector<std::pair<size_t, size_t>>& stale) noexcept;
+
+  /**
+   * @brief chunks never handed out
+   */
+  size_t pristine_chunks() noexcept;
 
   const size_t id() const noexcept;
 
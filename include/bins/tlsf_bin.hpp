@@ -0,0 +1,100 @@
+#pragma once
+
+#include "static_bin.hpp"
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace shm_kernel::memory_manager {
+
+/**
+ * @brief Two-Level Segregated Fit allocator over the same region a
+ * static_bin would manage. chunk_size is the allocation granule, a request
+ * takes exactly chunk_req(nbytes) chunks, the remainder of the picked free
+ * block is split off and freed blocks are merged with their free neighbours
+ * immediately.
+ *
+ * free blocks are kept in segregated lists indexed by (fl, sl), fl is the
+ * power of two of the block length and sl one of SL_COUNT linear subranges
+ * of it. two bitmaps locate a non-empty list with a couple of bit scans,
+ * so both malloc and free take a bounded number of steps. block links and
+ * boundary tags live in process memory, the shm only carries payloads.
+ */
+class tlsf_bin : public static_bin
+{
+protected:
+  static constexpr size_t SL_LOG2  = 4;
+  static constexpr size_t SL_COUNT = size_t(1) << SL_LOG2;
+  static constexpr size_t FL_COUNT = 64;
+  static constexpr size_t NIL      = static_cast<size_t>(-1);
+
+  uint64_t                                    fl_bitmap_;
+  std::array<uint32_t, FL_COUNT>              sl_bitmap_;
+  std::array<std::array<size_t, SL_COUNT>, FL_COUNT> heads_;
+
+  // indexed by chunk, valid at the first chunk of a free block
+  std::vector<size_t> len_;
+  std::vector<size_t> next_;
+  std::vector<size_t> prev_;
+  // boundary tag, first chunk of the free block ending at this chunk
+  std::vector<size_t> head_of_;
+
+  static void mapping_insert(const size_t nchunks, size_t& fl, size_t& sl) noexcept;
+
+  /**
+   * @brief round nchunks up so every block of the found list fits
+   */
+  static void mapping_search(const size_t nchunks, size_t& fl, size_t& sl) noexcept;
+
+  /**
+   * @brief first free block of a list at least (fl, sl), NIL if none
+   */
+  size_t find_suitable(size_t& fl, size_t& sl) const noexcept;
+
+  void insert_block(const size_t chunk, const size_t nchunks) noexcept;
+  void remove_block(const size_t chunk) noexcept;
+
+  /**
+   * @brief take [chunk, chunk + nchunks) out of the free block starting at
+   * block, the leftovers on both sides go back to the free lists
+   */
+  void carve(const size_t block, const size_t chunk, const size_t nchunks) noexcept;
+
+  void init_free_lists() noexcept;
+
+public:
+  explicit tlsf_bin(
+    const size_t        id,
+    std::atomic_size_t& segment_counter,
+    const size_t&       chunk_size,
+    const size_t&       chunk_count,
+    const size_t&       base_pshift,
+    std::shared_ptr<spdlog::logger> = spdlog::default_logger());
+
+  std::shared_ptr<static_segment> malloc(const size_t     nbytes,
+                                         std::error_code& ec) noexcept override;
+
+  int free(std::shared_ptr<static_segment> segment,
+           std::error_code&                ec) noexcept override;
+
+  int reserve(const size_t     addr_pshift,
+              const size_t     nbytes,
+              std::error_code& ec) noexcept override;
+
+  int resize(std::shared_ptr<static_segment> segment,
+             const size_t                    nbytes,
+             std::error_code&                ec) noexcept override;
+
+  void clear() noexcept override;
+
+  size_t max_request() const noexcept override;
+
+  BIN_TYPE type() const noexcept override;
+
+  /**
+   * @brief chunks of the largest free block
+   */
+  const size_t largest_free() noexcept override;
+};
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+namespace shm_kernel::memory_manager {
+
+/**
+ * @brief everything an incremental checkpoint of one batch has to write.
+ * the header (bin layout + segment directory) is copied when the delta is
+ * collected, chunk data is read from the live batch when it is written.
+ */
+struct checkpoint_delta
+{
+  size_t                                 batch_id;
+  // checkpoint whose snapshot file the ranges apply on top of, 0 when the
+  // delta carries every allocated chunk
+  size_t                                 base_sequence;
+  size_t                                 total_bytes;
+  std::vector<char>                      header;
+  std::vector<std::pair<size_t, size_t>> ranges;
+};
+
+/**
+ * @brief `{mmgr}#batchN#statbin.{sequence}.snap`, every checkpoint writes a
+ * new file so the one named by the manifest is never touched
+ */
+std::string
+snapshot_path(std::string_view snapshot_dir,
+              std::string_view mmgr_name,
+              const size_t     batch_id,
+              const size_t     sequence);
+
+/**
+ * @brief build the snapshot file at path from the one at base_path (none for
+ * a full delta) plus the delta, in `path.tmp`: chunk ranges first, then the
+ * header, then fdatasync and rename. throw std::system_error on failure, the
+ * file at base_path is left as it was.
+ *
+ * @return size_t bytes of chunk data written
+ */
+size_t
+write_snapshot(const std::string&      base_path,
+               const std::string&      path,
+               const char*             base,
+               const checkpoint_delta& delta);
+
+/**
+ * @brief remove the snapshot files of every checkpoint but sequence
+ */
+void
+prune_snapshots(std::string_view snapshot_dir,
+                std::string_view mmgr_name,
+                const size_t     sequence) noexcept;
+
+/**
+ * @brief atomically replace the manifest, which names the latest complete
+ * checkpoint. throw std::system_error on failure.
+ */
+void
+write_manifest(std::string_view snapshot_dir,
+               std::string_view mmgr_name,
+               const size_t     sequence,
+               const size_t     batch_count);
+
+/**
+ * @brief false if there is no readable manifest
+ */
+bool
+read_manifest(std::string_view snapshot_dir,
+              std::string_view mmgr_name,
+              size_t&          sequence,
+              size_t&          batch_count) noexcept;
+
+/**
+ * @brief size of a snapshot file, 0 if it can't be opened
+ */
+size_t
+snapshot_size(const std::string& path) noexcept;
+
+/**
+ * @brief read a whole snapshot file into dst
+ */
+int
+read_snapshot(const std::string& path,
+              void*              dst,
+              const size_t       nbytes,
+              std::error_code&   ec) noexcept;
+}
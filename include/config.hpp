@@ -3,3 +3,62 @@
 #ifndef ALIGNMENT
 #define ALIGNMENT 8
 #endif
+
+// batch header (bin layout + segment directory) is padded to this size, so
+// static bin data always starts on a page boundary.
+#ifndef BATCH_HEADER_ALIGNMENT
+#define BATCH_HEADER_ALIGNMENT 4096
+#endif
+
+// max number of live instant segments tracked for warm restart.
+#ifndef INSTANT_DIR_CAPACITY
+#define INSTANT_DIR_CAPACITY 4096
+#endif
+
+// entries of the compaction forwarding table, moved segments share entries
+// by id modulo this.
+#ifndef FORWARD_CAPACITY
+#define FORWARD_CAPACITY 4096
+#endif
+
+// how long COMPACT waits for pinned consumers before giving up.
+#ifndef COMPACT_PIN_TIMEOUT_MS
+#define COMPACT_PIN_TIMEOUT_MS 1000
+#endif
+
+// object size classes of the slab bin are the powers of two in
+// [SLAB_MIN_OBJECT, SLAB_MAX_OBJECT].
+#ifndef SLAB_MIN_OBJECT
+#define SLAB_MIN_OBJECT 32
+#endif
+
+#ifndef SLAB_MAX_OBJECT
+#define SLAB_MAX_OBJECT 512
+#endif
+
+#ifndef SLAB_SIZE
+#define SLAB_SIZE 4096
+#endif
+
+// shards of the cache bin, each with its own lock, pool and share of the
+// cache budget.
+#ifndef CACHE_SHARDS
+#define CACHE_SHARDS 16
+#endif
+
+// bytes of a shm region of a shared cache bin. larger cache segments get a
+// region of their own.
+#ifndef CACHE_REGION_SIZE
+#define CACHE_REGION_SIZE (4 * 1024 * 1024)
+#endif
+
+// memops::copy switches to non-temporal stores from this many bytes, about
+// where the payload stops fitting in the last level cache.
+#ifndef NT_COPY_THRESHOLD
+#define NT_COPY_THRESHOLD (4 * 1024 * 1024)
+#endif
+
+// stripe_pool never hands a worker less than this many bytes
+#ifndef PARALLEL_STRIPE_MIN
+#define PARALLEL_STRIPE_MIN (4 * 1024 * 1024)
+#endif
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Layouts persisted inside shared memory objects, so that a restarted mmgr
+ * can reattach to the batches and instant segments it left behind.
+ *
+ * Every structure here lives in shm and is only ever accessed in place.
+ */
+namespace shm_kernel::memory_manager {
+
+constexpr uint64_t BATCH_MAGIC       = 0x4354414252474d4d; // "MMGRBATC"
+constexpr uint64_t INSTANT_DIR_MAGIC = 0x5249444e52474d4d; // "MMGRNDIR"
+constexpr uint64_t FORWARD_MAGIC     = 0x4452574652474d4d; // "MMGRFWRD"
+constexpr uint32_t DIRECTORY_VERSION = 5;
+
+/**
+ * @brief one slot of a segment directory. a slot is live when size != 0,
+ * size is always the last field written and the first field cleared.
+ */
+struct dir_entry
+{
+  std::atomic_uint64_t id;
+  std::atomic_uint64_t size;
+};
+
+struct bin_desc
+{
+  uint64_t id;
+  uint64_t chunk_size;
+  uint64_t chunk_count;
+  uint64_t base_pshift;
+  // index of this bin's first slot in the batch directory
+  uint64_t slot_base;
+  // slots of this bin, each one covers slot_size bytes
+  uint64_t slot_count;
+  uint64_t slot_size;
+  // BIN_TYPE of the allocator that manages the chunks
+  uint64_t type;
+};
+
+/**
+ * @brief header at pshift 0 of every `#batchN#statbin` object.
+ * followed by bin_desc[bin_count] and dir_entry[slot_count]. the directory
+ * holds one slot per chunk (per smallest object for slab bins), a live
+ * segment is recorded in the slot it starts at.
+ */
+struct batch_header
+{
+  uint64_t             magic;
+  uint32_t             version;
+  uint32_t             bin_count;
+  uint64_t             total_bytes;
+  uint64_t             data_pshift;
+  uint64_t             slot_count;
+  std::atomic_uint64_t next_segment_id;
+
+  bin_desc* bins() noexcept { return reinterpret_cast<bin_desc*>(this + 1); }
+
+  dir_entry* slots() noexcept
+  {
+    return reinterpret_cast<dir_entry*>(bins() + bin_count);
+  }
+
+  static constexpr size_t bytes(const size_t bin_count,
+                                const size_t slot_count) noexcept
+  {
+    return sizeof(batch_header) + bin_count * sizeof(bin_desc) +
+           slot_count * sizeof(dir_entry);
+  }
+};
+
+/**
+ * @brief `#instbin#dir` object, records every live instant segment.
+ * followed by dir_entry[capacity] and a generation per slot, which is
+ * bumped whenever the segment in the slot is resized, so consumers know
+ * to remap it.
+ */
+struct instant_dir_header
+{
+  uint64_t             magic;
+  uint32_t             version;
+  uint32_t             capacity;
+  std::atomic_uint64_t next_segment_id;
+
+  dir_entry* slots() noexcept { return reinterpret_cast<dir_entry*>(this + 1); }
+
+  std::atomic_uint64_t* generations() noexcept
+  {
+    return reinterpret_cast<std::atomic_uint64_t*>(slots() + capacity);
+  }
+
+  static constexpr size_t bytes(const size_t capacity) noexcept
+  {
+    return sizeof(instant_dir_header) +
+           capacity * (sizeof(dir_entry) + sizeof(std::atomic_uint64_t));
+  }
+};
+
+/**
+ * @brief raise a persisted id counter to at least `next`
+ */
+inline void
+bump_next_id(std::atomic_uint64_t& counter, const uint64_t next) noexcept
+{
+  uint64_t __cur = counter.load(std::memory_order_relaxed);
+  while (__cur < next && !counter.compare_exchange_weak(
+                           __cur, next, std::memory_order_relaxed)) {
+  }
+}
+
+/**
+ * @brief where compaction moved a static segment. written under a seqlock:
+ * seq is odd while the entry is being updated.
+ */
+struct forward_entry
+{
+  std::atomic_uint64_t seq;
+  std::atomic_uint64_t id;
+  std::atomic_uint64_t batch_id;
+  std::atomic_uint64_t bin_id;
+  std::atomic_uint64_t addr_pshift;
+};
+
+/**
+ * @brief `{mmgr}#forward` object, followed by forward_entry[capacity]. a
+ * moved segment is recorded at entries()[id % capacity] and epoch is bumped
+ * afterwards, so consumers only look the table up when epoch moved.
+ * consumers using raw pointers count themselves in pins, COMPACT raises
+ * compacting and waits for pins to drain before it moves anything.
+ */
+struct forward_header
+{
+  uint64_t             magic;
+  uint32_t             version;
+  uint32_t             capacity;
+  std::atomic_uint64_t epoch;
+  std::atomic_uint64_t compacting;
+  std::atomic_uint64_t pins;
+
+  forward_entry* entries() noexcept
+  {
+    return reinterpret_cast<forward_entry*>(this + 1);
+  }
+
+  static constexpr size_t bytes(const size_t capacity) noexcept
+  {
+    return sizeof(forward_header) + capacity * sizeof(forward_entry);
+  }
+};
+
+}
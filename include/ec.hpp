@@ -23,6 +23,14 @@ enum class MmgrErrc
   UnableToRegisterSegment,
   UnableToAttachShm,
   SegmentExist,
+  IncompatibleBatch,
+  SnapshotFailed,
+  FrameNotFound,
+  IllegalAlignment,
+  CacheBudgetExceeded,
+  MemoryCeilingReached,
+  AllocTimeout,
+  WouldBlock,
 };
 
 namespace std {
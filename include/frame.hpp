@@ -0,0 +1,71 @@
+#pragma once
+
+#include "segment.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <system_error>
+
+namespace shm_kernel::memory_manager {
+
+/**
+ * @brief bump-pointer arena over one contiguous static segment. segments are
+ * handed out by advancing an offset and are all released at once by reset.
+ *
+ * frame segment ids don't come from the mmgr's segment counter, they encode
+ * [63] FRAME_ID_BIT, [62:48] frame id, [47:24] generation, [23:0] index.
+ * reset bumps the generation, so ids handed out before it no longer match
+ * the frame. generations wrap after 2^24 resets.
+ */
+class frame_arena
+{
+public:
+  static constexpr uint64_t FRAME_ID_BIT   = uint64_t(1) << 63;
+  static constexpr size_t   FRAME_BITS     = 15;
+  static constexpr size_t   GEN_BITS       = 24;
+  static constexpr size_t   INDEX_BITS     = 24;
+  static constexpr size_t   MAX_FRAMES     = size_t(1) << FRAME_BITS;
+  static constexpr size_t   MAX_ALLOCATION = size_t(1) << INDEX_BITS;
+
+private:
+  const size_t                    id_;
+  std::shared_ptr<static_segment> region_;
+  // offset and allocation count packed together, so a single CAS
+  // advances both
+  std::atomic_uint64_t            cursor_{ 0 };
+  std::atomic_uint32_t            generation_{ 0 };
+
+public:
+  frame_arena(const size_t id, std::shared_ptr<static_segment> region);
+
+  /**
+   * @brief bump allocate nbytes, rounded up to ALIGNMENT. lock-free, NoMemory
+   * if the frame is full.
+   */
+  std::shared_ptr<static_segment> allocate(const size_t     nbytes,
+                                           std::error_code& ec) noexcept;
+
+  /**
+   * @brief release every segment of the frame in O(1). must not race with
+   * allocate.
+   */
+  void reset() noexcept;
+
+  /**
+   * @brief true if segment_id was handed out by this frame since the last
+   * reset
+   */
+  bool valid(const size_t segment_id) const noexcept;
+
+  static bool   is_frame_id(const size_t segment_id) noexcept;
+  static size_t frame_of(const size_t segment_id) noexcept;
+
+  const size_t                    id() const noexcept;
+  const uint32_t                  generation() const noexcept;
+  const size_t                    used() const noexcept;
+  const size_t                    capacity() const noexcept;
+  std::shared_ptr<static_segment> region() const noexcept;
+};
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "segment.hpp"
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace shm_kernel::memory_manager {
+
+/**
+ * @brief lock-free multi-producer single-consumer queue of segments waiting
+ * to be released. producers push onto an atomic list head, the consumer
+ * takes the whole list at once, so there is no ABA to guard against.
+ */
+class free_queue
+{
+private:
+  struct node
+  {
+    size_t   id;
+    SEG_TYPE type;
+    node*    next;
+  };
+
+  std::atomic<node*> head_{ nullptr };
+  std::atomic_size_t size_{ 0 };
+
+public:
+  free_queue() = default;
+  free_queue(const free_queue&) = delete;
+  free_queue& operator=(const free_queue&) = delete;
+  ~free_queue();
+
+  /**
+   * @brief false if no node could be allocated, release the segment now
+   * then
+   */
+  bool push(const size_t segment_id, const SEG_TYPE type) noexcept;
+
+  /**
+   * @brief append every queued segment to out in push order, return how
+   * many. single consumer only.
+   */
+  size_t take(std::vector<std::pair<size_t, SEG_TYPE>>& out);
+
+  /**
+   * @brief queued segments, approximate while producers push
+   */
+  size_t size() const noexcept;
+};
+
+}
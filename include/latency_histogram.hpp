@@ -0,0 +1,102 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+namespace shm_kernel::memory_manager {
+
+/**
+ * @brief cheap timestamps for latencies. the TSC on x86-64, calibrated
+ * against steady_clock once, steady_clock elsewhere.
+ */
+struct latency_clock
+{
+  static uint64_t now() noexcept
+  {
+#if defined(__x86_64__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+#endif
+  }
+
+  /**
+   * @brief the first call calibrates for a few milliseconds
+   */
+  static double nanos_per_tick() noexcept;
+
+  static uint64_t to_nanos(const uint64_t ticks) noexcept
+  {
+    return static_cast<uint64_t>(ticks * nanos_per_tick());
+  }
+};
+
+/**
+ * @brief latency percentiles in nanoseconds, each the upper bound of its
+ * bucket
+ */
+struct latency_summary
+{
+  uint64_t count;
+  uint64_t p50;
+  uint64_t p90;
+  uint64_t p99;
+  uint64_t p999;
+  uint64_t max;
+  uint64_t sum;
+};
+
+/**
+ * @brief HDR style histogram of latencies in nanoseconds. below 16ns a
+ * bucket per nanosecond, above 16 linear buckets per power of two, so a
+ * bucket's upper bound is at most 6.25% above any value in it. recording is
+ * a relaxed add, lock-free.
+ */
+class latency_histogram
+{
+public:
+  static constexpr size_t SUB_BUCKETS = 16;
+  static constexpr size_t BUCKETS     = SUB_BUCKETS + 60 * SUB_BUCKETS;
+
+private:
+  std::array<std::atomic_uint64_t, BUCKETS> counts_{};
+  std::atomic_uint64_t                      max_{ 0 };
+  std::atomic_uint64_t                      sum_{ 0 };
+
+public:
+  static size_t bucket_of(const uint64_t nanos) noexcept;
+
+  /**
+   * @brief largest latency falling into the bucket
+   */
+  static uint64_t upper_bound(const size_t bucket) noexcept;
+
+  void record(const uint64_t nanos) noexcept;
+
+  uint64_t count() const noexcept;
+
+  uint64_t max() const noexcept;
+
+  /**
+   * @brief smallest bucket bound at or above the given fraction of the
+   * samples, e.g. 0.99. 0 without samples.
+   */
+  uint64_t percentile(const double fraction) const noexcept;
+
+  latency_summary summary() const noexcept;
+
+  /**
+   * @brief samples recorded concurrently may survive it
+   */
+  void reset() noexcept;
+};
+
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+namespace shm_kernel::memory_manager {
+
+enum class ACCESS_ADVICE
+{
+  NORMAL,
+  SEQUENTIAL,
+  RANDOM,
+  WILLNEED,
+  DONTNEED,
+};
+
+/**
+ * @brief a file mmap'ed with MAP_SHARED, the file-backed counterpart of
+ * ipc::shmhdl. pages are written back to the file by the kernel, so a
+ * working set larger than RAM can page out to disk.
+ *
+ * the creator removes the file when it is destroyed.
+ */
+class mapped_file
+{
+private:
+  std::string path_;
+  int         fd_;
+  void*       addr_;
+  size_t      nbytes_;
+  bool        owner_;
+  // alignment of addr_ beyond a page, 0 if none
+  size_t      align_{ 0 };
+
+  // map the whole object behind fd_, fd_ is closed on failure
+  void map_fd();
+
+  // reserve nbytes of address space starting on a multiple of align_
+  void* aligned_window(const size_t nbytes, std::error_code& ec) noexcept;
+
+  mapped_file() = default;
+
+public:
+  /**
+   * @brief create a new file of nbytes and map it. throw if the file
+   * already exists or can't be mapped.
+   */
+  mapped_file(std::string_view path, const size_t nbytes);
+
+  /**
+   * @brief attach to an existing file, throw if it doesn't exist.
+   */
+  explicit mapped_file(std::string_view path);
+
+  mapped_file(const mapped_file&) = delete;
+  mapped_file& operator=(const mapped_file&) = delete;
+
+  ~mapped_file();
+
+  /**
+   * @brief map an existing POSIX shm object through its own descriptor, so
+   * it can be resized and remapped. the object is never unlinked by it.
+   */
+  static std::shared_ptr<mapped_file> open_shm(std::string_view shm_name);
+
+  void* map(std::error_code& ec) noexcept;
+
+  int advise(const ACCESS_ADVICE advice, std::error_code& ec) noexcept;
+
+  /**
+   * @brief write dirty pages back to the file. if async is true, only
+   * schedule the write back.
+   */
+  int flush(const bool async, std::error_code& ec) noexcept;
+
+  /**
+   * @brief ftruncate the object to nbytes and mremap the mapping, which may
+   * move. contents up to the smaller size are kept, nothing is copied.
+   */
+  int resize(const size_t nbytes, std::error_code& ec) noexcept;
+
+  /**
+   * @brief follow a resize done through another descriptor, the mapping is
+   * mremap'ed to the current size of the object.
+   */
+  int remap(std::error_code& ec) noexcept;
+
+  /**
+   * @brief move the mapping to an address aligned to alignment, a power of
+   * two. later resizes and remaps keep it aligned.
+   */
+  int align(const size_t alignment, std::error_code& ec) noexcept;
+
+  size_t           nbytes() const noexcept;
+  std::string_view path() const noexcept;
+  int              fd() const noexcept;
+};
+
+size_t
+page_size() noexcept;
+
+/**
+ * @brief join backing_dir and a shm object name into a file path
+ */
+std::string
+backing_path(std::string_view backing_dir, std::string_view shm_name);
+
+/**
+ * @brief madvise [addr, addr + nbytes), the range is widened to pages.
+ */
+int
+advise_range(void*               addr,
+             const size_t        nbytes,
+             const ACCESS_ADVICE advice,
+             std::error_code&    ec) noexcept;
+
+/**
+ * @brief msync [addr, addr + nbytes), the range is widened to pages.
+ */
+int
+flush_range(void*            addr,
+            const size_t     nbytes,
+            const bool       async,
+            std::error_code& ec) noexcept;
+}
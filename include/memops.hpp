@@ -0,0 +1,110 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Bulk memory kernels used when the memory manager itself moves segment
+ * payloads, e.g. STATIC_REALLOC falling back to allocate + copy.
+ */
+namespace shm_kernel::memory_manager::memops {
+
+enum class COPY_KERNEL
+{
+  // libc memcpy, goes through the cache
+  LIBC = 0,
+  // 16 bytes non-temporal stores
+  SSE2 = 1,
+  // 32 bytes non-temporal stores
+  AVX2 = 2,
+};
+
+/**
+ * @brief the widest non-temporal kernel the CPU supports, picked once.
+ * LIBC when there is none.
+ */
+COPY_KERNEL stream_kernel() noexcept;
+
+const char* kernel_name(const COPY_KERNEL kernel) noexcept;
+
+/**
+ * @brief copy n bytes between non-overlapping buffers. copies of at least
+ * NT_COPY_THRESHOLD bytes bypass the cache with non-temporal stores, the
+ * destination is not expected to be read back soon.
+ */
+void copy(void* dst, const void* src, const size_t n) noexcept;
+
+/**
+ * @brief copy with non-temporal stores whatever the size
+ */
+void stream_copy(void* dst, const void* src, const size_t n) noexcept;
+
+/**
+ * @brief copy with the given kernel, falling back to LIBC if the CPU lacks
+ * it. for benchmarks and tests.
+ */
+void copy_with(const COPY_KERNEL kernel,
+               void*             dst,
+               const void*       src,
+               const size_t      n) noexcept;
+
+/**
+ * @brief memset to zero, with non-temporal stores from NT_COPY_THRESHOLD
+ * bytes like copy
+ */
+void zero(void* dst, const size_t n) noexcept;
+
+/**
+ * @brief workers splitting a large copy or fill into page-aligned stripes,
+ * one contiguous stripe per worker. each worker is pinned to a CPU, so on
+ * a fresh mapping a stripe's pages are first touched, and placed, on the
+ * NUMA node of the worker that keeps writing them on later calls. the
+ * caller runs the first stripe. one job at a time.
+ */
+class stripe_pool
+{
+private:
+  using stripe_job = std::function<void(const size_t begin, const size_t end)>;
+
+  std::vector<std::thread> workers_;
+  std::mutex               run_mtx_;
+  std::mutex               mtx_;
+  std::condition_variable  start_cv_;
+  std::condition_variable  done_cv_;
+  const stripe_job*        job_ = nullptr;
+  std::vector<std::pair<size_t, size_t>> stripes_;
+  size_t                   generation_ = 0;
+  size_t                   pending_    = 0;
+  bool                     stop_       = false;
+
+  void work(const size_t index);
+
+  // split [0, n) of dst into stripes ending on page boundaries of dst
+  void run(const char* dst, const size_t n, const stripe_job& job);
+
+public:
+  stripe_pool(const stripe_pool&) = delete;
+  stripe_pool& operator=(const stripe_pool&) = delete;
+
+  /**
+   * @brief threads includes the caller, 0 for hardware_concurrency
+   */
+  explicit stripe_pool(const size_t threads = 0);
+  ~stripe_pool();
+
+  size_t threads() const noexcept;
+
+  /**
+   * @brief memops::copy per stripe, stripes are never shorter than
+   * PARALLEL_STRIPE_MIN bytes so small copies stay on the caller
+   */
+  void copy(void* dst, const void* src, const size_t n);
+
+  void fill(void* dst, const int value, const size_t n);
+};
+
+}
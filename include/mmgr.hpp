@@ -1,18 +1,107 @@
 #pragma once
 #include "batch.hpp"
+#include "batch_list.hpp"
 #include "bins/cache_bin.hpp"
 #include "bins/instant_bin.hpp"
+#include "frame.hpp"
+#include "free_queue.hpp"
 #include "mem_literals.hpp"
+#include "memops.hpp"
+#include "mmgr_stats.hpp"
 #include "segment.hpp"
+#include "size_histogram.hpp"
 #include "spdlog/logger.h"
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstddef>
+#include <deque>
 #include <functional>
+#include <future>
+#include <map>
 #include <mutex>
+#include <shared_mutex>
 #include <spdlog/spdlog.h>
+#include <thread>
 
 namespace shm_kernel::memory_manager {
 
+struct mmgr_options
+{
+  // reattach to the batches and instant segments left by a previous mmgr
+  // with the same name, instead of creating batch0 from scratch. on
+  // destruction the objects are kept rather than unlinked, until the next
+  // mmgr of the name takes them over (see shm_keeper.hpp).
+  bool warm_restart = false;
+  // if not empty, batches and instant segments are files mmap'ed from this
+  // directory (local disk or tmpfs) instead of POSIX shm objects.
+  std::string backing_dir;
+  // directory of incremental checkpoints. if set and warm_restart didn't
+  // reattach anything, static batches are restored from the latest
+  // checkpoint on startup.
+  std::string snapshot_dir;
+  // allocator of the static bins in new batches
+  BIN_TYPE bin_type = BIN_TYPE::STATIC;
+  // slabs of SLAB_SIZE bytes per batch serving SMALL_ALLOC, 0 disables it
+  size_t slab_count = 0;
+  // lay out batches added after adaptive_min_samples STATIC_ALLOC calls
+  // from the request size histogram instead of batch_bin_size/count
+  bool   adaptive_layout      = false;
+  size_t adaptive_min_samples = 1024;
+  // most bytes the cache bin may hold, 0 for no limit. beyond it unpinned
+  // cache segments are evicted by cache_policy.
+  size_t       cache_budget = 0;
+  CACHE_POLICY cache_policy = CACHE_POLICY::LRU;
+  // the cache budget is split evenly between the shards
+  size_t       cache_shards = CACHE_SHARDS;
+  // cache buffers live in `{mmgr}#cache#regionN` shm objects, so smgr
+  // consumers attach cache segments like static ones
+  bool         shared_cache = false;
+  // threads of PARALLEL_WRITE/PARALLEL_FILL including the caller, 0 for
+  // hardware_concurrency. started on first use.
+  size_t       parallel_threads = 0;
+  // STATIC_DEALLOC and INSTANT_DEALLOC only queue the segment, a
+  // background reclaimer releases the queue at least every
+  // deferred_free_latency, or as soon as deferred_free_batch segments are
+  // waiting.
+  bool                      deferred_free         = false;
+  std::chrono::microseconds deferred_free_latency = std::chrono::milliseconds(1);
+  size_t                    deferred_free_batch   = 256;
+  // most bytes of static batches and instant segments together, 0 for no
+  // limit. an allocation needing more fails with MemoryCeilingReached, the
+  // *_WAIT variants block until frees make room.
+  size_t memory_ceiling = 0;
+  // time every op into a latency histogram per op, see mmgr::LATENCY.
+  // ignored unless built with MMGR_LATENCY_HISTOGRAMS.
+  bool latency_histograms = false;
+};
+
+/**
+ * @brief runs the completion of an async allocation, e.g. by posting it to
+ * an event loop
+ */
+using async_executor = std::function<void(std::function<void()>)>;
+
+template<typename Segment>
+using async_alloc_callback =
+  std::function<void(std::shared_ptr<Segment>, std::error_code)>;
+
+/**
+ * @brief waste is the fraction of requested bytes lost to chunk rounding
+ */
+struct layout_report
+{
+  // layout the next add_BATCH uses
+  bin_layout next_layout;
+  size_t     samples;
+  // of the recorded requests under next_layout and under the configured
+  // batch_bin_size, when served by the smallest chunk size that fits
+  double predicted_waste;
+  double baseline_waste;
+  // of the live static segments
+  double actual_waste;
+};
+
 class mmgr
 {
 
@@ -20,23 +109,227 @@ private:
   const std::string         name_;
   const std::vector<size_t> batch_bin_size_;
   const std::vector<size_t> batch_bin_count_;
+  const mmgr_options        options_;
 
   std::shared_ptr<spdlog::logger>                 _M_mmgr_logger;
   std::mutex                                      mtx_;
   std::shared_ptr<instant_bin>                    instant_bin_;
   std::shared_ptr<cache_bin>                      cache_bin_;
-  std::vector<std::shared_ptr<batch>>             batches_;
+  // read without locks, appended under mtx_
+  batch_list                                      batches_;
   bool                                            is_initialized_;
   std::atomic_size_t                              segment_counter_{ 0 };
   std::map<size_t, std::shared_ptr<base_segment>> segment_table_;
+  // serializes checkpoints
+  std::shared_ptr<std::mutex>                     checkpoint_mtx_;
+  std::shared_ptr<std::atomic_size_t>             checkpoint_seq_;
+  // runs the CHECKPOINT tasks in order, started on the first one and
+  // joined by ~mmgr once the queued ones are written
+  std::once_flag                                  checkpointer_once_;
+  std::thread                                     checkpointer_;
+  std::mutex                                      checkpointer_mtx_;
+  std::condition_variable                         checkpointer_cv_;
+  std::deque<std::function<void()>>               checkpoint_tasks_;
+  bool                                            checkpointer_stop_{ false };
+  // guards frames_ and next_frame_id_, FRAME_CREATE/FRAME_DESTROY are the
+  // only writers
+  mutable std::shared_mutex                       frame_mtx_;
+  std::map<size_t, std::shared_ptr<frame_arena>>  frames_;
+  size_t                                          next_frame_id_{ 0 };
+  // `{mmgr}#forward`, tells consumers where COMPACT moved segments
+  std::unique_ptr<ipc::shmhdl>                    forward_handle_;
+  forward_header*                                 forward_{ nullptr };
+  // sizes requested from STATIC_ALLOC
+  size_histogram                                  size_histogram_;
+  cache_evict_callback                            on_cache_evict_;
+  // guards every access to segment_table_, lookups share it
+  mutable std::shared_mutex                       table_mtx_;
+  // shared while a static segment's location is in use, COMPACT holds it
+  // exclusively before any other lock
+  std::shared_mutex                               compact_mtx_;
+  std::once_flag                                  stripe_once_;
+  // segments queued by deferred STATIC_DEALLOC/INSTANT_DEALLOC
+  free_queue                                      free_queue_;
+  // one drain at a time, COMPACT holds it to keep segments still
+  std::mutex                                      reclaim_mtx_;
+  std::thread                                     reclaimer_;
+  std::mutex                                      reclaimer_mtx_;
+  std::condition_variable                         reclaimer_cv_;
+  bool                                            reclaimer_stop_{ false };
+  // bytes of live instant segments, counted against memory_ceiling
+  std::atomic_size_t                              instant_bytes_{ 0 };
+  // bytes reserved against memory_ceiling by allocations in flight, only
+  // the arithmetic runs under ceiling_mtx_
+  std::mutex                                      ceiling_mtx_;
+  size_t                                          ceiling_reserved_{ 0 };
+  // blocked *_WAIT callers and parked ASYNC_* requests, FIFO per size class
+  struct alloc_waiter
+  {
+    std::condition_variable cv;
+    // an ASYNC_* request, async_worker_ retries it instead of the cv
+    bool                    parked{ false };
+  };
+  struct async_request
+  {
+    alloc_waiter                          waiter;
+    size_t                                size_class;
+    std::chrono::steady_clock::time_point deadline;
+    // free_epoch_ of the last attempt, none yet if fresh
+    size_t                                seen{ 0 };
+    bool                                  fresh{ true };
+    // completes the request and returns true if the allocation succeeds
+    std::function<bool(std::error_code&)> attempt;
+    std::function<void(std::error_code)>  fail;
+  };
+  std::mutex                                      wait_mtx_;
+  std::map<size_t, std::deque<alloc_waiter*>>     waiters_;
+  std::atomic_size_t                              waiting_{ 0 };
+  // bumped by every free while someone waits
+  size_t                                          free_epoch_{ 0 };
+  // slow halves of the ASYNC_* calls, parked by async_worker_
+  std::once_flag                                  async_once_;
+  std::thread                                     async_worker_;
+  std::mutex                                      async_mtx_;
+  std::condition_variable                         async_cv_;
+  std::deque<std::unique_ptr<async_request>>      async_tasks_;
+  // a parked request reached the front of its class or saw a free
+  bool                                            async_wake_{ false };
+  bool                                            async_stop_{ false };
+  async_executor                                  async_executor_;
+  op_counters                                     op_counters_;
+  std::unique_ptr<memops::stripe_pool>            stripe_pool_;
 
   void PRE_CHECK() const;
   void init_INSTANT_BIN();
   void init_CACHE_BIN();
+  void init_FORWARD();
+
+  // insert a new cache segment into segment_table_, unless it was evicted
+  // already
+  int register_CACHE(std::shared_ptr<cache_segment> segment,
+                     std::error_code&               ec) noexcept;
+
+  std::shared_ptr<cache_segment> find_CACHE(const size_t     segment_id,
+                                            std::error_code& ec) noexcept;
+
+  // find any segment and its mapping in this process
+  std::shared_ptr<base_segment> locate_BUFFER(const size_t     segment_id,
+                                              char**           ptr,
+                                              std::error_code& ec) noexcept;
+
+  // run writer on the mapping at offset after a range check, then mark
+  // static segments dirty
+  int write_RANGE(const size_t                       segment_id,
+                  const size_t                       offset,
+                  const size_t                       nbytes,
+                  const std::function<void(char*)>& writer,
+                  std::error_code&                   ec) noexcept;
+
+  memops::stripe_pool& stripe_POOL();
+
+  // nullptr if there is no such segment
+  std::shared_ptr<base_segment> find_SEGMENT(const size_t segment_id) const
+    noexcept;
+
+  // nullptr if there is no such frame
+  std::shared_ptr<frame_arena> find_FRAME(const size_t frame_id) const noexcept;
+
+  // erase a static or instant segment from segment_table_ and free it in its
+  // bin. the reclaimer logs an id it no longer finds as a double free
+  int release_SEGMENT(const size_t     segment_id,
+                      const SEG_TYPE   type,
+                      const bool       reclaimer,
+                      std::error_code& ec) noexcept;
+
+  // STATIC_DEALLOC without counting it, for calls made on behalf of other ops
+  int dealloc_STATIC(const size_t segment_id, std::error_code& ec) noexcept;
+
+  // release every queued segment, return how many were released
+  size_t drain_FREES() noexcept;
+
+  void reclaimer_LOOP() noexcept;
+
+  void checkpoint_LOOP() noexcept;
+
+  // reserve nbytes if the batches, instant segments and other reservations
+  // plus nbytes stay within memory_ceiling. release_CEILING once the bytes
+  // are counted as a batch or in instant_bytes_, or the allocation failed
+  bool reserve_CEILING(const size_t nbytes) noexcept;
+  void release_CEILING(const size_t nbytes) noexcept;
+
+  // now + timeout, a timeout past the clock's range waits forever
+  static std::chrono::steady_clock::time_point deadline_AFTER(
+    const std::chrono::nanoseconds timeout) noexcept;
+
+  // add_BATCH unless it would pass memory_ceiling
+  std::shared_ptr<batch> grow_BATCH(std::error_code& ec);
+
+  // queue request for async_worker_, started on first use
+  void post_ASYNC(std::unique_ptr<async_request> request);
+
+  // attempt a parked request if it is its class's turn, or expire it.
+  // true once it is completed
+  bool retry_ASYNC(async_request& request) noexcept;
+
+  // hand a completion to the executor, or run it here without one
+  void complete_ASYNC(std::function<void()> completion) noexcept;
+
+  void async_LOOP() noexcept;
+
+  // let the oldest waiter of each size class retry
+  void wake_WAITERS() noexcept;
+
+  // the allocation failed for lack of room, waiting may help
+  static bool out_of_ROOM(const std::error_code& ec) noexcept;
+
+  // wake a blocked waiter or the async worker. wait_mtx_ is held
+  void notify_WAITER(alloc_waiter& waiter) noexcept;
+
+  // drop waiter from its class and hand the turn to the next one
+  void leave_WAITERS(alloc_waiter& waiter, const size_t size_class) noexcept;
+
+  // retry attempt until it succeeds, fails for another reason than lack of
+  // room, or timeout passes
+  bool wait_ALLOC(const size_t                    size_class,
+                  const std::chrono::nanoseconds  timeout,
+                  const std::function<bool()>&    attempt,
+                  std::error_code&                ec) noexcept;
+
+  // without may_block only the existing batches are tried, WouldBlock if
+  // they are full
+  std::shared_ptr<static_segment> alloc_STATIC(const size_t     size,
+                                               const size_t     alignment,
+                                               const bool       zeroed,
+                                               const bool       may_block,
+                                               std::error_code& ec) noexcept;
+
+  std::shared_ptr<instant_segment> alloc_INSTANT(const size_t     size,
+                                                 const size_t     alignment,
+                                                 std::error_code& ec) noexcept;
+
+  std::shared_ptr<static_segment> alloc_SMALL(const size_t     size,
+                                              const bool       zeroed,
+                                              std::error_code& ec) noexcept;
+
+  // record the segment's new location in the forwarding table
+  void publish_FORWARD(const static_segment& segment) noexcept;
+
+  // return true if batch0 was reattached
+  bool warm_RESTART();
+
+  // return true if batches were restored from the latest checkpoint
+  bool restore_SNAPSHOT();
+
+  // insert the batch's live segments into segment_table_
+  void adopt_BATCH(std::shared_ptr<batch> batch, size_t& next_id);
 
   // return new added batch sptr
   std::shared_ptr<batch> add_BATCH();
 
+  batch_options make_BATCH_OPTIONS() const;
+
+  bin_layout next_LAYOUT() const;
+
 public:
   mmgr(const mmgr&) = delete;
   mmgr(mmgr&&)      = delete;
@@ -46,6 +339,11 @@ public:
        const std::vector<size_t>& batch_bin_size,
        const std::vector<size_t>& batch_bin_count,
        std::shared_ptr<spdlog::logger> = spdlog::default_logger());
+  mmgr(const std::string&         name,
+       const std::vector<size_t>& batch_bin_size,
+       const std::vector<size_t>& batch_bin_count,
+       const mmgr_options&        options,
+       std::shared_ptr<spdlog::logger> = spdlog::default_logger());
   virtual ~mmgr();
 
   std::shared_ptr<cache_segment> CACHE_STORE(
@@ -57,6 +355,16 @@ public:
                                                std::error_code& ec) noexcept;
   std::shared_ptr<cache_segment> CACHE_STORE(const void*  buffer,
                                                const size_t size);
+  /**
+   * @brief store a copy whose buffer is aligned to alignment, a power of two
+   */
+  std::shared_ptr<cache_segment> CACHE_STORE(const void*      buffer,
+                                             const size_t     size,
+                                             const size_t     alignment,
+                                             std::error_code& ec) noexcept;
+  std::shared_ptr<cache_segment> CACHE_STORE(const void*  buffer,
+                                             const size_t size,
+                                             const size_t alignment);
 
   int CACHE_DEALLOC(const size_t segment_id, std::error_code& ec) noexcept;
   int CACHE_DEALLOC(const size_t segment_id);
@@ -76,20 +384,341 @@ public:
   void* CACHE_RETRIEVE(const size_t segment_id, std::error_code& ec) noexcept;
   void* CACHE_RETRIEVE(const size_t segment_id);
 
+  /**
+   * @brief protect a cache segment from eviction, pins nest
+   */
+  int CACHE_PIN(const size_t segment_id, std::error_code& ec) noexcept;
+  int CACHE_PIN(const size_t segment_id);
+
+  int CACHE_UNPIN(const size_t segment_id, std::error_code& ec) noexcept;
+  int CACHE_UNPIN(const size_t segment_id);
+
+  /**
+   * @brief called with the id and size of every evicted cache segment,
+   * after it left the segment table
+   */
+  void CACHE_ON_EVICT(cache_evict_callback callback);
+
+  cache_stats CACHE_STATS() noexcept;
+
   std::shared_ptr<instant_segment> INSTANT_ALLOC(const size_t     size,
                                                  std::error_code& ec) noexcept;
   std::shared_ptr<instant_segment> INSTANT_ALLOC(const size_t size);
+  /**
+   * @brief alignment is a power of two. mappings are page aligned, larger
+   * alignments get an over-aligned mapping in the mmgr and in every smgr.
+   */
+  std::shared_ptr<instant_segment> INSTANT_ALLOC(const size_t     size,
+                                                 const size_t     alignment,
+                                                 std::error_code& ec) noexcept;
+  std::shared_ptr<instant_segment> INSTANT_ALLOC(const size_t size,
+                                                 const size_t alignment);
+
+  /**
+   * @brief INSTANT_ALLOC blocking like STATIC_ALLOC_WAIT
+   */
+  std::shared_ptr<instant_segment> INSTANT_ALLOC_WAIT(
+    const size_t                   size,
+    const std::chrono::nanoseconds timeout,
+    std::error_code&               ec) noexcept;
+  std::shared_ptr<instant_segment> INSTANT_ALLOC_WAIT(
+    const size_t                   size,
+    const std::chrono::nanoseconds timeout);
+
+  /**
+   * @brief STATIC_ALLOC that never blocks: only the existing batches are
+   * tried. WouldBlock if a new batch, draining deferred frees or waiting is
+   * needed.
+   */
+  std::shared_ptr<static_segment> TRY_STATIC_ALLOC(const size_t     size,
+                                                   std::error_code& ec) noexcept;
+
+  /**
+   * @brief complete in place through TRY_STATIC_ALLOC and return true if
+   * possible. otherwise return false and park the request in its size class
+   * like STATIC_ALLOC_WAIT, the async worker retries it after frees. callback
+   * gets its result through the ASYNC_EXECUTOR. requests still pending when
+   * the mmgr is destroyed fail with std::errc::operation_canceled.
+   */
+  bool ASYNC_STATIC_ALLOC(const size_t                          size,
+                          const std::chrono::nanoseconds        timeout,
+                          std::shared_ptr<static_segment>&      segment,
+                          std::error_code&                      ec,
+                          async_alloc_callback<static_segment>  callback) noexcept;
 
+  /**
+   * @brief creating the shm object is always slow work, the request is
+   * parked like INSTANT_ALLOC_WAIT and completed by the async worker. false,
+   * unless the request is rejected at once.
+   */
+  bool ASYNC_INSTANT_ALLOC(const size_t                           size,
+                           const std::chrono::nanoseconds         timeout,
+                           std::shared_ptr<instant_segment>&      segment,
+                           std::error_code&                       ec,
+                           async_alloc_callback<instant_segment>  callback) noexcept;
+
+  /**
+   * @brief where async completions run. without one they run on the async
+   * worker thread.
+   */
+  void ASYNC_EXECUTOR(async_executor executor);
+
+  /**
+   * @brief queued like STATIC_DEALLOC with mmgr_options::deferred_free
+   */
   int INSTANT_DEALLOC(const size_t segment_id, std::error_code& ec) noexcept;
   int INSTANT_DEALLOC(const size_t segment_id);
 
+  /**
+   * @brief grow or shrink an instant segment in place with ftruncate +
+   * mremap, the contents are kept without copying. consumers notice the new
+   * size through the directory generation and remap on their next bufferize.
+   */
+  std::shared_ptr<instant_segment> INSTANT_REALLOC(const size_t     segment_id,
+                                                   const size_t     size,
+                                                   std::error_code& ec) noexcept;
+  std::shared_ptr<instant_segment> INSTANT_REALLOC(const size_t segment_id,
+                                                   const size_t size);
+
   std::shared_ptr<static_segment> STATIC_ALLOC(const size_t     size,
                                                 std::error_code& ec) noexcept;
   std::shared_ptr<static_segment> STATIC_ALLOC(const size_t size);
+  /**
+   * @brief alignment is a power of two up to the page size, the batch
+   * mapping is only page aligned. IllegalAlignment otherwise.
+   */
+  std::shared_ptr<static_segment> STATIC_ALLOC(const size_t     size,
+                                                const size_t     alignment,
+                                                std::error_code& ec) noexcept;
+  std::shared_ptr<static_segment> STATIC_ALLOC(const size_t size,
+                                                const size_t alignment);
+
+  /**
+   * @brief STATIC_ALLOC that blocks up to timeout while memory_ceiling
+   * leaves no room, until frees release enough. waiters of each size class
+   * retry in arrival order and every class gets a turn on each free.
+   * AllocTimeout if it is still full. may be called from several threads.
+   */
+  std::shared_ptr<static_segment> STATIC_ALLOC_WAIT(
+    const size_t                   size,
+    const std::chrono::nanoseconds timeout,
+    std::error_code&               ec) noexcept;
+  std::shared_ptr<static_segment> STATIC_ALLOC_WAIT(
+    const size_t                   size,
+    const std::chrono::nanoseconds timeout);
 
+  /**
+   * @brief with mmgr_options::deferred_free the segment is only queued and
+   * 0 returned, errors are logged by the reclaimer. queueing is lock-free
+   * and may be done from any thread.
+   */
   int STATIC_DEALLOC(const size_t segment_id, std::error_code& ec) noexcept;
   int STATIC_DEALLOC(const size_t segment_id);
 
+  /**
+   * @brief resize a static segment. it is grown into the free chunks right
+   * after it or shrunk in place when possible, the same segment is returned
+   * then. otherwise a new segment is allocated, the contents are copied and
+   * the old segment is released, consumers have to register the returned
+   * segment again.
+   */
+  std::shared_ptr<static_segment> STATIC_REALLOC(const size_t     segment_id,
+                                                 const size_t     size,
+                                                 std::error_code& ec) noexcept;
+  std::shared_ptr<static_segment> STATIC_REALLOC(const size_t segment_id,
+                                                 const size_t size);
+
+  /**
+   * @brief allocate an object of at most SLAB_MAX_OBJECT bytes from the slab
+   * bins, requires mmgr_options::slab_count. the returned static segment is
+   * released with STATIC_DEALLOC.
+   */
+  std::shared_ptr<static_segment> SMALL_ALLOC(const size_t     size,
+                                              std::error_code& ec) noexcept;
+  std::shared_ptr<static_segment> SMALL_ALLOC(const size_t size);
+
+  /**
+   * @brief STATIC_ALLOC whose segment reads as zeros. batches track which
+   * chunks were ever handed out, only those are cleared, chunks of a fresh
+   * batch are zero already.
+   */
+  std::shared_ptr<static_segment> STATIC_CALLOC(const size_t     size,
+                                                 std::error_code& ec) noexcept;
+  std::shared_ptr<static_segment> STATIC_CALLOC(const size_t     size,
+                                                 const size_t     alignment,
+                                                 std::error_code& ec) noexcept;
+  std::shared_ptr<static_segment> STATIC_CALLOC(const size_t size,
+                                                 const size_t alignment = 0);
+
+  std::shared_ptr<static_segment> SMALL_CALLOC(const size_t     size,
+                                               std::error_code& ec) noexcept;
+  std::shared_ptr<static_segment> SMALL_CALLOC(const size_t size);
+
+  /**
+   * @brief same as INSTANT_ALLOC, a new instant segment is always zero
+   */
+  std::shared_ptr<instant_segment> INSTANT_CALLOC(const size_t     size,
+                                                  std::error_code& ec) noexcept;
+  std::shared_ptr<instant_segment> INSTANT_CALLOC(const size_t size);
+
+  /**
+   * @brief reserve a contiguous static segment of capacity bytes as a frame
+   * arena and return the frame id.
+   */
+  size_t FRAME_CREATE(const size_t capacity, std::error_code& ec) noexcept;
+  size_t FRAME_CREATE(const size_t capacity);
+
+  /**
+   * @brief bump allocate a segment inside a frame. frame segments are not
+   * tracked by the segment table and are only released by FRAME_RESET.
+   */
+  std::shared_ptr<static_segment> FRAME_ALLOC(const size_t     frame_id,
+                                              const size_t     size,
+                                              std::error_code& ec) noexcept;
+  std::shared_ptr<static_segment> FRAME_ALLOC(const size_t frame_id,
+                                              const size_t size);
+
+  /**
+   * @brief release every segment of a frame at once, their ids become
+   * invalid.
+   */
+  int FRAME_RESET(const size_t frame_id, std::error_code& ec) noexcept;
+  int FRAME_RESET(const size_t frame_id);
+
+  int FRAME_DESTROY(const size_t frame_id, std::error_code& ec) noexcept;
+  int FRAME_DESTROY(const size_t frame_id);
+
+  /**
+   * @brief true if the frame segment hasn't been released by a reset
+   */
+  bool FRAME_VALID(const size_t segment_id) const noexcept;
+
+  /**
+   * @brief madvise the pages of a static or instant segment, e.g.
+   * SEQUENTIAL before streaming through a file-backed segment.
+   */
+  int ADVISE(const size_t        segment_id,
+             const ACCESS_ADVICE advice,
+             std::error_code&    ec) noexcept;
+  int ADVISE(const size_t segment_id, const ACCESS_ADVICE advice);
+
+  /**
+   * @brief write a file-backed segment back to disk. if async is true, the
+   * write back is only scheduled. a no-op for shm-backed segments.
+   */
+  int FLUSH(const size_t     segment_id,
+            const bool       async,
+            std::error_code& ec) noexcept;
+  int FLUSH(const size_t segment_id, const bool async = false);
+
+  /**
+   * @brief copy nbytes from src into the segment at offset through
+   * memops::copy, large writes stream past the cache. static segments are
+   * marked dirty.
+   */
+  int WRITE(const size_t     segment_id,
+            const size_t     offset,
+            const void*      src,
+            const size_t     nbytes,
+            std::error_code& ec) noexcept;
+  int WRITE(const size_t segment_id,
+            const size_t offset,
+            const void*  src,
+            const size_t nbytes);
+
+  /**
+   * @brief WRITE split into page-aligned stripes over the workers of a
+   * stripe_pool, for huge instant or static segments. a fresh instant
+   * segment gets each stripe's pages first touched by its worker.
+   */
+  int PARALLEL_WRITE(const size_t     segment_id,
+                     const size_t     offset,
+                     const void*      src,
+                     const size_t     nbytes,
+                     std::error_code& ec) noexcept;
+  int PARALLEL_WRITE(const size_t segment_id,
+                     const size_t offset,
+                     const void*  src,
+                     const size_t nbytes);
+
+  /**
+   * @brief memset nbytes at offset with value through the stripe_pool
+   */
+  int PARALLEL_FILL(const size_t     segment_id,
+                    const size_t     offset,
+                    const int        value,
+                    const size_t     nbytes,
+                    std::error_code& ec) noexcept;
+  int PARALLEL_FILL(const size_t segment_id,
+                    const size_t offset,
+                    const int    value,
+                    const size_t nbytes);
+
+  /**
+   * @brief write every file-backed batch and instant segment back to disk.
+   */
+  int FLUSH_ALL(const bool async, std::error_code& ec) noexcept;
+
+  /**
+   * @brief write-notify for a static segment, its chunks will be written by
+   * the next checkpoint.
+   */
+  int MARK_DIRTY(const size_t segment_id, std::error_code& ec) noexcept;
+  int MARK_DIRTY(const size_t segment_id);
+
+  /**
+   * @brief asynchronously write dirty chunks and bitmap metadata of every
+   * static batch into mmgr_options::snapshot_dir. producers are not
+   * stalled, chunks written during the checkpoint are fuzzy and must be
+   * write-notified again. the future yields the bytes of chunk data written
+   * and rethrows IO errors, dropping it does not wait for the checkpoint.
+   * ~mmgr waits for the checkpoints still queued.
+   */
+  std::future<size_t> CHECKPOINT(std::error_code& ec) noexcept;
+  std::future<size_t> CHECKPOINT();
+
+  /**
+   * @brief slide static segments towards the front of the batches, so free
+   * chunks are merged at the end. a moved segment keeps its id, its entry in
+   * the segment table is updated and the move is published in
+   * `{mmgr}#forward`, smgr re-resolves it on the next bufferize. slab
+   * objects and frame regions stay. runs next to other mmgr calls, which
+   * wait for it. consumers pinned with smgr::pin keep it from starting,
+   * after COMPACT_PIN_TIMEOUT_MS it fails with WouldBlock.
+   *
+   * @return size_t segments moved
+   */
+  size_t COMPACT(std::error_code& ec) noexcept;
+  size_t COMPACT();
+
+  /**
+   * @brief release the deferred frees queued so far and drop them from the
+   * segment table, for tests and before measuring usage. return the
+   * segments released.
+   */
+  size_t RECLAIM() noexcept;
+
+  /**
+   * @brief predicted vs. actual chunk rounding waste of the static bins
+   */
+  layout_report LAYOUT_REPORT() const noexcept;
+
+  /**
+   * @brief chunk usage of every bin, instant and cache bin usage and the op
+   * counters. each bin is read under its own lock, so the parts may be a
+   * few operations apart. render it with to_prometheus.
+   */
+  mmgr_stats STATS();
+
+  /**
+   * @brief latency histogram of op, for percentiles. nullptr unless
+   * mmgr_options::latency_histograms is set and the library was built with
+   * MMGR_LATENCY_HISTOGRAMS.
+   */
+  const latency_histogram* LATENCY(const MMGR_OP op) const noexcept;
+
+  void RESET_LATENCY() noexcept;
+
   std::shared_ptr<base_segment> get_segment(const size_t     segment_id,
                                             std::error_code& ec) noexcept;
   std::shared_ptr<base_segment> get_segment(const size_t segment_id);
@@ -99,6 +728,7 @@ public:
   size_t                     segment_count() const noexcept;
   const std::vector<size_t>& batch_bin_size() const noexcept;
   const std::vector<size_t>& batch_bin_count() const noexcept;
+  const mmgr_options&        options() const noexcept;
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,188 @@
+#pragma once
+
+#include "batch.hpp"
+#include "bins/cache_bin.hpp"
+#include "ec.hpp"
+#include "latency_histogram.hpp"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+namespace shm_kernel::memory_manager {
+
+/**
+ * @brief operations counted by mmgr. the CALLOC variants count as their
+ * ALLOC, TRY and the ASYNC variants as STATIC_ALLOC and INSTANT_ALLOC.
+ * CHECKPOINT counts starting a checkpoint, not writing it.
+ */
+enum class MMGR_OP
+{
+  STATIC_ALLOC       = 0,
+  SMALL_ALLOC        = 1,
+  STATIC_REALLOC     = 2,
+  STATIC_DEALLOC     = 3,
+  INSTANT_ALLOC      = 4,
+  INSTANT_REALLOC    = 5,
+  INSTANT_DEALLOC    = 6,
+  CACHE_STORE        = 7,
+  CACHE_DEALLOC      = 8,
+  FRAME_ALLOC        = 9,
+  STATIC_ALLOC_WAIT  = 10,
+  INSTANT_ALLOC_WAIT = 11,
+  CACHE_SET          = 12,
+  CACHE_RETRIEVE     = 13,
+  FRAME_CREATE       = 14,
+  FRAME_RESET        = 15,
+  FRAME_DESTROY      = 16,
+  COMPACT            = 17,
+  CHECKPOINT         = 18,
+  WRITE              = 19,
+  PARALLEL_WRITE     = 20,
+  PARALLEL_FILL      = 21,
+};
+
+constexpr size_t MMGR_OP_COUNT = 22;
+
+/**
+ * @brief lower case name of the op, e.g. "static_alloc"
+ */
+std::string_view op_name(const MMGR_OP op) noexcept;
+
+struct op_stats
+{
+  uint64_t calls;
+  uint64_t failures;
+};
+
+/**
+ * @brief calls and failures per op. every thread bumps its own cache line
+ * aligned stripe with relaxed atomics, a snapshot sums the stripes. built
+ * with MMGR_LATENCY_HISTOGRAMS, ops can also be timed into a latency
+ * histogram each.
+ */
+class op_counters
+{
+public:
+  static constexpr size_t STRIPES = 16;
+
+private:
+  struct alignas(64) stripe
+  {
+    std::array<std::atomic_uint64_t, MMGR_OP_COUNT> calls{};
+    std::array<std::atomic_uint64_t, MMGR_OP_COUNT> failures{};
+  };
+  std::array<stripe, STRIPES> stripes_{};
+#ifdef MMGR_LATENCY_HISTOGRAMS
+  std::array<latency_histogram, MMGR_OP_COUNT> latency_;
+  bool                                         timed_{ false };
+#endif
+
+  static size_t stripe_of() noexcept;
+
+public:
+  /**
+   * @brief start or stop timing ops, a no-op without MMGR_LATENCY_HISTOGRAMS
+   */
+  void time_ops(const bool timed) noexcept;
+
+  /**
+   * @brief nullptr if ops aren't timed
+   */
+  latency_histogram*       latency(const MMGR_OP op) noexcept;
+  const latency_histogram* latency(const MMGR_OP op) const noexcept;
+
+  /**
+   * @brief empty if ops aren't timed
+   */
+  latency_summary latency_summary_of(const MMGR_OP op) const noexcept;
+
+  void reset_latency() noexcept;
+
+  void record(const MMGR_OP op, const bool failed) noexcept;
+
+  std::array<op_stats, MMGR_OP_COUNT> snapshot() const noexcept;
+
+  void reset() noexcept;
+};
+
+/**
+ * @brief counts op once the scope is left, as a failure if ec is set then.
+ * WouldBlock is not counted, the caller retries or goes async.
+ */
+class op_scope
+{
+private:
+  op_counters&           counters_;
+  const MMGR_OP          op_;
+  const std::error_code& ec_;
+#ifdef MMGR_LATENCY_HISTOGRAMS
+  latency_histogram* latency_;
+  uint64_t           start_{ 0 };
+#endif
+
+public:
+  op_scope(op_counters&           counters,
+           const MMGR_OP          op,
+           const std::error_code& ec) noexcept
+    : counters_(counters)
+    , op_(op)
+    , ec_(ec)
+#ifdef MMGR_LATENCY_HISTOGRAMS
+    , latency_(counters.latency(op))
+#endif
+  {
+#ifdef MMGR_LATENCY_HISTOGRAMS
+    if (latency_ != nullptr) {
+      start_ = latency_clock::now();
+    }
+#endif
+  }
+  op_scope(const op_scope&) = delete;
+  op_scope& operator=(const op_scope&) = delete;
+
+  ~op_scope()
+  {
+    if (ec_ == MmgrErrc::WouldBlock) {
+      return;
+    }
+#ifdef MMGR_LATENCY_HISTOGRAMS
+    if (latency_ != nullptr) {
+      latency_->record(latency_clock::to_nanos(latency_clock::now() - start_));
+    }
+#endif
+    counters_.record(op_, static_cast<bool>(ec_));
+  }
+};
+
+/**
+ * @brief point in time view of an mmgr, see mmgr::STATS
+ */
+struct mmgr_stats
+{
+  std::string                                name;
+  size_t                                     segments;
+  std::vector<batch_stats>                   batches;
+  size_t                                     instant_segments;
+  size_t                                     instant_bytes;
+  cache_stats                                cache;
+  std::array<op_stats, MMGR_OP_COUNT>        ops;
+  // bin type of the static ops, from mmgr_options::bin_type. batches
+  // reattached or restored with another type are still counted under it
+  BIN_TYPE                                   bin_type;
+  // all zero unless ops are timed
+  std::array<latency_summary, MMGR_OP_COUNT> latency;
+};
+
+/**
+ * @brief render stats in the Prometheus text exposition format, every
+ * sample labeled with the mmgr name. latencies are a summary per op and
+ * bin, only emitted for timed ops.
+ */
+std::string to_prometheus(const mmgr_stats& stats);
+
+}
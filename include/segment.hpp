@@ -21,12 +21,19 @@ struct base_segment
   size_t           id;
   size_t           size;
   SEG_TYPE         type;
+  // alignment requested at allocation, 0 if none
+  size_t           alignment{ 0 };
 
   virtual segment_info to_seginfo() const noexcept = 0;
 };
 
 struct cache_segment : base_segment
 {
+  // shm region of a shared cache bin and offset in it, NO_REGION if the
+  // buffer is private to the mmgr
+  size_t region_id{ static_cast<size_t>(-1) };
+  size_t addr_pshift{ 0 };
+
   cache_segment();
   cache_segment(std::string_view mmgr_name, const size_t id, const size_t size);
 
@@ -87,9 +94,11 @@ private:
     size_t addr_pshift_;
     void*  local_buffer_;
   };
+  // shm region for cache segments
   size_t batch_id_;
   size_t bin_id_;
   STATUS status_;
+  size_t alignment_;
 
   void set_ptr(void* const ptr) noexcept;
 
@@ -124,5 +133,6 @@ public:
   std::string      shm_name() const noexcept;
   char*            ptr() const noexcept;
   STATUS           status() const noexcept;
+  size_t           alignment() const noexcept;
 };
 }
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <memory>
+#include <string_view>
+
+namespace shm_kernel::memory_manager {
+
+/**
+ * @brief hold a shm handle or mapped file of a warm_restart mmgr past the
+ * mmgr, so the object is not unlinked and the next mmgr of the name can
+ * reattach it. the keeper is never destroyed, kept objects also outlive a
+ * clean exit of the process.
+ */
+void keep_shm(std::string_view mmgr_name, std::shared_ptr<void> owner) noexcept;
+
+/**
+ * @brief drop what was kept for mmgr_name, the last handle of an object
+ * unlinks it
+ */
+void release_kept_shm(std::string_view mmgr_name) noexcept;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace ipc {
+class shmhdl;
+}
+
+namespace shm_kernel::memory_manager {
+
+/**
+ * @brief memory resource carving memory out of shm regions named
+ * `{mmgr}#cache#region{N}`, so consumers can attach what it hands out.
+ * requests of at least half a region get a region of their own. a region is
+ * unlinked once everything allocated from it was returned. not thread-safe,
+ * the owner serializes calls.
+ */
+class shm_resource : public std::pmr::memory_resource
+{
+  struct region
+  {
+    std::unique_ptr<ipc::shmhdl> handle;
+    char*                        base;
+    size_t                       id;
+    size_t                       nbytes;
+    size_t                       top;
+    // bytes handed out and not returned yet
+    size_t                       live;
+  };
+
+  std::string         mmgr_name_;
+  // shared by every resource of an mmgr, keeps region names unique
+  std::atomic_size_t& region_counter_;
+  std::map<const char* /* base */, region> regions_;
+  region*                                  current_{ nullptr };
+
+  region* make_region(const size_t nbytes);
+
+  const region* find(const void* ptr) const noexcept;
+
+protected:
+  void* do_allocate(size_t bytes, size_t alignment) override;
+
+  void do_deallocate(void* ptr, size_t bytes, size_t alignment) override;
+
+  bool do_is_equal(const std::pmr::memory_resource& other) const
+    noexcept override;
+
+public:
+  static constexpr size_t NO_REGION = static_cast<size_t>(-1);
+
+  shm_resource(std::string_view mmgr_name, std::atomic_size_t& region_counter);
+
+  ~shm_resource() override;
+
+  static std::string region_name(std::string_view mmgr_name,
+                                 const size_t     region_id);
+
+  /**
+   * @brief region id and offset of a pointer handed out by this resource,
+   * (NO_REGION, 0) if it isn't
+   */
+  std::pair<size_t, size_t> locate(const void* ptr) const noexcept;
+
+  size_t region_count() const noexcept;
+};
+
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace shm_kernel::memory_manager {
+
+/**
+ * @brief chunk sizes and counts of the static bins of a batch
+ */
+struct bin_layout
+{
+  std::vector<size_t> chunk_size;
+  std::vector<size_t> chunk_count;
+};
+
+/**
+ * @brief streaming histogram of request sizes. sizes up to 32 bytes get a
+ * bucket per 8 bytes, larger ones 4 log-linear buckets per power of two, so
+ * a bucket's upper bound is at most 25% above any size in it. recording is
+ * lock-free.
+ */
+class size_histogram
+{
+public:
+  static constexpr size_t SUB_BUCKETS = 4;
+  static constexpr size_t BUCKETS     = SUB_BUCKETS + 59 * SUB_BUCKETS;
+
+private:
+  std::array<std::atomic_uint64_t, BUCKETS> counts_{};
+  // sum of the recorded sizes per bucket, to model waste exactly
+  std::array<std::atomic_uint64_t, BUCKETS> bytes_{};
+
+public:
+  static size_t bucket_of(const size_t nbytes) noexcept;
+
+  /**
+   * @brief largest size falling into the bucket
+   */
+  static size_t upper_bound(const size_t bucket) noexcept;
+
+  void record(const size_t nbytes) noexcept;
+
+  size_t samples() const noexcept;
+
+  /**
+   * @brief pick at most bin_count chunk sizes among the bucket bounds that
+   * minimize the bytes lost to rounding, when every request is served by
+   * the smallest chunk size that holds it. the counts split budget bytes in
+   * proportion to the bytes each chunk size serves. empty without samples.
+   */
+  bin_layout derive_layout(const size_t bin_count,
+                           const size_t budget) const;
+
+  /**
+   * @brief fraction of the recorded bytes that would be lost to rounding if
+   * the requests were served by the given chunk sizes, requests larger than
+   * every chunk size take several of the largest.
+   */
+  double predicted_waste(const std::vector<size_t>& chunk_size) const noexcept;
+};
+
+}
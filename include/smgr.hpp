@@ -1,4 +1,6 @@
 #pragma once
+#include "directory.hpp"
+#include "mapped_file.hpp"
 #include "segment.hpp"
 #include <atomic>
 #include <cstddef>
@@ -17,6 +19,7 @@ namespace shm_kernel::memory_manager {
 using shm      = ipc::shmhdl;
 using buffer   = std::pair<void*, size_t>;
 using shm_refc = std::pair<std::shared_ptr<shm>, size_t>;
+using file_refc = std::pair<std::shared_ptr<mapped_file>, size_t>;
 
 class smgr
 {
@@ -25,8 +28,59 @@ private:
   std::shared_ptr<spdlog::logger>              logger_;
   std::pmr::unsynchronized_pool_resource       pmr_pool_;
   std::map<std::string, shm_refc, std::less<>> attached_shm_;
+  std::map<std::string, file_refc, std::less<>> attached_file_;
   std::map<size_t, std::shared_ptr<segment_info>, std::less<>>
     attached_segment_;
+  // same as the mmgr's mmgr_options::backing_dir
+  std::string backing_dir_;
+  // `#instbin#dir`, attached on the first instant segment
+  std::unique_ptr<shm> instant_dir_handle_;
+  instant_dir_header*  instant_dir_{ nullptr };
+  // instant segment id -> (directory slot, generation it was mapped at)
+  std::map<size_t, std::pair<size_t, uint64_t>> instant_gens_;
+  // `{mmgr}#forward`, attached on the first static segment
+  std::unique_ptr<shm> forward_handle_;
+  forward_header*      forward_{ nullptr };
+  // static segment id -> (addr_pshift, forwarding epoch it was resolved at)
+  std::map<size_t, std::pair<size_t, uint64_t>> static_locs_;
+  // pins this smgr holds in forward_->pins
+  size_t pins_{ 0 };
+
+  /**
+   * @brief map a shm object (or its backing file) and increase the local
+   * ref count. alignment beyond a page maps it at an aligned address.
+   * shm_only ignores backing_dir_, cache regions are never files.
+   */
+  char* attach(const std::string& shm_name,
+               std::error_code&   ec,
+               const size_t       alignment = 0,
+               const bool         shm_only  = false) noexcept;
+
+  void detach(const std::string& shm_name) noexcept;
+
+  instant_dir_header* instant_dir(std::string_view mmgr_name) noexcept;
+
+  /**
+   * @brief follow an INSTANT_REALLOC of the segment if its generation in
+   * the directory moved since it was mapped.
+   */
+  int remap_instant(std::shared_ptr<segment_info> seg,
+                    std::error_code&              ec) noexcept;
+
+  forward_header* forward_table(std::string_view mmgr_name) noexcept;
+
+  /**
+   * @brief base address of an attached shm object or backing file
+   */
+  char* mapped_base(const std::string& shm_name) noexcept;
+
+  /**
+   * @brief follow a COMPACT that moved the static segment since it was
+   * resolved. the forwarding table is consulted first, if its entry was
+   * taken over by another segment the batch directories are searched.
+   */
+  int forward_static(std::shared_ptr<segment_info> seg,
+                     std::error_code&              ec) noexcept;
 
 public:
   const std::string name_;
@@ -35,6 +89,13 @@ public:
        std::shared_ptr<spdlog::logger> = spdlog::default_logger());
   smgr(std::string&& name,
        std::shared_ptr<spdlog::logger> = spdlog::default_logger());
+  /**
+   * @brief consumer of a mmgr whose segments are files in backing_dir
+   */
+  smgr(std::string_view name,
+       std::string_view backing_dir,
+       std::shared_ptr<spdlog::logger> = spdlog::default_logger());
+  ~smgr();
 
   std::shared_ptr<segment_info> register_segment(const segment_info* segment,
                                                  std::error_code& ec) noexcept;
@@ -48,6 +109,15 @@ public:
    */
   buffer bufferize(std::shared_ptr<segment_info>, std::error_code& ec) noexcept;
   buffer bufferize(const size_t segment_id, std::error_code& ec) noexcept;
+
+  /**
+   * @brief keep COMPACT of the mmgr from moving static segments until the
+   * matching unpin. bufferize after pin, the pointer stays valid while
+   * pinned. waits while a COMPACT runs, keep pins short: COMPACT gives up
+   * after COMPACT_PIN_TIMEOUT_MS.
+   */
+  void pin(std::string_view mmgr_name) noexcept;
+  void unpin() noexcept;
 };
 
 }
@@ -1,6 +1,8 @@
 #include "batch.hpp"
 #include "config.hpp"
+#include "memops.hpp"
 #include "segment.hpp"
+#include "shm_keeper.hpp"
 
 #include <algorithm>
 #include <atomic>
@@ -35,8 +37,25 @@ batch::batch(std::string_view                memmgr_name,
              const std::vector<size_t>&      statbin_chunksz,
              const std::vector<size_t>&      statbin_chunkcnt,
              std::shared_ptr<spdlog::logger> logger)
+  : batch(memmgr_name,
+          id,
+          segment_counter,
+          statbin_chunksz,
+          statbin_chunkcnt,
+          batch_options{},
+          logger)
+{}
+
+batch::batch(std::string_view                memmgr_name,
+             const size_t&                   id,
+             std::atomic_size_t&             segment_counter,
+             const std::vector<size_t>&      statbin_chunksz,
+             const std::vector<size_t>&      statbin_chunkcnt,
+             const batch_options&            options,
+             std::shared_ptr<spdlog::logger> logger)
   : batch(memmgr_name, id, segment_counter, logger)
 {
+  this->options_ = options;
   logger->trace("正在初始化Batch...");
   if (statbin_chunkcnt.size() == 0) {
     logger->critical("Chunk Count不允许为空.");
@@ -55,6 +74,7 @@ batch::batch(std::string_view                memmgr_name,
   }
 
   this->init_shm(this->init_static_bins(statbin_chunksz, statbin_chunkcnt));
+  this->init_header();
   logger->trace("{}/batch{} 初始化完毕!", mmgr_name_, id_);
 }
 
@@ -94,6 +114,7 @@ batch::batch(std::string_view                arena_name,
 
   this->init_shm(this->init_static_bins(
     __chunksz, std::vector<size_t>(__bin_count, statbin_size)));
+  this->init_header();
   logger->trace("{}/batch{} 初始化完毕!", mmgr_name_, id_);
 }
 
@@ -116,6 +137,371 @@ batch::~batch()
   _M_batch_logger->trace("destroying {}/batch{}", mmgr_name(), id());
 }
 
+void
+batch::keep() noexcept
+{
+  // header_ stays mapped, the keeper owns the handle now
+  keep_shm(mmgr_name_, std::shared_ptr<ipc::shmhdl>(std::move(this->handle_)));
+  keep_shm(mmgr_name_, std::shared_ptr<mapped_file>(std::move(this->file_)));
+}
+
+std::shared_ptr<batch>
+batch::reattach(std::string_view                mmgr_name,
+                const size_t&                   id,
+                std::atomic_size_t&             segment_counter,
+                const batch_options&            options,
+                std::error_code&                ec,
+                std::shared_ptr<spdlog::logger> logger) noexcept
+{
+  ec.clear();
+  auto handle_name = fmt::format("{}#batch{}#statbin", mmgr_name, id);
+  std::unique_ptr<ipc::shmhdl> __handle;
+  std::unique_ptr<mapped_file> __file;
+  batch_header*                __hdr;
+  try {
+    if (options.backing_dir.empty()) {
+      __handle = std::make_unique<ipc::shmhdl>(handle_name);
+      __hdr    = static_cast<batch_header*>(__handle->map(ec));
+    } else {
+      __file = std::make_unique<mapped_file>(
+        backing_path(options.backing_dir, handle_name));
+      __hdr    = static_cast<batch_header*>(__file->map(ec));
+    }
+  } catch (const std::exception& e) {
+    logger->trace("no existing {} to reattach: {}", handle_name, e.what());
+    ec = MmgrErrc::UnableToAttachShm;
+    return nullptr;
+  }
+  if (ec || __hdr == nullptr) {
+    ec = MmgrErrc::UnableToAttachShm;
+    return nullptr;
+  }
+  return rebuild(mmgr_name,
+                 id,
+                 segment_counter,
+                 options,
+                 std::move(__handle),
+                 std::move(__file),
+                 ec,
+                 logger);
+}
+
+std::shared_ptr<batch>
+batch::restore(std::string_view                mmgr_name,
+               const size_t&                   id,
+               std::atomic_size_t&             segment_counter,
+               const batch_options&            options,
+               const std::string&              snapshot,
+               const size_t                    sequence,
+               std::error_code&                ec,
+               std::shared_ptr<spdlog::logger> logger) noexcept
+{
+  ec.clear();
+  auto   handle_name = fmt::format("{}#batch{}#statbin", mmgr_name, id);
+  size_t __nbytes    = snapshot_size(snapshot);
+  if (__nbytes < sizeof(batch_header)) {
+    logger->error("snapshot {} is missing or truncated", snapshot);
+    ec = MmgrErrc::SnapshotFailed;
+    return nullptr;
+  }
+  std::unique_ptr<ipc::shmhdl> __handle;
+  std::unique_ptr<mapped_file> __file;
+  void*                        __buffer;
+  try {
+    if (options.backing_dir.empty()) {
+      __handle = std::make_unique<ipc::shmhdl>(handle_name, __nbytes);
+      __buffer = __handle->map(ec);
+    } else {
+      __file = std::make_unique<mapped_file>(
+        backing_path(options.backing_dir, handle_name), __nbytes);
+      __buffer = __file->map(ec);
+    }
+  } catch (const std::exception& e) {
+    logger->error("无法创建{}用于恢复snapshot: {}", handle_name, e.what());
+    ec = MmgrErrc::UnableToCreateShm;
+    return nullptr;
+  }
+  if (ec || __buffer == nullptr ||
+      read_snapshot(snapshot, __buffer, __nbytes, ec) != 0) {
+    logger->error("unable to load snapshot {}. {}", snapshot, ec.message());
+    ec = MmgrErrc::SnapshotFailed;
+    return nullptr;
+  }
+  auto __batch = rebuild(mmgr_name,
+                         id,
+                         segment_counter,
+                         options,
+                         std::move(__handle),
+                         std::move(__file),
+                         ec,
+                         logger);
+  if (__batch) {
+    // the snapshot already holds every allocated chunk
+    __batch->snapshot_seq_ = sequence;
+  }
+  return __batch;
+}
+
+std::shared_ptr<batch>
+batch::rebuild(std::string_view                mmgr_name,
+               const size_t&                   id,
+               std::atomic_size_t&             segment_counter,
+               const batch_options&            options,
+               std::unique_ptr<ipc::shmhdl>&&  handle,
+               std::unique_ptr<mapped_file>&&  file,
+               std::error_code&                ec,
+               std::shared_ptr<spdlog::logger> logger) noexcept
+{
+  auto handle_name = fmt::format("{}#batch{}#statbin", mmgr_name, id);
+  auto __handle    = std::move(handle);
+  auto __file      = std::move(file);
+  auto*  __hdr     = static_cast<batch_header*>(
+    __handle ? __handle->map(ec) : __file->map(ec));
+  size_t __nbytes = __handle ? __handle->nbytes() : __file->nbytes();
+  if (__nbytes < sizeof(batch_header) || __hdr->magic != BATCH_MAGIC ||
+      __hdr->version != DIRECTORY_VERSION || __nbytes < __hdr->total_bytes ||
+      batch_header::bytes(__hdr->bin_count, __hdr->slot_count) >
+        __hdr->data_pshift) {
+    logger->error("{} has an incompatible batch header, refuse to reattach",
+                  handle_name);
+    ec = MmgrErrc::IncompatibleBatch;
+    return nullptr;
+  }
+
+  std::shared_ptr<batch> __batch;
+  try {
+    __batch.reset(new batch(mmgr_name, id, segment_counter, logger));
+    __batch->static_bins_.reserve(__hdr->bin_count);
+    for (size_t i = 0; i < __hdr->bin_count; i++) {
+      const auto& __desc = __hdr->bins()[i];
+      if (__desc.slot_size == 0 ||
+          __desc.slot_base + __desc.slot_count > __hdr->slot_count) {
+        throw std::invalid_argument("bin directory out of range");
+      }
+      __batch->static_bins_.push_back(
+        make_static_bin(static_cast<BIN_TYPE>(__desc.type),
+                        __desc.id,
+                        segment_counter,
+                        __desc.chunk_size,
+                        __desc.chunk_count,
+                        __desc.base_pshift,
+                        logger));
+    }
+  } catch (const std::exception& e) {
+    logger->error("unable to rebuild bins of {}: {}", handle_name, e.what());
+    ec = MmgrErrc::IncompatibleBatch;
+    return nullptr;
+  }
+  __batch->options_     = options;
+  __batch->handle_      = std::move(__handle);
+  __batch->file_        = std::move(__file);
+  __batch->header_      = __hdr;
+  __batch->total_bytes_ = __hdr->total_bytes;
+  // whatever a previous mmgr wrote is still there
+  for (const auto& bin : __batch->static_bins_) {
+    __batch->claim_range(bin->id(),
+                         bin->base_pshift(),
+                         bin->chunk_size() * bin->chunk_count(),
+                         false);
+  }
+
+  // replay the directory onto the bitmaps
+  size_t __live = 0;
+  for (const auto& bin : __batch->static_bins_) {
+    const auto& __desc = __hdr->bins()[bin->id()];
+    for (size_t i = 0; i < __desc.slot_count; i++) {
+      auto&  __slot = __hdr->slots()[__desc.slot_base + i];
+      size_t __size = __slot.size.load(std::memory_order_acquire);
+      if (__size == 0) {
+        continue;
+      }
+      if (bin->reserve(__desc.base_pshift + i * __desc.slot_size, __size, ec) !=
+          0) {
+        logger->warn("drop corrupted directory slot {} of {}, segment_{}",
+                     __desc.slot_base + i,
+                     handle_name,
+                     __slot.id.load(std::memory_order_relaxed));
+        __slot.size.store(0, std::memory_order_release);
+        continue;
+      }
+      __live++;
+    }
+  }
+  ec.clear();
+  __batch->sort_static_bins();
+  logger->info("reattached {} with {} live segments", handle_name, __live);
+  return __batch;
+}
+
+std::vector<std::shared_ptr<static_segment>>
+batch::segments() const
+{
+  std::vector<std::shared_ptr<static_segment>> __segments;
+  for (size_t b = 0; b < this->header_->bin_count; b++) {
+    const auto& __desc = this->header_->bins()[b];
+    for (size_t i = 0; i < __desc.slot_count; i++) {
+      auto&  __slot = this->header_->slots()[__desc.slot_base + i];
+      size_t __size = __slot.size.load(std::memory_order_acquire);
+      if (__size == 0) {
+        continue;
+      }
+      __segments.push_back(std::make_shared<static_segment>(
+        this->mmgr_name(),
+        __slot.id.load(std::memory_order_relaxed),
+        __size,
+        this->id(),
+        __desc.id,
+        __desc.base_pshift + i * __desc.slot_size));
+    }
+  }
+  return __segments;
+}
+
+int
+batch::advise(std::shared_ptr<static_segment> segment,
+              const ACCESS_ADVICE             advice,
+              std::error_code&                ec) noexcept
+{
+  ec.clear();
+  if (segment->batch_id != this->id()) {
+    ec = MmgrErrc::BatchUnmatched;
+    return -1;
+  }
+  if (segment->addr_pshift + segment->size > this->total_bytes()) {
+    ec = MmgrErrc::IllegalSegmentRange;
+    return -1;
+  }
+  return advise_range(
+    this->base() + segment->addr_pshift, segment->size, advice, ec);
+}
+
+int
+batch::flush(std::shared_ptr<static_segment> segment,
+             const bool                      async,
+             std::error_code&                ec) noexcept
+{
+  ec.clear();
+  if (segment->batch_id != this->id()) {
+    ec = MmgrErrc::BatchUnmatched;
+    return -1;
+  }
+  if (segment->addr_pshift + segment->size > this->total_bytes()) {
+    ec = MmgrErrc::IllegalSegmentRange;
+    return -1;
+  }
+  if (!this->is_file_backed()) {
+    return 0;
+  }
+  return flush_range(
+    this->base() + segment->addr_pshift, segment->size, async, ec);
+}
+
+int
+batch::flush(const bool async, std::error_code& ec) noexcept
+{
+  ec.clear();
+  if (!this->is_file_backed()) {
+    return 0;
+  }
+  return this->file_->flush(async, ec);
+}
+
+bool
+batch::is_file_backed() const noexcept
+{
+  return this->file_ != nullptr;
+}
+
+void
+batch::mark_dirty(std::shared_ptr<static_segment> segment) noexcept
+{
+  for (const auto& bin : this->static_bins_) {
+    if (bin->id() == segment->bin_id) {
+      bin->mark_dirty(segment->addr_pshift, segment->size);
+      return;
+    }
+  }
+}
+
+checkpoint_delta
+batch::collect_checkpoint()
+{
+  checkpoint_delta __delta;
+  __delta.batch_id      = this->id();
+  __delta.base_sequence = this->snapshot_seq_;
+  __delta.total_bytes   = this->total_bytes();
+  // the first checkpoint of a batch has to carry every allocated chunk, later
+  // ones only what was written since.
+  for (const auto& bin : this->static_bins_) {
+    bin->collect_dirty(__delta.ranges, this->snapshot_seq_ == 0);
+  }
+  __delta.header.assign(this->base(),
+                        this->base() + this->header_->data_pshift);
+  return __delta;
+}
+
+void
+batch::commit_checkpoint(const size_t sequence) noexcept
+{
+  this->snapshot_seq_ = sequence;
+}
+
+void
+batch::abort_checkpoint(const checkpoint_delta& delta) noexcept
+{
+  // a full delta stays full, snapshot_seq_ was not advanced
+  for (const auto& [pshift, nbytes] : delta.ranges) {
+    for (const auto& bin : this->static_bins_) {
+      bin->mark_dirty(pshift, nbytes);
+    }
+  }
+}
+
+dir_entry&
+batch::slot_of(const static_segment& segment) const noexcept
+{
+  const auto& __desc = this->header_->bins()[segment.bin_id];
+  return this->header_->slots()[__desc.slot_base +
+                                (segment.addr_pshift - __desc.base_pshift) /
+                                  __desc.slot_size];
+}
+
+std::shared_ptr<static_segment>
+batch::commit_segment(std::shared_ptr<static_segment> segment,
+                      const bool                      zeroed) noexcept
+{
+  segment->batch_id  = this->id();
+  segment->mmgr_name = this->mmgr_name();
+  auto& __slot       = this->slot_of(*segment);
+  __slot.id.store(segment->id, std::memory_order_relaxed);
+  __slot.size.store(segment->size, std::memory_order_release);
+  bump_next_id(this->header_->next_segment_id, segment->id + 1);
+  this->claim_range(segment->bin_id, segment->addr_pshift, segment->size, zeroed);
+  return segment;
+}
+
+void
+batch::claim_range(const size_t bin_id,
+                   const size_t addr_pshift,
+                   const size_t nbytes,
+                   const bool   zeroed) noexcept
+{
+  std::vector<std::pair<size_t, size_t>> __stale;
+  for (const auto& bin : this->static_bins_) {
+    if (bin->id() == bin_id) {
+      bin->claim(addr_pshift, nbytes, __stale);
+      break;
+    }
+  }
+  if (!zeroed) {
+    return;
+  }
+  // pristine chunks are still zero since the batch was created
+  for (const auto& [pshift, len] : __stale) {
+    memops::zero(this->base() + pshift, len);
+  }
+}
+
 size_t
 batch::init_static_bins(const std::vector<size_t>& statbin_chunksz,
                         const std::vector<size_t>& statbin_chunkcnt)
@@ -124,10 +510,25 @@ batch::init_static_bins(const std::vector<size_t>& statbin_chunksz,
   // reserve
   this->static_bins_.reserve(statbin_chunksz.size());
 
+  // bins start right after the page aligned header
+  size_t __slot_count = 0;
+  for (const auto& cnt : statbin_chunkcnt) {
+    __slot_count += cnt;
+  }
+  size_t __bin_count = statbin_chunksz.size();
+  if (this->options_.slab_count > 0) {
+    __slot_count +=
+      this->options_.slab_count * this->options_.slab_size / SLAB_MIN_OBJECT;
+    __bin_count++;
+  }
+  size_t __header_bytes = batch_header::bytes(__bin_count, __slot_count);
+  __header_bytes = (__header_bytes + BATCH_HEADER_ALIGNMENT - 1) /
+                   BATCH_HEADER_ALIGNMENT * BATCH_HEADER_ALIGNMENT;
+
   auto   __sz_iter        = statbin_chunksz.begin();
   auto   __cnt_iter       = statbin_chunkcnt.begin();
   size_t __idx            = 0;
-  size_t __current_pshift = 0;
+  size_t __current_pshift = __header_bytes;
 
   // init this->static_bins_
   for (; __sz_iter != statbin_chunksz.end(); __sz_iter++, __cnt_iter++) {
@@ -136,25 +537,117 @@ batch::init_static_bins(const std::vector<size_t>& statbin_chunksz,
       throw std::invalid_argument("static bin chunk size must be aligned to " +
                                   std::to_string(ALIGNMENT));
     }
-    this->static_bins_.push_back(
-      std::make_unique<static_bin>(__idx++,
-                                   this->segment_counter_ref_,
-                                   *__sz_iter,
-                                   *__cnt_iter,
-                                   __current_pshift));
+    this->static_bins_.push_back(make_static_bin(this->options_.bin_type,
+                                                 __idx++,
+                                                 this->segment_counter_ref_,
+                                                 *__sz_iter,
+                                                 *__cnt_iter,
+                                                 __current_pshift,
+                                                 _M_batch_logger));
     __current_pshift += *__sz_iter * *__cnt_iter;
   }
+  if (this->options_.slab_count > 0) {
+    this->static_bins_.push_back(
+      std::make_unique<slab_bin>(__idx++,
+                                 this->segment_counter_ref_,
+                                 this->options_.slab_size,
+                                 this->options_.slab_count,
+                                 __current_pshift,
+                                 _M_batch_logger));
+    __current_pshift += this->options_.slab_size * this->options_.slab_count;
+  }
+
+  this->total_bytes_ = __current_pshift;
 
+  _M_batch_logger->trace("Static Bins 配置完毕!");
+  return __current_pshift;
+}
+
+std::unique_ptr<static_bin>
+batch::make_static_bin(const BIN_TYPE                  type,
+                       const size_t                    id,
+                       std::atomic_size_t&             segment_counter,
+                       const size_t                    chunk_size,
+                       const size_t                    chunk_count,
+                       const size_t                    base_pshift,
+                       std::shared_ptr<spdlog::logger> logger)
+{
+  switch (type) {
+    case BIN_TYPE::STATIC:
+      return std::make_unique<static_bin>(
+        id, segment_counter, chunk_size, chunk_count, base_pshift, logger);
+    case BIN_TYPE::BUDDY:
+      return std::make_unique<buddy_bin>(
+        id, segment_counter, chunk_size, chunk_count, base_pshift, logger);
+    case BIN_TYPE::TLSF:
+      return std::make_unique<tlsf_bin>(
+        id, segment_counter, chunk_size, chunk_count, base_pshift, logger);
+    case BIN_TYPE::SLAB:
+      return std::make_unique<slab_bin>(
+        id, segment_counter, chunk_size, chunk_count, base_pshift, logger);
+  }
+  throw std::invalid_argument("unknown static bin type " +
+                              std::to_string(static_cast<uint64_t>(type)));
+}
+
+void
+batch::sort_static_bins() noexcept
+{
   // desc sort
   std::sort(this->static_bins_.begin(),
             this->static_bins_.end(),
             [](const auto& a, const auto& b) {
               return a->chunk_size() > b->chunk_size();
             });
-  this->total_bytes_ = __current_pshift;
+  // the slab bin only serves allocate_small
+  this->slab_bin_ = nullptr;
+  for (const auto& bin : this->static_bins_) {
+    if (bin->type() == BIN_TYPE::SLAB) {
+      this->slab_bin_ = bin.get();
+    }
+  }
+}
 
-  _M_batch_logger->trace("Static Bins 配置完毕!");
-  return __current_pshift;
+void
+batch::init_header()
+{
+  std::error_code ec;
+  this->header_ = static_cast<batch_header*>(
+    this->file_ ? this->file_->map(ec) : this->handle_->map(ec));
+  if (ec || this->header_ == nullptr) {
+    _M_batch_logger->critical("无法映射{}/batch{}的shm_handle", mmgr_name_, id_);
+    throw std::runtime_error("unable to map batch shm handle");
+  }
+  // static_bins_ is still in id order here
+  size_t __slot_base = 0;
+  this->header_->bin_count = this->static_bins_.size();
+  for (const auto& bin : this->static_bins_) {
+    auto& __desc       = this->header_->bins()[bin->id()];
+    __desc.id          = bin->id();
+    __desc.chunk_size  = bin->chunk_size();
+    __desc.chunk_count = bin->chunk_count();
+    __desc.base_pshift = bin->base_pshift();
+    __desc.slot_base   = __slot_base;
+    __desc.slot_count  = bin->chunk_count() * bin->chunk_size() / bin->slot_size();
+    __desc.slot_size   = bin->slot_size();
+    __desc.type        = static_cast<uint64_t>(bin->type());
+    __slot_base += __desc.slot_count;
+  }
+  this->header_->total_bytes = this->total_bytes_;
+  this->header_->data_pshift =
+    this->static_bins_.empty() ? 0 : this->static_bins_.front()->base_pshift();
+  this->header_->slot_count = __slot_base;
+  this->header_->next_segment_id.store(0, std::memory_order_relaxed);
+  auto* __slots = this->header_->slots();
+  for (size_t i = 0; i < __slot_base; i++) {
+    __slots[i].size.store(0, std::memory_order_relaxed);
+    __slots[i].id.store(0, std::memory_order_relaxed);
+  }
+  this->header_->version = DIRECTORY_VERSION;
+  // magic goes last, a half-written header is never treated as valid
+  std::atomic_thread_fence(std::memory_order_release);
+  this->header_->magic = BATCH_MAGIC;
+  this->sort_static_bins();
 }
 
 void
@@ -162,6 +655,22 @@ batch::init_shm(const size_t& buffsz)
 {
   _M_batch_logger->trace("正在初始化shm_handle... size: {}KB", buffsz);
   auto handle_name = fmt::format("{}#batch{}#statbin", mmgr_name_, id_);
+  if (!this->options_.backing_dir.empty()) {
+    auto __path = backing_path(this->options_.backing_dir, handle_name);
+    try {
+      this->file_ = std::make_unique<mapped_file>(__path, buffsz);
+    } catch (const std::exception& e) {
+      _M_batch_logger->critical(
+        "无法创建backing file with following args: "
+        "{{path: {}, buffer_size: {}}}. error message: {}",
+        __path,
+        buffsz,
+        e.what());
+      throw;
+    }
+    _M_batch_logger->trace("backing file {} 初始化完毕!", __path);
+    return;
+  }
   try {
     this->handle_ =
       std::make_unique<ipc::shmhdl>(handle_name, buffsz);
@@ -180,15 +689,36 @@ batch::init_shm(const size_t& buffsz)
 
 std::shared_ptr<static_segment>
 batch::allocate(const size_t nbytes, std::error_code& ec) noexcept
+{
+  return this->allocate(nbytes, 0, ec);
+}
+
+std::shared_ptr<static_segment>
+batch::allocate(const size_t     nbytes,
+                const size_t     alignment,
+                std::error_code& ec) noexcept
+{
+  return this->allocate(nbytes, alignment, false, ec);
+}
+
+std::shared_ptr<static_segment>
+batch::allocate(const size_t     nbytes,
+                const size_t     alignment,
+                const bool       zeroed,
+                std::error_code& ec) noexcept
 {
   ec.clear();
+  auto __malloc = [&](static_bin& bin) {
+    return alignment > ALIGNMENT ? bin.malloc_aligned(nbytes, alignment, ec)
+                                 : bin.malloc(nbytes, ec);
+  };
   _M_batch_logger->trace("allocate {} bytes of segment", nbytes);
   // Too large, should've used instant bin
-  if (nbytes > this->max_chunksz() * 8) {
+  if (nbytes > this->max_request()) {
     _M_batch_logger->error(
       "allocate size too large for static bin, please consider "
       "using instant bin instead! acceptable size should <= {}",
-      this->max_chunksz() * 8);
+      this->max_request());
     ec = MmgrErrc::TooBigForStaticBin;
     return nullptr;
   }
@@ -198,18 +728,20 @@ batch::allocate(const size_t nbytes, std::error_code& ec) noexcept
   __rem.reserve(static_bins_.size());
   size_t i;
   for (i = 0; i < this->static_bins_.size(); i++) {
+    if (static_bins_[i].get() == this->slab_bin_) {
+      __rem.push_back(std::numeric_limits<size_t>::max());
+      continue;
+    }
     auto __t_rem = nbytes % static_bins_[i]->chunk_size();
     // perfect match
     if (__t_rem == 0) {
-      __segment = static_bins_[i]->malloc(nbytes, ec);
+      __segment = __malloc(*static_bins_[i]);
       if (__segment == nullptr) {
         __rem.push_back(std::numeric_limits<size_t>::max());
         continue;
       } else {
         // perfect match available
-        __segment->batch_id  = this->id();
-        __segment->mmgr_name = this->mmgr_name();
-        return __segment;
+        return this->commit_segment(__segment, zeroed);
       }
     }
     __rem.push_back(__t_rem);
@@ -218,18 +750,19 @@ batch::allocate(const size_t nbytes, std::error_code& ec) noexcept
   size_t idx;
   for (i = 0; i < __rem.size(); i++) {
     auto min_iter = std::min_element(__rem.begin(), __rem.end());
-    idx           = std::distance(__rem.begin(), min_iter);
+    if (*min_iter == std::numeric_limits<size_t>::max()) {
+      break;
+    }
+    idx = std::distance(__rem.begin(), min_iter);
     // change min_iter to max
     *min_iter = std::numeric_limits<size_t>::max();
-    __segment = this->static_bins_[idx]->malloc(nbytes, ec);
+    __segment = __malloc(*this->static_bins_[idx]);
     if (__segment == nullptr) {
       // if fail to malloc with the bin, then fallback to next smallest
       // remainder bin.
       continue;
     } else {
-      __segment->batch_id  = this->id();
-      __segment->mmgr_name = this->mmgr_name();
-      return __segment;
+      return this->commit_segment(__segment, zeroed);
     }
   }
   // 没辙了, arena should push back a batch
@@ -255,7 +788,11 @@ batch::deallocate(std::shared_ptr<static_segment> segment,
   if (segment->bin_id < this->static_bins_.size()) {
     for (const auto& bin : this->static_bins_) {
       if (bin->id() == segment->bin_id) {
-        return bin->free(segment, ec);
+        int rv = bin->free(segment, ec);
+        if (rv == 0) {
+          this->slot_of(*segment).size.store(0, std::memory_order_release);
+        }
+        return rv;
       }
     }
     _M_batch_logger->error("unalbe to find the allocate bin.");
@@ -266,15 +803,109 @@ batch::deallocate(std::shared_ptr<static_segment> segment,
   }
 }
 
+int
+batch::reallocate(std::shared_ptr<static_segment> segment,
+                  const size_t                    nbytes,
+                  std::error_code&                ec) noexcept
+{
+  ec.clear();
+  if (segment->batch_id != this->id()) {
+    ec = MmgrErrc::BatchUnmatched;
+    return -1;
+  }
+  for (const auto& bin : this->static_bins_) {
+    if (bin->id() == segment->bin_id) {
+      if (bin->resize(segment, nbytes, ec) != 0) {
+        return -1;
+      }
+      segment->size = nbytes;
+      this->slot_of(*segment).size.store(nbytes, std::memory_order_release);
+      this->claim_range(segment->bin_id, segment->addr_pshift, nbytes, false);
+      return 0;
+    }
+  }
+  ec = MmgrErrc::BinUnmatched;
+  return -1;
+}
+
+std::shared_ptr<static_segment>
+batch::allocate_small(const size_t nbytes, std::error_code& ec) noexcept
+{
+  return this->allocate_small(nbytes, false, ec);
+}
+
+std::shared_ptr<static_segment>
+batch::allocate_small(const size_t     nbytes,
+                      const bool       zeroed,
+                      std::error_code& ec) noexcept
+{
+  ec.clear();
+  if (this->slab_bin_ == nullptr) {
+    ec = MmgrErrc::NoSuitableStaticBin;
+    return nullptr;
+  }
+  auto __segment = this->slab_bin_->malloc(nbytes, ec);
+  if (__segment == nullptr) {
+    return nullptr;
+  }
+  return this->commit_segment(__segment, zeroed);
+}
+
+bool
+batch::has_slab_bin() const noexcept
+{
+  return this->slab_bin_ != nullptr;
+}
+
+bool
+batch::movable(const static_segment& segment) const noexcept
+{
+  return segment.batch_id == this->id() &&
+         (this->slab_bin_ == nullptr ||
+          segment.bin_id != this->slab_bin_->id());
+}
+
+void
+batch::relabel(std::shared_ptr<static_segment> segment,
+               const size_t                    id) noexcept
+{
+  segment->id = id;
+  this->slot_of(*segment).id.store(id, std::memory_order_release);
+}
+
 const size_t
 batch::max_chunksz() const noexcept
 {
-  return this->static_bins_.front()->chunk_size();
+  for (const auto& bin : this->static_bins_) {
+    if (bin.get() != this->slab_bin_) {
+      return bin->chunk_size();
+    }
+  }
+  return 0;
 }
 const size_t
 batch::min_chunksz() const noexcept
 {
-  return this->static_bins_.back()->chunk_size();
+  for (auto __iter = this->static_bins_.rbegin();
+       __iter != this->static_bins_.rend();
+       __iter++) {
+    if (__iter->get() != this->slab_bin_) {
+      return (*__iter)->chunk_size();
+    }
+  }
+  return 0;
+}
+
+const size_t
+batch::max_request() const noexcept
+{
+  size_t __max = 0;
+  for (const auto& bin : this->static_bins_) {
+    if (bin.get() != this->slab_bin_) {
+      __max = std::max(__max, bin->max_request());
+    }
+  }
+  return __max;
 }
 
 std::string_view
@@ -295,4 +926,43 @@ batch::total_bytes() const noexcept
   return this->total_bytes_;
 }
 
+const size_t
+batch::used_bytes() const noexcept
+{
+  size_t __used = 0;
+  for (const auto& bin : this->static_bins_) {
+    if (bin.get() != this->slab_bin_) {
+      __used += (bin->chunk_count() - bin->chunk_left()) * bin->chunk_size();
+    }
+  }
+  return __used;
+}
+
+batch_stats
+batch::stats() const
+{
+  batch_stats __stats{ this->id_, this->total_bytes_, 0, {} };
+  for (const auto& bin : this->static_bins_) {
+    auto __bin = bin->stats();
+    if (bin.get() != this->slab_bin_) {
+      __stats.used_bytes +=
+        (__bin.chunk_count - __bin.free_chunks) * __bin.chunk_size;
+    }
+    __stats.bins.push_back(__bin);
+  }
+  return __stats;
+}
+
+const size_t
+batch::next_segment_id() const noexcept
+{
+  return this->header_->next_segment_id.load(std::memory_order_relaxed);
+}
+
+char*
+batch::base() const noexcept
+{
+  return reinterpret_cast<char*>(this->header_);
+}
+
 }
\ No newline at end of file
@@ -0,0 +1,105 @@
+#include "batch_list.hpp"
+#include "batch.hpp"
+
+#include <stdexcept>
+
+namespace shm_kernel::memory_manager {
+
+batch_list::~batch_list()
+{
+  for (auto& chunk : this->chunks_) {
+    delete[] chunk.load(std::memory_order_relaxed);
+  }
+}
+
+std::pair<size_t, size_t>
+batch_list::locate(const size_t index) noexcept
+{
+  // chunk k starts at FIRST_CHUNK * (2^k - 1)
+  const size_t __biased = index + FIRST_CHUNK;
+  const size_t __k      = (63 - __builtin_clzll(__biased)) -
+                     (63 - __builtin_clzll(FIRST_CHUNK));
+  return { __k, __biased - (FIRST_CHUNK << __k) };
+}
+
+size_t
+batch_list::push_back(std::shared_ptr<batch> batch)
+{
+  std::lock_guard<std::mutex> GG(this->mtx_);
+  const size_t                __index = this->size_.load(std::memory_order_relaxed);
+  const auto [__k, __offset]          = locate(__index);
+  if (__k >= CHUNKS) {
+    throw std::length_error("batch_list is full");
+  }
+  auto* __chunk = this->chunks_[__k].load(std::memory_order_relaxed);
+  if (__chunk == nullptr) {
+    __chunk = new std::shared_ptr<class batch>[FIRST_CHUNK << __k];
+    this->chunks_[__k].store(__chunk, std::memory_order_release);
+  }
+  __chunk[__offset] = std::move(batch);
+  this->size_.store(__index + 1, std::memory_order_release);
+  return __index;
+}
+
+const std::shared_ptr<batch>&
+batch_list::operator[](const size_t index) const noexcept
+{
+  const auto [__k, __offset] = locate(index);
+  return this->chunks_[__k].load(std::memory_order_acquire)[__offset];
+}
+
+const std::shared_ptr<batch>&
+batch_list::back() const noexcept
+{
+  return (*this)[this->size() - 1];
+}
+
+size_t
+batch_list::size() const noexcept
+{
+  return this->size_.load(std::memory_order_acquire);
+}
+
+bool
+batch_list::empty() const noexcept
+{
+  return this->size() == 0;
+}
+
+batch_list::const_iterator
+batch_list::begin() const noexcept
+{
+  return { this, 0 };
+}
+
+batch_list::const_iterator
+batch_list::end() const noexcept
+{
+  return { this, this->size() };
+}
+
+std::vector<std::shared_ptr<batch>>
+batch_list::snapshot() const
+{
+  const size_t                        __size = this->size();
+  std::vector<std::shared_ptr<batch>> __batches;
+  __batches.reserve(__size);
+  for (size_t i = 0; i < __size; i++) {
+    __batches.push_back((*this)[i]);
+  }
+  return __batches;
+}
+
+void
+batch_list::clear() noexcept
+{
+  std::lock_guard<std::mutex> GG(this->mtx_);
+  const size_t                __size = this->size_.load(std::memory_order_relaxed);
+  for (size_t i = 0; i < __size; i++) {
+    const auto [__k, __offset] = locate(i);
+    this->chunks_[__k].load(std::memory_order_relaxed)[__offset].reset();
+  }
+  this->size_.store(0, std::memory_order_release);
+}
+
+}
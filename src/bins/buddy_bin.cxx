@@ -0,0 +1,334 @@
+#include "bins/buddy_bin.hpp"
+#include "ec.hpp"
+#include "segment.hpp"
+
+#include <algorithm>
+
+namespace shm_kernel::memory_manager {
+
+buddy_bin::buddy_bin(const size_t                    id,
+                     std::atomic_size_t&             segment_counter,
+                     const size_t&                   chunk_size,
+                     const size_t&                   chunk_count,
+                     const size_t&                   base_pshift,
+                     std::shared_ptr<spdlog::logger> logger)
+  : static_bin(id, segment_counter, chunk_size, chunk_count, base_pshift, logger)
+  , max_order_(0)
+{
+  while (chunk_count >> (max_order_ + 1)) {
+    max_order_++;
+  }
+  this->free_.resize(max_order_ + 1);
+  this->summary_.resize(max_order_ + 1);
+  this->free_count_.resize(max_order_ + 1);
+  for (size_t k = 0; k <= max_order_; k++) {
+    this->free_[k].resize(((chunk_count >> k) + 64) / 64);
+    this->summary_[k].resize((this->free_[k].size() + 63) / 64);
+  }
+  this->init_free_lists();
+  logger->debug("<buddy_bin>{{ID: {}, Max Order: {}}}", id, max_order_);
+}
+
+size_t
+buddy_bin::order_of(const size_t chunks) noexcept
+{
+  size_t __order = 0;
+  while ((size_t(1) << __order) < chunks) {
+    __order++;
+  }
+  return __order;
+}
+
+bool
+buddy_bin::test(const size_t order, const size_t idx) const noexcept
+{
+  const auto& __bits = this->free_[order];
+  return idx / 64 < __bits.size() && (__bits[idx / 64] >> (idx % 64)) & 1;
+}
+
+void
+buddy_bin::set(const size_t order, const size_t idx) noexcept
+{
+  auto& __word = this->free_[order][idx / 64];
+  if (__word == 0) {
+    this->summary_[order][idx / 4096] |= uint64_t(1) << (idx / 64 % 64);
+  }
+  __word |= uint64_t(1) << (idx % 64);
+  this->free_count_[order]++;
+}
+
+void
+buddy_bin::reset(const size_t order, const size_t idx) noexcept
+{
+  auto& __word = this->free_[order][idx / 64];
+  __word &= ~(uint64_t(1) << (idx % 64));
+  if (__word == 0) {
+    this->summary_[order][idx / 4096] &= ~(uint64_t(1) << (idx / 64 % 64));
+  }
+  this->free_count_[order]--;
+}
+
+size_t
+buddy_bin::find_free(const size_t order) const noexcept
+{
+  const auto& __summary = this->summary_[order];
+  for (size_t s = 0; s < __summary.size(); s++) {
+    if (__summary[s] != 0) {
+      auto __w = s * 64 + __builtin_ctzll(__summary[s]);
+      return __w * 64 + __builtin_ctzll(this->free_[order][__w]);
+    }
+  }
+  return this->free_[order].size() * 64;
+}
+
+void
+buddy_bin::init_free_lists() noexcept
+{
+  for (size_t k = 0; k <= max_order_; k++) {
+    std::fill(this->free_[k].begin(), this->free_[k].end(), 0);
+    std::fill(this->summary_[k].begin(), this->summary_[k].end(), 0);
+    this->free_count_[k] = 0;
+  }
+  // carve the region into descending power-of-two top blocks, each one is
+  // naturally aligned to its own size
+  size_t __chunk = 0;
+  for (size_t k = max_order_ + 1; k-- > 0;) {
+    if (this->chunk_count() & (size_t(1) << k)) {
+      this->set(k, __chunk >> k);
+      __chunk += size_t(1) << k;
+    }
+  }
+}
+
+void
+buddy_bin::mark(const size_t chunk, const size_t nchunks, const bool used) noexcept
+{
+  auto __end = std::min(chunk + nchunks, this->chunk_count());
+  for (size_t i = chunk; i < __end; i++) {
+    this->chunks_[i] = !used;
+    if (used) {
+      this->dirty_[i] = true;
+    }
+  }
+}
+
+void
+buddy_bin::release(size_t chunk, size_t order) noexcept
+{
+  this->mark(chunk, size_t(1) << order, false);
+  this->chunk_left_ += size_t(1) << order;
+  while (order < max_order_) {
+    size_t __buddy = (chunk >> order) ^ 1;
+    if (!this->test(order, __buddy)) {
+      break;
+    }
+    this->reset(order, __buddy);
+    chunk = std::min(chunk, __buddy << order);
+    order++;
+  }
+  this->set(order, chunk >> order);
+}
+
+std::shared_ptr<static_segment>
+buddy_bin::malloc(const size_t nbytes, std::error_code& ec) noexcept
+{
+  ec.clear();
+  size_t __segment_id = this->segment_counter_ref_++;
+  std::lock_guard<std::mutex> GGGGGGGGGGGGGGGGGGGGGGGG(this->mtx_);
+
+  auto __order = order_of(std::max<size_t>(this->chunk_req(nbytes), 1));
+  auto __found = __order;
+  while (__found <= max_order_ && this->free_count_[__found] == 0) {
+    __found++;
+  }
+  if (__found > max_order_) {
+    _M_statbin_logger->error("当前Buddy Bin的内存不足以分配!");
+    ec = MmgrErrc::NoMemory;
+    return nullptr;
+  }
+
+  auto __idx = this->find_free(__found);
+  this->reset(__found, __idx);
+  size_t __chunk = __idx << __found;
+  // split, the upper half of every level goes back to its free list
+  while (__found > __order) {
+    __found--;
+    this->set(__found, (__chunk >> __found) + 1);
+  }
+  this->mark(__chunk, size_t(1) << __order, true);
+  this->chunk_left_ -= size_t(1) << __order;
+
+  auto __seg         = std::make_shared<static_segment>();
+  __seg->addr_pshift = __chunk * this->chunk_size() + this->base_pshift();
+  __seg->size        = nbytes;
+  __seg->bin_id      = this->id();
+  __seg->id          = __segment_id;
+  return __seg;
+}
+
+int
+buddy_bin::free(std::shared_ptr<static_segment> segment,
+                std::error_code&                ec) noexcept
+{
+  ec.clear();
+  if (segment == nullptr) {
+    ec = MmgrErrc::NullptrSegment;
+    return -1;
+  }
+  if (segment->bin_id != this->id()) {
+    ec = MmgrErrc::BinUnmatched;
+    return -1;
+  }
+  auto __order = order_of(std::max<size_t>(this->chunk_req(segment->size), 1));
+  if (segment->addr_pshift < this->base_pshift() ||
+      (segment->addr_pshift - this->base_pshift()) % this->chunk_size() != 0) {
+    ec = MmgrErrc::IllegalSegmentRange;
+    return -1;
+  }
+  auto __chunk = (segment->addr_pshift - this->base_pshift()) / this->chunk_size();
+  if (__order > max_order_ || __chunk % (size_t(1) << __order) != 0 ||
+      __chunk + (size_t(1) << __order) > this->chunk_count()) {
+    ec = MmgrErrc::IllegalSegmentRange;
+    return -1;
+  }
+  std::lock_guard<std::mutex> GGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGG(mtx_);
+  for (size_t i = __chunk; i < __chunk + (size_t(1) << __order); i++) {
+    if (this->chunks_[i]) {
+      ec = MmgrErrc::SegmentDoubleFree;
+      return -1;
+    }
+  }
+  this->release(__chunk, __order);
+  return 0;
+}
+
+int
+buddy_bin::reserve(const size_t     addr_pshift,
+                   const size_t     nbytes,
+                   std::error_code& ec) noexcept
+{
+  ec.clear();
+  if (addr_pshift < this->base_pshift() ||
+      (addr_pshift - this->base_pshift()) % this->chunk_size() != 0) {
+    ec = MmgrErrc::IllegalSegmentRange;
+    return -1;
+  }
+  auto __order = order_of(std::max<size_t>(this->chunk_req(nbytes), 1));
+  auto __chunk = (addr_pshift - this->base_pshift()) / this->chunk_size();
+  if (__order > max_order_ || __chunk % (size_t(1) << __order) != 0) {
+    ec = MmgrErrc::IllegalSegmentRange;
+    return -1;
+  }
+  std::lock_guard<std::mutex> GGGGGGGGGGGGGGGGGGGGGGGGGG(mtx_);
+  // find the free block that contains the range
+  auto __found = __order;
+  while (__found <= max_order_ && !this->test(__found, __chunk >> __found)) {
+    __found++;
+  }
+  if (__found > max_order_) {
+    ec = MmgrErrc::IllegalSegmentRange;
+    return -1;
+  }
+  this->reset(__found, __chunk >> __found);
+  while (__found > __order) {
+    __found--;
+    this->set(__found, (__chunk >> __found) ^ 1);
+  }
+  this->mark(__chunk, size_t(1) << __order, true);
+  this->chunk_left_ -= size_t(1) << __order;
+  return 0;
+}
+
+int
+buddy_bin::resize(std::shared_ptr<static_segment> segment,
+                  const size_t                    nbytes,
+                  std::error_code&                ec) noexcept
+{
+  ec.clear();
+  if (segment == nullptr) {
+    ec = MmgrErrc::NullptrSegment;
+    return -1;
+  }
+  if (segment->bin_id != this->id()) {
+    ec = MmgrErrc::BinUnmatched;
+    return -1;
+  }
+  if (segment->addr_pshift < this->base_pshift()) {
+    ec = MmgrErrc::IllegalSegmentRange;
+    return -1;
+  }
+  auto __chunk = (segment->addr_pshift - this->base_pshift()) / this->chunk_size();
+  auto __old   = order_of(std::max<size_t>(this->chunk_req(segment->size), 1));
+  auto __new   = order_of(std::max<size_t>(this->chunk_req(nbytes), 1));
+  std::lock_guard<std::mutex> GGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGG(mtx_);
+  if (__new < __old) {
+    // give back the upper halves, from the largest one down
+    for (size_t k = __old; k-- > __new;) {
+      this->release(__chunk + (size_t(1) << k), k);
+    }
+    return 0;
+  }
+  if (__new == __old) {
+    return 0;
+  }
+  // the block can only grow if it is the lower half at every level and all
+  // the buddies up to the new order are free
+  if (__new > max_order_ || __chunk % (size_t(1) << __new) != 0) {
+    ec = MmgrErrc::NoMemory;
+    return -1;
+  }
+  for (size_t k = __old; k < __new; k++) {
+    if (!this->test(k, (__chunk >> k) ^ 1)) {
+      ec = MmgrErrc::NoMemory;
+      return -1;
+    }
+  }
+  for (size_t k = __old; k < __new; k++) {
+    this->reset(k, (__chunk >> k) ^ 1);
+  }
+  this->mark(__chunk + (size_t(1) << __old),
+             (size_t(1) << __new) - (size_t(1) << __old),
+             true);
+  this->chunk_left_ -= (size_t(1) << __new) - (size_t(1) << __old);
+  return 0;
+}
+
+void
+buddy_bin::clear() noexcept
+{
+  std::lock_guard<std::mutex> GGGGGGGGGGGGGGGGGGGGGGG(mtx_);
+  std::fill(this->chunks_.begin(), this->chunks_.end(), true);
+  this->chunk_left_ = this->chunk_count();
+  this->init_free_lists();
+}
+
+size_t
+buddy_bin::max_request() const noexcept
+{
+  return (size_t(1) << max_order_) * this->chunk_size();
+}
+
+BIN_TYPE
+buddy_bin::type() const noexcept
+{
+  return BIN_TYPE::BUDDY;
+}
+
+const size_t
+buddy_bin::max_order() const noexcept
+{
+  return this->max_order_;
+}
+
+const size_t
+buddy_bin::largest_free() noexcept
+{
+  std::lock_guard<std::mutex> GGGGGGGGGGGGGGGGGGGGGGG(mtx_);
+  for (size_t k = max_order_ + 1; k-- > 0;) {
+    if (this->free_count_[k] > 0) {
+      return size_t(1) << k;
+    }
+  }
+  return 0;
+}
+}
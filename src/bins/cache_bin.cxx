@@ -1,6 +1,8 @@
 #include "bins/cache_bin.hpp"
 #include "ec.hpp"
+#include "memops.hpp"
 #include "segment.hpp"
+#include <algorithm>
 #include <chrono>
 #include <condition_variable>
 #include <cstddef>
@@ -16,21 +18,53 @@
 #include <stdexcept>
 #include <system_error>
 #include <thread>
+#include <tuple>
 #include <utility>
 
 namespace shm_kernel::memory_manager {
 
 using namespace std::chrono_literals;
 
+static size_t
+pool_alignment(const size_t alignment) noexcept
+{
+  return std::max(alignment, alignof(std::max_align_t));
+}
+
 cache_bin::cache_bin(std::atomic_size_t&             segment_counter,
                      std::string_view                memmgr_name,
                      std::shared_ptr<spdlog::logger> logger)
+  : cache_bin(segment_counter,
+              memmgr_name,
+              0,
+              CACHE_POLICY::LRU,
+              CACHE_SHARDS,
+              false,
+              logger)
+{}
+
+cache_bin::cache_bin(std::atomic_size_t&             segment_counter,
+                     std::string_view                memmgr_name,
+                     const size_t                    budget,
+                     const CACHE_POLICY              policy,
+                     const size_t                    shards,
+                     const bool                      shared,
+                     std::shared_ptr<spdlog::logger> logger)
   : segment_counter_ref_(segment_counter)
+  , shard_budget_(budget / std::max<size_t>(shards, 1))
+  , policy_(policy)
   , mmgr_name_(memmgr_name)
   , _M_cachbin_logger(logger)
 {
   logger->trace("正在初始化Cache bin...");
-
+  if (budget != 0 && shard_budget_ == 0) {
+    throw std::invalid_argument("cache budget is smaller than shard count");
+  }
+  for (size_t i = 0; i < std::max<size_t>(shards, 1); i++) {
+    this->shards_.push_back(std::make_unique<cache_shard>(
+      shared ? std::make_unique<shm_resource>(memmgr_name, region_counter_)
+             : nullptr));
+  }
   logger->trace("Cache bin 初始化完毕!");
 }
 
@@ -40,10 +74,189 @@ cache_bin::set_logger(std::shared_ptr<spdlog::logger> logger)
   this->_M_cachbin_logger = logger;
 }
 
+void
+cache_bin::set_evict_callback(cache_evict_callback callback)
+{
+  this->on_evict_ = std::move(callback);
+}
+
+cache_bin::cache_shard&
+cache_bin::shard_of(const size_t segment_id) const noexcept
+{
+  return *this->shards_[segment_id % this->shards_.size()];
+}
+
+void*
+cache_bin::pool_allocate(cache_shard& shard,
+                         const size_t nbytes,
+                         const size_t alignment) noexcept
+{
+  try {
+    return shard.pool.allocate(nbytes, pool_alignment(alignment));
+  } catch (const std::bad_alloc&) {
+    return nullptr;
+  }
+}
+
+void
+cache_bin::insert(cache_shard& shard,
+                  const size_t id,
+                  void*        buffer,
+                  const size_t nbytes,
+                  const size_t alignment) noexcept
+{
+  // new segments start as most recent, CLOCK puts them behind the hand
+  auto __order = shard.order.insert(
+    this->policy_ == CACHE_POLICY::LRU ? shard.order.begin() : shard.hand, id);
+  shard.entries.insert(std::make_pair(
+    id, cache_entry{ buffer, nbytes, nbytes, alignment, 0, false, __order }));
+  shard.bytes += nbytes;
+}
+
+void
+cache_bin::touch(cache_shard& shard, cache_entry& entry) noexcept
+{
+  if (this->policy_ == CACHE_POLICY::LRU) {
+    shard.order.splice(shard.order.begin(), shard.order, entry.order);
+  } else {
+    entry.referenced = true;
+  }
+}
+
+void
+cache_bin::drop(cache_shard&                                      shard,
+                std::unordered_map<size_t, cache_entry>::iterator iter) noexcept
+{
+  auto& __entry = iter->second;
+  if (shard.hand == __entry.order) {
+    ++shard.hand;
+  }
+  shard.order.erase(__entry.order);
+  shard.pool.deallocate(
+    __entry.buffer, __entry.capacity, pool_alignment(__entry.alignment));
+  shard.bytes -= __entry.capacity;
+  shard.entries.erase(iter);
+}
+
+int
+cache_bin::make_room(cache_shard&                            shard,
+                     const size_t                            nbytes,
+                     const size_t                            keep_id,
+                     std::vector<std::pair<size_t, size_t>>& evicted,
+                     std::error_code&                        ec) noexcept
+{
+  if (this->shard_budget_ == 0) {
+    return 0;
+  }
+  if (nbytes > this->shard_budget_) {
+    ec = MmgrErrc::CacheBudgetExceeded;
+    return -1;
+  }
+  // CLOCK may pass every segment twice, once to clear its reference bit
+  size_t __steps = 2 * shard.order.size();
+  while (shard.bytes + nbytes > this->shard_budget_ && __steps-- > 0) {
+    std::list<size_t>::iterator __victim;
+    if (this->policy_ == CACHE_POLICY::LRU) {
+      // oldest unpinned from the back
+      auto __rit = std::find_if(
+        shard.order.rbegin(), shard.order.rend(), [&](const size_t id) {
+          return id != keep_id && shard.entries.at(id).pins == 0;
+        });
+      if (__rit == shard.order.rend()) {
+        break;
+      }
+      __victim = std::prev(__rit.base());
+    } else {
+      if (shard.hand == shard.order.end()) {
+        shard.hand = shard.order.begin();
+      }
+      __victim    = shard.hand++;
+      auto& __ent = shard.entries.at(*__victim);
+      if (*__victim == keep_id || __ent.pins != 0) {
+        continue;
+      }
+      if (__ent.referenced) {
+        __ent.referenced = false;
+        continue;
+      }
+    }
+    auto __iter = shard.entries.find(*__victim);
+    evicted.emplace_back(__iter->first, __iter->second.size);
+    this->drop(shard, __iter);
+    this->evictions_++;
+  }
+  if (shard.bytes + nbytes > this->shard_budget_) {
+    _M_cachbin_logger->warn(
+      "cache bin 无法腾出 {} bytes, 剩余的segment都被pin住了", nbytes);
+    ec = MmgrErrc::CacheBudgetExceeded;
+    return -1;
+  }
+  return 0;
+}
+
+void*
+cache_bin::grow(cache_shard&                            shard,
+                const size_t                            id,
+                cache_entry&                            entry,
+                const size_t                            nbytes,
+                const size_t                            preserve,
+                std::vector<std::pair<size_t, size_t>>& evicted,
+                std::error_code&                        ec) noexcept
+{
+  if (nbytes <= entry.capacity) {
+    this->in_place_.fetch_add(1, std::memory_order_relaxed);
+    return entry.buffer;
+  }
+  // double for repeated growth, but never evict for the headroom
+  size_t __capacity = std::max(nbytes, 2 * entry.capacity);
+  if (this->shard_budget_ != 0 &&
+      shard.bytes + __capacity - entry.capacity > this->shard_budget_) {
+    __capacity = nbytes;
+  }
+  if (this->make_room(shard, __capacity - entry.capacity, id, evicted, ec) !=
+      0) {
+    return nullptr;
+  }
+  void* __buffer = this->pool_allocate(shard, __capacity, entry.alignment);
+  if (__buffer == nullptr) {
+    this->_M_cachbin_logger->error("pmr_pool 分配内存失败!");
+    ec = MmgrErrc::NoMemory;
+    return nullptr;
+  }
+  memops::copy(__buffer, entry.buffer, preserve);
+  shard.pool.deallocate(
+    entry.buffer, entry.capacity, pool_alignment(entry.alignment));
+  shard.bytes += __capacity - entry.capacity;
+  entry.buffer   = __buffer;
+  entry.capacity = __capacity;
+  return __buffer;
+}
+
+void
+cache_bin::notify(
+  const std::vector<std::pair<size_t, size_t>>& evicted) noexcept
+{
+  if (!this->on_evict_) {
+    return;
+  }
+  for (const auto& [id, size] : evicted) {
+    this->on_evict_(id, size);
+  }
+}
+
 std::shared_ptr<cache_segment>
 cache_bin::store(const void*      buffer,
                  const size_t     size,
                  std::error_code& ec) noexcept
+{
+  return this->store(buffer, size, 0, ec);
+}
+
+std::shared_ptr<cache_segment>
+cache_bin::store(const void*      buffer,
+                 const size_t     size,
+                 const size_t     alignment,
+                 std::error_code& ec) noexcept
 {
   ec.clear();
   // check buffer
@@ -53,21 +266,34 @@ cache_bin::store(const void*      buffer,
     return nullptr;
   }
   const size_t __tmp_id = this->segment_counter_ref_++;
+  auto&        __shard  = this->shard_of(__tmp_id);
   auto __seg = std::make_shared<cache_segment>(mmgr_name_, __tmp_id, size);
-
-  void* __alloc_buff = this->pmr_pool_.allocate(size);
+  std::vector<std::pair<size_t, size_t>> __evicted;
+  std::unique_lock<std::mutex>           __lock(__shard.mtx);
+  if (this->make_room(__shard, size, -1, __evicted, ec) != 0) {
+    __lock.unlock();
+    this->notify(__evicted);
+    return nullptr;
+  }
+  void* __alloc_buff = this->pool_allocate(__shard, size, alignment);
   // check if allocate success
   if (__alloc_buff == nullptr) {
+    __lock.unlock();
+    // whatever make_room evicted is gone either way
+    this->notify(__evicted);
     ec = MmgrErrc::NoMemory;
     _M_cachbin_logger->error("分配{} bytes时失败!可能是内存不足", size);
     return nullptr;
   }
   // copy data to pool
-  std::memcpy(__alloc_buff, buffer, size);
-  // store it in data_map
-  this->mtx_.lock();
-  this->data_map_[__seg->id] = __alloc_buff;
-  this->mtx_.unlock();
+  memops::copy(__alloc_buff, buffer, size);
+  // store it in the shard
+  this->insert(__shard, __tmp_id, __alloc_buff, size, alignment);
+  std::tie(__seg->region_id, __seg->addr_pshift) =
+    this->locate(__shard, __alloc_buff);
+  __lock.unlock();
+  this->notify(__evicted);
+  __seg->alignment = alignment;
   // return segment
   return __seg;
 }
@@ -77,11 +303,15 @@ cache_bin::retrieve(const size_t segment_id, std::error_code& ec) noexcept
 {
   ec.clear();
   // try to find the segment
-  std::lock_guard __G(this->mtx_);
-  if (auto __iter = this->data_map_.find(segment_id);
-      __iter != this->data_map_.end()) {
-    return __iter->second;
+  auto&           __shard = this->shard_of(segment_id);
+  std::lock_guard __G(__shard.mtx);
+  if (auto __iter = __shard.entries.find(segment_id);
+      __iter != __shard.entries.end()) {
+    this->touch(__shard, __iter->second);
+    this->hits_.fetch_add(1, std::memory_order_relaxed);
+    return __iter->second.buffer;
   }
+  this->misses_.fetch_add(1, std::memory_order_relaxed);
   ec = MmgrErrc::SegmentNotFound;
   return nullptr;
 }
@@ -90,15 +320,29 @@ std::shared_ptr<cache_segment>
 cache_bin::malloc(const size_t size, void** ptr, std::error_code& ec) noexcept
 {
   ec.clear();
-  void* __buff = this->pmr_pool_.allocate(size);
+  size_t __tmp_id = this->segment_counter_ref_++;
+  auto&  __shard  = this->shard_of(__tmp_id);
+  std::vector<std::pair<size_t, size_t>> __evicted;
+  std::unique_lock<std::mutex>           __lock(__shard.mtx);
+  if (this->make_room(__shard, size, -1, __evicted, ec) != 0) {
+    __lock.unlock();
+    this->notify(__evicted);
+    return nullptr;
+  }
+  void* __buff = this->pool_allocate(__shard, size, 0);
   if (__buff == nullptr) {
+    __lock.unlock();
+    this->notify(__evicted);
     ec = MmgrErrc::NoMemory;
     return nullptr;
   }
-  size_t __tmp_id = this->segment_counter_ref_++;
-  this->data_map_.insert(std::make_pair(__tmp_id, __buff));
+  this->insert(__shard, __tmp_id, __buff, size, 0);
   auto __seg = std::make_shared<cache_segment>(mmgr_name_, __tmp_id, size);
-  *ptr       = __buff;
+  std::tie(__seg->region_id, __seg->addr_pshift) =
+    this->locate(__shard, __buff);
+  __lock.unlock();
+  this->notify(__evicted);
+  *ptr = __buff;
   return __seg;
 }
 
@@ -107,19 +351,18 @@ cache_bin::free(std::shared_ptr<cache_segment> segment,
                 std::error_code&               ec) noexcept
 {
   ec.clear();
+  auto&                       __shard = this->shard_of(segment->id);
+  std::lock_guard<std::mutex> GGGGGGGGGGGG(__shard.mtx);
   // find ptr by segment->id_
-  auto __iter = this->data_map_.find(segment->id);
-  if (__iter == this->data_map_.end()) {
+  auto __iter = __shard.entries.find(segment->id);
+  if (__iter == __shard.entries.end()) {
     _M_cachbin_logger->error(
       "没有在当前Cache bin中找到这个segment! segment id: {}", segment->id);
     ec = MmgrErrc::SegmentNotFound;
     return -1;
   }
-  auto __pair = __iter->second;
-  // deallocate heap buffer
-  this->pmr_pool_.deallocate(__iter->second, segment->size);
-  // erase
-  this->data_map_.erase(__iter);
+  // deallocate heap buffer and erase
+  this->drop(__shard, __iter);
   return 0;
 }
 
@@ -133,24 +376,44 @@ cache_bin::free(std::shared_ptr<cache_segment> segment)
 
 int
 cache_bin::set(const size_t     segment_id,
-               const size_t     origin_size,
                const void*      new_buffer,
                const size_t     new_size,
                std::error_code& ec) noexcept
 {
   ec.clear();
-  std::lock_guard<std::mutex> __lock(mtx_);
-  auto                        __iter = this->data_map_.find(segment_id);
-  if (__iter == this->data_map_.end()) {
+  auto&                                  __shard = this->shard_of(segment_id);
+  std::vector<std::pair<size_t, size_t>> __evicted;
+  std::unique_lock<std::mutex>           __lock(__shard.mtx);
+  auto __iter = __shard.entries.find(segment_id);
+  if (__iter == __shard.entries.end()) {
     ec = MmgrErrc::SegmentNotFound;
     return -1;
-  } else {
-    this->pmr_pool_.deallocate(__iter->second, origin_size);
-    void* __new_addr = this->pmr_pool_.allocate(new_size);
-    std::memcpy(__new_addr, new_buffer, new_size);
-    __iter->second = __new_addr;
-    return 0;
   }
+  auto&       __entry = __iter->second;
+  const char* __src   = static_cast<const char*>(new_buffer);
+  const char* __own   = static_cast<const char*>(__entry.buffer);
+  // new_buffer may point into the segment's own buffer, which grow frees.
+  // move it to the front and let grow carry it over
+  size_t __preserve = 0;
+  if (__src >= __own && __src < __own + __entry.capacity) {
+    __preserve = std::min(new_size, size_t(__own + __entry.capacity - __src));
+    std::memmove(__entry.buffer, __src, __preserve);
+  }
+  void* __buffer = this->grow(
+    __shard, segment_id, __entry, new_size, __preserve, __evicted, ec);
+  if (__buffer == nullptr) {
+    __lock.unlock();
+    this->notify(__evicted);
+    return -1;
+  }
+  if (__preserve == 0) {
+    std::memcpy(__buffer, new_buffer, new_size);
+  }
+  __entry.size = new_size;
+  this->touch(__shard, __entry);
+  __lock.unlock();
+  this->notify(__evicted);
+  return 0;
 }
 
 void*
@@ -158,41 +421,157 @@ cache_bin::realloc(std::shared_ptr<cache_segment> segment,
                    const size_t                   new_size,
                    std::error_code&               ec) noexcept
 {
+  ec.clear();
   if (segment->type != SEG_TYPE::CACHE_SEGMENT) {
     ec = MmgrErrc::SegmentTypeUnmatched;
     return nullptr;
   }
+  auto&                                  __shard = this->shard_of(segment->id);
+  std::vector<std::pair<size_t, size_t>> __evicted;
+  std::unique_lock<std::mutex>           __lock(__shard.mtx);
   // find ptr
-  std::lock_guard<std::mutex> __lock(this->mtx_);
-  void*                       __ptr = this->data_map_[segment->id];
-  if (__ptr == nullptr) {
+  auto __iter = __shard.entries.find(segment->id);
+  if (__iter == __shard.entries.end()) {
     _M_cachbin_logger->error("Segment的buffer是nullptr!");
     ec = MmgrErrc::NullptrSegment;
     return nullptr;
   }
-  // dealloc it
-  this->pmr_pool_.deallocate(__ptr, segment->size);
-  void* __new_ptr = this->pmr_pool_.allocate(new_size);
+  auto& __entry   = __iter->second;
+  void* __new_ptr = this->grow(__shard,
+                               segment->id,
+                               __entry,
+                               new_size,
+                               std::min(__entry.size, new_size),
+                               __evicted,
+                               ec);
   if (__new_ptr == nullptr) {
-    this->_M_cachbin_logger->error("pmr_pool 分配内存失败!");
-    ec = MmgrErrc::NoMemory;
+    __lock.unlock();
+    this->notify(__evicted);
     return nullptr;
   }
-  this->data_map_[segment->id] = __new_ptr;
-  segment->size                = new_size;
+  __entry.size = new_size;
+  this->touch(__shard, __entry);
+  segment->size = new_size;
+  std::tie(segment->region_id, segment->addr_pshift) =
+    this->locate(__shard, __new_ptr);
+  __lock.unlock();
+  this->notify(__evicted);
   return __new_ptr;
 }
 
+int
+cache_bin::pin(const size_t segment_id, std::error_code& ec) noexcept
+{
+  ec.clear();
+  auto&                       __shard = this->shard_of(segment_id);
+  std::lock_guard<std::mutex> GGGGGGGGGGGG(__shard.mtx);
+  auto __iter = __shard.entries.find(segment_id);
+  if (__iter == __shard.entries.end()) {
+    ec = MmgrErrc::SegmentNotFound;
+    return -1;
+  }
+  __iter->second.pins++;
+  return 0;
+}
+
+int
+cache_bin::unpin(const size_t segment_id, std::error_code& ec) noexcept
+{
+  ec.clear();
+  auto&                       __shard = this->shard_of(segment_id);
+  std::lock_guard<std::mutex> GGGGGGGGGGGG(__shard.mtx);
+  auto __iter = __shard.entries.find(segment_id);
+  if (__iter == __shard.entries.end()) {
+    ec = MmgrErrc::SegmentNotFound;
+    return -1;
+  }
+  if (__iter->second.pins == 0) {
+    ec = MmgrErrc::IllegalSegmentRange;
+    return -1;
+  }
+  __iter->second.pins--;
+  return 0;
+}
+
+cache_stats
+cache_bin::stats() noexcept
+{
+  cache_stats __stats{ this->hits_.load(),
+                       this->misses_.load(),
+                       this->evictions_.load(),
+                       this->in_place_.load(),
+                       0,
+                       this->shard_budget_ * this->shards_.size(),
+                       0 };
+  for (const auto& shard : this->shards_) {
+    std::lock_guard<std::mutex> GGGGGGGGGGGG(shard->mtx);
+    __stats.bytes += shard->bytes;
+    __stats.segments += shard->entries.size();
+  }
+  return __stats;
+}
+
+std::pair<size_t, size_t>
+cache_bin::locate(const cache_shard& shard, const void* buffer) const noexcept
+{
+  if (!shard.shm) {
+    return { shm_resource::NO_REGION, 0 };
+  }
+  return shard.shm->locate(buffer);
+}
+
+std::pair<size_t, size_t>
+cache_bin::location(const size_t segment_id) const noexcept
+{
+  auto&                       __shard = this->shard_of(segment_id);
+  std::lock_guard<std::mutex> GGGGGGGGGGGG(__shard.mtx);
+  auto __iter = __shard.entries.find(segment_id);
+  if (__iter == __shard.entries.end()) {
+    return { shm_resource::NO_REGION, 0 };
+  }
+  return this->locate(__shard, __iter->second.buffer);
+}
+
+size_t
+cache_bin::region_count() const noexcept
+{
+  size_t __count = 0;
+  for (const auto& shard : this->shards_) {
+    std::lock_guard<std::mutex> GGGGGGGGGGGG(shard->mtx);
+    __count += shard->shm ? shard->shm->region_count() : 0;
+  }
+  return __count;
+}
+
+bool
+cache_bin::contains(const size_t segment_id) const noexcept
+{
+  auto&                       __shard = this->shard_of(segment_id);
+  std::lock_guard<std::mutex> GGGGGGGGGGGG(__shard.mtx);
+  return __shard.entries.count(segment_id) != 0;
+}
+
 void
 cache_bin::clear() noexcept
 {
-  this->data_map_.clear();
-  this->pmr_pool_.release();
+  for (auto& shard : this->shards_) {
+    std::lock_guard<std::mutex> GGGGGGGGGGGG(shard->mtx);
+    shard->entries.clear();
+    shard->order.clear();
+    shard->hand  = shard->order.end();
+    shard->bytes = 0;
+    shard->pool.release();
+  }
 }
 
 size_t
 cache_bin::segment_count() const noexcept
 {
-  return this->data_map_.size();
+  size_t __count = 0;
+  for (const auto& shard : this->shards_) {
+    std::lock_guard<std::mutex> GGGGGGGGGGGG(shard->mtx);
+    __count += shard->entries.size();
+  }
+  return __count;
 }
 }
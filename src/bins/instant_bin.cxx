@@ -2,7 +2,9 @@
 #include <fmt/format.h>
 #include <spdlog/spdlog.h>
 
+#include "config.hpp"
 #include "ec.hpp"
+#include "shm_keeper.hpp"
 #include <segment.hpp>
 
 namespace shm_kernel::memory_manager {
@@ -12,33 +14,218 @@ instant_bin::instant_bin(std::atomic_size_t&             segment_counter,
   : segment_counter_ref_(segment_counter)
   , mmgr_name_(memmgr_name)
   , _M_instbin_logger(logger)
-{}
+{
+  this->init_directory();
+}
+
+instant_bin::instant_bin(std::atomic_size_t&             segment_counter,
+                         std::string_view                memmgr_name,
+                         const bool                      reattach,
+                         std::string_view                backing_dir,
+                         std::shared_ptr<spdlog::logger> logger)
+  : segment_counter_ref_(segment_counter)
+  , mmgr_name_(memmgr_name)
+  , backing_dir_(backing_dir)
+  , _M_instbin_logger(logger)
+{
+  if (!reattach || !this->reattach_directory()) {
+    this->init_directory();
+  }
+}
+
+void
+instant_bin::init_directory() noexcept
+{
+  auto __name = fmt::format("{}#instbin#dir", mmgr_name_);
+  try {
+    this->dir_handle_ = std::make_unique<ipc::shmhdl>(
+      __name, instant_dir_header::bytes(INSTANT_DIR_CAPACITY));
+  } catch (const std::exception& e) {
+    // not fatal, instant segments just won't survive a restart
+    _M_instbin_logger->warn(
+      "无法创建{}, instant segments will not be persisted. {}",
+      __name,
+      e.what());
+    return;
+  }
+  std::error_code ec;
+  auto* __dir = static_cast<instant_dir_header*>(this->dir_handle_->map(ec));
+  if (ec || __dir == nullptr) {
+    _M_instbin_logger->warn("无法映射{}", __name);
+    this->dir_handle_.reset();
+    return;
+  }
+  __dir->version  = DIRECTORY_VERSION;
+  __dir->capacity = INSTANT_DIR_CAPACITY;
+  __dir->next_segment_id.store(0, std::memory_order_relaxed);
+  for (size_t i = 0; i < INSTANT_DIR_CAPACITY; i++) {
+    __dir->slots()[i].size.store(0, std::memory_order_relaxed);
+    __dir->generations()[i].store(0, std::memory_order_relaxed);
+  }
+  std::atomic_thread_fence(std::memory_order_release);
+  __dir->magic = INSTANT_DIR_MAGIC;
+  this->dir_   = __dir;
+}
+
+bool
+instant_bin::reattach_directory() noexcept
+{
+  auto                         __name = fmt::format("{}#instbin#dir", mmgr_name_);
+  std::unique_ptr<ipc::shmhdl> __handle;
+  try {
+    __handle = std::make_unique<ipc::shmhdl>(__name);
+  } catch (const std::exception& e) {
+    return false;
+  }
+  std::error_code ec;
+  auto* __dir = static_cast<instant_dir_header*>(__handle->map(ec));
+  if (ec || __dir == nullptr || __handle->nbytes() < sizeof(*__dir) ||
+      __dir->magic != INSTANT_DIR_MAGIC ||
+      __dir->version != DIRECTORY_VERSION ||
+      __handle->nbytes() < instant_dir_header::bytes(__dir->capacity)) {
+    _M_instbin_logger->error("{} is incompatible, refuse to reattach", __name);
+    return false;
+  }
+
+  std::lock_guard<std::mutex> GGGGGGGGGGGGGGGGGGGGGG(mtx_);
+  for (size_t i = 0; i < __dir->capacity; i++) {
+    auto& __slot = __dir->slots()[i];
+    if (__slot.size.load(std::memory_order_acquire) == 0) {
+      continue;
+    }
+    size_t __id       = __slot.id.load(std::memory_order_relaxed);
+    auto   __seg_name = fmt::format("{}#instbin#seg{}", mmgr_name_, __id);
+    try {
+      if (this->backing_dir_.empty()) {
+        this->segments_.insert(
+          std::make_pair(__id, std::make_shared<ipc::shmhdl>(__seg_name)));
+      } else {
+        this->files_.insert(std::make_pair(
+          __id,
+          std::make_shared<mapped_file>(
+            backing_path(this->backing_dir_, __seg_name))));
+      }
+      this->slots_.insert(std::make_pair(__id, i));
+    } catch (const std::exception& e) {
+      _M_instbin_logger->warn(
+        "instant segment_{} is gone, drop it from directory. {}", __id, e.what());
+      __slot.size.store(0, std::memory_order_release);
+    }
+  }
+  this->dir_handle_ = std::move(__handle);
+  this->dir_        = __dir;
+  _M_instbin_logger->info("reattached {} with {} live segments",
+                          __name,
+                          this->slots_.size());
+  return true;
+}
+
+void
+instant_bin::record(const size_t segment_id, const size_t nbytes) noexcept
+{
+  if (this->dir_ == nullptr) {
+    return;
+  }
+  bump_next_id(this->dir_->next_segment_id, segment_id + 1);
+  for (size_t i = 0; i < this->dir_->capacity; i++) {
+    auto& __slot = this->dir_->slots()[i];
+    if (__slot.size.load(std::memory_order_relaxed) == 0) {
+      __slot.id.store(segment_id, std::memory_order_relaxed);
+      this->dir_->generations()[i].store(0, std::memory_order_relaxed);
+      __slot.size.store(nbytes, std::memory_order_release);
+      this->slots_.insert(std::make_pair(segment_id, i));
+      return;
+    }
+  }
+  _M_instbin_logger->warn(
+    "instant directory is full, segment_{} will not survive a restart",
+    segment_id);
+}
+
+void
+instant_bin::forget(const size_t segment_id) noexcept
+{
+  auto __iter = this->slots_.find(segment_id);
+  if (__iter == this->slots_.end()) {
+    return;
+  }
+  this->dir_->slots()[__iter->second].size.store(0, std::memory_order_release);
+  this->slots_.erase(__iter);
+}
 
 std::shared_ptr<instant_segment>
 instant_bin::malloc(const size_t nbytes, std::error_code& ec) noexcept
+{
+  return this->malloc(nbytes, 0, ec);
+}
+
+std::shared_ptr<instant_segment>
+instant_bin::malloc(const size_t     nbytes,
+                    const size_t     alignment,
+                    std::error_code& ec) noexcept
 {
   ec.clear();
   size_t                      __tmp = this->segment_counter_ref_++;
   std::lock_guard<std::mutex> GGGGGGGGGGGGGGGGGGGGG(mtx_);
-  std::shared_ptr<ipc::shmhdl> __shm;
-  try {
-    __shm = std::make_shared<ipc::shmhdl>(
-      fmt::format("{}#instbin#seg{}", mmgr_name_, __tmp), nbytes);
-  } catch (const std::exception& e) {
-    this->_M_instbin_logger->error(
-      "创建instant segment的shm_handle失败！ ({}) {}",
-      ec.value(),
-      ec.message());
-    return nullptr;
-  }
+  auto __seg_name = fmt::format("{}#instbin#seg{}", mmgr_name_, __tmp);
+  if (!this->backing_dir_.empty()) {
+    std::shared_ptr<mapped_file> __file;
+    try {
+      __file = std::make_shared<mapped_file>(
+        backing_path(this->backing_dir_, __seg_name), nbytes);
+    } catch (const std::exception& e) {
+      this->_M_instbin_logger->error(
+        "创建instant segment的backing file失败！ {}", e.what());
+      ec = MmgrErrc::UnableToCreateShm;
+      return nullptr;
+    }
+    if (alignment > page_size() && __file->align(alignment, ec) != 0) {
+      this->_M_instbin_logger->error("对齐instant segment失败！ {}", ec.message());
+      return nullptr;
+    }
+    if (!this->files_.insert(std::make_pair(__tmp, __file)).second) {
+      ec = MmgrErrc::DuplicatedKey;
+      return nullptr;
+    }
+  } else {
+    std::shared_ptr<ipc::shmhdl> __shm;
+    try {
+      __shm = std::make_shared<ipc::shmhdl>(__seg_name, nbytes);
+    } catch (const std::exception& e) {
+      this->_M_instbin_logger->error(
+        "创建instant segment的shm_handle失败！ ({}) {}",
+        ec.value(),
+        ec.message());
+      return nullptr;
+    }
 
-  auto __insert_rv = this->segments_.insert(std::make_pair(__tmp, __shm));
-  if (!__insert_rv.second) {
-    ec = MmgrErrc::DuplicatedKey;
-    return nullptr;
+    if (alignment > page_size()) {
+      std::shared_ptr<mapped_file> __view;
+      try {
+        __view = mapped_file::open_shm(__seg_name);
+      } catch (const std::exception& e) {
+        this->_M_instbin_logger->error("无法映射instant segment: {}", e.what());
+        ec = MmgrErrc::UnableToAttachShm;
+        return nullptr;
+      }
+      if (__view->align(alignment, ec) != 0) {
+        this->_M_instbin_logger->error("对齐instant segment失败！ {}",
+                                       ec.message());
+        return nullptr;
+      }
+      this->resized_.insert(std::make_pair(__tmp, __view));
+    }
+    auto __insert_rv = this->segments_.insert(std::make_pair(__tmp, __shm));
+    if (!__insert_rv.second) {
+      ec = MmgrErrc::DuplicatedKey;
+      return nullptr;
+    }
   }
 
+  this->record(__tmp, nbytes);
+
   auto __seg = std::make_shared<instant_segment>(mmgr_name_, __tmp, nbytes);
+  __seg->alignment = alignment;
   return __seg;
 }
 
@@ -49,20 +236,103 @@ instant_bin::free(std::shared_ptr<instant_segment> segment,
   ec.clear();
   std::lock_guard<std::mutex> GGGGGGGGGGGGGGGGGGGGGGGGGGGGGGG(mtx_);
 
+  // drop our own mapping before the handle
+  this->resized_.erase(segment->id);
   // search for segment's shm_handler
   auto __pair = this->segments_.find(segment->id);
-  if (__pair == this->segments_.end()) {
+  if (__pair != this->segments_.end()) {
+    this->segments_.erase(__pair);
+  } else if (auto __file = this->files_.find(segment->id);
+             __file != this->files_.end()) {
+    this->files_.erase(__file);
+  } else {
     ec = MmgrErrc::SegmentNotFound;
     return -1;
   }
-  this->segments_.erase(__pair);
+  this->forget(segment->id);
   return 0;
 }
 
 void
 instant_bin::clear() noexcept
 {
+  std::lock_guard<std::mutex> GGGGGGGGGGGGGGGGGGGGGGGGG(mtx_);
+  while (!this->slots_.empty()) {
+    this->forget(this->slots_.begin()->first);
+  }
+  this->resized_.clear();
   this->segments_.clear();
+  this->files_.clear();
+}
+
+void
+instant_bin::keep() noexcept
+{
+  std::lock_guard<std::mutex> GGGGGGGGGGGGGGGGGGGGGGGGGG(mtx_);
+  for (auto& [id, handle] : this->segments_) {
+    keep_shm(mmgr_name_, std::move(handle));
+  }
+  for (auto& [id, file] : this->files_) {
+    keep_shm(mmgr_name_, std::move(file));
+  }
+  keep_shm(mmgr_name_, std::shared_ptr<ipc::shmhdl>(std::move(this->dir_handle_)));
+  this->dir_ = nullptr;
+  this->segments_.clear();
+  this->files_.clear();
+}
+
+int
+instant_bin::resize(std::shared_ptr<instant_segment> segment,
+                    const size_t                     nbytes,
+                    std::error_code&                 ec) noexcept
+{
+  ec.clear();
+  std::lock_guard<std::mutex> GGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGG(mtx_);
+  std::shared_ptr<mapped_file> __view;
+  if (auto __file = this->files_.find(segment->id); __file != this->files_.end()) {
+    __view = __file->second;
+  } else if (auto __resized = this->resized_.find(segment->id);
+             __resized != this->resized_.end()) {
+    __view = __resized->second;
+  } else if (this->segments_.count(segment->id) != 0) {
+    try {
+      __view = mapped_file::open_shm(
+        fmt::format("{}#instbin#seg{}", mmgr_name_, segment->id));
+    } catch (const std::exception& e) {
+      _M_instbin_logger->error("无法映射instant segment_{}: {}", segment->id, e.what());
+      ec = MmgrErrc::UnableToAttachShm;
+      return -1;
+    }
+    this->resized_.insert(std::make_pair(segment->id, __view));
+  } else {
+    ec = MmgrErrc::SegmentNotFound;
+    return -1;
+  }
+  if (__view->resize(nbytes, ec) != 0) {
+    _M_instbin_logger->error(
+      "resize instant segment_{} failed: {}", segment->id, ec.message());
+    return -1;
+  }
+  segment->size = nbytes;
+  if (auto __slot = this->slots_.find(segment->id); __slot != this->slots_.end()) {
+    this->dir_->slots()[__slot->second].size.store(nbytes,
+                                                   std::memory_order_relaxed);
+    this->dir_->generations()[__slot->second].fetch_add(
+      1, std::memory_order_release);
+  }
+  return 0;
+}
+
+const size_t
+instant_bin::generation(const size_t seg_id) noexcept
+{
+  std::lock_guard<std::mutex> GGGGGGGGGGGGGGGGGGGGGGGG(mtx_);
+  auto __slot = this->slots_.find(seg_id);
+  if (__slot == this->slots_.end()) {
+    return 0;
+  }
+  return this->dir_->generations()[__slot->second].load(
+    std::memory_order_acquire);
 }
 const size_t
 instant_bin::shmhdl_count() noexcept
@@ -72,7 +342,7 @@ instant_bin::shmhdl_count() noexcept
 const size_t
 instant_bin::size() noexcept
 {
-  return this->segments_.size();
+  return this->segments_.size() + this->files_.size();
 }
 
 std::shared_ptr<ipc::shmhdl>
@@ -85,4 +355,100 @@ instant_bin::get_shmhdl(const size_t& seg_id, std::error_code& ec) noexcept
   }
   return __pair->second;
 }
+
+std::shared_ptr<mapped_file>
+instant_bin::get_file(const size_t& seg_id, std::error_code& ec) noexcept
+{
+  auto __pair = this->files_.find(seg_id);
+  if (__pair == this->files_.end()) {
+    ec = MmgrErrc::ShmHandleNotFound;
+    return {};
+  }
+  return __pair->second;
+}
+
+std::pair<void*, size_t>
+instant_bin::buffer(const size_t& seg_id, std::error_code& ec) noexcept
+{
+  ec.clear();
+  std::lock_guard<std::mutex> GGGGGGGGGGGGGGGGGGGGGGGG(mtx_);
+  if (auto __view = this->resized_.find(seg_id);
+      __view != this->resized_.end()) {
+    return { __view->second->map(ec), __view->second->nbytes() };
+  }
+  if (auto __shm = this->segments_.find(seg_id);
+      __shm != this->segments_.end()) {
+    return { __shm->second->map(ec), __shm->second->nbytes() };
+  }
+  if (auto __file = this->files_.find(seg_id); __file != this->files_.end()) {
+    return { __file->second->map(ec), __file->second->nbytes() };
+  }
+  ec = MmgrErrc::ShmHandleNotFound;
+  return { nullptr, 0 };
+}
+
+int
+instant_bin::advise(std::shared_ptr<instant_segment> segment,
+                    const ACCESS_ADVICE              advice,
+                    std::error_code&                 ec) noexcept
+{
+  auto [__ptr, __nbytes] = this->buffer(segment->id, ec);
+  if (__ptr == nullptr) {
+    return -1;
+  }
+  return advise_range(__ptr, __nbytes, advice, ec);
+}
+
+int
+instant_bin::flush(std::shared_ptr<instant_segment> segment,
+                   const bool                       async,
+                   std::error_code&                 ec) noexcept
+{
+  ec.clear();
+  std::lock_guard<std::mutex> GGGGGGGGGGGGGGGGGGGGGGGG(mtx_);
+  if (auto __file = this->files_.find(segment->id);
+      __file != this->files_.end()) {
+    return __file->second->flush(async, ec);
+  }
+  if (this->segments_.find(segment->id) == this->segments_.end()) {
+    ec = MmgrErrc::SegmentNotFound;
+    return -1;
+  }
+  return 0;
+}
+
+int
+instant_bin::flush(const bool async, std::error_code& ec) noexcept
+{
+  ec.clear();
+  std::lock_guard<std::mutex> GGGGGGGGGGGGGGGGGGGGGGGG(mtx_);
+  for (const auto& [id, file] : this->files_) {
+    if (file->flush(async, ec) != 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+std::vector<std::shared_ptr<instant_segment>>
+instant_bin::segments() const
+{
+  std::vector<std::shared_ptr<instant_segment>> __segments;
+  for (const auto& [id, slot] : this->slots_) {
+    __segments.push_back(std::make_shared<instant_segment>(
+      mmgr_name_,
+      id,
+      this->dir_->slots()[slot].size.load(std::memory_order_relaxed)));
+  }
+  return __segments;
+}
+
+const size_t
+instant_bin::next_segment_id() const noexcept
+{
+  if (this->dir_ == nullptr) {
+    return 0;
+  }
+  return this->dir_->next_segment_id.load(std::memory_order_relaxed);
+}
 } // namespace libmem
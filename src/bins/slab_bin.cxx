@@ -0,0 +1,432 @@
+#include "bins/slab_bin.hpp"
+#include "ec.hpp"
+#include "segment.hpp"
+
+#include <algorithm>
+#include <unordered_map>
+
+namespace shm_kernel::memory_manager {
+
+namespace {
+std::atomic_size_t slab_bin_uid{ 0 };
+
+struct active_slabs
+{
+  std::weak_ptr<slab_bin::owner_link>       link;
+  size_t                                    generation;
+  std::array<size_t, slab_bin::CLASS_COUNT> slabs;
+};
+
+/**
+ * @brief active slabs of every bin the calling thread allocated from, handed
+ * back to the bins still alive when the thread exits
+ */
+struct thread_slabs
+{
+  std::unordered_map<size_t, active_slabs> bins;
+
+  ~thread_slabs()
+  {
+    for (const auto& [uid, active] : this->bins) {
+      if (auto __link = active.link.lock()) {
+        std::lock_guard<std::mutex> GG(__link->mtx);
+        if (__link->bin != nullptr) {
+          __link->bin->drop_owner(active.slabs, active.generation);
+        }
+      }
+    }
+  }
+};
+
+/**
+ * @brief active slab of each size class of a bin for the calling thread
+ */
+std::array<size_t, slab_bin::CLASS_COUNT>&
+local_slabs(const size_t                                 uid,
+            const std::shared_ptr<slab_bin::owner_link>& link,
+            const size_t                                 generation)
+{
+  thread_local thread_slabs __local;
+  auto                      __iter = __local.bins.find(uid);
+  if (__iter == __local.bins.end()) {
+    // drop the entries of destroyed bins before adding one
+    for (auto __it = __local.bins.begin(); __it != __local.bins.end();) {
+      __it = __it->second.link.expired() ? __local.bins.erase(__it)
+                                         : std::next(__it);
+    }
+    active_slabs __none{ link, generation, {} };
+    __none.slabs.fill(static_cast<size_t>(-1));
+    __iter = __local.bins.emplace(uid, __none).first;
+  } else if (__iter->second.generation != generation) {
+    // the bin was cleared, nothing is owned anymore
+    __iter->second.generation = generation;
+    __iter->second.slabs.fill(static_cast<size_t>(-1));
+  }
+  return __iter->second.slabs;
+}
+}
+
+slab_bin::slab_bin(const size_t                    id,
+                   std::atomic_size_t&             segment_counter,
+                   const size_t&                   slab_size,
+                   const size_t&                   slab_count,
+                   const size_t&                   base_pshift,
+                   std::shared_ptr<spdlog::logger> logger)
+  : static_bin(id, segment_counter, slab_size, slab_count, base_pshift, logger)
+  , uid_(slab_bin_uid++)
+  , words_per_slab_((slab_size / SLAB_MIN_OBJECT + 63) / 64)
+  , link_(std::make_shared<owner_link>())
+  , class_(slab_count, NO_CLASS)
+  , owned_(slab_count, false)
+  , live_(new std::atomic_size_t[slab_count]())
+  , touched_(new std::atomic_bool[slab_count]())
+  , objects_(new std::atomic<uint64_t>[slab_count * words_per_slab_]())
+{
+  if (slab_size % SLAB_MAX_OBJECT != 0) {
+    logger->critical("Slab Size 必须对齐 {} bytes.", SLAB_MAX_OBJECT);
+    throw std::invalid_argument("slab size must be aligned as " +
+                                std::to_string(SLAB_MAX_OBJECT));
+  }
+  this->link_->bin = this;
+}
+
+slab_bin::~slab_bin()
+{
+  std::lock_guard<std::mutex> GG(this->link_->mtx);
+  this->link_->bin = nullptr;
+}
+
+size_t
+slab_bin::class_of(const size_t nbytes) noexcept
+{
+  size_t __cls = 0;
+  while ((size_t(SLAB_MIN_OBJECT) << __cls) < nbytes) {
+    __cls++;
+  }
+  return __cls;
+}
+
+size_t
+slab_bin::object_size(const size_t cls) const noexcept
+{
+  return size_t(SLAB_MIN_OBJECT) << cls;
+}
+
+size_t
+slab_bin::object_count(const size_t cls) const noexcept
+{
+  return this->chunk_size() / this->object_size(cls);
+}
+
+size_t
+slab_bin::acquire(const size_t cls) noexcept
+{
+  if (!this->partial_[cls].empty()) {
+    size_t __slab = *this->partial_[cls].begin();
+    this->partial_[cls].erase(this->partial_[cls].begin());
+    this->owned_[__slab] = true;
+    return __slab;
+  }
+  auto __iter = std::find(this->chunks_.begin(), this->chunks_.end(), true);
+  if (__iter == this->chunks_.end()) {
+    return this->chunk_count();
+  }
+  size_t __slab        = std::distance(this->chunks_.begin(), __iter);
+  *__iter              = false;
+  this->class_[__slab] = cls;
+  this->owned_[__slab] = true;
+  this->chunk_left_--;
+  return __slab;
+}
+
+void
+slab_bin::retire(const size_t slab) noexcept
+{
+  auto __cls         = this->class_[slab];
+  auto __live        = this->live_[slab].load();
+  this->owned_[slab] = false;
+  if (__live == 0) {
+    // the slab is empty, give it back to every size class
+    this->partial_[__cls].erase(slab);
+    this->class_[slab]  = NO_CLASS;
+    this->chunks_[slab] = true;
+    this->chunk_left_++;
+  } else if (__live < this->object_count(__cls)) {
+    this->partial_[__cls].insert(slab);
+  }
+}
+
+size_t
+slab_bin::claim_object(const size_t slab, const size_t cls) noexcept
+{
+  auto*  __words = &this->objects_[slab * words_per_slab_];
+  size_t __count = this->object_count(cls);
+  for (size_t w = 0; w * 64 < __count; w++) {
+    auto __word = __words[w].load(std::memory_order_relaxed);
+    while (~__word != 0) {
+      size_t __obj = w * 64 + __builtin_ctzll(~__word);
+      if (__obj >= __count) {
+        break;
+      }
+      // only frees race with the owner, they clear bits
+      if (__words[w].compare_exchange_weak(__word,
+                                           __word | uint64_t(1) << (__obj % 64),
+                                           std::memory_order_acquire,
+                                           std::memory_order_relaxed)) {
+        this->live_[slab].fetch_add(1, std::memory_order_relaxed);
+        return __obj;
+      }
+    }
+  }
+  return __count;
+}
+
+bool
+slab_bin::take(const size_t slab, const size_t obj) noexcept
+{
+  auto __bit = uint64_t(1) << (obj % 64);
+  if (this->objects_[slab * words_per_slab_ + obj / 64].fetch_or(__bit) & __bit) {
+    return false;
+  }
+  this->dirty_[slab] = true;
+  if (++this->live_[slab] == this->object_count(this->class_[slab])) {
+    this->partial_[this->class_[slab]].erase(slab);
+  }
+  return true;
+}
+
+void
+slab_bin::clear_slabs() noexcept
+{
+  std::fill(this->class_.begin(), this->class_.end(), NO_CLASS);
+  std::fill(this->owned_.begin(), this->owned_.end(), false);
+  for (size_t i = 0; i < this->chunk_count(); i++) {
+    this->live_[i]    = 0;
+    this->touched_[i] = false;
+  }
+  for (size_t i = 0; i < this->chunk_count() * words_per_slab_; i++) {
+    this->objects_[i] = 0;
+  }
+  for (auto& __partial : this->partial_) {
+    __partial.clear();
+  }
+  this->generation_++;
+}
+
+std::shared_ptr<static_segment>
+slab_bin::make_segment(const size_t slab,
+                       const size_t obj,
+                       const size_t cls,
+                       const size_t nbytes,
+                       const size_t segment_id) const
+{
+  auto __seg         = std::make_shared<static_segment>();
+  __seg->addr_pshift = this->base_pshift() + slab * this->chunk_size() +
+                       obj * this->object_size(cls);
+  __seg->size        = nbytes;
+  __seg->bin_id      = this->id();
+  __seg->id          = segment_id;
+  return __seg;
+}
+
+void
+slab_bin::drop_owner(const std::array<size_t, CLASS_COUNT>& active,
+                     const size_t                           generation) noexcept
+{
+  std::lock_guard<std::mutex> GGGGGGGGGGGGGGGGGGGGGGGG(this->mtx_);
+  if (generation != this->generation_) {
+    return;
+  }
+  for (auto __slab : active) {
+    if (__slab < this->chunk_count() && this->owned_[__slab]) {
+      this->retire(__slab);
+    }
+  }
+}
+
+std::shared_ptr<static_segment>
+slab_bin::malloc(const size_t nbytes, std::error_code& ec) noexcept
+{
+  ec.clear();
+  if (nbytes > this->max_request()) {
+    ec = MmgrErrc::TooBigForStaticBin;
+    return nullptr;
+  }
+  size_t __segment_id = this->segment_counter_ref_++;
+  auto   __cls        = class_of(nbytes);
+  auto&  __active = local_slabs(this->uid_, this->link_, this->generation_)[__cls];
+
+  // no other thread claims objects in the active slab
+  if (__active < this->chunk_count()) {
+    auto __obj = this->claim_object(__active, __cls);
+    if (__obj < this->object_count(__cls)) {
+      this->touched_[__active].store(true, std::memory_order_relaxed);
+      return this->make_segment(__active, __obj, __cls, nbytes, __segment_id);
+    }
+  }
+
+  std::lock_guard<std::mutex> GGGGGGGGGGGGGGGGGGGGGGGG(this->mtx_);
+  if (__active < this->chunk_count()) {
+    this->retire(__active);
+  }
+  __active = this->acquire(__cls);
+  if (__active == this->chunk_count()) {
+    _M_statbin_logger->error("当前Slab Bin的内存不足以分配!");
+    ec = MmgrErrc::NoMemory;
+    return nullptr;
+  }
+  auto __obj             = this->claim_object(__active, __cls);
+  this->dirty_[__active] = true;
+  return this->make_segment(__active, __obj, __cls, nbytes, __segment_id);
+}
+
+int
+slab_bin::free(std::shared_ptr<static_segment> segment,
+               std::error_code&                ec) noexcept
+{
+  ec.clear();
+  if (segment == nullptr) {
+    ec = MmgrErrc::NullptrSegment;
+    return -1;
+  }
+  if (segment->bin_id != this->id()) {
+    ec = MmgrErrc::BinUnmatched;
+    return -1;
+  }
+  if (segment->addr_pshift < this->base_pshift() ||
+      segment->size > this->max_request()) {
+    ec = MmgrErrc::IllegalSegmentRange;
+    return -1;
+  }
+  auto __offset = segment->addr_pshift - this->base_pshift();
+  auto __slab   = __offset / this->chunk_size();
+  auto __cls    = class_of(segment->size);
+  if (__slab >= this->chunk_count() ||
+      (__offset % this->chunk_size()) % this->object_size(__cls) != 0) {
+    ec = MmgrErrc::IllegalSegmentRange;
+    return -1;
+  }
+  auto  __obj    = (__offset % this->chunk_size()) / this->object_size(__cls);
+  auto& __active = local_slabs(this->uid_, this->link_, this->generation_)[__cls];
+  std::lock_guard<std::mutex> GGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGG(mtx_);
+  if (this->class_[__slab] != __cls) {
+    ec = MmgrErrc::IllegalSegmentRange;
+    return -1;
+  }
+  auto __bit = uint64_t(1) << (__obj % 64);
+  if (!(this->objects_[__slab * words_per_slab_ + __obj / 64].fetch_and(~__bit) &
+        __bit)) {
+    ec = MmgrErrc::SegmentDoubleFree;
+    return -1;
+  }
+  auto __live = --this->live_[__slab];
+  if (!this->owned_[__slab]) {
+    this->retire(__slab);
+  } else if (__live == 0 && __active == __slab) {
+    // the calling thread owns it, an empty slab goes back right away
+    __active = static_cast<size_t>(-1);
+    this->retire(__slab);
+  }
+  return 0;
+}
+
+int
+slab_bin::reserve(const size_t     addr_pshift,
+                  const size_t     nbytes,
+                  std::error_code& ec) noexcept
+{
+  ec.clear();
+  if (addr_pshift < this->base_pshift() || nbytes > this->max_request()) {
+    ec = MmgrErrc::IllegalSegmentRange;
+    return -1;
+  }
+  auto __offset = addr_pshift - this->base_pshift();
+  auto __slab   = __offset / this->chunk_size();
+  auto __cls    = class_of(nbytes);
+  if (__slab >= this->chunk_count() ||
+      (__offset % this->chunk_size()) % this->object_size(__cls) != 0) {
+    ec = MmgrErrc::IllegalSegmentRange;
+    return -1;
+  }
+  auto __obj = (__offset % this->chunk_size()) / this->object_size(__cls);
+  std::lock_guard<std::mutex> GGGGGGGGGGGGGGGGGGGGGGGGGG(mtx_);
+  if (this->class_[__slab] == NO_CLASS) {
+    this->class_[__slab]  = __cls;
+    this->chunks_[__slab] = false;
+    this->chunk_left_--;
+    this->partial_[__cls].insert(__slab);
+  } else if (this->class_[__slab] != __cls) {
+    ec = MmgrErrc::IllegalSegmentRange;
+    return -1;
+  }
+  if (!this->take(__slab, __obj)) {
+    ec = MmgrErrc::IllegalSegmentRange;
+    return -1;
+  }
+  return 0;
+}
+
+int
+slab_bin::resize(std::shared_ptr<static_segment> segment,
+                 const size_t                    nbytes,
+                 std::error_code&                ec) noexcept
+{
+  ec.clear();
+  if (segment == nullptr) {
+    ec = MmgrErrc::NullptrSegment;
+    return -1;
+  }
+  if (segment->bin_id != this->id()) {
+    ec = MmgrErrc::BinUnmatched;
+    return -1;
+  }
+  if (nbytes > this->max_request() ||
+      class_of(nbytes) != class_of(segment->size)) {
+    ec = MmgrErrc::NoMemory;
+    return -1;
+  }
+  return 0;
+}
+
+void
+slab_bin::clear() noexcept
+{
+  std::lock_guard<std::mutex> GGGGGGGGGGGGGGGGGGGGGGG(mtx_);
+  std::fill(this->chunks_.begin(), this->chunks_.end(), true);
+  this->chunk_left_ = this->chunk_count();
+  this->clear_slabs();
+}
+
+void
+slab_bin::collect_dirty(std::vector<std::pair<size_t, size_t>>& ranges,
+                        const bool                              all) noexcept
+{
+  {
+    std::lock_guard<std::mutex> GGGGGGGGGGGGGGGGGGGGGGG(mtx_);
+    for (size_t i = 0; i < this->chunk_count(); i++) {
+      if (this->touched_[i].exchange(false, std::memory_order_relaxed)) {
+        this->dirty_[i] = true;
+      }
+    }
+  }
+  static_bin::collect_dirty(ranges, all);
+}
+
+size_t
+slab_bin::max_request() const noexcept
+{
+  return SLAB_MAX_OBJECT;
+}
+
+size_t
+slab_bin::slot_size() const noexcept
+{
+  return SLAB_MIN_OBJECT;
+}
+
+BIN_TYPE
+slab_bin::type() const noexcept
+{
+  return BIN_TYPE::SLAB;
+}
+}
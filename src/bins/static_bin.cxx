@@ -18,7 +18,9 @@ static_bin::static_bin(const size_t                    id,
   , base_pshift_(base_pshift)
   , chunk_size_(chunk_size)
   , chunk_count_(chunk_count)
-  , chunks_(chunk_size_, true)
+  , chunks_(chunk_count_, true)
+  , dirty_(chunk_count_, false)
+  , used_(chunk_count_, false)
   , _M_statbin_logger(logger)
 {
   logger->trace("正在初始化Static Bin...");
@@ -90,6 +92,8 @@ static_bin::malloc(const size_t nbytes, std::error_code& ec) noexcept
   auto __seg = std::make_shared<static_segment>();
   // tag chunks as false which means not available
   std::for_each(__iter, __iter + __chunkreq, [](auto&& tag) { tag = false; });
+  auto __dirty = dirty_.begin() + std::distance(chunks_.begin(), __iter);
+  std::for_each(__dirty, __dirty + __chunkreq, [](auto&& tag) { tag = true; });
   // decrease chunk_left;
   this->chunk_left_ -= __chunkreq;
 
@@ -105,6 +109,39 @@ static_bin::malloc(const size_t nbytes, std::error_code& ec) noexcept
   return __seg;
 }
 
+std::shared_ptr<static_segment>
+static_bin::malloc_aligned(const size_t     nbytes,
+                           const size_t     alignment,
+                           std::error_code& ec) noexcept
+{
+  ec.clear();
+  const size_t __slot = this->slot_size();
+  if (this->base_pshift() % alignment == 0 && __slot % alignment == 0) {
+    return this->malloc(nbytes, ec);
+  }
+  if (nbytes > this->max_request()) {
+    ec = MmgrErrc::NoMemory;
+    return nullptr;
+  }
+  const size_t __end = this->base_pshift() + this->chunk_size() * this->chunk_count();
+  for (size_t __pshift = this->base_pshift(); __pshift + nbytes <= __end;
+       __pshift += __slot) {
+    if (__pshift % alignment != 0 || this->reserve(__pshift, nbytes, ec) != 0) {
+      continue;
+    }
+    this->mark_dirty(__pshift, nbytes);
+    auto __seg         = std::make_shared<static_segment>();
+    __seg->addr_pshift = __pshift;
+    __seg->size        = nbytes;
+    __seg->bin_id      = this->id();
+    __seg->id          = this->segment_counter_ref_++;
+    __seg->alignment   = alignment;
+    return __seg;
+  }
+  ec = MmgrErrc::NoMemory;
+  return nullptr;
+}
+
 int
 static_bin::free(std::shared_ptr<static_segment> segment, std::error_code& ec) noexcept
 {
@@ -157,6 +194,88 @@ static_bin::free(std::shared_ptr<static_segment> segment, std::error_code& ec) n
   return 0;
 }
 
+int
+static_bin::reserve(const size_t     addr_pshift,
+                    const size_t     nbytes,
+                    std::error_code& ec) noexcept
+{
+  ec.clear();
+  if (addr_pshift < this->base_pshift() ||
+      (addr_pshift - this->base_pshift()) % this->chunk_size() != 0) {
+    ec = MmgrErrc::IllegalSegmentRange;
+    return -1;
+  }
+  auto __ptr_chunks = (addr_pshift - this->base_pshift()) / this->chunk_size();
+  auto __chunks     = this->chunk_req(nbytes);
+  if (__ptr_chunks + __chunks > this->chunk_count()) {
+    ec = MmgrErrc::IllegalSegmentRange;
+    return -1;
+  }
+  std::lock_guard<std::mutex> GGGGGGGGGGGGGGGGGGGGGGGGGG(mtx_);
+
+  auto __start_chunk = chunks_.begin() + __ptr_chunks;
+  auto __end_chunk   = __start_chunk + __chunks;
+  if (std::any_of(
+        __start_chunk, __end_chunk, [](const auto& tag) { return !tag; })) {
+    ec = MmgrErrc::IllegalSegmentRange;
+    return -1;
+  }
+  std::for_each(__start_chunk, __end_chunk, [](auto&& tag) { tag = false; });
+  chunk_left_ -= __chunks;
+  return 0;
+}
+
+int
+static_bin::resize(std::shared_ptr<static_segment> segment,
+                   const size_t                    nbytes,
+                   std::error_code&                ec) noexcept
+{
+  ec.clear();
+  if (segment == nullptr) {
+    ec = MmgrErrc::NullptrSegment;
+    return -1;
+  }
+  if (segment->bin_id != this->id()) {
+    ec = MmgrErrc::BinUnmatched;
+    return -1;
+  }
+  if (segment->addr_pshift < this->base_pshift()) {
+    ec = MmgrErrc::IllegalSegmentRange;
+    return -1;
+  }
+  auto __first = (segment->addr_pshift - this->base_pshift()) / this->chunk_size();
+  auto __old   = this->chunk_req(segment->size);
+  auto __new   = std::max<size_t>(this->chunk_req(nbytes), 1);
+  if (__new > this->max_request() / this->chunk_size() ||
+      __first + __new > this->chunk_count()) {
+    ec = MmgrErrc::NoMemory;
+    return -1;
+  }
+  // lock
+  std::lock_guard<std::mutex> GGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGG(mtx_);
+  auto __begin = this->chunks_.begin() + __first;
+  if (__new <= __old) {
+    // release the tail
+    std::for_each(
+      __begin + __new, __begin + __old, [](auto&& tag) { tag = true; });
+    this->chunk_left_ += __old - __new;
+    return 0;
+  }
+  if (std::any_of(__begin + __old, __begin + __new, [](const auto& tag) {
+        return !tag;
+      })) {
+    ec = MmgrErrc::NoMemory;
+    return -1;
+  }
+  std::for_each(
+    __begin + __old, __begin + __new, [](auto&& tag) { tag = false; });
+  auto __dirty = this->dirty_.begin() + __first;
+  std::for_each(
+    __dirty + __old, __dirty + __new, [](auto&& tag) { tag = true; });
+  this->chunk_left_ -= __new - __old;
+  return 0;
+}
+
 void
 static_bin::clear() noexcept
 {
@@ -167,6 +286,81 @@ static_bin::clear() noexcept
   this->chunk_left_ = this->chunk_count();
 }
 
+void
+static_bin::mark_dirty(const size_t addr_pshift, const size_t nbytes) noexcept
+{
+  if (addr_pshift < this->base_pshift()) {
+    return;
+  }
+  auto __first = (addr_pshift - this->base_pshift()) / this->chunk_size();
+  auto __last  = std::min(
+    this->chunk_req(addr_pshift - this->base_pshift() + nbytes),
+    this->chunk_count());
+  std::lock_guard<std::mutex> GGGGGGGGGGGGGGGGGGGGGGGGGGGGGG(mtx_);
+  for (auto i = __first; i < __last; i++) {
+    dirty_[i] = true;
+  }
+}
+
+void
+static_bin::collect_dirty(std::vector<std::pair<size_t, size_t>>& ranges,
+                          const bool all) noexcept
+{
+  std::lock_guard<std::mutex> GGGGGGGGGGGGGGGGGGGGGGGGGGGGGG(mtx_);
+  size_t i = 0;
+  while (i < this->chunk_count()) {
+    if (!dirty_[i] && !(all && !chunks_[i])) {
+      i++;
+      continue;
+    }
+    size_t __run = i;
+    while (__run < this->chunk_count() && (dirty_[__run] || (all && !chunks_[__run]))) {
+      dirty_[__run] = false;
+      __run++;
+    }
+    ranges.emplace_back(this->base_pshift() + i * this->chunk_size(),
+                        (__run - i) * this->chunk_size());
+    i = __run;
+  }
+}
+
+void
+static_bin::claim(const size_t                            addr_pshift,
+                  const size_t                            nbytes,
+                  std::vector<std::pair<size_t, size_t>>& stale) noexcept
+{
+  if (addr_pshift < this->base_pshift() || nbytes == 0) {
+    return;
+  }
+  const size_t __end   = addr_pshift + nbytes;
+  const size_t __first = (addr_pshift - this->base_pshift()) / this->chunk_size();
+  const size_t __last  = std::min(
+    this->chunk_req(__end - this->base_pshift()), this->chunk_count());
+  std::lock_guard<std::mutex> GGGGGGGGGGGGGGGGGGGGGGGGGGGGGG(mtx_);
+  for (size_t i = __first; i < __last; i++) {
+    if (used_[i]) {
+      // clipped to the range, slab chunks are shared by several objects
+      const size_t __lo =
+        std::max(addr_pshift, this->base_pshift() + i * this->chunk_size());
+      const size_t __hi =
+        std::min(__end, this->base_pshift() + (i + 1) * this->chunk_size());
+      if (!stale.empty() && stale.back().first + stale.back().second == __lo) {
+        stale.back().second += __hi - __lo;
+      } else {
+        stale.emplace_back(__lo, __hi - __lo);
+      }
+    }
+    used_[i] = true;
+  }
+}
+
+size_t
+static_bin::pristine_chunks() noexcept
+{
+  std::lock_guard<std::mutex> GGGGGGGGGGGGGGGGGGGGGGGGGGGGGG(mtx_);
+  return std::count(used_.begin(), used_.end(), false);
+}
+
 size_t
 static_bin::chunk_req(const size_t& nbytes) const noexcept
 {
@@ -174,6 +368,24 @@ static_bin::chunk_req(const size_t& nbytes) const noexcept
                                     : nbytes / chunk_size() + 1;
 }
 
+size_t
+static_bin::max_request() const noexcept
+{
+  return this->chunk_size() * 8;
+}
+
+size_t
+static_bin::slot_size() const noexcept
+{
+  return this->chunk_size();
+}
+
+BIN_TYPE
+static_bin::type() const noexcept
+{
+  return BIN_TYPE::STATIC;
+}
+
 const size_t
 static_bin::id() const noexcept
 {
@@ -199,4 +411,27 @@ static_bin::chunk_left() const noexcept
 {
   return this->chunk_left_;
 }
+
+const size_t
+static_bin::largest_free() noexcept
+{
+  std::lock_guard<std::mutex> GGGGGGGGGGGGGGGGGGGGGGG(mtx_);
+  size_t                      __max = 0, __run = 0;
+  for (const bool chunk : this->chunks_) {
+    __run = chunk ? __run + 1 : 0;
+    __max = std::max(__max, __run);
+  }
+  return __max;
+}
+
+bin_stats
+static_bin::stats() noexcept
+{
+  bin_stats __stats{ this->id_,         this->type(),
+                     this->chunk_size_, this->chunk_count_,
+                     0,                 this->largest_free() };
+  std::lock_guard<std::mutex> GG(mtx_);
+  __stats.free_chunks = this->chunk_left_;
+  return __stats;
+}
 } // namespace libmem
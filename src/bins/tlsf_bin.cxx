@@ -0,0 +1,355 @@
+#include "bins/tlsf_bin.hpp"
+#include "ec.hpp"
+#include "segment.hpp"
+
+#include <algorithm>
+
+namespace shm_kernel::memory_manager {
+
+namespace {
+inline size_t
+msb(const uint64_t v) noexcept
+{
+  return 63 - __builtin_clzll(v);
+}
+}
+
+tlsf_bin::tlsf_bin(const size_t                    id,
+                   std::atomic_size_t&             segment_counter,
+                   const size_t&                   chunk_size,
+                   const size_t&                   chunk_count,
+                   const size_t&                   base_pshift,
+                   std::shared_ptr<spdlog::logger> logger)
+  : static_bin(id, segment_counter, chunk_size, chunk_count, base_pshift, logger)
+  , len_(chunk_count, 0)
+  , next_(chunk_count, NIL)
+  , prev_(chunk_count, NIL)
+  , head_of_(chunk_count, NIL)
+{
+  this->init_free_lists();
+}
+
+void
+tlsf_bin::mapping_insert(const size_t nchunks, size_t& fl, size_t& sl) noexcept
+{
+  if (nchunks < SL_COUNT) {
+    fl = 0;
+    sl = nchunks;
+  } else {
+    auto __msb = msb(nchunks);
+    fl         = __msb - SL_LOG2 + 1;
+    sl         = (nchunks >> (__msb - SL_LOG2)) ^ SL_COUNT;
+  }
+}
+
+void
+tlsf_bin::mapping_search(const size_t nchunks, size_t& fl, size_t& sl) noexcept
+{
+  auto __round = nchunks;
+  if (nchunks >= SL_COUNT) {
+    __round += (size_t(1) << (msb(nchunks) - SL_LOG2)) - 1;
+  }
+  mapping_insert(__round, fl, sl);
+}
+
+size_t
+tlsf_bin::find_suitable(size_t& fl, size_t& sl) const noexcept
+{
+  if (fl >= FL_COUNT) {
+    return NIL;
+  }
+  uint32_t __sl_map = sl < SL_COUNT ? sl_bitmap_[fl] & (~uint32_t(0) << sl) : 0;
+  if (__sl_map == 0) {
+    uint64_t __fl_map =
+      fl + 1 < FL_COUNT ? fl_bitmap_ & (~uint64_t(0) << (fl + 1)) : 0;
+    if (__fl_map == 0) {
+      return NIL;
+    }
+    fl       = __builtin_ctzll(__fl_map);
+    __sl_map = sl_bitmap_[fl];
+  }
+  sl = __builtin_ctz(__sl_map);
+  return heads_[fl][sl];
+}
+
+void
+tlsf_bin::insert_block(const size_t chunk, const size_t nchunks) noexcept
+{
+  size_t fl, sl;
+  mapping_insert(nchunks, fl, sl);
+  this->len_[chunk]                   = nchunks;
+  this->head_of_[chunk + nchunks - 1] = chunk;
+  this->prev_[chunk]                  = NIL;
+  this->next_[chunk]                  = heads_[fl][sl];
+  if (heads_[fl][sl] != NIL) {
+    this->prev_[heads_[fl][sl]] = chunk;
+  }
+  heads_[fl][sl] = chunk;
+  fl_bitmap_ |= uint64_t(1) << fl;
+  sl_bitmap_[fl] |= uint32_t(1) << sl;
+}
+
+void
+tlsf_bin::remove_block(const size_t chunk) noexcept
+{
+  size_t fl, sl;
+  mapping_insert(this->len_[chunk], fl, sl);
+  auto __prev = this->prev_[chunk];
+  auto __next = this->next_[chunk];
+  if (__prev != NIL) {
+    this->next_[__prev] = __next;
+  } else {
+    heads_[fl][sl] = __next;
+  }
+  if (__next != NIL) {
+    this->prev_[__next] = __prev;
+  }
+  if (heads_[fl][sl] == NIL) {
+    sl_bitmap_[fl] &= ~(uint32_t(1) << sl);
+    if (sl_bitmap_[fl] == 0) {
+      fl_bitmap_ &= ~(uint64_t(1) << fl);
+    }
+  }
+}
+
+void
+tlsf_bin::carve(const size_t block, const size_t chunk, const size_t nchunks) noexcept
+{
+  auto __end = block + this->len_[block];
+  this->remove_block(block);
+  if (chunk > block) {
+    this->insert_block(block, chunk - block);
+  }
+  if (chunk + nchunks < __end) {
+    this->insert_block(chunk + nchunks, __end - chunk - nchunks);
+  }
+  std::fill(this->chunks_.begin() + chunk,
+            this->chunks_.begin() + chunk + nchunks,
+            false);
+  this->chunk_left_ -= nchunks;
+}
+
+void
+tlsf_bin::init_free_lists() noexcept
+{
+  fl_bitmap_ = 0;
+  sl_bitmap_.fill(0);
+  for (auto& __heads : heads_) {
+    __heads.fill(NIL);
+  }
+  if (this->chunk_count() > 0) {
+    this->insert_block(0, this->chunk_count());
+  }
+}
+
+std::shared_ptr<static_segment>
+tlsf_bin::malloc(const size_t nbytes, std::error_code& ec) noexcept
+{
+  ec.clear();
+  size_t __segment_id = this->segment_counter_ref_++;
+  std::lock_guard<std::mutex> GGGGGGGGGGGGGGGGGGGGGGGG(this->mtx_);
+
+  auto   __nchunks = std::max<size_t>(this->chunk_req(nbytes), 1);
+  size_t fl, sl;
+  mapping_search(__nchunks, fl, sl);
+  auto __block = this->find_suitable(fl, sl);
+  if (__block == NIL) {
+    // the rounded search skips the list nchunks itself maps to, its head
+    // may still be large enough
+    mapping_insert(__nchunks, fl, sl);
+    __block = heads_[fl][sl];
+    if (__block != NIL && this->len_[__block] < __nchunks) {
+      __block = NIL;
+    }
+  }
+  if (__block == NIL) {
+    _M_statbin_logger->error("当前TLSF Bin的内存不足以分配!");
+    ec = MmgrErrc::NoMemory;
+    return nullptr;
+  }
+  this->carve(__block, __block, __nchunks);
+  std::fill(this->dirty_.begin() + __block,
+            this->dirty_.begin() + __block + __nchunks,
+            true);
+
+  auto __seg         = std::make_shared<static_segment>();
+  __seg->addr_pshift = __block * this->chunk_size() + this->base_pshift();
+  __seg->size        = nbytes;
+  __seg->bin_id      = this->id();
+  __seg->id          = __segment_id;
+  return __seg;
+}
+
+int
+tlsf_bin::free(std::shared_ptr<static_segment> segment,
+               std::error_code&                ec) noexcept
+{
+  ec.clear();
+  if (segment == nullptr) {
+    ec = MmgrErrc::NullptrSegment;
+    return -1;
+  }
+  if (segment->bin_id != this->id()) {
+    ec = MmgrErrc::BinUnmatched;
+    return -1;
+  }
+  if (segment->addr_pshift < this->base_pshift() ||
+      (segment->addr_pshift - this->base_pshift()) % this->chunk_size() != 0) {
+    ec = MmgrErrc::IllegalSegmentRange;
+    return -1;
+  }
+  auto __chunk   = (segment->addr_pshift - this->base_pshift()) / this->chunk_size();
+  auto __nchunks = std::max<size_t>(this->chunk_req(segment->size), 1);
+  if (__chunk + __nchunks > this->chunk_count()) {
+    ec = MmgrErrc::IllegalSegmentRange;
+    return -1;
+  }
+  std::lock_guard<std::mutex> GGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGG(mtx_);
+  auto __first = this->chunks_.begin() + __chunk;
+  if (std::any_of(
+        __first, __first + __nchunks, [](const auto& tag) { return tag; })) {
+    ec = MmgrErrc::SegmentDoubleFree;
+    return -1;
+  }
+  std::fill(__first, __first + __nchunks, true);
+  this->chunk_left_ += __nchunks;
+
+  // merge with the physical neighbours
+  auto __start = __chunk;
+  auto __end   = __chunk + __nchunks;
+  if (__end < this->chunk_count() && this->chunks_[__end]) {
+    auto __next_len = this->len_[__end];
+    this->remove_block(__end);
+    __end += __next_len;
+  }
+  if (__start > 0 && this->chunks_[__start - 1]) {
+    __start = this->head_of_[__start - 1];
+    this->remove_block(__start);
+  }
+  this->insert_block(__start, __end - __start);
+  return 0;
+}
+
+int
+tlsf_bin::reserve(const size_t     addr_pshift,
+                  const size_t     nbytes,
+                  std::error_code& ec) noexcept
+{
+  ec.clear();
+  if (addr_pshift < this->base_pshift() ||
+      (addr_pshift - this->base_pshift()) % this->chunk_size() != 0) {
+    ec = MmgrErrc::IllegalSegmentRange;
+    return -1;
+  }
+  auto __chunk   = (addr_pshift - this->base_pshift()) / this->chunk_size();
+  auto __nchunks = std::max<size_t>(this->chunk_req(nbytes), 1);
+  if (__chunk + __nchunks > this->chunk_count()) {
+    ec = MmgrErrc::IllegalSegmentRange;
+    return -1;
+  }
+  std::lock_guard<std::mutex> GGGGGGGGGGGGGGGGGGGGGGGGGG(mtx_);
+  // free neighbours are always merged, so a run of free chunks is exactly
+  // one block and its last chunk carries the boundary tag
+  auto __first = this->chunks_.begin() + __chunk;
+  auto __end   = std::find(__first, this->chunks_.end(), false);
+  if (std::distance(__first, __end) < static_cast<ptrdiff_t>(__nchunks)) {
+    ec = MmgrErrc::IllegalSegmentRange;
+    return -1;
+  }
+  auto __block = this->head_of_[std::distance(this->chunks_.begin(), __end) - 1];
+  this->carve(__block, __chunk, __nchunks);
+  return 0;
+}
+
+int
+tlsf_bin::resize(std::shared_ptr<static_segment> segment,
+                 const size_t                    nbytes,
+                 std::error_code&                ec) noexcept
+{
+  ec.clear();
+  if (segment == nullptr) {
+    ec = MmgrErrc::NullptrSegment;
+    return -1;
+  }
+  if (segment->bin_id != this->id()) {
+    ec = MmgrErrc::BinUnmatched;
+    return -1;
+  }
+  if (segment->addr_pshift < this->base_pshift()) {
+    ec = MmgrErrc::IllegalSegmentRange;
+    return -1;
+  }
+  auto __chunk = (segment->addr_pshift - this->base_pshift()) / this->chunk_size();
+  auto __old   = std::max<size_t>(this->chunk_req(segment->size), 1);
+  auto __new   = std::max<size_t>(this->chunk_req(nbytes), 1);
+  if (__chunk + __old > this->chunk_count()) {
+    ec = MmgrErrc::IllegalSegmentRange;
+    return -1;
+  }
+  std::lock_guard<std::mutex> GGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGGG(mtx_);
+  auto __end = __chunk + __old;
+  if (__new < __old) {
+    // the released tail merges with a free block right after it
+    auto __tail = __chunk + __new;
+    std::fill(this->chunks_.begin() + __tail, this->chunks_.begin() + __end, true);
+    this->chunk_left_ += __old - __new;
+    if (__end < this->chunk_count() && this->chunks_[__end]) {
+      auto __next_len = this->len_[__end];
+      this->remove_block(__end);
+      __end += __next_len;
+    }
+    this->insert_block(__tail, __end - __tail);
+    return 0;
+  }
+  if (__new == __old) {
+    return 0;
+  }
+  if (__end >= this->chunk_count() || !this->chunks_[__end] ||
+      this->len_[__end] < __new - __old) {
+    ec = MmgrErrc::NoMemory;
+    return -1;
+  }
+  this->carve(__end, __end, __new - __old);
+  std::fill(this->dirty_.begin() + __end,
+            this->dirty_.begin() + __chunk + __new,
+            true);
+  return 0;
+}
+
+void
+tlsf_bin::clear() noexcept
+{
+  std::lock_guard<std::mutex> GGGGGGGGGGGGGGGGGGGGGGG(mtx_);
+  std::fill(this->chunks_.begin(), this->chunks_.end(), true);
+  this->chunk_left_ = this->chunk_count();
+  this->init_free_lists();
+}
+
+size_t
+tlsf_bin::max_request() const noexcept
+{
+  return this->chunk_count() * this->chunk_size();
+}
+
+BIN_TYPE
+tlsf_bin::type() const noexcept
+{
+  return BIN_TYPE::TLSF;
+}
+
+const size_t
+tlsf_bin::largest_free() noexcept
+{
+  std::lock_guard<std::mutex> GGGGGGGGGGGGGGGGGGGGGGG(mtx_);
+  if (fl_bitmap_ == 0) {
+    return 0;
+  }
+  auto   fl      = msb(fl_bitmap_);
+  auto   sl      = msb(sl_bitmap_[fl]);
+  size_t __max   = 0;
+  for (auto __block = heads_[fl][sl]; __block != NIL; __block = this->next_[__block]) {
+    __max = std::max(__max, this->len_[__block]);
+  }
+  return __max;
+}
+}
@@ -0,0 +1,281 @@
+#include "checkpoint.hpp"
+#include "mapped_file.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fmt/format.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace shm_kernel::memory_manager {
+
+static void
+pwrite_all(const int fd, const char* buffer, size_t nbytes, off_t offset)
+{
+  while (nbytes > 0) {
+    auto __written = ::pwrite(fd, buffer, nbytes, offset);
+    if (__written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::system_error(errno, std::generic_category(), "pwrite");
+    }
+    buffer += __written;
+    offset += __written;
+    nbytes -= __written;
+  }
+}
+
+// copy the file at src into dst from offset 0
+static void
+copy_all(const std::string& src, const int dst)
+{
+  int fd = ::open(src.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::system_error(
+      errno, std::generic_category(), fmt::format("open {}", src));
+  }
+  loff_t __in  = 0;
+  loff_t __out = 0;
+  while (true) {
+    auto __rv = ::copy_file_range(fd, &__in, dst, &__out, 1 << 30, 0);
+    if (__rv > 0) {
+      continue;
+    }
+    if (__rv == 0) {
+      ::close(fd);
+      return;
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    if (errno == EXDEV || errno == ENOSYS || errno == EINVAL) {
+      break;
+    }
+    auto __errno = errno;
+    ::close(fd);
+    throw std::system_error(__errno, std::generic_category(), "copy_file_range");
+  }
+  // no in-kernel copy between these files
+  char __buffer[64 * 1024];
+  while (true) {
+    auto __rv = ::pread(fd, __buffer, sizeof(__buffer), __in);
+    if (__rv < 0 && errno == EINTR) {
+      continue;
+    }
+    if (__rv < 0) {
+      auto __errno = errno;
+      ::close(fd);
+      throw std::system_error(__errno, std::generic_category(), "pread");
+    }
+    if (__rv == 0) {
+      break;
+    }
+    try {
+      pwrite_all(dst, __buffer, __rv, __in);
+    } catch (...) {
+      ::close(fd);
+      throw;
+    }
+    __in += __rv;
+  }
+  ::close(fd);
+}
+
+// make a rename in the directory of path durable
+static void
+sync_dir(const std::string& path)
+{
+  auto __slash = path.rfind('/');
+  auto __dir   = __slash == std::string::npos ? std::string(".")
+                 : __slash == 0               ? std::string("/")
+                                              : path.substr(0, __slash);
+  int  fd      = ::open(__dir.c_str(), O_RDONLY | O_DIRECTORY);
+  if (fd < 0) {
+    throw std::system_error(
+      errno, std::generic_category(), fmt::format("open {}", __dir));
+  }
+  if (::fsync(fd) != 0) {
+    auto __errno = errno;
+    ::close(fd);
+    throw std::system_error(__errno, std::generic_category(), "fsync");
+  }
+  ::close(fd);
+}
+
+static std::string
+manifest_path(std::string_view snapshot_dir, std::string_view mmgr_name)
+{
+  return backing_path(snapshot_dir, fmt::format("{}#manifest", mmgr_name));
+}
+
+std::string
+snapshot_path(std::string_view snapshot_dir,
+              std::string_view mmgr_name,
+              const size_t     batch_id,
+              const size_t     sequence)
+{
+  return backing_path(
+    snapshot_dir,
+    fmt::format("{}#batch{}#statbin.{}.snap", mmgr_name, batch_id, sequence));
+}
+
+size_t
+write_snapshot(const std::string&      base_path,
+               const std::string&      path,
+               const char*             base,
+               const checkpoint_delta& delta)
+{
+  auto __tmp = path + ".tmp";
+  int  fd    = ::open(__tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0666);
+  if (fd < 0) {
+    throw std::system_error(
+      errno, std::generic_category(), fmt::format("open {}", __tmp));
+  }
+  size_t __written = 0;
+  try {
+    if (!base_path.empty()) {
+      copy_all(base_path, fd);
+    }
+    if (::ftruncate(fd, delta.total_bytes) != 0) {
+      throw std::system_error(errno, std::generic_category(), "ftruncate");
+    }
+    for (const auto& [pshift, nbytes] : delta.ranges) {
+      pwrite_all(fd, base + pshift, nbytes, pshift);
+      __written += nbytes;
+    }
+    // header goes last, it only refers to chunks that are already on disk
+    pwrite_all(fd, delta.header.data(), delta.header.size(), 0);
+    if (::fdatasync(fd) != 0) {
+      throw std::system_error(errno, std::generic_category(), "fdatasync");
+    }
+  } catch (...) {
+    ::close(fd);
+    ::unlink(__tmp.c_str());
+    throw;
+  }
+  ::close(fd);
+  if (std::rename(__tmp.c_str(), path.c_str()) != 0) {
+    auto __errno = errno;
+    ::unlink(__tmp.c_str());
+    throw std::system_error(
+      __errno, std::generic_category(), fmt::format("rename {}", __tmp));
+  }
+  sync_dir(path);
+  return __written;
+}
+
+void
+prune_snapshots(std::string_view snapshot_dir,
+                std::string_view mmgr_name,
+                const size_t     sequence) noexcept
+{
+  auto __dir    = std::string(snapshot_dir.empty() ? "." : snapshot_dir);
+  auto __prefix = fmt::format("{}#batch", mmgr_name);
+  DIR* __stream = ::opendir(__dir.c_str());
+  if (__stream == nullptr) {
+    return;
+  }
+  while (auto* __entry = ::readdir(__stream)) {
+    const char* __name = __entry->d_name;
+    if (std::strncmp(__name, __prefix.data(), __prefix.size()) != 0) {
+      continue;
+    }
+    size_t __batch_id, __sequence;
+    int    __end = 0;
+    if (std::sscanf(__name + __prefix.size(),
+                    "%zu#statbin.%zu.snap%n",
+                    &__batch_id,
+                    &__sequence,
+                    &__end) == 2 &&
+        __name[__prefix.size() + __end] == '\0' && __sequence != sequence) {
+      ::unlink(backing_path(__dir, __name).c_str());
+    }
+  }
+  ::closedir(__stream);
+}
+
+void
+write_manifest(std::string_view snapshot_dir,
+               std::string_view mmgr_name,
+               const size_t     sequence,
+               const size_t     batch_count)
+{
+  auto  __path = manifest_path(snapshot_dir, mmgr_name);
+  auto  __tmp  = __path + ".tmp";
+  FILE* __file = std::fopen(__tmp.c_str(), "w");
+  if (__file == nullptr) {
+    throw std::system_error(
+      errno, std::generic_category(), fmt::format("fopen {}", __tmp));
+  }
+  fmt::print(__file, "{} {}\n", sequence, batch_count);
+  std::fflush(__file);
+  ::fdatasync(::fileno(__file));
+  std::fclose(__file);
+  if (std::rename(__tmp.c_str(), __path.c_str()) != 0) {
+    throw std::system_error(
+      errno, std::generic_category(), fmt::format("rename {}", __tmp));
+  }
+  sync_dir(__path);
+}
+
+bool
+read_manifest(std::string_view snapshot_dir,
+              std::string_view mmgr_name,
+              size_t&          sequence,
+              size_t&          batch_count) noexcept
+{
+  auto  __path = manifest_path(snapshot_dir, mmgr_name);
+  FILE* __file = std::fopen(__path.c_str(), "r");
+  if (__file == nullptr) {
+    return false;
+  }
+  int __rv = std::fscanf(__file, "%zu %zu", &sequence, &batch_count);
+  std::fclose(__file);
+  return __rv == 2;
+}
+
+size_t
+snapshot_size(const std::string& path) noexcept
+{
+  struct stat __st;
+  if (::stat(path.c_str(), &__st) != 0) {
+    return 0;
+  }
+  return static_cast<size_t>(__st.st_size);
+}
+
+int
+read_snapshot(const std::string& path,
+              void*              dst,
+              const size_t       nbytes,
+              std::error_code&   ec) noexcept
+{
+  ec.clear();
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    ec = std::error_code(errno, std::generic_category());
+    return -1;
+  }
+  size_t __read = 0;
+  auto*  __dst  = static_cast<char*>(dst);
+  while (__read < nbytes) {
+    auto __rv = ::pread(fd, __dst + __read, nbytes - __read, __read);
+    if (__rv < 0 && errno == EINTR) {
+      continue;
+    }
+    if (__rv <= 0) {
+      ec = __rv == 0 ? std::make_error_code(std::errc::io_error)
+                     : std::error_code(errno, std::generic_category());
+      ::close(fd);
+      return -1;
+    }
+    __read += __rv;
+  }
+  ::close(fd);
+  return 0;
+}
+}
@@ -54,6 +54,22 @@ MmgrErrorCategory::message(int ev) const
       return "unable to attach to a shared memory object!";
     case MmgrErrc::SegmentExist:
       return "segment already exist!";
+    case MmgrErrc::IncompatibleBatch:
+      return "batch header is missing or incompatible!";
+    case MmgrErrc::SnapshotFailed:
+      return "unable to write or load snapshot!";
+    case MmgrErrc::FrameNotFound:
+      return "frame not found!";
+    case MmgrErrc::IllegalAlignment:
+      return "illegal alignment!";
+    case MmgrErrc::CacheBudgetExceeded:
+      return "cache budget exceeded!";
+    case MmgrErrc::MemoryCeilingReached:
+      return "memory ceiling reached!";
+    case MmgrErrc::AllocTimeout:
+      return "allocation timed out!";
+    case MmgrErrc::WouldBlock:
+      return "allocation would block!";
     default:
       return "unknown error";
   }
@@ -0,0 +1,116 @@
+#include "frame.hpp"
+#include "config.hpp"
+#include "ec.hpp"
+
+namespace shm_kernel::memory_manager {
+
+namespace {
+// cursor layout, [63:40] allocation count, [39:0] offset
+constexpr size_t   OFFSET_BITS = 40;
+constexpr uint64_t OFFSET_MASK = (uint64_t(1) << OFFSET_BITS) - 1;
+constexpr uint64_t GEN_MASK    = (uint64_t(1) << frame_arena::GEN_BITS) - 1;
+constexpr uint64_t INDEX_MASK  = (uint64_t(1) << frame_arena::INDEX_BITS) - 1;
+}
+
+frame_arena::frame_arena(const size_t id, std::shared_ptr<static_segment> region)
+  : id_(id)
+  , region_(std::move(region))
+{
+  if (id >= MAX_FRAMES) {
+    throw std::invalid_argument("frame id out of range");
+  }
+  if (region_->size > OFFSET_MASK) {
+    throw std::invalid_argument("frame region too large");
+  }
+}
+
+std::shared_ptr<static_segment>
+frame_arena::allocate(const size_t nbytes, std::error_code& ec) noexcept
+{
+  ec.clear();
+  auto __aligned = (nbytes + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+  auto __cursor  = this->cursor_.load(std::memory_order_relaxed);
+  uint64_t __offset, __index;
+  do {
+    __offset = __cursor & OFFSET_MASK;
+    __index  = __cursor >> OFFSET_BITS;
+    if (__aligned > this->region_->size - __offset || __index >= MAX_ALLOCATION) {
+      ec = MmgrErrc::NoMemory;
+      return nullptr;
+    }
+  } while (!this->cursor_.compare_exchange_weak(
+    __cursor,
+    ((__index + 1) << OFFSET_BITS) | (__offset + __aligned),
+    std::memory_order_acq_rel,
+    std::memory_order_relaxed));
+
+  uint64_t __gen = this->generation_.load(std::memory_order_acquire) & GEN_MASK;
+  return std::make_shared<static_segment>(
+    this->region_->mmgr_name,
+    FRAME_ID_BIT | (uint64_t(this->id_) << (GEN_BITS + INDEX_BITS)) |
+      (__gen << INDEX_BITS) | __index,
+    nbytes,
+    this->region_->batch_id,
+    this->region_->bin_id,
+    this->region_->addr_pshift + __offset);
+}
+
+void
+frame_arena::reset() noexcept
+{
+  this->generation_.fetch_add(1, std::memory_order_acq_rel);
+  this->cursor_.store(0, std::memory_order_release);
+}
+
+bool
+frame_arena::valid(const size_t segment_id) const noexcept
+{
+  return is_frame_id(segment_id) && frame_of(segment_id) == this->id_ &&
+         ((segment_id >> INDEX_BITS) & GEN_MASK) ==
+           (this->generation_.load(std::memory_order_acquire) & GEN_MASK) &&
+         (segment_id & INDEX_MASK) <
+           (this->cursor_.load(std::memory_order_acquire) >> OFFSET_BITS);
+}
+
+bool
+frame_arena::is_frame_id(const size_t segment_id) noexcept
+{
+  return segment_id & FRAME_ID_BIT;
+}
+
+size_t
+frame_arena::frame_of(const size_t segment_id) noexcept
+{
+  return (segment_id & ~FRAME_ID_BIT) >> (GEN_BITS + INDEX_BITS);
+}
+
+const size_t
+frame_arena::id() const noexcept
+{
+  return this->id_;
+}
+
+const uint32_t
+frame_arena::generation() const noexcept
+{
+  return this->generation_.load(std::memory_order_acquire);
+}
+
+const size_t
+frame_arena::used() const noexcept
+{
+  return this->cursor_.load(std::memory_order_acquire) & OFFSET_MASK;
+}
+
+const size_t
+frame_arena::capacity() const noexcept
+{
+  return this->region_->size;
+}
+
+std::shared_ptr<static_segment>
+frame_arena::region() const noexcept
+{
+  return this->region_;
+}
+}
@@ -0,0 +1,60 @@
+#include "free_queue.hpp"
+
+#include <algorithm>
+#include <new>
+
+namespace shm_kernel::memory_manager {
+
+free_queue::~free_queue()
+{
+  auto* __node = this->head_.exchange(nullptr, std::memory_order_acquire);
+  while (__node != nullptr) {
+    auto* __next = __node->next;
+    delete __node;
+    __node = __next;
+  }
+}
+
+bool
+free_queue::push(const size_t segment_id, const SEG_TYPE type) noexcept
+{
+  auto* __node = new (std::nothrow) node{ segment_id, type, nullptr };
+  if (__node == nullptr) {
+    return false;
+  }
+  __node->next = this->head_.load(std::memory_order_relaxed);
+  while (!this->head_.compare_exchange_weak(__node->next,
+                                            __node,
+                                            std::memory_order_release,
+                                            std::memory_order_relaxed)) {
+  }
+  this->size_.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+size_t
+free_queue::take(std::vector<std::pair<size_t, SEG_TYPE>>& out)
+{
+  auto* __node = this->head_.exchange(nullptr, std::memory_order_acquire);
+  // the list is newest first
+  const size_t __first = out.size();
+  size_t       __count = 0;
+  while (__node != nullptr) {
+    out.emplace_back(__node->id, __node->type);
+    auto* __next = __node->next;
+    delete __node;
+    __node = __next;
+    __count++;
+  }
+  std::reverse(out.begin() + __first, out.end());
+  this->size_.fetch_sub(__count, std::memory_order_relaxed);
+  return __count;
+}
+
+size_t
+free_queue::size() const noexcept
+{
+  return this->size_.load(std::memory_order_relaxed);
+}
+
+}
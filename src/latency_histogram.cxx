@@ -0,0 +1,118 @@
+#include "latency_histogram.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+namespace shm_kernel::memory_manager {
+
+double
+latency_clock::nanos_per_tick() noexcept
+{
+#if defined(__x86_64__)
+  static const double __ratio = [] {
+    const auto     __start = std::chrono::steady_clock::now();
+    const uint64_t __ticks = now();
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    const std::chrono::duration<double, std::nano> __elapsed =
+      std::chrono::steady_clock::now() - __start;
+    const uint64_t __delta = now() - __ticks;
+    return __delta == 0 ? 1.0 : __elapsed.count() / __delta;
+  }();
+  return __ratio;
+#else
+  return 1.0;
+#endif
+}
+
+size_t
+latency_histogram::bucket_of(const uint64_t nanos) noexcept
+{
+  if (nanos < SUB_BUCKETS) {
+    return nanos;
+  }
+  // nanos in [2^k, 2^(k+1)), split into SUB_BUCKETS of 2^(k-4)
+  const size_t __k   = 63 - __builtin_clzll(nanos);
+  const size_t __sub = (nanos >> (__k - 4)) & (SUB_BUCKETS - 1);
+  return SUB_BUCKETS + (__k - 4) * SUB_BUCKETS + __sub;
+}
+
+uint64_t
+latency_histogram::upper_bound(const size_t bucket) noexcept
+{
+  if (bucket < SUB_BUCKETS) {
+    return bucket;
+  }
+  const size_t   __k     = 4 + (bucket - SUB_BUCKETS) / SUB_BUCKETS;
+  const size_t   __sub   = (bucket - SUB_BUCKETS) % SUB_BUCKETS;
+  const uint64_t __width = uint64_t(1) << (__k - 4);
+  return (uint64_t(1) << __k) + (__sub + 1) * __width - 1;
+}
+
+void
+latency_histogram::record(const uint64_t nanos) noexcept
+{
+  this->counts_[bucket_of(nanos)].fetch_add(1, std::memory_order_relaxed);
+  this->sum_.fetch_add(nanos, std::memory_order_relaxed);
+  auto __max = this->max_.load(std::memory_order_relaxed);
+  while (nanos > __max &&
+         !this->max_.compare_exchange_weak(__max, nanos, std::memory_order_relaxed)) {
+  }
+}
+
+uint64_t
+latency_histogram::count() const noexcept
+{
+  uint64_t __count = 0;
+  for (const auto& count : this->counts_) {
+    __count += count.load(std::memory_order_relaxed);
+  }
+  return __count;
+}
+
+uint64_t
+latency_histogram::max() const noexcept
+{
+  return this->max_.load(std::memory_order_relaxed);
+}
+
+uint64_t
+latency_histogram::percentile(const double fraction) const noexcept
+{
+  const uint64_t __count = this->count();
+  if (__count == 0) {
+    return 0;
+  }
+  const auto __rank =
+    std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(fraction * __count)));
+  uint64_t __seen = 0;
+  for (size_t b = 0; b < BUCKETS; b++) {
+    __seen += this->counts_[b].load(std::memory_order_relaxed);
+    if (__seen >= __rank) {
+      // never report past the largest sample
+      return std::min(upper_bound(b), this->max());
+    }
+  }
+  return this->max();
+}
+
+latency_summary
+latency_histogram::summary() const noexcept
+{
+  return { this->count(),          this->percentile(0.5),
+           this->percentile(0.9),  this->percentile(0.99),
+           this->percentile(0.999), this->max(),
+           this->sum_.load(std::memory_order_relaxed) };
+}
+
+void
+latency_histogram::reset() noexcept
+{
+  for (auto& count : this->counts_) {
+    count.store(0, std::memory_order_relaxed);
+  }
+  this->max_.store(0, std::memory_order_relaxed);
+  this->sum_.store(0, std::memory_order_relaxed);
+}
+
+}
@@ -0,0 +1,332 @@
+#include "mapped_file.hpp"
+
+#include <cerrno>
+#include <cstdint>
+#include <fcntl.h>
+#include <fmt/format.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace shm_kernel::memory_manager {
+
+size_t
+page_size() noexcept
+{
+  static const size_t __page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+  return __page;
+}
+
+mapped_file::mapped_file(std::string_view path, const size_t nbytes)
+  : path_(path)
+  , fd_(-1)
+  , addr_(nullptr)
+  , nbytes_(nbytes)
+  , owner_(true)
+{
+  this->fd_ = ::open(path_.c_str(), O_RDWR | O_CREAT | O_EXCL, 0666);
+  if (this->fd_ < 0) {
+    throw std::system_error(
+      errno, std::generic_category(), fmt::format("open {} failed", path_));
+  }
+  // sparse, blocks are only allocated when pages are written back
+  if (::ftruncate(this->fd_, nbytes_) != 0) {
+    int __err = errno;
+    ::close(this->fd_);
+    ::unlink(path_.c_str());
+    throw std::system_error(
+      __err, std::generic_category(), fmt::format("ftruncate {} failed", path_));
+  }
+  this->addr_ =
+    ::mmap(nullptr, nbytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (this->addr_ == MAP_FAILED) {
+    int __err = errno;
+    ::close(this->fd_);
+    ::unlink(path_.c_str());
+    throw std::system_error(
+      __err, std::generic_category(), fmt::format("mmap {} failed", path_));
+  }
+}
+
+mapped_file::mapped_file(std::string_view path)
+  : path_(path)
+  , fd_(-1)
+  , addr_(nullptr)
+  , nbytes_(0)
+  , owner_(false)
+{
+  this->fd_ = ::open(path_.c_str(), O_RDWR);
+  if (this->fd_ < 0) {
+    throw std::system_error(
+      errno, std::generic_category(), fmt::format("open {} failed", path_));
+  }
+  this->map_fd();
+}
+
+std::shared_ptr<mapped_file>
+mapped_file::open_shm(std::string_view shm_name)
+{
+  std::shared_ptr<mapped_file> __file(new mapped_file());
+  __file->path_   = std::string(shm_name);
+  __file->fd_     = -1;
+  __file->addr_   = nullptr;
+  __file->nbytes_ = 0;
+  __file->owner_  = false;
+  __file->fd_     = ::shm_open(fmt::format("/{}", shm_name).c_str(), O_RDWR, 0666);
+  if (__file->fd_ < 0) {
+    throw std::system_error(errno,
+                            std::generic_category(),
+                            fmt::format("shm_open {} failed", shm_name));
+  }
+  __file->map_fd();
+  return __file;
+}
+
+void
+mapped_file::map_fd()
+{
+  struct stat __st;
+  if (::fstat(this->fd_, &__st) != 0 || __st.st_size == 0) {
+    ::close(this->fd_);
+    this->fd_ = -1;
+    throw std::runtime_error(fmt::format("{} is empty", path_));
+  }
+  this->nbytes_ = static_cast<size_t>(__st.st_size);
+  this->addr_ =
+    ::mmap(nullptr, nbytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (this->addr_ == MAP_FAILED) {
+    int __err = errno;
+    ::close(this->fd_);
+    this->fd_   = -1;
+    this->addr_ = nullptr;
+    throw std::system_error(
+      __err, std::generic_category(), fmt::format("mmap {} failed", path_));
+  }
+}
+
+mapped_file::~mapped_file()
+{
+  if (this->addr_ != nullptr && this->addr_ != MAP_FAILED) {
+    ::munmap(this->addr_, this->nbytes_);
+  }
+  if (this->fd_ >= 0) {
+    ::close(this->fd_);
+  }
+  if (this->owner_) {
+    ::unlink(this->path_.c_str());
+  }
+}
+
+void*
+mapped_file::map(std::error_code& ec) noexcept
+{
+  ec.clear();
+  return this->addr_;
+}
+
+int
+mapped_file::advise(const ACCESS_ADVICE advice, std::error_code& ec) noexcept
+{
+  return advise_range(this->addr_, this->nbytes_, advice, ec);
+}
+
+int
+mapped_file::flush(const bool async, std::error_code& ec) noexcept
+{
+  return flush_range(this->addr_, this->nbytes_, async, ec);
+}
+
+int
+mapped_file::resize(const size_t nbytes, std::error_code& ec) noexcept
+{
+  ec.clear();
+  if (nbytes == 0) {
+    ec = std::make_error_code(std::errc::invalid_argument);
+    return -1;
+  }
+  if (::ftruncate(this->fd_, nbytes) != 0) {
+    ec = std::error_code(errno, std::generic_category());
+    return -1;
+  }
+  return this->remap(ec);
+}
+
+int
+mapped_file::remap(std::error_code& ec) noexcept
+{
+  ec.clear();
+  struct stat __st;
+  if (::fstat(this->fd_, &__st) != 0) {
+    ec = std::error_code(errno, std::generic_category());
+    return -1;
+  }
+  auto __nbytes = static_cast<size_t>(__st.st_size);
+  if (__nbytes == this->nbytes_) {
+    return 0;
+  }
+  void* __addr;
+  if (this->align_ != 0) {
+    auto* __window = this->aligned_window(__nbytes, ec);
+    if (__window == nullptr) {
+      return -1;
+    }
+    __addr = ::mremap(this->addr_,
+                      this->nbytes_,
+                      __nbytes,
+                      MREMAP_MAYMOVE | MREMAP_FIXED,
+                      __window);
+    if (__addr == MAP_FAILED) {
+      ::munmap(__window, __nbytes);
+    }
+  } else {
+    __addr = ::mremap(this->addr_, this->nbytes_, __nbytes, MREMAP_MAYMOVE);
+  }
+  if (__addr == MAP_FAILED) {
+    ec = std::error_code(errno, std::generic_category());
+    return -1;
+  }
+  this->addr_   = __addr;
+  this->nbytes_ = __nbytes;
+  return 0;
+}
+
+void*
+mapped_file::aligned_window(const size_t nbytes, std::error_code& ec) noexcept
+{
+  ec.clear();
+  // munmap wants page boundaries, the window covers whole pages
+  const size_t __page = page_size();
+  const size_t __len  = (nbytes + __page - 1) / __page * __page;
+  const size_t __span = __len + this->align_;
+  auto*        __reserved =
+    ::mmap(nullptr, __span, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (__reserved == MAP_FAILED) {
+    ec = std::error_code(errno, std::generic_category());
+    return nullptr;
+  }
+  auto __begin   = reinterpret_cast<uintptr_t>(__reserved);
+  auto __aligned = (__begin + this->align_ - 1) / this->align_ * this->align_;
+  // give back the head and the tail around the aligned window
+  if (__aligned > __begin) {
+    ::munmap(__reserved, __aligned - __begin);
+  }
+  const size_t __tail = __begin + __span - (__aligned + __len);
+  if (__tail > 0) {
+    ::munmap(reinterpret_cast<void*>(__aligned + __len), __tail);
+  }
+  return reinterpret_cast<void*>(__aligned);
+}
+
+int
+mapped_file::align(const size_t alignment, std::error_code& ec) noexcept
+{
+  ec.clear();
+  if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+    ec = std::make_error_code(std::errc::invalid_argument);
+    return -1;
+  }
+  if (alignment <= page_size()) {
+    return 0;
+  }
+  this->align_ = alignment;
+  if (reinterpret_cast<uintptr_t>(this->addr_) % alignment == 0) {
+    return 0;
+  }
+  auto* __window = this->aligned_window(this->nbytes_, ec);
+  if (__window == nullptr) {
+    return -1;
+  }
+  auto* __addr = ::mremap(this->addr_,
+                          this->nbytes_,
+                          this->nbytes_,
+                          MREMAP_MAYMOVE | MREMAP_FIXED,
+                          __window);
+  if (__addr == MAP_FAILED) {
+    ec = std::error_code(errno, std::generic_category());
+    ::munmap(__window, this->nbytes_);
+    return -1;
+  }
+  this->addr_ = __addr;
+  return 0;
+}
+
+size_t
+mapped_file::nbytes() const noexcept
+{
+  return this->nbytes_;
+}
+
+std::string_view
+mapped_file::path() const noexcept
+{
+  return this->path_;
+}
+
+int
+mapped_file::fd() const noexcept
+{
+  return this->fd_;
+}
+
+std::string
+backing_path(std::string_view backing_dir, std::string_view shm_name)
+{
+  if (!backing_dir.empty() && backing_dir.back() == '/') {
+    return fmt::format("{}{}", backing_dir, shm_name);
+  }
+  return fmt::format("{}/{}", backing_dir, shm_name);
+}
+
+int
+advise_range(void*               addr,
+             const size_t        nbytes,
+             const ACCESS_ADVICE advice,
+             std::error_code&    ec) noexcept
+{
+  ec.clear();
+  int __advice;
+  switch (advice) {
+    case ACCESS_ADVICE::SEQUENTIAL:
+      __advice = MADV_SEQUENTIAL;
+      break;
+    case ACCESS_ADVICE::RANDOM:
+      __advice = MADV_RANDOM;
+      break;
+    case ACCESS_ADVICE::WILLNEED:
+      __advice = MADV_WILLNEED;
+      break;
+    case ACCESS_ADVICE::DONTNEED:
+      __advice = MADV_DONTNEED;
+      break;
+    default:
+      __advice = MADV_NORMAL;
+  }
+  auto __begin = reinterpret_cast<uintptr_t>(addr) / page_size() * page_size();
+  auto __end   = reinterpret_cast<uintptr_t>(addr) + nbytes;
+  if (::madvise(reinterpret_cast<void*>(__begin), __end - __begin, __advice) !=
+      0) {
+    ec = std::error_code(errno, std::generic_category());
+    return -1;
+  }
+  return 0;
+}
+
+int
+flush_range(void*            addr,
+            const size_t     nbytes,
+            const bool       async,
+            std::error_code& ec) noexcept
+{
+  ec.clear();
+  auto __begin = reinterpret_cast<uintptr_t>(addr) / page_size() * page_size();
+  auto __end   = reinterpret_cast<uintptr_t>(addr) + nbytes;
+  if (::msync(reinterpret_cast<void*>(__begin),
+              __end - __begin,
+              async ? MS_ASYNC : MS_SYNC) != 0) {
+    ec = std::error_code(errno, std::generic_category());
+    return -1;
+  }
+  return 0;
+}
+}
@@ -0,0 +1,336 @@
+#include "memops.hpp"
+#include "config.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MEMOPS_X86 1
+#endif
+
+namespace shm_kernel::memory_manager::memops {
+
+#ifdef MEMOPS_X86
+namespace {
+
+/**
+ * @brief copy until dst is aligned to width, return the bytes copied
+ */
+size_t
+align_head(char* dst, const char* src, const size_t n, const size_t width)
+{
+  const size_t __misalign = reinterpret_cast<uintptr_t>(dst) & (width - 1);
+  const size_t __head     = __misalign == 0 ? 0 : width - __misalign;
+  const size_t __len      = __head < n ? __head : n;
+  std::memcpy(dst, src, __len);
+  return __len;
+}
+
+__attribute__((target("sse2"))) void
+stream_sse2(void* dst, const void* src, const size_t n) noexcept
+{
+  auto*       __d = static_cast<char*>(dst);
+  const auto* __s = static_cast<const char*>(src);
+  size_t      __i = align_head(__d, __s, n, 16);
+  // 64 bytes per iteration, a cache line
+  for (; __i + 64 <= n; __i += 64) {
+    const __m128i __a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(__s + __i));
+    const __m128i __b =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(__s + __i + 16));
+    const __m128i __c =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(__s + __i + 32));
+    const __m128i __e =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(__s + __i + 48));
+    _mm_stream_si128(reinterpret_cast<__m128i*>(__d + __i), __a);
+    _mm_stream_si128(reinterpret_cast<__m128i*>(__d + __i + 16), __b);
+    _mm_stream_si128(reinterpret_cast<__m128i*>(__d + __i + 32), __c);
+    _mm_stream_si128(reinterpret_cast<__m128i*>(__d + __i + 48), __e);
+  }
+  _mm_sfence();
+  std::memcpy(__d + __i, __s + __i, n - __i);
+}
+
+__attribute__((target("avx2"))) void
+stream_avx2(void* dst, const void* src, const size_t n) noexcept
+{
+  auto*       __d = static_cast<char*>(dst);
+  const auto* __s = static_cast<const char*>(src);
+  size_t      __i = align_head(__d, __s, n, 32);
+  // 128 bytes per iteration, two cache lines
+  for (; __i + 128 <= n; __i += 128) {
+    const __m256i __a =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(__s + __i));
+    const __m256i __b =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(__s + __i + 32));
+    const __m256i __c =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(__s + __i + 64));
+    const __m256i __e =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(__s + __i + 96));
+    _mm256_stream_si256(reinterpret_cast<__m256i*>(__d + __i), __a);
+    _mm256_stream_si256(reinterpret_cast<__m256i*>(__d + __i + 32), __b);
+    _mm256_stream_si256(reinterpret_cast<__m256i*>(__d + __i + 64), __c);
+    _mm256_stream_si256(reinterpret_cast<__m256i*>(__d + __i + 96), __e);
+  }
+  _mm_sfence();
+  _mm256_zeroupper();
+  std::memcpy(__d + __i, __s + __i, n - __i);
+}
+
+__attribute__((target("sse2"))) void
+zero_sse2(void* dst, const size_t n) noexcept
+{
+  auto*         __d = static_cast<char*>(dst);
+  size_t        __i = (16 - (reinterpret_cast<uintptr_t>(__d) & 15)) & 15;
+  const __m128i __z = _mm_setzero_si128();
+  __i               = __i < n ? __i : n;
+  std::memset(__d, 0, __i);
+  for (; __i + 64 <= n; __i += 64) {
+    _mm_stream_si128(reinterpret_cast<__m128i*>(__d + __i), __z);
+    _mm_stream_si128(reinterpret_cast<__m128i*>(__d + __i + 16), __z);
+    _mm_stream_si128(reinterpret_cast<__m128i*>(__d + __i + 32), __z);
+    _mm_stream_si128(reinterpret_cast<__m128i*>(__d + __i + 48), __z);
+  }
+  _mm_sfence();
+  std::memset(__d + __i, 0, n - __i);
+}
+
+__attribute__((target("avx2"))) void
+zero_avx2(void* dst, const size_t n) noexcept
+{
+  auto*         __d = static_cast<char*>(dst);
+  size_t        __i = (32 - (reinterpret_cast<uintptr_t>(__d) & 31)) & 31;
+  const __m256i __z = _mm256_setzero_si256();
+  __i               = __i < n ? __i : n;
+  std::memset(__d, 0, __i);
+  for (; __i + 128 <= n; __i += 128) {
+    _mm256_stream_si256(reinterpret_cast<__m256i*>(__d + __i), __z);
+    _mm256_stream_si256(reinterpret_cast<__m256i*>(__d + __i + 32), __z);
+    _mm256_stream_si256(reinterpret_cast<__m256i*>(__d + __i + 64), __z);
+    _mm256_stream_si256(reinterpret_cast<__m256i*>(__d + __i + 96), __z);
+  }
+  _mm_sfence();
+  _mm256_zeroupper();
+  std::memset(__d + __i, 0, n - __i);
+}
+
+}
+#endif
+
+COPY_KERNEL
+stream_kernel() noexcept
+{
+#ifdef MEMOPS_X86
+  static const COPY_KERNEL __kernel = [] {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+      return COPY_KERNEL::AVX2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+      return COPY_KERNEL::SSE2;
+    }
+    return COPY_KERNEL::LIBC;
+  }();
+  return __kernel;
+#else
+  return COPY_KERNEL::LIBC;
+#endif
+}
+
+const char*
+kernel_name(const COPY_KERNEL kernel) noexcept
+{
+  switch (kernel) {
+    case COPY_KERNEL::SSE2:
+      return "sse2";
+    case COPY_KERNEL::AVX2:
+      return "avx2";
+    default:
+      return "libc";
+  }
+}
+
+void
+copy_with(const COPY_KERNEL kernel,
+          void*             dst,
+          const void*       src,
+          const size_t      n) noexcept
+{
+#ifdef MEMOPS_X86
+  const auto __best = stream_kernel();
+  if (kernel == COPY_KERNEL::AVX2 && __best == COPY_KERNEL::AVX2) {
+    stream_avx2(dst, src, n);
+    return;
+  }
+  if (kernel != COPY_KERNEL::LIBC && __best != COPY_KERNEL::LIBC) {
+    stream_sse2(dst, src, n);
+    return;
+  }
+#endif
+  std::memcpy(dst, src, n);
+}
+
+void
+stream_copy(void* dst, const void* src, const size_t n) noexcept
+{
+  copy_with(stream_kernel(), dst, src, n);
+}
+
+void
+copy(void* dst, const void* src, const size_t n) noexcept
+{
+  // below the threshold the destination likely stays hot, libc's memcpy
+  // already picks rep movsb / wide vector loops
+  if (n < NT_COPY_THRESHOLD) {
+    std::memcpy(dst, src, n);
+    return;
+  }
+  stream_copy(dst, src, n);
+}
+
+void
+zero(void* dst, const size_t n) noexcept
+{
+  if (n < NT_COPY_THRESHOLD) {
+    std::memset(dst, 0, n);
+    return;
+  }
+#ifdef MEMOPS_X86
+  switch (stream_kernel()) {
+    case COPY_KERNEL::AVX2:
+      zero_avx2(dst, n);
+      return;
+    case COPY_KERNEL::SSE2:
+      zero_sse2(dst, n);
+      return;
+    default:
+      break;
+  }
+#endif
+  std::memset(dst, 0, n);
+}
+
+stripe_pool::stripe_pool(const size_t threads)
+{
+  const size_t __hw = std::max(1u, std::thread::hardware_concurrency());
+  const size_t __n  = threads == 0 ? __hw : threads;
+  for (size_t i = 1; i < __n; i++) {
+    this->workers_.emplace_back(&stripe_pool::work, this, i);
+#ifdef __linux__
+    // best effort, keeps a stripe's pages on one node across calls
+    cpu_set_t __cpus;
+    CPU_ZERO(&__cpus);
+    CPU_SET(i % __hw, &__cpus);
+    pthread_setaffinity_np(
+      this->workers_.back().native_handle(), sizeof(__cpus), &__cpus);
+#endif
+  }
+}
+
+stripe_pool::~stripe_pool()
+{
+  {
+    std::lock_guard<std::mutex> GG(this->mtx_);
+    this->stop_ = true;
+  }
+  this->start_cv_.notify_all();
+  for (auto& worker : this->workers_) {
+    worker.join();
+  }
+}
+
+size_t
+stripe_pool::threads() const noexcept
+{
+  return this->workers_.size() + 1;
+}
+
+void
+stripe_pool::work(const size_t index)
+{
+  size_t __seen = 0;
+  while (true) {
+    std::pair<size_t, size_t> __stripe;
+    const stripe_job*         __job;
+    {
+      std::unique_lock<std::mutex> GG(this->mtx_);
+      this->start_cv_.wait(
+        GG, [&] { return this->stop_ || this->generation_ != __seen; });
+      if (this->stop_) {
+        return;
+      }
+      __seen = this->generation_;
+      if (index >= this->stripes_.size()) {
+        continue;
+      }
+      __stripe = this->stripes_[index];
+      __job    = this->job_;
+    }
+    (*__job)(__stripe.first, __stripe.second);
+    std::lock_guard<std::mutex> GG(this->mtx_);
+    if (--this->pending_ == 0) {
+      this->done_cv_.notify_one();
+    }
+  }
+}
+
+void
+stripe_pool::run(const char* dst, const size_t n, const stripe_job& job)
+{
+  static const size_t __page = ::sysconf(_SC_PAGESIZE);
+  const size_t __ways =
+    std::max<size_t>(1, std::min(this->threads(), n / PARALLEL_STRIPE_MIN));
+  if (__ways == 1) {
+    job(0, n);
+    return;
+  }
+  std::lock_guard<std::mutex> GGGGGGGGGGGG(this->run_mtx_);
+  // stripe boundaries on pages of dst, so no page is shared by two workers
+  const size_t __head = reinterpret_cast<uintptr_t>(dst) & (__page - 1);
+  const size_t __step = (n / __ways + __page - 1) / __page * __page;
+  std::vector<std::pair<size_t, size_t>> __stripes;
+  size_t __begin = 0;
+  for (size_t i = 0; i < __ways && __begin < n; i++) {
+    size_t __end = i + 1 == __ways ? n : (i + 1) * __step - __head;
+    __end        = std::min(__end, n);
+    __stripes.emplace_back(__begin, __end);
+    __begin = __end;
+  }
+  {
+    std::lock_guard<std::mutex> GG(this->mtx_);
+    this->stripes_ = __stripes;
+    this->job_     = &job;
+    this->pending_ = __stripes.size() - 1;
+    this->generation_++;
+  }
+  this->start_cv_.notify_all();
+  job(__stripes[0].first, __stripes[0].second);
+  std::unique_lock<std::mutex> GG(this->mtx_);
+  this->done_cv_.wait(GG, [&] { return this->pending_ == 0; });
+  this->job_ = nullptr;
+}
+
+void
+stripe_pool::copy(void* dst, const void* src, const size_t n)
+{
+  auto*       __d = static_cast<char*>(dst);
+  const auto* __s = static_cast<const char*>(src);
+  this->run(__d, n, [&](const size_t begin, const size_t end) {
+    memops::copy(__d + begin, __s + begin, end - begin);
+  });
+}
+
+void
+stripe_pool::fill(void* dst, const int value, const size_t n)
+{
+  auto* __d = static_cast<char*>(dst);
+  this->run(__d, n, [&](const size_t begin, const size_t end) {
+    std::memset(__d + begin, value, end - begin);
+  });
+}
+
+}
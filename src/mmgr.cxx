@@ -3,10 +3,15 @@
 #include "bins/instant_bin.hpp"
 #include "ec.hpp"
 #include "except.hpp"
+#include "memops.hpp"
 #include "segment.hpp"
+#include "shm_keeper.hpp"
+#include <algorithm>
+#include <list>
 #include <memory>
 #include <mutex>
 #include <spdlog/spdlog.h>
+#include <tuple>
 #include <utility>
 
 namespace shm_kernel::memory_manager {
@@ -25,22 +30,82 @@ mmgr::mmgr(const std::string&              name,
            const std::vector<size_t>&      batch_bin_size,
            const std::vector<size_t>&      batch_bin_count,
            std::shared_ptr<spdlog::logger> logger)
+  : mmgr(name, batch_bin_size, batch_bin_count, mmgr_options{}, logger)
+{}
+
+mmgr::mmgr(const std::string&              name,
+           const std::vector<size_t>&      batch_bin_size,
+           const std::vector<size_t>&      batch_bin_count,
+           const mmgr_options&             options,
+           std::shared_ptr<spdlog::logger> logger)
   : name_(name)
   , batch_bin_count_(batch_bin_count)
   , batch_bin_size_(batch_bin_size)
+  , options_(options)
   , _M_mmgr_logger(logger)
+  , checkpoint_mtx_(std::make_shared<std::mutex>())
+  , checkpoint_seq_(std::make_shared<std::atomic_size_t>(0))
 {
   _M_mmgr_logger->trace("正在初始化Memory Manager...");
+  this->op_counters_.time_ops(this->options_.latency_histograms);
   this->PRE_CHECK();
+  // objects kept by a previous warm_restart mmgr of the name are either
+  // reattached below or in the way of fresh ones
+  if (!this->options_.warm_restart) {
+    release_kept_shm(this->name());
+  }
   this->init_INSTANT_BIN();
   this->init_CACHE_BIN();
-  this->add_BATCH();
+  this->init_FORWARD();
+  if (!this->warm_RESTART() && !this->restore_SNAPSHOT()) {
+    this->add_BATCH();
+  }
+  if (this->options_.warm_restart) {
+    release_kept_shm(this->name());
+  }
+  if (this->options_.deferred_free) {
+    this->reclaimer_ = std::thread(&mmgr::reclaimer_LOOP, this);
+  }
   _M_mmgr_logger->trace("Memory Manager 初始化完毕!");
 }
 
 mmgr::~mmgr()
 {
   _M_mmgr_logger->trace("正在清理shm_kernel::memory_manager::mmgr...");
+  if (this->checkpointer_.joinable()) {
+    {
+      std::lock_guard<std::mutex> GG(this->checkpointer_mtx_);
+      this->checkpointer_stop_ = true;
+    }
+    this->checkpointer_cv_.notify_one();
+    this->checkpointer_.join();
+  }
+  if (this->async_worker_.joinable()) {
+    {
+      std::lock_guard<std::mutex> GG(this->async_mtx_);
+      this->async_stop_ = true;
+    }
+    this->async_cv_.notify_one();
+    this->async_worker_.join();
+  }
+  if (this->reclaimer_.joinable()) {
+    {
+      std::lock_guard<std::mutex> GG(this->reclaimer_mtx_);
+      this->reclaimer_stop_ = true;
+    }
+    this->reclaimer_cv_.notify_one();
+    this->reclaimer_.join();
+  }
+  this->RECLAIM();
+  if (this->options_.warm_restart) {
+    // the next mmgr of the name reattaches them, see keep_shm
+    for (const auto& batch : this->batches_) {
+      batch->keep();
+    }
+    this->instant_bin_->keep();
+    keep_shm(this->name(),
+             std::shared_ptr<ipc::shmhdl>(std::move(this->forward_handle_)));
+  }
 
   _M_mmgr_logger->trace("shm_kernel::memory_manager::mmgr清理完毕!");
 }
@@ -48,28 +113,443 @@ mmgr::~mmgr()
 void
 mmgr::init_INSTANT_BIN()
 {
-  this->instant_bin_ = std::make_shared<instant_bin>(
-    this->segment_counter_, this->name(), this->_M_mmgr_logger);
+  this->instant_bin_ = std::make_shared<instant_bin>(this->segment_counter_,
+                                                     this->name(),
+                                                     options_.warm_restart,
+                                                     options_.backing_dir,
+                                                     this->_M_mmgr_logger);
 }
 
 void
 mmgr::init_CACHE_BIN()
 {
-  this->cache_bin_ =
-    std::make_shared<cache_bin>(segment_counter_, name(), this->_M_mmgr_logger);
+  this->cache_bin_ = std::make_shared<cache_bin>(segment_counter_,
+                                                 name(),
+                                                 options_.cache_budget,
+                                                 options_.cache_policy,
+                                                 options_.cache_shards,
+                                                 options_.shared_cache,
+                                                 this->_M_mmgr_logger);
+  // evicted segments leave the table, CACHE_RETRIEVE reports them missing
+  this->cache_bin_->set_evict_callback([this](size_t id, size_t size) {
+    {
+      std::lock_guard<std::shared_mutex> GG(this->table_mtx_);
+      this->segment_table_.erase(id);
+    }
+    if (this->on_cache_evict_) {
+      this->on_cache_evict_(id, size);
+    }
+  });
+}
+
+int
+mmgr::register_CACHE(std::shared_ptr<cache_segment> segment,
+                     std::error_code&               ec) noexcept
+{
+  std::lock_guard<std::shared_mutex> GG(this->table_mtx_);
+  // another thread's store may already have evicted it, its callback found
+  // nothing to erase
+  if (!this->cache_bin_->contains(segment->id)) {
+    ec = MmgrErrc::CacheBudgetExceeded;
+    return -1;
+  }
+  if (!this->segment_table_.insert(std::make_pair(segment->id, segment))
+         .second) {
+    _M_mmgr_logger->error("无法将Segment添加进Table!");
+    this->cache_bin_->free(segment, ec);
+    ec = MmgrErrc::UnableToRegisterSegment;
+    return -1;
+  }
+  return 0;
+}
+
+std::shared_ptr<cache_segment>
+mmgr::find_CACHE(const size_t segment_id, std::error_code& ec) noexcept
+{
+  ec.clear();
+  std::shared_lock<std::shared_mutex> GG(this->table_mtx_);
+  auto __iter = this->segment_table_.find(segment_id);
+  if (__iter == this->segment_table_.end()) {
+    ec = MmgrErrc::SegmentNotFound;
+    _M_mmgr_logger->error("没有找到Segment_{}", segment_id);
+    return nullptr;
+  }
+  auto __seg = std::dynamic_pointer_cast<cache_segment>(__iter->second);
+  if (__seg == nullptr) {
+    _M_mmgr_logger->error("无法将Segment_{}转换为 cache_segment!", segment_id);
+    ec = MmgrErrc::SegmentTypeUnmatched;
+  }
+  return __seg;
+}
+
+void
+mmgr::init_FORWARD()
+{
+  auto __name  = fmt::format("{}#forward", name());
+  auto __bytes = forward_header::bytes(FORWARD_CAPACITY);
+  try {
+    if (options_.warm_restart) {
+      try {
+        this->forward_handle_ = std::make_unique<ipc::shmhdl>(__name);
+      } catch (...) {
+      }
+    }
+    if (this->forward_handle_ == nullptr) {
+      this->forward_handle_ = std::make_unique<ipc::shmhdl>(__name, __bytes);
+    }
+  } catch (const std::exception& e) {
+    // not fatal, COMPACT is just unavailable
+    _M_mmgr_logger->warn("无法创建{}, COMPACT is disabled. {}", __name, e.what());
+    this->forward_handle_.reset();
+    return;
+  }
+  std::error_code ec;
+  auto* __fwd = static_cast<forward_header*>(this->forward_handle_->map(ec));
+  if (ec || __fwd == nullptr || this->forward_handle_->nbytes() < __bytes) {
+    _M_mmgr_logger->warn("无法映射{}, COMPACT is disabled", __name);
+    this->forward_handle_.reset();
+    return;
+  }
+  if (__fwd->magic != FORWARD_MAGIC || __fwd->version != DIRECTORY_VERSION ||
+      __fwd->capacity != FORWARD_CAPACITY) {
+    for (size_t i = 0; i < FORWARD_CAPACITY; i++) {
+      __fwd->entries()[i].seq.store(0, std::memory_order_relaxed);
+      __fwd->entries()[i].id.store(0, std::memory_order_relaxed);
+    }
+    __fwd->epoch.store(0, std::memory_order_relaxed);
+    __fwd->pins.store(0, std::memory_order_relaxed);
+    __fwd->capacity = FORWARD_CAPACITY;
+    __fwd->version  = DIRECTORY_VERSION;
+    std::atomic_thread_fence(std::memory_order_release);
+    __fwd->magic = FORWARD_MAGIC;
+  }
+  // a COMPACT of the previous run may have died halfway
+  __fwd->compacting.store(0, std::memory_order_release);
+  this->forward_ = __fwd;
+}
+
+void
+mmgr::publish_FORWARD(const static_segment& segment) noexcept
+{
+  auto& __entry = this->forward_->entries()[segment.id % this->forward_->capacity];
+  __entry.seq.fetch_add(1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  __entry.id.store(segment.id, std::memory_order_relaxed);
+  __entry.batch_id.store(segment.batch_id, std::memory_order_relaxed);
+  __entry.bin_id.store(segment.bin_id, std::memory_order_relaxed);
+  __entry.addr_pshift.store(segment.addr_pshift, std::memory_order_relaxed);
+  __entry.seq.fetch_add(1, std::memory_order_release);
+  this->forward_->epoch.fetch_add(1, std::memory_order_release);
+}
+
+bool
+mmgr::warm_RESTART()
+{
+  if (!options_.warm_restart) {
+    return false;
+  }
+  _M_mmgr_logger->trace("正在尝试重新挂载{}的Batches...", name());
+  size_t __next_id = this->instant_bin_->next_segment_id();
+  for (const auto& seg : this->instant_bin_->segments()) {
+    std::lock_guard<std::shared_mutex> GG(this->table_mtx_);
+    this->segment_table_.insert(std::make_pair(seg->id, seg));
+    this->instant_bytes_ += seg->size;
+    __next_id = std::max(__next_id, seg->id + 1);
+  }
+
+  std::error_code ec;
+  for (size_t i = 0;; i++) {
+    auto __batch = batch::reattach(this->name(),
+                                   i,
+                                   segment_counter_,
+                                   this->make_BATCH_OPTIONS(),
+                                   ec,
+                                   _M_mmgr_logger);
+    if (__batch == nullptr) {
+      break;
+    }
+    this->adopt_BATCH(std::move(__batch), __next_id);
+  }
+  this->segment_counter_ = __next_id;
+
+  if (this->batches_.empty()) {
+    _M_mmgr_logger->info("没有可以重新挂载的Batch, 将重新创建batch0");
+    return false;
+  }
+  _M_mmgr_logger->info("{} warm restart: {} batches, {} segments",
+                       name(),
+                       this->batches_.size(),
+                       this->segment_count());
+  return true;
+}
+
+batch_options
+mmgr::make_BATCH_OPTIONS() const
+{
+  batch_options __options;
+  __options.backing_dir = options_.backing_dir;
+  __options.bin_type    = options_.bin_type;
+  __options.slab_count  = options_.slab_count;
+  return __options;
+}
+
+bool
+mmgr::restore_SNAPSHOT()
+{
+  size_t __seq, __batch_count;
+  if (options_.snapshot_dir.empty() ||
+      !read_manifest(options_.snapshot_dir, name(), __seq, __batch_count)) {
+    return false;
+  }
+  _M_mmgr_logger->trace("正在从checkpoint {} 恢复{}...", __seq, name());
+  std::error_code ec;
+  size_t          __next_id = this->segment_counter_;
+  for (size_t i = 0; i < __batch_count; i++) {
+    auto __batch =
+      batch::restore(this->name(),
+                     i,
+                     segment_counter_,
+                     this->make_BATCH_OPTIONS(),
+                     snapshot_path(options_.snapshot_dir, this->name(), i, __seq),
+                     __seq,
+                     ec,
+                     _M_mmgr_logger);
+    if (__batch == nullptr) {
+      _M_mmgr_logger->error("无法恢复batch{}, 放弃checkpoint {}", i, __seq);
+      // never serve a partial restore
+      std::lock_guard<std::shared_mutex> GG(this->table_mtx_);
+      for (const auto& batch : this->batches_) {
+        for (const auto& seg : batch->segments()) {
+          this->segment_table_.erase(seg->id);
+        }
+      }
+      this->batches_.clear();
+      return false;
+    }
+    this->adopt_BATCH(std::move(__batch), __next_id);
+  }
+  this->segment_counter_ = __next_id;
+  this->checkpoint_seq_->store(__seq);
+  _M_mmgr_logger->info("{} restored from checkpoint {}: {} batches",
+                       name(),
+                       __seq,
+                       this->batches_.size());
+  return true;
+}
+
+void
+mmgr::adopt_BATCH(std::shared_ptr<batch> batch, size_t& next_id)
+{
+  for (const auto& seg : batch->segments()) {
+    std::lock_guard<std::shared_mutex> GG(this->table_mtx_);
+    this->segment_table_.insert(std::make_pair(seg->id, seg));
+    next_id = std::max(next_id, seg->id + 1);
+  }
+  next_id = std::max(next_id, batch->next_segment_id());
+  this->batches_.push_back(std::move(batch));
+}
+
+bin_layout
+mmgr::next_LAYOUT() const
+{
+  bin_layout __layout{ batch_bin_size_, batch_bin_count_ };
+  if (!options_.adaptive_layout ||
+      this->size_histogram_.samples() < options_.adaptive_min_samples) {
+    return __layout;
+  }
+  // same number of bins and bytes as configured
+  size_t __budget = 0;
+  for (size_t i = 0; i < batch_bin_size_.size(); i++) {
+    __budget += batch_bin_size_[i] * batch_bin_count_[i];
+  }
+  auto __learned =
+    this->size_histogram_.derive_layout(batch_bin_size_.size(), __budget);
+  return __learned.chunk_size.empty() ? __layout : __learned;
 }
 
 std::shared_ptr<batch>
 mmgr::add_BATCH()
 {
   std::lock_guard<std::mutex> GG(this->mtx_);
-  this->batches_.push_back(std::make_shared<batch>(this->name(),
-                                                   batches_.size(),
-                                                   segment_counter_,
-                                                   batch_bin_size_,
-                                                   batch_bin_count_,
-                                                   this->_M_mmgr_logger));
-  return this->batches_.back();
+  auto __layout = this->next_LAYOUT();
+  if (__layout.chunk_size != batch_bin_size_) {
+    _M_mmgr_logger->info("{}/batch{} uses a learned layout of {} bins",
+                         name(),
+                         batches_.size(),
+                         __layout.chunk_size.size());
+  }
+  auto __batch = std::make_shared<batch>(this->name(),
+                                        batches_.size(),
+                                        segment_counter_,
+                                        __layout.chunk_size,
+                                        __layout.chunk_count,
+                                        this->make_BATCH_OPTIONS(),
+                                        this->_M_mmgr_logger);
+  this->batches_.push_back(__batch);
+  return __batch;
+}
+
+bool
+mmgr::reserve_CEILING(const size_t nbytes) noexcept
+{
+  if (this->options_.memory_ceiling == 0) {
+    return true;
+  }
+  std::lock_guard<std::mutex> GG(this->ceiling_mtx_);
+  size_t __total = this->instant_bytes_.load() + this->ceiling_reserved_;
+  for (const auto& batch : this->batches_) {
+    __total += batch->total_bytes();
+  }
+  if (__total + nbytes > this->options_.memory_ceiling) {
+    return false;
+  }
+  this->ceiling_reserved_ += nbytes;
+  return true;
+}
+
+void
+mmgr::release_CEILING(const size_t nbytes) noexcept
+{
+  if (this->options_.memory_ceiling == 0) {
+    return;
+  }
+  std::lock_guard<std::mutex> GG(this->ceiling_mtx_);
+  this->ceiling_reserved_ -= nbytes;
+}
+
+std::chrono::steady_clock::time_point
+mmgr::deadline_AFTER(const std::chrono::nanoseconds timeout) noexcept
+{
+  const auto __now = std::chrono::steady_clock::now();
+  if (timeout >= std::chrono::steady_clock::time_point::max() - __now) {
+    return std::chrono::steady_clock::time_point::max();
+  }
+  return __now + timeout;
+}
+
+std::shared_ptr<batch>
+mmgr::grow_BATCH(std::error_code& ec)
+{
+  size_t __bytes = 0;
+  if (this->options_.memory_ceiling != 0) {
+    // the header is left out, it's a few pages at most
+    const auto __layout = this->next_LAYOUT();
+    __bytes             = this->options_.slab_count * SLAB_SIZE;
+    for (size_t i = 0; i < __layout.chunk_size.size(); i++) {
+      __bytes += __layout.chunk_size[i] * __layout.chunk_count[i];
+    }
+    if (!this->reserve_CEILING(__bytes)) {
+      _M_mmgr_logger->warn("{}已到达memory ceiling {} bytes, 无法新增Batch",
+                           name(),
+                           this->options_.memory_ceiling);
+      ec = MmgrErrc::MemoryCeilingReached;
+      return nullptr;
+    }
+  }
+  std::shared_ptr<batch> __batch;
+  try {
+    __batch = this->add_BATCH();
+  } catch (...) {
+    this->release_CEILING(__bytes);
+    throw;
+  }
+  // counted as a batch now
+  this->release_CEILING(__bytes);
+  return __batch;
+}
+
+void
+mmgr::wake_WAITERS() noexcept
+{
+  if (this->waiting_.load() == 0) {
+    return;
+  }
+  std::lock_guard<std::mutex> GG(this->wait_mtx_);
+  this->free_epoch_++;
+  for (const auto& [cls, queue] : this->waiters_) {
+    if (!queue.empty()) {
+      this->notify_WAITER(*queue.front());
+    }
+  }
+}
+
+bool
+mmgr::out_of_ROOM(const std::error_code& ec) noexcept
+{
+  return ec == MmgrErrc::MemoryCeilingReached || ec == MmgrErrc::NoMemory ||
+         ec == MmgrErrc::NoSuitableStaticBin ||
+         ec == MmgrErrc::UnableToCreateShm;
+}
+
+void
+mmgr::notify_WAITER(alloc_waiter& waiter) noexcept
+{
+  if (!waiter.parked) {
+    waiter.cv.notify_one();
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> GGG(this->async_mtx_);
+    this->async_wake_ = true;
+  }
+  this->async_cv_.notify_one();
+}
+
+void
+mmgr::leave_WAITERS(alloc_waiter& waiter, const size_t size_class) noexcept
+{
+  std::lock_guard<std::mutex> GG(this->wait_mtx_);
+  auto& __queue = this->waiters_[size_class];
+  __queue.erase(std::find(__queue.begin(), __queue.end(), &waiter));
+  this->waiting_--;
+  // the next of the class takes over, there may be room left for it
+  if (!__queue.empty()) {
+    this->free_epoch_++;
+    this->notify_WAITER(*__queue.front());
+  }
+}
+
+bool
+mmgr::wait_ALLOC(const size_t                   size_class,
+                 const std::chrono::nanoseconds timeout,
+                 const std::function<bool()>&   attempt,
+                 std::error_code&               ec) noexcept
+{
+  const auto   __deadline = deadline_AFTER(timeout);
+  alloc_waiter __self;
+  size_t       __seen;
+  bool         __first;
+  {
+    // registered before the first attempt, so a free during it is not missed
+    std::lock_guard<std::mutex> GG(this->wait_mtx_);
+    auto& __queue = this->waiters_[size_class];
+    __queue.push_back(&__self);
+    this->waiting_++;
+    __seen  = this->free_epoch_;
+    __first = __queue.front() == &__self;
+  }
+  // don't overtake the ones already waiting in the class
+  bool __done = __first && (attempt() || !out_of_ROOM(ec));
+  while (!__done) {
+    {
+      std::unique_lock<std::mutex> GG(this->wait_mtx_);
+      const bool __turn = __self.cv.wait_until(GG, __deadline, [&] {
+        return this->waiters_[size_class].front() == &__self &&
+               this->free_epoch_ != __seen;
+      });
+      if (!__turn) {
+        break;
+      }
+      __seen = this->free_epoch_;
+    }
+    __done = attempt() || !out_of_ROOM(ec);
+  }
+  this->leave_WAITERS(__self, size_class);
+  if (!__done) {
+    ec = MmgrErrc::AllocTimeout;
+    return false;
+  }
+  return !ec;
 }
 
 std::shared_ptr<cache_segment>
@@ -77,349 +557,1828 @@ mmgr::CACHE_STORE(const void*      buffer,
                     const size_t     size,
                     std::error_code& ec) noexcept
 {
+  return this->CACHE_STORE(buffer, size, 0, ec);
+}
+std::shared_ptr<cache_segment>
+mmgr::CACHE_STORE(const void* buffer, const size_t size)
+{
+  std::error_code ec;
+  auto            __seg = this->CACHE_STORE(buffer, size, ec);
+  if (ec) {
+    throw MmgrExcept(ec);
+  }
+  return __seg;
+}
+
+std::shared_ptr<cache_segment>
+mmgr::CACHE_STORE(const void*      buffer,
+                  const size_t     size,
+                  const size_t     alignment,
+                  std::error_code& ec) noexcept
+{
+  op_scope __op(this->op_counters_, MMGR_OP::CACHE_STORE, ec);
+  ec.clear();
   if (buffer == nullptr) {
     _M_mmgr_logger->error("Buffer 不能为空指针!");
+    ec = MmgrErrc::NullptrBuffer;
+    return nullptr;
+  }
+  if ((alignment & (alignment - 1)) != 0) {
+    ec = MmgrErrc::IllegalAlignment;
+    return nullptr;
+  }
+  auto __seg = this->cache_bin_->store(buffer, size, alignment, ec);
+  if (!__seg || this->register_CACHE(__seg, ec) != 0) {
+    return nullptr;
+  }
+  return __seg;
+}
+
+std::shared_ptr<cache_segment>
+mmgr::CACHE_STORE(const void* buffer, const size_t size, const size_t alignment)
+{
+  std::error_code ec;
+  auto            __seg = this->CACHE_STORE(buffer, size, alignment, ec);
+  if (ec) {
+    throw MmgrExcept(ec);
+  }
+  return __seg;
+}
+
+std::shared_ptr<cache_segment>
+mmgr::CACHE_STORE(const size_t                      size,
+                    std::function<void(void* buffer)> callback,
+                    std::error_code&                  ec) noexcept
+{
+  op_scope __op(this->op_counters_, MMGR_OP::CACHE_STORE, ec);
+  ec.clear();
+  void* __alloc_buffer;
+  auto  __seg = this->cache_bin_->malloc(size, &__alloc_buffer, ec);
+  if (ec || this->register_CACHE(__seg, ec) != 0) {
+    return nullptr;
+  }
+  callback(__alloc_buffer);
+  return __seg;
+}
+
+int
+mmgr::CACHE_SET(const size_t                      segment_id,
+                  const size_t                      size,
+                  std::function<void(void* buffer)> callback,
+                  std::error_code&                  ec) noexcept
+{
+  op_scope __op(this->op_counters_, MMGR_OP::CACHE_SET, ec);
+  ec.clear();
+  auto __seg = this->find_CACHE(segment_id, ec);
+  if (__seg == nullptr) {
+    return -1;
+  }
+  void* __new_buffer = this->cache_bin_->realloc(__seg, size, ec);
+  if (__new_buffer == nullptr) {
+    return -1;
+  }
+  callback(__new_buffer);
+  return 0;
+}
+
+int
+mmgr::CACHE_SET(const size_t     segment_id,
+                  const void*      buffer,
+                  const size_t     size,
+                  std::error_code& ec) noexcept
+{
+  op_scope __op(this->op_counters_, MMGR_OP::CACHE_SET, ec);
+  ec.clear();
+  auto __seg = this->find_CACHE(segment_id, ec);
+  if (__seg == nullptr) {
+    return -1;
+  }
+  if (this->cache_bin_->set(segment_id, buffer, size, ec) != 0) {
+    _M_mmgr_logger->error("Segment修改失败! ({}) {}", ec.value(), ec.message());
+    return -1;
+  }
+  __seg->size = size;
+  // a grown buffer may have moved to another region
+  std::tie(__seg->region_id, __seg->addr_pshift) =
+    this->cache_bin_->location(segment_id);
+  return 0;
+}
+
+int
+mmgr::CACHE_SET(const size_t segment_id,
+                  const void*  buffer,
+                  const size_t size)
+{
+  std::error_code ec;
+  this->CACHE_SET(segment_id, buffer, size, ec);
+  if (ec) {
+    throw MmgrExcept(ec);
+  }
+  return 0;
+}
+
+void*
+mmgr::CACHE_RETRIEVE(const size_t segment_id, std::error_code& ec) noexcept
+{
+  op_scope __op(this->op_counters_, MMGR_OP::CACHE_RETRIEVE, ec);
+  // ask the cache bin first, it counts the hit or miss
+  auto __buff = this->cache_bin_->retrieve(segment_id, ec);
+  if (__buff != nullptr) {
+    return __buff;
+  }
+  std::shared_lock<std::shared_mutex> GG(this->table_mtx_);
+  if (this->segment_table_.count(segment_id) == 0) {
+    ec = MmgrErrc::SegmentNotFound;
+    _M_mmgr_logger->error("没有找到Segment {}", segment_id);
     return nullptr;
   }
-  auto __seg = this->cache_bin_->store(buffer, size, ec);
-  auto __insert_rv =
-    this->segment_table_.insert(std::make_pair(__seg->id, __seg));
-  if (!__insert_rv.second) {
-    _M_mmgr_logger->error("无法将Segment添加进Table!");
-    this->cache_bin_->free(__seg, ec);
-    return nullptr;
+  _M_mmgr_logger->error("segment {} 不是一个Cache Segment!", segment_id);
+  ec = MmgrErrc::SegmentTypeUnmatched;
+  return nullptr;
+}
+void*
+mmgr::CACHE_RETRIEVE(const size_t segment_id)
+{
+  std::error_code ec;
+  void*           __ptr = this->CACHE_RETRIEVE(segment_id, ec);
+  if (ec) {
+    throw MmgrExcept(ec);
+  }
+  return __ptr;
+}
+
+int
+mmgr::CACHE_PIN(const size_t segment_id, std::error_code& ec) noexcept
+{
+  return this->cache_bin_->pin(segment_id, ec);
+}
+
+int
+mmgr::CACHE_PIN(const size_t segment_id)
+{
+  std::error_code ec;
+  this->CACHE_PIN(segment_id, ec);
+  if (ec) {
+    throw MmgrExcept(ec);
+  }
+  return 0;
+}
+
+int
+mmgr::CACHE_UNPIN(const size_t segment_id, std::error_code& ec) noexcept
+{
+  return this->cache_bin_->unpin(segment_id, ec);
+}
+
+int
+mmgr::CACHE_UNPIN(const size_t segment_id)
+{
+  std::error_code ec;
+  this->CACHE_UNPIN(segment_id, ec);
+  if (ec) {
+    throw MmgrExcept(ec);
+  }
+  return 0;
+}
+
+void
+mmgr::CACHE_ON_EVICT(cache_evict_callback callback)
+{
+  this->on_cache_evict_ = std::move(callback);
+}
+
+cache_stats
+mmgr::CACHE_STATS() noexcept
+{
+  return this->cache_bin_->stats();
+}
+std::shared_ptr<instant_segment>
+mmgr::INSTANT_ALLOC(const size_t size, std::error_code& ec) noexcept
+{
+  return this->INSTANT_ALLOC(size, 0, ec);
+}
+
+std::shared_ptr<instant_segment>
+mmgr::INSTANT_ALLOC(const size_t     size,
+                    const size_t     alignment,
+                    std::error_code& ec) noexcept
+{
+  op_scope __op(this->op_counters_, MMGR_OP::INSTANT_ALLOC, ec);
+  return this->alloc_INSTANT(size, alignment, ec);
+}
+
+std::shared_ptr<instant_segment>
+mmgr::alloc_INSTANT(const size_t     size,
+                    const size_t     alignment,
+                    std::error_code& ec) noexcept
+{
+  ec.clear();
+  if ((alignment & (alignment - 1)) != 0) {
+    ec = MmgrErrc::IllegalAlignment;
+    return nullptr;
+  }
+  if (!this->reserve_CEILING(size)) {
+    ec = MmgrErrc::MemoryCeilingReached;
+    return nullptr;
+  }
+  auto __seg = this->instant_bin_->malloc(size, alignment, ec);
+  if (__seg) {
+    this->instant_bytes_ += __seg->size;
+  }
+  this->release_CEILING(size);
+  if (!__seg) {
+    return nullptr;
+  }
+  bool __inserted;
+  {
+    std::lock_guard<std::shared_mutex> GG(this->table_mtx_);
+    __inserted =
+      this->segment_table_.insert(std::make_pair(__seg->id, __seg)).second;
+  }
+  if (!__inserted) {
+    _M_mmgr_logger->error("无法将Segment添加进Table!");
+    this->instant_bytes_ -= __seg->size;
+    this->instant_bin_->free(__seg, ec);
+    return nullptr;
+  }
+  return __seg;
+}
+std::shared_ptr<instant_segment>
+mmgr::INSTANT_ALLOC(const size_t size)
+{
+  std::error_code ec;
+  auto            __seg = this->INSTANT_ALLOC(size, ec);
+  if (ec) {
+    throw MmgrExcept(ec);
+  }
+  return __seg;
+}
+
+std::shared_ptr<instant_segment>
+mmgr::INSTANT_ALLOC(const size_t size, const size_t alignment)
+{
+  std::error_code ec;
+  auto            __seg = this->INSTANT_ALLOC(size, alignment, ec);
+  if (ec) {
+    throw MmgrExcept(ec);
+  }
+  return __seg;
+}
+
+std::shared_ptr<instant_segment>
+mmgr::INSTANT_ALLOC_WAIT(const size_t                   size,
+                         const std::chrono::nanoseconds timeout,
+                         std::error_code&               ec) noexcept
+{
+  op_scope __op(this->op_counters_, MMGR_OP::INSTANT_ALLOC_WAIT, ec);
+  ec.clear();
+  std::shared_ptr<instant_segment> __seg;
+  // instant classes after the static ones
+  const size_t __class = 128 - __builtin_clzll(size | 1);
+  this->wait_ALLOC(
+    __class,
+    timeout,
+    [&] { return (__seg = this->alloc_INSTANT(size, 0, ec)) != nullptr; },
+    ec);
+  return ec ? nullptr : __seg;
+}
+
+std::shared_ptr<instant_segment>
+mmgr::INSTANT_ALLOC_WAIT(const size_t                   size,
+                         const std::chrono::nanoseconds timeout)
+{
+  std::error_code ec;
+  auto            __seg = this->INSTANT_ALLOC_WAIT(size, timeout, ec);
+  if (ec) {
+    throw MmgrExcept(ec);
+  }
+  return __seg;
+}
+
+std::shared_ptr<static_segment>
+mmgr::STATIC_ALLOC(const size_t size, std::error_code& ec) noexcept
+{
+  return this->STATIC_ALLOC(size, 0, ec);
+}
+
+std::shared_ptr<static_segment>
+mmgr::STATIC_ALLOC(const size_t     size,
+                   const size_t     alignment,
+                   std::error_code& ec) noexcept
+{
+  op_scope __op(this->op_counters_, MMGR_OP::STATIC_ALLOC, ec);
+  return this->alloc_STATIC(size, alignment, false, true, ec);
+}
+
+std::shared_ptr<static_segment>
+mmgr::alloc_STATIC(const size_t     size,
+                   const size_t     alignment,
+                   const bool       zeroed,
+                   const bool       may_block,
+                   std::error_code& ec) noexcept
+{
+  ec.clear();
+  if ((alignment & (alignment - 1)) != 0 || alignment > page_size()) {
+    _M_mmgr_logger->error("illegal static segment alignment {}", alignment);
+    ec = MmgrErrc::IllegalAlignment;
+    return nullptr;
+  }
+  this->size_histogram_.record(size);
+  std::shared_ptr<static_segment> __seg;
+  for (const auto& batch : batches_) {
+    __seg = batch->allocate(size, alignment, zeroed, ec);
+    if (__seg) {
+      // if allocate success, break loop
+      break;
+    }
+  }
+  // draining and adding a batch are the slow path
+  if (!__seg && !may_block) {
+    ec = MmgrErrc::WouldBlock;
+    return nullptr;
+  }
+  // queued frees may make room before a new batch is needed
+  if (!__seg && this->free_queue_.size() > 0 && this->RECLAIM() > 0) {
+    for (const auto& batch : batches_) {
+      __seg = batch->allocate(size, alignment, zeroed, ec);
+      if (__seg) {
+        break;
+      }
+    }
+  }
+  // all of batches can't meet the requirement, add a new batch
+  if (!__seg) {
+    auto __new_batch = this->grow_BATCH(ec);
+    if (!__new_batch) {
+      return nullptr;
+    }
+    __seg = __new_batch->allocate(size, alignment, zeroed, ec);
+    // if still fail
+    if (!__seg) {
+      _M_mmgr_logger->error("新增的Batch也无法分配空间, 真奇怪...");
+      return nullptr;
+    }
+  }
+  __seg->alignment = alignment;
+  bool __inserted;
+  {
+    std::lock_guard<std::shared_mutex> GG(this->table_mtx_);
+    __inserted =
+      this->segment_table_.insert(std::make_pair(__seg->id, __seg)).second;
+  }
+  if (!__inserted) {
+    this->batches_[__seg->batch_id]->deallocate(__seg, ec);
+    _M_mmgr_logger->error("无法将Segment添加进Table.");
+    ec = MmgrErrc::UnableToRegisterSegment;
+    return nullptr;
+  }
+  return __seg;
+}
+
+std::shared_ptr<static_segment>
+mmgr::STATIC_ALLOC(const size_t size)
+{
+  std::error_code ec;
+  auto            __seg = this->STATIC_ALLOC(size, ec);
+  if (ec) {
+    throw MmgrExcept(ec);
+  }
+  return __seg;
+}
+
+std::shared_ptr<static_segment>
+mmgr::STATIC_ALLOC(const size_t size, const size_t alignment)
+{
+  std::error_code ec;
+  auto            __seg = this->STATIC_ALLOC(size, alignment, ec);
+  if (ec) {
+    throw MmgrExcept(ec);
+  }
+  return __seg;
+}
+
+std::shared_ptr<static_segment>
+mmgr::STATIC_ALLOC_WAIT(const size_t                   size,
+                        const std::chrono::nanoseconds timeout,
+                        std::error_code&               ec) noexcept
+{
+  op_scope __op(this->op_counters_, MMGR_OP::STATIC_ALLOC_WAIT, ec);
+  ec.clear();
+  std::shared_ptr<static_segment> __seg;
+  // a size class per power of two
+  const size_t __class = 64 - __builtin_clzll(size | 1);
+  this->wait_ALLOC(
+    __class,
+    timeout,
+    [&] {
+      return (__seg = this->alloc_STATIC(size, 0, false, true, ec)) != nullptr;
+    },
+    ec);
+  return ec ? nullptr : __seg;
+}
+
+std::shared_ptr<static_segment>
+mmgr::STATIC_ALLOC_WAIT(const size_t                   size,
+                        const std::chrono::nanoseconds timeout)
+{
+  std::error_code ec;
+  auto            __seg = this->STATIC_ALLOC_WAIT(size, timeout, ec);
+  if (ec) {
+    throw MmgrExcept(ec);
+  }
+  return __seg;
+}
+
+std::shared_ptr<static_segment>
+mmgr::TRY_STATIC_ALLOC(const size_t size, std::error_code& ec) noexcept
+{
+  op_scope __op(this->op_counters_, MMGR_OP::STATIC_ALLOC, ec);
+  return this->alloc_STATIC(size, 0, false, false, ec);
+}
+
+void
+mmgr::post_ASYNC(std::unique_ptr<async_request> request)
+{
+  std::call_once(this->async_once_, [this] {
+    this->async_worker_ = std::thread(&mmgr::async_LOOP, this);
+  });
+  {
+    std::lock_guard<std::mutex> GG(this->async_mtx_);
+    this->async_tasks_.push_back(std::move(request));
+  }
+  this->async_cv_.notify_one();
+}
+
+void
+mmgr::complete_ASYNC(std::function<void()> completion) noexcept
+{
+  async_executor __executor;
+  {
+    std::lock_guard<std::mutex> GG(this->async_mtx_);
+    __executor = this->async_executor_;
+  }
+  try {
+    if (__executor) {
+      __executor(std::move(completion));
+    } else {
+      completion();
+    }
+  } catch (const std::exception& e) {
+    _M_mmgr_logger->error("async completion抛出了异常: {}", e.what());
+  }
+}
+
+bool
+mmgr::retry_ASYNC(async_request& request) noexcept
+{
+  bool __turn;
+  {
+    std::lock_guard<std::mutex> GG(this->wait_mtx_);
+    __turn = this->waiters_[request.size_class].front() == &request.waiter &&
+             (request.fresh || this->free_epoch_ != request.seen);
+    if (__turn) {
+      request.seen  = this->free_epoch_;
+      request.fresh = false;
+    }
+  }
+  bool __done = false;
+  if (__turn) {
+    std::error_code __ec;
+    __done = request.attempt(__ec);
+    if (!__done && !out_of_ROOM(__ec)) {
+      request.fail(__ec);
+      __done = true;
+    }
+  }
+  if (!__done && std::chrono::steady_clock::now() >= request.deadline) {
+    request.fail(MmgrErrc::AllocTimeout);
+    __done = true;
+  }
+  if (__done) {
+    this->leave_WAITERS(request.waiter, request.size_class);
+  }
+  return __done;
+}
+
+void
+mmgr::async_LOOP() noexcept
+{
+  // waiting for room, in arrival order
+  std::list<std::unique_ptr<async_request>> __parked;
+  std::unique_lock<std::mutex>              GG(this->async_mtx_);
+  while (true) {
+    auto __ready = [&] {
+      return this->async_stop_ || !this->async_tasks_.empty() ||
+             this->async_wake_;
+    };
+    if (__parked.empty()) {
+      this->async_cv_.wait(GG, __ready);
+    } else {
+      auto __deadline = __parked.front()->deadline;
+      for (const auto& request : __parked) {
+        __deadline = std::min(__deadline, request->deadline);
+      }
+      this->async_cv_.wait_until(GG, __deadline, __ready);
+    }
+    // the mmgr is going away, don't keep it waiting for the timeouts
+    if (this->async_stop_) {
+      auto __posted = std::move(this->async_tasks_);
+      this->async_tasks_.clear();
+      GG.unlock();
+      const auto __canceled = std::make_error_code(std::errc::operation_canceled);
+      for (auto& request : __posted) {
+        request->fail(__canceled);
+      }
+      for (auto& request : __parked) {
+        request->fail(__canceled);
+        this->leave_WAITERS(request->waiter, request->size_class);
+      }
+      return;
+    }
+    this->async_wake_ = false;
+    auto __posted     = std::move(this->async_tasks_);
+    this->async_tasks_.clear();
+    GG.unlock();
+    for (auto& request : __posted) {
+      std::lock_guard<std::mutex> GGG(this->wait_mtx_);
+      this->waiters_[request->size_class].push_back(&request->waiter);
+      this->waiting_++;
+      __parked.push_back(std::move(request));
+    }
+    for (auto iter = __parked.begin(); iter != __parked.end();) {
+      iter = this->retry_ASYNC(**iter) ? __parked.erase(iter) : std::next(iter);
+    }
+    GG.lock();
+  }
+}
+
+bool
+mmgr::ASYNC_STATIC_ALLOC(const size_t                         size,
+                         const std::chrono::nanoseconds       timeout,
+                         std::shared_ptr<static_segment>&     segment,
+                         std::error_code&                     ec,
+                         async_alloc_callback<static_segment> callback) noexcept
+{
+  segment = this->TRY_STATIC_ALLOC(size, ec);
+  if (ec != MmgrErrc::WouldBlock) {
+    return true;
+  }
+  // segment and ec may be gone once the request is posted
+  ec.clear();
+  try {
+    auto __request           = std::make_unique<async_request>();
+    __request->waiter.parked = true;
+    // same classes as STATIC_ALLOC_WAIT
+    __request->size_class = 64 - __builtin_clzll(size | 1);
+    __request->deadline   = deadline_AFTER(timeout);
+    __request->attempt    = [this, size, callback](std::error_code& __ec) {
+      auto __seg = this->alloc_STATIC(size, 0, false, true, __ec);
+      if (__seg) {
+        this->op_counters_.record(MMGR_OP::STATIC_ALLOC, false);
+        this->complete_ASYNC([callback, __seg] { callback(__seg, {}); });
+      }
+      return __seg != nullptr;
+    };
+    __request->fail = [this, callback](std::error_code __ec) {
+      this->op_counters_.record(MMGR_OP::STATIC_ALLOC, true);
+      this->complete_ASYNC([callback, __ec] { callback(nullptr, __ec); });
+    };
+    this->post_ASYNC(std::move(__request));
+  } catch (const std::system_error& e) {
+    _M_mmgr_logger->error("无法启动async worker: {}", e.what());
+    ec = e.code();
+    return true;
+  } catch (const std::bad_alloc&) {
+    ec = MmgrErrc::NoMemory;
+    return true;
+  }
+  return false;
+}
+
+bool
+mmgr::ASYNC_INSTANT_ALLOC(const size_t                          size,
+                          const std::chrono::nanoseconds        timeout,
+                          std::shared_ptr<instant_segment>&     segment,
+                          std::error_code&                      ec,
+                          async_alloc_callback<instant_segment> callback) noexcept
+{
+  segment = nullptr;
+  ec.clear();
+  try {
+    auto __request           = std::make_unique<async_request>();
+    __request->waiter.parked = true;
+    // same classes as INSTANT_ALLOC_WAIT
+    __request->size_class = 128 - __builtin_clzll(size | 1);
+    __request->deadline   = deadline_AFTER(timeout);
+    __request->attempt    = [this, size, callback](std::error_code& __ec) {
+      auto __seg = this->alloc_INSTANT(size, 0, __ec);
+      if (__seg) {
+        this->op_counters_.record(MMGR_OP::INSTANT_ALLOC, false);
+        this->complete_ASYNC([callback, __seg] { callback(__seg, {}); });
+      }
+      return __seg != nullptr;
+    };
+    __request->fail = [this, callback](std::error_code __ec) {
+      this->op_counters_.record(MMGR_OP::INSTANT_ALLOC, true);
+      this->complete_ASYNC([callback, __ec] { callback(nullptr, __ec); });
+    };
+    this->post_ASYNC(std::move(__request));
+  } catch (const std::system_error& e) {
+    _M_mmgr_logger->error("无法启动async worker: {}", e.what());
+    ec = e.code();
+    return true;
+  } catch (const std::bad_alloc&) {
+    ec = MmgrErrc::NoMemory;
+    return true;
+  }
+  return false;
+}
+
+void
+mmgr::ASYNC_EXECUTOR(async_executor executor)
+{
+  std::lock_guard<std::mutex> GG(this->async_mtx_);
+  this->async_executor_ = std::move(executor);
+}
+
+std::shared_ptr<static_segment>
+mmgr::SMALL_ALLOC(const size_t size, std::error_code& ec) noexcept
+{
+  op_scope __op(this->op_counters_, MMGR_OP::SMALL_ALLOC, ec);
+  return this->alloc_SMALL(size, false, ec);
+}
+
+std::shared_ptr<static_segment>
+mmgr::alloc_SMALL(const size_t     size,
+                  const bool       zeroed,
+                  std::error_code& ec) noexcept
+{
+  ec.clear();
+  if (this->options_.slab_count == 0) {
+    _M_mmgr_logger->error("slab bin is disabled, set mmgr_options::slab_count");
+    ec = MmgrErrc::NoSuitableStaticBin;
+    return nullptr;
+  }
+  if (size > SLAB_MAX_OBJECT) {
+    ec = MmgrErrc::TooBigForStaticBin;
+    return nullptr;
+  }
+  std::shared_ptr<static_segment> __seg;
+  for (const auto& batch : batches_) {
+    __seg = batch->allocate_small(size, zeroed, ec);
+    if (__seg) {
+      break;
+    }
+  }
+  if (!__seg && this->free_queue_.size() > 0 && this->RECLAIM() > 0) {
+    for (const auto& batch : batches_) {
+      __seg = batch->allocate_small(size, zeroed, ec);
+      if (__seg) {
+        break;
+      }
+    }
+  }
+  if (!__seg) {
+    auto __new_batch = this->grow_BATCH(ec);
+    if (!__new_batch) {
+      return nullptr;
+    }
+    __seg = __new_batch->allocate_small(size, zeroed, ec);
+    if (!__seg) {
+      _M_mmgr_logger->error("新增的Batch也无法分配空间, 真奇怪...");
+      return nullptr;
+    }
+  }
+  bool __inserted;
+  {
+    std::lock_guard<std::shared_mutex> GG(this->table_mtx_);
+    __inserted =
+      this->segment_table_.insert(std::make_pair(__seg->id, __seg)).second;
+  }
+  if (!__inserted) {
+    this->batches_[__seg->batch_id]->deallocate(__seg, ec);
+    _M_mmgr_logger->error("无法将Segment添加进Table.");
+    ec = MmgrErrc::UnableToRegisterSegment;
+    return nullptr;
+  }
+  return __seg;
+}
+
+std::shared_ptr<static_segment>
+mmgr::SMALL_ALLOC(const size_t size)
+{
+  std::error_code ec;
+  auto            __seg = this->SMALL_ALLOC(size, ec);
+  if (ec) {
+    throw MmgrExcept(ec);
+  }
+  return __seg;
+}
+
+std::shared_ptr<static_segment>
+mmgr::STATIC_CALLOC(const size_t size, std::error_code& ec) noexcept
+{
+  return this->STATIC_CALLOC(size, 0, ec);
+}
+
+std::shared_ptr<static_segment>
+mmgr::STATIC_CALLOC(const size_t     size,
+                    const size_t     alignment,
+                    std::error_code& ec) noexcept
+{
+  op_scope __op(this->op_counters_, MMGR_OP::STATIC_ALLOC, ec);
+  return this->alloc_STATIC(size, alignment, true, true, ec);
+}
+
+std::shared_ptr<static_segment>
+mmgr::STATIC_CALLOC(const size_t size, const size_t alignment)
+{
+  std::error_code ec;
+  auto            __seg = this->STATIC_CALLOC(size, alignment, ec);
+  if (ec) {
+    throw MmgrExcept(ec);
+  }
+  return __seg;
+}
+
+std::shared_ptr<static_segment>
+mmgr::SMALL_CALLOC(const size_t size, std::error_code& ec) noexcept
+{
+  op_scope __op(this->op_counters_, MMGR_OP::SMALL_ALLOC, ec);
+  return this->alloc_SMALL(size, true, ec);
+}
+
+std::shared_ptr<static_segment>
+mmgr::SMALL_CALLOC(const size_t size)
+{
+  std::error_code ec;
+  auto            __seg = this->SMALL_CALLOC(size, ec);
+  if (ec) {
+    throw MmgrExcept(ec);
+  }
+  return __seg;
+}
+
+std::shared_ptr<instant_segment>
+mmgr::INSTANT_CALLOC(const size_t size, std::error_code& ec) noexcept
+{
+  // every instant segment is a new shm object or file, zero filled by
+  // ftruncate
+  return this->INSTANT_ALLOC(size, 0, ec);
+}
+
+std::shared_ptr<instant_segment>
+mmgr::INSTANT_CALLOC(const size_t size)
+{
+  std::error_code ec;
+  auto            __seg = this->INSTANT_CALLOC(size, ec);
+  if (ec) {
+    throw MmgrExcept(ec);
+  }
+  return __seg;
+}
+
+size_t
+mmgr::FRAME_CREATE(const size_t capacity, std::error_code& ec) noexcept
+{
+  op_scope __op(this->op_counters_, MMGR_OP::FRAME_CREATE, ec);
+  ec.clear();
+  {
+    std::shared_lock<std::shared_mutex> GG(this->frame_mtx_);
+    if (this->frames_.size() >= frame_arena::MAX_FRAMES) {
+      _M_mmgr_logger->error("Frame数量已达上限 {}", frame_arena::MAX_FRAMES);
+      ec = MmgrErrc::NoMemory;
+      return static_cast<size_t>(-1);
+    }
+  }
+  auto __region = this->alloc_STATIC(capacity, 0, false, true, ec);
+  if (!__region) {
+    return static_cast<size_t>(-1);
+  }
+  std::unique_lock<std::shared_mutex> GG(this->frame_mtx_);
+  // another FRAME_CREATE took the last id meanwhile
+  if (this->frames_.size() >= frame_arena::MAX_FRAMES) {
+    GG.unlock();
+    _M_mmgr_logger->error("Frame数量已达上限 {}", frame_arena::MAX_FRAMES);
+    this->dealloc_STATIC(__region->id, ec);
+    ec = MmgrErrc::NoMemory;
+    return static_cast<size_t>(-1);
+  }
+  // frame ids are recycled once the counter wraps
+  size_t __id;
+  do {
+    __id = this->next_frame_id_++ % frame_arena::MAX_FRAMES;
+  } while (this->frames_.count(__id) != 0);
+  this->frames_.emplace(__id, std::make_shared<frame_arena>(__id, __region));
+  return __id;
+}
+
+size_t
+mmgr::FRAME_CREATE(const size_t capacity)
+{
+  std::error_code ec;
+  auto            __id = this->FRAME_CREATE(capacity, ec);
+  if (ec) {
+    throw MmgrExcept(ec);
+  }
+  return __id;
+}
+
+std::shared_ptr<static_segment>
+mmgr::FRAME_ALLOC(const size_t     frame_id,
+                  const size_t     size,
+                  std::error_code& ec) noexcept
+{
+  op_scope __op(this->op_counters_, MMGR_OP::FRAME_ALLOC, ec);
+  ec.clear();
+  auto __frame = this->find_FRAME(frame_id);
+  if (__frame == nullptr) {
+    ec = MmgrErrc::FrameNotFound;
+    return nullptr;
+  }
+  return __frame->allocate(size, ec);
+}
+
+std::shared_ptr<static_segment>
+mmgr::FRAME_ALLOC(const size_t frame_id, const size_t size)
+{
+  std::error_code ec;
+  auto            __seg = this->FRAME_ALLOC(frame_id, size, ec);
+  if (ec) {
+    throw MmgrExcept(ec);
+  }
+  return __seg;
+}
+
+int
+mmgr::FRAME_RESET(const size_t frame_id, std::error_code& ec) noexcept
+{
+  op_scope __op(this->op_counters_, MMGR_OP::FRAME_RESET, ec);
+  ec.clear();
+  auto __frame = this->find_FRAME(frame_id);
+  if (__frame == nullptr) {
+    ec = MmgrErrc::FrameNotFound;
+    return -1;
+  }
+  __frame->reset();
+  return 0;
+}
+
+int
+mmgr::FRAME_RESET(const size_t frame_id)
+{
+  std::error_code ec;
+  this->FRAME_RESET(frame_id, ec);
+  if (ec) {
+    throw MmgrExcept(ec);
+  }
+  return 0;
+}
+
+int
+mmgr::FRAME_DESTROY(const size_t frame_id, std::error_code& ec) noexcept
+{
+  op_scope __op(this->op_counters_, MMGR_OP::FRAME_DESTROY, ec);
+  ec.clear();
+  std::unique_lock<std::shared_mutex> GG(this->frame_mtx_);
+  auto                                __iter = this->frames_.find(frame_id);
+  if (__iter == this->frames_.end()) {
+    ec = MmgrErrc::FrameNotFound;
+    return -1;
+  }
+  auto __region = __iter->second->region();
+  this->frames_.erase(__iter);
+  GG.unlock();
+  return this->dealloc_STATIC(__region->id, ec);
+}
+
+int
+mmgr::FRAME_DESTROY(const size_t frame_id)
+{
+  std::error_code ec;
+  this->FRAME_DESTROY(frame_id, ec);
+  if (ec) {
+    throw MmgrExcept(ec);
+  }
+  return 0;
+}
+
+bool
+mmgr::FRAME_VALID(const size_t segment_id) const noexcept
+{
+  if (!frame_arena::is_frame_id(segment_id)) {
+    return false;
+  }
+  auto __frame = this->find_FRAME(frame_arena::frame_of(segment_id));
+  return __frame != nullptr && __frame->valid(segment_id);
+}
+
+std::shared_ptr<frame_arena>
+mmgr::find_FRAME(const size_t frame_id) const noexcept
+{
+  std::shared_lock<std::shared_mutex> GG(this->frame_mtx_);
+  auto                                __iter = this->frames_.find(frame_id);
+  return __iter == this->frames_.end() ? nullptr : __iter->second;
+}
+
+int
+mmgr::INSTANT_DEALLOC(const size_t segment_id, std::error_code& ec) noexcept
+{
+  op_scope __op(this->op_counters_, MMGR_OP::INSTANT_DEALLOC, ec);
+  ec.clear();
+  if (this->options_.deferred_free &&
+      this->free_queue_.push(segment_id, SEG_TYPE::INSTANT_SEGMENT)) {
+    if (this->free_queue_.size() >= this->options_.deferred_free_batch) {
+      this->reclaimer_cv_.notify_one();
+    }
+    return 0;
+  }
+  return this->release_SEGMENT(
+    segment_id, SEG_TYPE::INSTANT_SEGMENT, false, ec);
+}
+
+int
+mmgr::INSTANT_DEALLOC(const size_t segment_id)
+{
+  std::error_code ec;
+  this->INSTANT_DEALLOC(segment_id, ec);
+  if (ec) {
+    throw MmgrExcept(ec);
+  }
+  return 0;
+}
+
+std::shared_ptr<instant_segment>
+mmgr::INSTANT_REALLOC(const size_t     segment_id,
+                      const size_t     size,
+                      std::error_code& ec) noexcept
+{
+  op_scope __op(this->op_counters_, MMGR_OP::INSTANT_REALLOC, ec);
+  ec.clear();
+  auto __base = this->find_SEGMENT(segment_id);
+  if (__base == nullptr) {
+    ec = MmgrErrc::SegmentNotFound;
+    _M_mmgr_logger->error("没有找到Segment");
+    return nullptr;
+  }
+  if (__base->type != SEG_TYPE::INSTANT_SEGMENT) {
+    _M_mmgr_logger->error(
+      "Segment_{}不是一个shm_kernel::memory_manager::instant_segment",
+      segment_id);
+    ec = MmgrErrc::SegmentTypeUnmatched;
+    return nullptr;
+  }
+  if (size == 0) {
+    ec = MmgrErrc::IllegalSegmentRange;
+    return nullptr;
+  }
+  auto __seg = std::dynamic_pointer_cast<instant_segment>(__base);
+  const size_t __old  = __seg->size;
+  const size_t __grow = size > __old ? size - __old : 0;
+  if (!this->reserve_CEILING(__grow)) {
+    ec = MmgrErrc::MemoryCeilingReached;
+    return nullptr;
+  }
+  if (this->instant_bin_->resize(__seg, size, ec) != 0) {
+    this->release_CEILING(__grow);
+    _M_mmgr_logger->error("Segment_{} realloc失败!", segment_id);
+    return nullptr;
+  }
+  this->instant_bytes_ += __seg->size;
+  this->instant_bytes_ -= __old;
+  this->release_CEILING(__grow);
+  if (__seg->size < __old) {
+    this->wake_WAITERS();
+  }
+  return __seg;
+}
+
+std::shared_ptr<instant_segment>
+mmgr::INSTANT_REALLOC(const size_t segment_id, const size_t size)
+{
+  std::error_code ec;
+  auto            __seg = this->INSTANT_REALLOC(segment_id, size, ec);
+  if (ec) {
+    throw MmgrExcept(ec);
+  }
+  return __seg;
+}
+
+int
+mmgr::STATIC_DEALLOC(const size_t segment_id, std::error_code& ec) noexcept
+{
+  op_scope __op(this->op_counters_, MMGR_OP::STATIC_DEALLOC, ec);
+  return this->dealloc_STATIC(segment_id, ec);
+}
+
+int
+mmgr::dealloc_STATIC(const size_t segment_id, std::error_code& ec) noexcept
+{
+  ec.clear();
+  if (this->options_.deferred_free &&
+      this->free_queue_.push(segment_id, SEG_TYPE::STATIC_SEGMENT)) {
+    if (this->free_queue_.size() >= this->options_.deferred_free_batch) {
+      this->reclaimer_cv_.notify_one();
+    }
+    return 0;
+  }
+  return this->release_SEGMENT(
+    segment_id, SEG_TYPE::STATIC_SEGMENT, false, ec);
+}
+
+int
+mmgr::release_SEGMENT(const size_t     segment_id,
+                      const SEG_TYPE   type,
+                      const bool       reclaimer,
+                      std::error_code& ec) noexcept
+{
+  ec.clear();
+  // take the entry out first, so a second free of the id finds nothing
+  std::shared_ptr<base_segment> __base;
+  {
+    std::lock_guard<std::shared_mutex> GG(this->table_mtx_);
+    auto __iter = this->segment_table_.find(segment_id);
+    if (__iter == this->segment_table_.end()) {
+      ec = MmgrErrc::SegmentNotFound;
+      if (reclaimer) {
+        _M_mmgr_logger->error("Segment {} 已被释放或不存在, double free?",
+                              segment_id);
+      } else {
+        _M_mmgr_logger->error("没有找到Segment {}", segment_id);
+      }
+      return -1;
+    }
+    if (__iter->second->type != type) {
+      _M_mmgr_logger->error("Segment_{}的类型不匹配", segment_id);
+      ec = MmgrErrc::SegmentTypeUnmatched;
+      return -1;
+    }
+    __base = std::move(__iter->second);
+    this->segment_table_.erase(__iter);
+  }
+  int rv;
+  if (type == SEG_TYPE::STATIC_SEGMENT) {
+    // the reclaimer already holds reclaim_mtx_, which keeps COMPACT out
+    std::shared_lock<std::shared_mutex> GG(this->compact_mtx_, std::defer_lock);
+    if (!reclaimer) {
+      GG.lock();
+    }
+    auto __seg = std::static_pointer_cast<static_segment>(__base);
+    rv = this->batches_[__seg->batch_id]->deallocate(__seg, ec);
+  } else {
+    auto __seg = std::static_pointer_cast<instant_segment>(__base);
+    rv         = this->instant_bin_->free(__seg, ec);
+    if (rv == 0) {
+      this->instant_bytes_ -= __seg->size;
+    }
+  }
+  if (rv != 0) {
+    _M_mmgr_logger->error("Segment_{} dealloc失败!", segment_id);
+    std::lock_guard<std::shared_mutex> GG(this->table_mtx_);
+    this->segment_table_.emplace(segment_id, std::move(__base));
+    return -1;
+  }
+  this->wake_WAITERS();
+  return 0;
+}
+
+size_t
+mmgr::drain_FREES() noexcept
+{
+  std::lock_guard<std::mutex> GGGGGGGGGGGG(this->reclaim_mtx_);
+  std::vector<std::pair<size_t, SEG_TYPE>> __queued;
+  try {
+    this->free_queue_.take(__queued);
+  } catch (const std::bad_alloc&) {
+    _M_mmgr_logger->error("无法取出deferred free队列");
+    return 0;
+  }
+  size_t          __released = 0;
+  std::error_code ec;
+  for (const auto& [id, type] : __queued) {
+    if (this->release_SEGMENT(id, type, true, ec) == 0) {
+      __released++;
+    }
+  }
+  return __released;
+}
+
+void
+mmgr::reclaimer_LOOP() noexcept
+{
+  std::unique_lock<std::mutex> GG(this->reclaimer_mtx_);
+  while (!this->reclaimer_stop_) {
+    this->reclaimer_cv_.wait_for(GG, this->options_.deferred_free_latency, [this] {
+      return this->reclaimer_stop_ ||
+             this->free_queue_.size() >= this->options_.deferred_free_batch;
+    });
+    if (this->free_queue_.size() == 0) {
+      continue;
+    }
+    GG.unlock();
+    this->drain_FREES();
+    GG.lock();
+  }
+}
+
+void
+mmgr::checkpoint_LOOP() noexcept
+{
+  std::unique_lock<std::mutex> GG(this->checkpointer_mtx_);
+  while (true) {
+    this->checkpointer_cv_.wait(GG, [this] {
+      return this->checkpointer_stop_ || !this->checkpoint_tasks_.empty();
+    });
+    // stopping, and nothing left to write
+    if (this->checkpoint_tasks_.empty()) {
+      return;
+    }
+    auto __task = std::move(this->checkpoint_tasks_.front());
+    this->checkpoint_tasks_.pop_front();
+    GG.unlock();
+    __task();
+    GG.lock();
+  }
+}
+
+size_t
+mmgr::RECLAIM() noexcept
+{
+  return this->drain_FREES();
+}
+
+int
+mmgr::STATIC_DEALLOC(const size_t segment_id)
+{
+  std::error_code ec;
+  this->STATIC_DEALLOC(segment_id, ec);
+  if (ec) {
+    throw MmgrExcept(ec);
+  }
+  return 0;
+}
+
+std::shared_ptr<static_segment>
+mmgr::STATIC_REALLOC(const size_t     segment_id,
+                     const size_t     size,
+                     std::error_code& ec) noexcept
+{
+  op_scope __op(this->op_counters_, MMGR_OP::STATIC_REALLOC, ec);
+  ec.clear();
+  auto __base = this->find_SEGMENT(segment_id);
+  if (__base == nullptr) {
+    ec = MmgrErrc::SegmentNotFound;
+    _M_mmgr_logger->error("没有找到Segment");
+    return nullptr;
+  }
+  if (__base->type != SEG_TYPE::STATIC_SEGMENT) {
+    _M_mmgr_logger->error(
+      "Segment_{}不是一个shm_kernel::memory_manager::static_segment",
+      segment_id);
+    ec = MmgrErrc::SegmentTypeUnmatched;
+    return nullptr;
+  }
+  if (size == 0) {
+    ec = MmgrErrc::IllegalSegmentRange;
+    return nullptr;
+  }
+  std::shared_lock<std::shared_mutex> GG(this->compact_mtx_);
+  auto __seg   = std::dynamic_pointer_cast<static_segment>(__base);
+  auto __batch = this->batches_[__seg->batch_id];
+  if (__batch->reallocate(__seg, size, ec) == 0) {
+    return __seg;
+  }
+  // move
+  auto __new_seg = this->alloc_STATIC(size, __seg->alignment, false, true, ec);
+  if (!__new_seg) {
+    return nullptr;
+  }
+  memops::copy(this->batches_[__new_seg->batch_id]->base() + __new_seg->addr_pshift,
+               __batch->base() + __seg->addr_pshift,
+               std::min(__seg->size, size));
+  GG.unlock();
+  // the move succeeded, a failed release of the old segment only leaks it
+  std::error_code __ec;
+  if (this->dealloc_STATIC(segment_id, __ec) != 0) {
+    _M_mmgr_logger->error(
+      "无法释放Segment_{}. {}", segment_id, __ec.message());
+  }
+  return __new_seg;
+}
+
+std::shared_ptr<static_segment>
+mmgr::STATIC_REALLOC(const size_t segment_id, const size_t size)
+{
+  std::error_code ec;
+  auto            __seg = this->STATIC_REALLOC(segment_id, size, ec);
+  if (ec) {
+    throw MmgrExcept(ec);
+  }
+  return __seg;
+}
+
+int
+mmgr::CACHE_DEALLOC(const size_t segment_id, std::error_code& ec) noexcept
+{
+  op_scope __op(this->op_counters_, MMGR_OP::CACHE_DEALLOC, ec);
+  auto __seg = this->find_CACHE(segment_id, ec);
+  if (__seg == nullptr) {
+    return -1;
+  }
+  if (this->cache_bin_->free(__seg, ec) != 0) {
+    _M_mmgr_logger->error("Segment dealloc失败!");
+    return -1;
+  }
+  std::lock_guard<std::shared_mutex> GG(this->table_mtx_);
+  this->segment_table_.erase(segment_id);
+  return 0;
+}
+int
+mmgr::CACHE_DEALLOC(const size_t segment_id)
+{
+  std::error_code ec;
+  this->CACHE_DEALLOC(segment_id, ec);
+  if (ec) {
+    throw MmgrExcept(ec);
+  }
+  return 0;
+}
+
+int
+mmgr::ADVISE(const size_t        segment_id,
+             const ACCESS_ADVICE advice,
+             std::error_code&    ec) noexcept
+{
+  ec.clear();
+  auto __base = this->find_SEGMENT(segment_id);
+  if (__base == nullptr) {
+    ec = MmgrErrc::SegmentNotFound;
+    _M_mmgr_logger->error("没有找到Segment {}", segment_id);
+    return -1;
+  }
+  switch (__base->type) {
+    case SEG_TYPE::STATIC_SEGMENT: {
+      std::shared_lock<std::shared_mutex> GG(this->compact_mtx_);
+      auto __seg = std::dynamic_pointer_cast<static_segment>(__base);
+      return this->batches_[__seg->batch_id]->advise(__seg, advice, ec);
+    }
+    case SEG_TYPE::INSTANT_SEGMENT: {
+      auto __seg = std::dynamic_pointer_cast<instant_segment>(__base);
+      return this->instant_bin_->advise(__seg, advice, ec);
+    }
+    default:
+      ec = MmgrErrc::SegmentTypeUnmatched;
+      return -1;
   }
-  return __seg;
 }
-std::shared_ptr<cache_segment>
-mmgr::CACHE_STORE(const void* buffer, const size_t size)
+
+int
+mmgr::ADVISE(const size_t segment_id, const ACCESS_ADVICE advice)
 {
   std::error_code ec;
-  auto            __seg = this->CACHE_STORE(buffer, size, ec);
+  this->ADVISE(segment_id, advice, ec);
   if (ec) {
     throw MmgrExcept(ec);
   }
-  return __seg;
+  return 0;
 }
 
-std::shared_ptr<cache_segment>
-mmgr::CACHE_STORE(const size_t                      size,
-                    std::function<void(void* buffer)> callback,
-                    std::error_code&                  ec) noexcept
+std::shared_ptr<base_segment>
+mmgr::locate_BUFFER(const size_t     segment_id,
+                    char**           ptr,
+                    std::error_code& ec) noexcept
 {
   ec.clear();
-  void* __alloc_buffer;
-  auto  __seg = this->cache_bin_->malloc(size, &__alloc_buffer, ec);
-  if (ec) {
+  auto __base = this->find_SEGMENT(segment_id);
+  if (!__base) {
+    ec = MmgrErrc::SegmentNotFound;
+    _M_mmgr_logger->error("没有找到Segment {}", segment_id);
     return nullptr;
   }
-  auto __insert_rv =
-    this->segment_table_.insert(std::make_pair(__seg->id, __seg));
-  if (!__insert_rv.second) {
-    this->_M_mmgr_logger->error("无法将Segment添加进Table");
-    ec = MmgrErrc::UnableToRegisterSegment;
-    this->cache_bin_->free(__seg);
+  switch (__base->type) {
+    case SEG_TYPE::STATIC_SEGMENT: {
+      auto __seg = std::static_pointer_cast<static_segment>(__base);
+      *ptr = this->batches_[__seg->batch_id]->base() + __seg->addr_pshift;
+      return __base;
+    }
+    case SEG_TYPE::INSTANT_SEGMENT:
+      *ptr = static_cast<char*>(this->instant_bin_->buffer(segment_id, ec).first);
+      break;
+    case SEG_TYPE::CACHE_SEGMENT:
+      *ptr = static_cast<char*>(this->cache_bin_->retrieve(segment_id, ec));
+      break;
   }
-  callback(__alloc_buffer);
-  return __seg;
+  return ec ? nullptr : __base;
 }
 
 int
-mmgr::CACHE_SET(const size_t                      segment_id,
-                  const size_t                      size,
-                  std::function<void(void* buffer)> callback,
-                  std::error_code&                  ec) noexcept
+mmgr::write_RANGE(const size_t                       segment_id,
+                  const size_t                       offset,
+                  const size_t                       nbytes,
+                  const std::function<void(char*)>& writer,
+                  std::error_code&                   ec) noexcept
 {
-  ec.clear();
-  std::lock_guard<std::mutex> __lock(this->mtx_);
-  auto                        __iter = this->segment_table_.find(segment_id);
-  if (__iter == this->segment_table_.end()) {
-    ec = MmgrErrc::SegmentNotFound;
-    _M_mmgr_logger->error("没有找到Segment_{}", segment_id);
+  std::shared_lock<std::shared_mutex> GG(this->compact_mtx_);
+  char*                               __dst = nullptr;
+  auto __seg = this->locate_BUFFER(segment_id, &__dst, ec);
+  if (!__seg) {
     return -1;
   }
-  // cast
-  auto __seg = std::dynamic_pointer_cast<cache_segment>(__iter->second);
-  if (__seg == nullptr) {
-    _M_mmgr_logger->error("无法将Segment_{}转换为 cache_segment!", segment_id);
-    ec = MmgrErrc::SegmentTypeUnmatched;
+  if (offset > __seg->size || nbytes > __seg->size - offset) {
+    ec = MmgrErrc::IllegalSegmentRange;
     return -1;
   }
-  void* __new_buffer = this->cache_bin_->realloc(__seg, size, ec);
-  if (__new_buffer == nullptr) {
-    return -1;
+  writer(__dst + offset);
+  if (__seg->type == SEG_TYPE::STATIC_SEGMENT) {
+    auto __stat = std::static_pointer_cast<static_segment>(__seg);
+    this->batches_[__stat->batch_id]->mark_dirty(__stat);
   }
-  callback(__new_buffer);
   return 0;
 }
 
-int
-mmgr::CACHE_SET(const size_t     segment_id,
-                  const void*      buffer,
-                  const size_t     size,
-                  std::error_code& ec) noexcept
+memops::stripe_pool&
+mmgr::stripe_POOL()
 {
-  std::lock_guard<std::mutex> __lock(this->mtx_);
-  auto                        __iter = this->segment_table_.find(segment_id);
-  if (__iter != this->segment_table_.end()) {
-    int rv =
-      this->cache_bin_->set(segment_id, __iter->second->size, buffer, size, ec);
-    if (rv == 0) {
-      return 0;
-    } else {
-      _M_mmgr_logger->error(
-        "Segment修改失败! ({}) {}", ec.value(), ec.message());
+  std::call_once(this->stripe_once_, [this] {
+    this->stripe_pool_ =
+      std::make_unique<memops::stripe_pool>(this->options_.parallel_threads);
+  });
+  return *this->stripe_pool_;
+}
 
-      return -1;
-    }
-  } else {
-    ec = MmgrErrc::SegmentNotFound;
-    _M_mmgr_logger->error("没有找到Segment {}", segment_id);
+int
+mmgr::WRITE(const size_t     segment_id,
+            const size_t     offset,
+            const void*      src,
+            const size_t     nbytes,
+            std::error_code& ec) noexcept
+{
+  op_scope __op(this->op_counters_, MMGR_OP::WRITE, ec);
+  ec.clear();
+  if (src == nullptr) {
+    ec = MmgrErrc::NullptrBuffer;
     return -1;
   }
+  return this->write_RANGE(
+    segment_id, offset, nbytes,
+    [&](char* dst) { memops::copy(dst, src, nbytes); }, ec);
 }
+
 int
-mmgr::CACHE_SET(const size_t segment_id,
-                  const void*  buffer,
-                  const size_t size)
+mmgr::WRITE(const size_t segment_id,
+            const size_t offset,
+            const void*  src,
+            const size_t nbytes)
 {
   std::error_code ec;
-  this->CACHE_SET(segment_id, buffer, size, ec);
+  this->WRITE(segment_id, offset, src, nbytes, ec);
   if (ec) {
     throw MmgrExcept(ec);
   }
   return 0;
 }
 
-void*
-mmgr::CACHE_RETRIEVE(const size_t segment_id, std::error_code& ec) noexcept
+int
+mmgr::PARALLEL_WRITE(const size_t     segment_id,
+                     const size_t     offset,
+                     const void*      src,
+                     const size_t     nbytes,
+                     std::error_code& ec) noexcept
 {
-  auto __iter = this->segment_table_.find(segment_id);
-  if (__iter == this->segment_table_.end()) {
-    ec = MmgrErrc::SegmentNotFound;
-    _M_mmgr_logger->error("没有找到Segment {}", segment_id);
-    return nullptr;
+  op_scope __op(this->op_counters_, MMGR_OP::PARALLEL_WRITE, ec);
+  ec.clear();
+  if (src == nullptr) {
+    ec = MmgrErrc::NullptrBuffer;
+    return -1;
   }
-  auto __buff = this->cache_bin_->retrieve(segment_id, ec);
-  if (__buff == nullptr) {
-    _M_mmgr_logger->error("segment {} 不是一个Cache Segment!", segment_id);
-    ec = MmgrErrc::SegmentTypeUnmatched;
-    return nullptr;
+  try {
+    auto& __pool = this->stripe_POOL();
+    return this->write_RANGE(
+      segment_id, offset, nbytes,
+      [&](char* dst) { __pool.copy(dst, src, nbytes); }, ec);
+  } catch (const std::system_error& e) {
+    _M_mmgr_logger->error("无法启动 stripe pool: {}", e.what());
+    ec = e.code();
+    return -1;
   }
-  return __buff;
 }
 
-void*
-mmgr::CACHE_RETRIEVE(const size_t segment_id)
+int
+mmgr::PARALLEL_WRITE(const size_t segment_id,
+                     const size_t offset,
+                     const void*  src,
+                     const size_t nbytes)
 {
   std::error_code ec;
-  void*           __ptr = this->CACHE_RETRIEVE(segment_id, ec);
+  this->PARALLEL_WRITE(segment_id, offset, src, nbytes, ec);
   if (ec) {
     throw MmgrExcept(ec);
   }
-  return __ptr;
+  return 0;
 }
-std::shared_ptr<instant_segment>
-mmgr::INSTANT_ALLOC(const size_t size, std::error_code& ec) noexcept
+
+int
+mmgr::PARALLEL_FILL(const size_t     segment_id,
+                    const size_t     offset,
+                    const int        value,
+                    const size_t     nbytes,
+                    std::error_code& ec) noexcept
 {
+  op_scope __op(this->op_counters_, MMGR_OP::PARALLEL_FILL, ec);
   ec.clear();
-  auto __seg = this->instant_bin_->malloc(size, ec);
-  auto __iter_rv =
-    this->segment_table_.insert(std::make_pair(__seg->id, __seg));
-  if (!__iter_rv.second) {
-    _M_mmgr_logger->error("无法将Segment添加进Table!");
-    this->instant_bin_->free(__seg, ec);
-    return nullptr;
+  try {
+    auto& __pool = this->stripe_POOL();
+    return this->write_RANGE(
+      segment_id, offset, nbytes,
+      [&](char* dst) { __pool.fill(dst, value, nbytes); }, ec);
+  } catch (const std::system_error& e) {
+    _M_mmgr_logger->error("无法启动 stripe pool: {}", e.what());
+    ec = e.code();
+    return -1;
   }
-  return __seg;
 }
-std::shared_ptr<instant_segment>
-mmgr::INSTANT_ALLOC(const size_t size)
+
+int
+mmgr::PARALLEL_FILL(const size_t segment_id,
+                    const size_t offset,
+                    const int    value,
+                    const size_t nbytes)
 {
   std::error_code ec;
-  auto            __seg = this->INSTANT_ALLOC(size, ec);
+  this->PARALLEL_FILL(segment_id, offset, value, nbytes, ec);
   if (ec) {
     throw MmgrExcept(ec);
   }
-  return __seg;
+  return 0;
 }
 
-std::shared_ptr<static_segment>
-mmgr::STATIC_ALLOC(const size_t size, std::error_code& ec) noexcept
+int
+mmgr::FLUSH(const size_t     segment_id,
+            const bool       async,
+            std::error_code& ec) noexcept
 {
   ec.clear();
-  std::shared_ptr<static_segment> __seg;
-  for (const auto& batch : batches_) {
-    __seg = batch->allocate(size, ec);
-    if (__seg) {
-      // if allocate success, break loop
-      break;
-    }
+  auto __base = this->find_SEGMENT(segment_id);
+  if (__base == nullptr) {
+    ec = MmgrErrc::SegmentNotFound;
+    _M_mmgr_logger->error("没有找到Segment {}", segment_id);
+    return -1;
   }
-  // all of batches can't meet the requirement, add a new batch
-  if (!__seg) {
-    auto __new_batch = this->add_BATCH();
-    __seg            = __new_batch->allocate(size, ec);
-    // if still fail
-    if (!__seg) {
-      _M_mmgr_logger->error("新增的Batch也无法分配空间, 真奇怪...");
-      return nullptr;
+  switch (__base->type) {
+    case SEG_TYPE::STATIC_SEGMENT: {
+      std::shared_lock<std::shared_mutex> GG(this->compact_mtx_);
+      auto __seg = std::dynamic_pointer_cast<static_segment>(__base);
+      return this->batches_[__seg->batch_id]->flush(__seg, async, ec);
     }
+    case SEG_TYPE::INSTANT_SEGMENT: {
+      auto __seg = std::dynamic_pointer_cast<instant_segment>(__base);
+      return this->instant_bin_->flush(__seg, async, ec);
+    }
+    default:
+      ec = MmgrErrc::SegmentTypeUnmatched;
+      return -1;
   }
-  auto __insert_rv =
-    this->segment_table_.insert(std::make_pair(__seg->id, __seg));
-  if (!__insert_rv.second) {
-    this->batches_[__seg->batch_id]->deallocate(__seg, ec);
-    _M_mmgr_logger->error("无法将Segment添加进Table.");
-    ec = MmgrErrc::UnableToRegisterSegment;
-    return nullptr;
-  }
-  return __seg;
 }
 
-std::shared_ptr<static_segment>
-mmgr::STATIC_ALLOC(const size_t size)
+int
+mmgr::FLUSH(const size_t segment_id, const bool async)
 {
   std::error_code ec;
-  auto            __seg = this->STATIC_ALLOC(size, ec);
+  this->FLUSH(segment_id, async, ec);
   if (ec) {
     throw MmgrExcept(ec);
   }
-  return __seg;
+  return 0;
 }
 
 int
-mmgr::INSTANT_DEALLOC(const size_t segment_id, std::error_code& ec) noexcept
+mmgr::FLUSH_ALL(const bool async, std::error_code& ec) noexcept
 {
   ec.clear();
-  auto __iter = this->segment_table_.find(segment_id);
-  if (__iter == this->segment_table_.end()) {
-    _M_mmgr_logger->error("没有找到Segment");
+  for (const auto& batch : this->batches_) {
+    if (batch->flush(async, ec) != 0) {
+      _M_mmgr_logger->error(
+        "batch{} flush失败! ({}) {}", batch->id(), ec.value(), ec.message());
+      return -1;
+    }
+  }
+  return this->instant_bin_->flush(async, ec);
+}
+
+int
+mmgr::MARK_DIRTY(const size_t segment_id, std::error_code& ec) noexcept
+{
+  ec.clear();
+  auto __base = this->find_SEGMENT(segment_id);
+  if (__base == nullptr) {
     ec = MmgrErrc::SegmentNotFound;
+    _M_mmgr_logger->error("没有找到Segment {}", segment_id);
     return -1;
   }
-  // if found  cehck if segment is instant segment
-  if (__iter->second->type != SEG_TYPE::INSTANT_SEGMENT) {
-    _M_mmgr_logger->error(
-      "Segment_{}不是一个shm_kernel::memory_manager::instant_segment",
-      segment_id);
+  if (__base->type != SEG_TYPE::STATIC_SEGMENT) {
     ec = MmgrErrc::SegmentTypeUnmatched;
     return -1;
   }
-  // cast to instant segment
-  auto __seg = std::dynamic_pointer_cast<instant_segment>(__iter->second);
-  // free
-  int rv = this->instant_bin_->free(__seg, ec);
-  if (rv == 0) {
-    this->segment_table_.erase(__iter);
-    return 0;
-  }
-  _M_mmgr_logger->error("Segment dealloc失败!");
-  return -1;
+  std::shared_lock<std::shared_mutex> GG(this->compact_mtx_);
+  auto __seg = std::dynamic_pointer_cast<static_segment>(__base);
+  this->batches_[__seg->batch_id]->mark_dirty(__seg);
+  return 0;
 }
 
 int
-mmgr::INSTANT_DEALLOC(const size_t segment_id)
+mmgr::MARK_DIRTY(const size_t segment_id)
 {
   std::error_code ec;
-  this->INSTANT_DEALLOC(segment_id, ec);
+  this->MARK_DIRTY(segment_id, ec);
   if (ec) {
     throw MmgrExcept(ec);
   }
   return 0;
 }
-int
-mmgr::STATIC_DEALLOC(const size_t segment_id, std::error_code& ec) noexcept
+
+std::future<size_t>
+mmgr::CHECKPOINT(std::error_code& ec) noexcept
 {
+  op_scope __op(this->op_counters_, MMGR_OP::CHECKPOINT, ec);
   ec.clear();
-  auto __iter = this->segment_table_.find(segment_id);
-  if (__iter == this->segment_table_.end()) {
-    ec = MmgrErrc::SegmentNotFound;
-    _M_mmgr_logger->error("没有找到Segment");
-    return -1;
-  }
-  // if found, check if segment is static segment
-  if (__iter->second->type != SEG_TYPE::STATIC_SEGMENT) {
-    _M_mmgr_logger->error(
-      "Segment_{}不是一个shm_kernel::memory_manager::static_segment",
-      segment_id);
-    ec = MmgrErrc::SegmentTypeUnmatched;
-    return -1;
+  if (options_.snapshot_dir.empty()) {
+    _M_mmgr_logger->error("没有配置snapshot_dir, 无法checkpoint!");
+    ec = MmgrErrc::SnapshotFailed;
+    return {};
   }
-  // cast to static segment
-  auto __seg = std::dynamic_pointer_cast<static_segment>(__iter->second);
-  // free
-  int rv = this->batches_[__seg->batch_id]->deallocate(__seg, ec);
-  if (rv == 0) {
-    this->segment_table_.erase(__iter);
-    return 0;
+  auto __batches = this->batches_.snapshot();
+  auto __checkpoint =
+    [__batches = std::move(__batches),
+     __dir     = options_.snapshot_dir,
+     __name    = this->name_,
+     __mtx     = this->checkpoint_mtx_,
+     __seq     = this->checkpoint_seq_,
+     __logger  = this->_M_mmgr_logger]() -> size_t {
+    // deltas are collected under the lock, so snapshot headers never go
+    // backwards when checkpoints overlap
+    std::lock_guard<std::mutex> __lock(*__mtx);
+    size_t                      __written = 0;
+    // files of the checkpoint named by the manifest are only read, it
+    // stays restorable until the manifest names this one
+    auto __current = __seq->load() + 1;
+    for (const auto& batch : __batches) {
+      auto __delta = batch->collect_checkpoint();
+      try {
+        __written += write_snapshot(
+          __delta.base_sequence == 0
+            ? std::string()
+            : snapshot_path(
+                __dir, __name, batch->id(), __delta.base_sequence),
+          snapshot_path(__dir, __name, batch->id(), __current),
+          batch->base(),
+          __delta);
+      } catch (...) {
+        batch->abort_checkpoint(__delta);
+        throw;
+      }
+      batch->commit_checkpoint(__current);
+    }
+    write_manifest(__dir, __name, __current, __batches.size());
+    __seq->store(__current);
+    prune_snapshots(__dir, __name, __current);
+    __logger->debug(
+      "checkpoint {} of {}: {} bytes", __current, __name, __written);
+    return __written;
+  };
+  auto __promise = std::make_shared<std::promise<size_t>>();
+  auto __future  = __promise->get_future();
+  try {
+    // not std::async, its future would block in its destructor
+    std::call_once(this->checkpointer_once_, [this] {
+      this->checkpointer_ = std::thread(&mmgr::checkpoint_LOOP, this);
+    });
+    {
+      std::lock_guard<std::mutex> GG(this->checkpointer_mtx_);
+      this->checkpoint_tasks_.push_back(
+        [__promise, __checkpoint = std::move(__checkpoint)] {
+          try {
+            __promise->set_value(__checkpoint());
+          } catch (...) {
+            __promise->set_exception(std::current_exception());
+          }
+        });
+    }
+    this->checkpointer_cv_.notify_one();
+    return __future;
+  } catch (const std::exception& e) {
+    _M_mmgr_logger->error("无法启动checkpoint: {}", e.what());
+    ec = MmgrErrc::SnapshotFailed;
+    return {};
   }
-  // fail
-  _M_mmgr_logger->error("Segment dealloc失败");
-  return -1;
 }
 
-int
-mmgr::STATIC_DEALLOC(const size_t segment_id)
+std::future<size_t>
+mmgr::CHECKPOINT()
 {
   std::error_code ec;
-  this->STATIC_DEALLOC(segment_id, ec);
+  auto            __future = this->CHECKPOINT(ec);
   if (ec) {
     throw MmgrExcept(ec);
   }
-  return 0;
+  return __future;
 }
 
-int
-mmgr::CACHE_DEALLOC(const size_t segment_id, std::error_code& ec) noexcept
+size_t
+mmgr::COMPACT(std::error_code& ec) noexcept
 {
+  op_scope __op(this->op_counters_, MMGR_OP::COMPACT, ec);
   ec.clear();
-  auto __iter = this->segment_table_.find(segment_id);
-  if (__iter == this->segment_table_.end()) {
-    ec = MmgrErrc::SegmentNotFound;
-    _M_mmgr_logger->error("没有找到Segment");
-    return -1;
+  if (this->forward_ == nullptr) {
+    _M_mmgr_logger->error("{}#forward is unavailable, unable to compact", name());
+    ec = MmgrErrc::UnableToCreateShm;
+    return 0;
   }
-  // if found, check if segment is cache segment
-  if (__iter->second->type != SEG_TYPE::CACHE_SEGMENT) {
-    ec = MmgrErrc::SegmentTypeUnmatched;
-    _M_mmgr_logger->error(
-      "Segment_{}不是一个shm_kernel::memory_manager::cache_segment",
-      segment_id);
-    return -1;
+  // location users in this process, then the reclaimer
+  std::lock_guard<std::shared_mutex> GGGGGGGGGGGGGG(this->compact_mtx_);
+  this->RECLAIM();
+  std::lock_guard<std::mutex> GGGGGGGGGGGGG(this->reclaim_mtx_);
+  // consumers holding raw pointers
+  this->forward_->compacting.store(1, std::memory_order_seq_cst);
+  const auto __deadline = std::chrono::steady_clock::now() +
+                          std::chrono::milliseconds(COMPACT_PIN_TIMEOUT_MS);
+  while (this->forward_->pins.load(std::memory_order_seq_cst) != 0) {
+    if (std::chrono::steady_clock::now() >= __deadline) {
+      this->forward_->compacting.store(0, std::memory_order_release);
+      _M_mmgr_logger->error("{} still has pinned consumers, unable to compact",
+                            name());
+      ec = MmgrErrc::WouldBlock;
+      return 0;
+    }
+    std::this_thread::yield();
   }
-  // cast to cache segment
-  auto __seg = std::dynamic_pointer_cast<cache_segment>(__iter->second);
-  // free
-  int rv = this->cache_bin_->free(__seg, ec);
-  if (rv == 0) {
-    this->segment_table_.erase(__iter);
-    return 0;
+  // frame segments point into their region, so regions stay where they are
+  std::vector<std::shared_ptr<static_segment>> __regions;
+  {
+    std::shared_lock<std::shared_mutex> GG(this->frame_mtx_);
+    for (const auto& [id, frame] : this->frames_) {
+      __regions.push_back(frame->region());
+    }
+  }
+  std::vector<std::shared_ptr<static_segment>> __candidates;
+  // held across the moves, segment_table_ readers see the fields settled
+  std::lock_guard<std::shared_mutex> GG(this->table_mtx_);
+  for (const auto& [id, seg] : this->segment_table_) {
+    if (seg->type != SEG_TYPE::STATIC_SEGMENT) {
+      continue;
+    }
+    auto __seg = std::dynamic_pointer_cast<static_segment>(seg);
+    if (!this->batches_[__seg->batch_id]->movable(*__seg) ||
+        std::find(__regions.begin(), __regions.end(), __seg) !=
+          __regions.end()) {
+      continue;
+    }
+    __candidates.push_back(std::move(__seg));
+  }
+  // the ones furthest back go first
+  std::sort(__candidates.begin(),
+            __candidates.end(),
+            [](const auto& a, const auto& b) {
+              return std::tie(a->batch_id, a->addr_pshift) >
+                     std::tie(b->batch_id, b->addr_pshift);
+            });
+
+  size_t __moved = 0;
+  for (const auto& seg : __candidates) {
+    std::shared_ptr<static_segment> __dst;
+    for (size_t b = 0; b <= seg->batch_id && !__dst; b++) {
+      __dst = this->batches_[b]->allocate(seg->size, seg->alignment, ec);
+    }
+    if (!__dst) {
+      continue;
+    }
+    auto& __from = this->batches_[seg->batch_id];
+    auto& __to   = this->batches_[__dst->batch_id];
+    if (std::tie(__dst->batch_id, __dst->addr_pshift) >=
+        std::tie(seg->batch_id, seg->addr_pshift)) {
+      // no lower hole fits it
+      __to->deallocate(__dst, ec);
+      continue;
+    }
+    memops::copy(__to->base() + __dst->addr_pshift,
+                 __from->base() + seg->addr_pshift,
+                 seg->size);
+    // allocate marked the chunks dirty before the copy, a checkpoint in
+    // between may have written and cleared them
+    __to->mark_dirty(__dst);
+    __to->relabel(__dst, seg->id);
+    if (__from->deallocate(seg, ec) != 0) {
+      _M_mmgr_logger->error("无法释放Segment_{}的旧位置", seg->id);
+    }
+    seg->batch_id    = __dst->batch_id;
+    seg->bin_id      = __dst->bin_id;
+    seg->addr_pshift = __dst->addr_pshift;
+    this->publish_FORWARD(*seg);
+    __moved++;
   }
-  // fail
-  _M_mmgr_logger->error("Segment dealloc失败!");
-  return -1;
+  this->forward_->compacting.store(0, std::memory_order_release);
+  ec.clear();
+  _M_mmgr_logger->info("{} compacted, {} segments moved", name(), __moved);
+  return __moved;
 }
-int
-mmgr::CACHE_DEALLOC(const size_t segment_id)
+
+size_t
+mmgr::COMPACT()
 {
   std::error_code ec;
-  this->CACHE_DEALLOC(segment_id, ec);
+  auto            __moved = this->COMPACT(ec);
   if (ec) {
     throw MmgrExcept(ec);
   }
-  return 0;
+  return __moved;
+}
+
+layout_report
+mmgr::LAYOUT_REPORT() const noexcept
+{
+  layout_report __report;
+  __report.next_layout     = this->next_LAYOUT();
+  __report.samples         = this->size_histogram_.samples();
+  __report.predicted_waste =
+    this->size_histogram_.predicted_waste(__report.next_layout.chunk_size);
+  __report.baseline_waste =
+    this->size_histogram_.predicted_waste(this->batch_bin_size_);
+
+  size_t __used = 0, __requested = 0;
+  for (const auto& batch : this->batches_) {
+    __used += batch->used_bytes();
+  }
+  std::shared_lock<std::shared_mutex> GG(this->table_mtx_);
+  for (const auto& [id, seg] : this->segment_table_) {
+    if (seg->type != SEG_TYPE::STATIC_SEGMENT) {
+      continue;
+    }
+    auto __seg = std::dynamic_pointer_cast<static_segment>(seg);
+    // slab objects are not in used_bytes
+    if (this->batches_[__seg->batch_id]->movable(*__seg)) {
+      __requested += __seg->size;
+    }
+  }
+  __report.actual_waste =
+    __requested == 0 ? 0 : double(__used - __requested) / __requested;
+  return __report;
+}
+
+mmgr_stats
+mmgr::STATS()
+{
+  mmgr_stats __stats{};
+  __stats.name = this->name_;
+  for (const auto& batch : this->batches_) {
+    __stats.batches.push_back(batch->stats());
+  }
+  {
+    std::shared_lock<std::shared_mutex> GG(this->table_mtx_);
+    __stats.segments = this->segment_table_.size();
+    for (const auto& [id, seg] : this->segment_table_) {
+      if (seg->type == SEG_TYPE::INSTANT_SEGMENT) {
+        __stats.instant_segments++;
+      }
+    }
+  }
+  __stats.instant_bytes = this->instant_bytes_.load();
+  __stats.cache         = this->cache_bin_->stats();
+  __stats.ops           = this->op_counters_.snapshot();
+  __stats.bin_type      = this->options_.bin_type;
+  for (size_t op = 0; op < MMGR_OP_COUNT; op++) {
+    __stats.latency[op] =
+      this->op_counters_.latency_summary_of(static_cast<MMGR_OP>(op));
+  }
+  return __stats;
+}
+
+const latency_histogram*
+mmgr::LATENCY(const MMGR_OP op) const noexcept
+{
+  return this->op_counters_.latency(op);
+}
+
+void
+mmgr::RESET_LATENCY() noexcept
+{
+  this->op_counters_.reset_latency();
 }
 
 std::shared_ptr<base_segment>
 mmgr::get_segment(const size_t segment_id, std::error_code& ec) noexcept
 {
-  auto __iter = this->segment_table_.find(segment_id);
-  if (__iter == this->segment_table_.end()) {
+  auto __base = this->find_SEGMENT(segment_id);
+  if (__base == nullptr) {
     ec = MmgrErrc::SegmentNotFound;
-    return {};
   }
-  return __iter->second;
+  return __base;
+}
+
+std::shared_ptr<base_segment>
+mmgr::find_SEGMENT(const size_t segment_id) const noexcept
+{
+  std::shared_lock<std::shared_mutex> GG(this->table_mtx_);
+  auto __iter = this->segment_table_.find(segment_id);
+  return __iter == this->segment_table_.end() ? nullptr : __iter->second;
 }
 
 std::shared_ptr<base_segment>
@@ -447,6 +2406,7 @@ mmgr::name() const noexcept
 size_t
 mmgr::segment_count() const noexcept
 {
+  std::shared_lock<std::shared_mutex> GG(this->table_mtx_);
   return this->segment_table_.size();
 }
 
@@ -460,4 +2420,10 @@ mmgr::batch_bin_count() const noexcept
 {
   return this->batch_bin_count_;
 }
+
+const mmgr_options&
+mmgr::options() const noexcept
+{
+  return this->options_;
+}
 }
\ No newline at end of file
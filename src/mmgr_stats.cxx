@@ -0,0 +1,376 @@
+#include "mmgr_stats.hpp"
+
+#include <fmt/format.h>
+
+namespace shm_kernel::memory_manager {
+
+namespace {
+
+std::string_view
+bin_type_name(const BIN_TYPE type) noexcept
+{
+  switch (type) {
+    case BIN_TYPE::STATIC:
+      return "static";
+    case BIN_TYPE::BUDDY:
+      return "buddy";
+    case BIN_TYPE::TLSF:
+      return "tlsf";
+    case BIN_TYPE::SLAB:
+      return "slab";
+  }
+  return "unknown";
+}
+
+// bin serving the op, static ops use the mmgr's bin type
+std::string_view
+op_bin_name(const MMGR_OP op, const BIN_TYPE bin_type) noexcept
+{
+  switch (op) {
+    case MMGR_OP::STATIC_ALLOC:
+    case MMGR_OP::STATIC_REALLOC:
+    case MMGR_OP::STATIC_DEALLOC:
+    case MMGR_OP::STATIC_ALLOC_WAIT:
+    case MMGR_OP::FRAME_ALLOC:
+    case MMGR_OP::FRAME_CREATE:
+    case MMGR_OP::FRAME_RESET:
+    case MMGR_OP::FRAME_DESTROY:
+    case MMGR_OP::COMPACT:
+    case MMGR_OP::CHECKPOINT:
+      return bin_type_name(bin_type);
+    case MMGR_OP::SMALL_ALLOC:
+      return bin_type_name(BIN_TYPE::SLAB);
+    case MMGR_OP::INSTANT_ALLOC:
+    case MMGR_OP::INSTANT_REALLOC:
+    case MMGR_OP::INSTANT_DEALLOC:
+    case MMGR_OP::INSTANT_ALLOC_WAIT:
+      return "instant";
+    case MMGR_OP::CACHE_STORE:
+    case MMGR_OP::CACHE_DEALLOC:
+    case MMGR_OP::CACHE_SET:
+    case MMGR_OP::CACHE_RETRIEVE:
+      return "cache";
+    case MMGR_OP::WRITE:
+    case MMGR_OP::PARALLEL_WRITE:
+    case MMGR_OP::PARALLEL_FILL:
+      // any kind of segment
+      return "any";
+  }
+  return "unknown";
+}
+
+// label values escape backslash, double quote and line feed
+std::string
+escape_label(std::string_view value)
+{
+  std::string __escaped;
+  __escaped.reserve(value.size());
+  for (const char c : value) {
+    switch (c) {
+      case '\\':
+        __escaped += "\\\\";
+        break;
+      case '"':
+        __escaped += "\\\"";
+        break;
+      case '\n':
+        __escaped += "\\n";
+        break;
+      default:
+        __escaped += c;
+    }
+  }
+  return __escaped;
+}
+
+void
+family(std::string&     out,
+       std::string_view metric,
+       std::string_view type,
+       std::string_view help)
+{
+  out += fmt::format("# HELP {} {}\n# TYPE {} {}\n", metric, help, metric, type);
+}
+
+}
+
+std::string_view
+op_name(const MMGR_OP op) noexcept
+{
+  switch (op) {
+    case MMGR_OP::STATIC_ALLOC:
+      return "static_alloc";
+    case MMGR_OP::SMALL_ALLOC:
+      return "small_alloc";
+    case MMGR_OP::STATIC_REALLOC:
+      return "static_realloc";
+    case MMGR_OP::STATIC_DEALLOC:
+      return "static_dealloc";
+    case MMGR_OP::INSTANT_ALLOC:
+      return "instant_alloc";
+    case MMGR_OP::INSTANT_REALLOC:
+      return "instant_realloc";
+    case MMGR_OP::INSTANT_DEALLOC:
+      return "instant_dealloc";
+    case MMGR_OP::CACHE_STORE:
+      return "cache_store";
+    case MMGR_OP::CACHE_DEALLOC:
+      return "cache_dealloc";
+    case MMGR_OP::FRAME_ALLOC:
+      return "frame_alloc";
+    case MMGR_OP::STATIC_ALLOC_WAIT:
+      return "static_alloc_wait";
+    case MMGR_OP::INSTANT_ALLOC_WAIT:
+      return "instant_alloc_wait";
+    case MMGR_OP::CACHE_SET:
+      return "cache_set";
+    case MMGR_OP::CACHE_RETRIEVE:
+      return "cache_retrieve";
+    case MMGR_OP::FRAME_CREATE:
+      return "frame_create";
+    case MMGR_OP::FRAME_RESET:
+      return "frame_reset";
+    case MMGR_OP::FRAME_DESTROY:
+      return "frame_destroy";
+    case MMGR_OP::COMPACT:
+      return "compact";
+    case MMGR_OP::CHECKPOINT:
+      return "checkpoint";
+    case MMGR_OP::WRITE:
+      return "write";
+    case MMGR_OP::PARALLEL_WRITE:
+      return "parallel_write";
+    case MMGR_OP::PARALLEL_FILL:
+      return "parallel_fill";
+  }
+  return "unknown";
+}
+
+size_t
+op_counters::stripe_of() noexcept
+{
+  static std::atomic_size_t  __next{ 0 };
+  thread_local const size_t __stripe =
+    __next.fetch_add(1, std::memory_order_relaxed) % STRIPES;
+  return __stripe;
+}
+
+void
+op_counters::record(const MMGR_OP op, const bool failed) noexcept
+{
+  auto&        __stripe = this->stripes_[stripe_of()];
+  const size_t __op     = static_cast<size_t>(op);
+  __stripe.calls[__op].fetch_add(1, std::memory_order_relaxed);
+  if (failed) {
+    __stripe.failures[__op].fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+std::array<op_stats, MMGR_OP_COUNT>
+op_counters::snapshot() const noexcept
+{
+  std::array<op_stats, MMGR_OP_COUNT> __ops{};
+  for (const auto& stripe : this->stripes_) {
+    for (size_t op = 0; op < MMGR_OP_COUNT; op++) {
+      __ops[op].calls += stripe.calls[op].load(std::memory_order_relaxed);
+      __ops[op].failures += stripe.failures[op].load(std::memory_order_relaxed);
+    }
+  }
+  return __ops;
+}
+
+void
+op_counters::time_ops(const bool timed) noexcept
+{
+#ifdef MMGR_LATENCY_HISTOGRAMS
+  if (timed) {
+    // calibrate now rather than in the first timed op
+    latency_clock::nanos_per_tick();
+  }
+  this->timed_ = timed;
+#endif
+}
+
+latency_histogram*
+op_counters::latency(const MMGR_OP op) noexcept
+{
+#ifdef MMGR_LATENCY_HISTOGRAMS
+  return this->timed_ ? &this->latency_[static_cast<size_t>(op)] : nullptr;
+#else
+  return nullptr;
+#endif
+}
+
+const latency_histogram*
+op_counters::latency(const MMGR_OP op) const noexcept
+{
+#ifdef MMGR_LATENCY_HISTOGRAMS
+  return this->timed_ ? &this->latency_[static_cast<size_t>(op)] : nullptr;
+#else
+  return nullptr;
+#endif
+}
+
+latency_summary
+op_counters::latency_summary_of(const MMGR_OP op) const noexcept
+{
+#ifdef MMGR_LATENCY_HISTOGRAMS
+  if (this->timed_) {
+    return this->latency_[static_cast<size_t>(op)].summary();
+  }
+#endif
+  return {};
+}
+
+void
+op_counters::reset_latency() noexcept
+{
+#ifdef MMGR_LATENCY_HISTOGRAMS
+  for (auto& histogram : this->latency_) {
+    histogram.reset();
+  }
+#endif
+}
+
+void
+op_counters::reset() noexcept
+{
+  for (auto& stripe : this->stripes_) {
+    for (size_t op = 0; op < MMGR_OP_COUNT; op++) {
+      stripe.calls[op].store(0, std::memory_order_relaxed);
+      stripe.failures[op].store(0, std::memory_order_relaxed);
+    }
+  }
+}
+
+std::string
+to_prometheus(const mmgr_stats& stats)
+{
+  std::string __out;
+  const auto  __mmgr = fmt::format("mmgr=\"{}\"", escape_label(stats.name));
+
+  family(__out, "mmgr_segments", "gauge", "Live segments of every kind.");
+  __out += fmt::format("mmgr_segments{{{}}} {}\n", __mmgr, stats.segments);
+
+  family(__out, "mmgr_batch_bytes", "gauge", "Bytes of a static batch.");
+  for (const auto& batch : stats.batches) {
+    __out += fmt::format(
+      "mmgr_batch_bytes{{{},batch=\"{}\"}} {}\n", __mmgr, batch.id, batch.total_bytes);
+  }
+  family(__out,
+         "mmgr_batch_used_bytes",
+         "gauge",
+         "Bytes of the chunks taken in the static bins of a batch.");
+  for (const auto& batch : stats.batches) {
+    __out += fmt::format("mmgr_batch_used_bytes{{{},batch=\"{}\"}} {}\n",
+                         __mmgr,
+                         batch.id,
+                         batch.used_bytes);
+  }
+
+  family(__out, "mmgr_bin_chunks", "gauge", "Chunks of a bin by state.");
+  for (const auto& batch : stats.batches) {
+    for (const auto& bin : batch.bins) {
+      const auto __labels =
+        fmt::format("{},batch=\"{}\",bin=\"{}\",type=\"{}\",chunk_size=\"{}\"",
+                    __mmgr,
+                    batch.id,
+                    bin.id,
+                    bin_type_name(bin.type),
+                    bin.chunk_size);
+      __out += fmt::format("mmgr_bin_chunks{{{},state=\"free\"}} {}\n",
+                           __labels,
+                           bin.free_chunks);
+      __out += fmt::format("mmgr_bin_chunks{{{},state=\"allocated\"}} {}\n",
+                           __labels,
+                           bin.chunk_count - bin.free_chunks);
+    }
+  }
+  family(__out,
+         "mmgr_bin_largest_free_chunks",
+         "gauge",
+         "Chunks of the longest free run of a bin.");
+  for (const auto& batch : stats.batches) {
+    for (const auto& bin : batch.bins) {
+      __out += fmt::format(
+        "mmgr_bin_largest_free_chunks{{{},batch=\"{}\",bin=\"{}\"}} {}\n",
+        __mmgr,
+        batch.id,
+        bin.id,
+        bin.largest_free);
+    }
+  }
+
+  family(__out, "mmgr_instant_segments", "gauge", "Live instant segments.");
+  __out +=
+    fmt::format("mmgr_instant_segments{{{}}} {}\n", __mmgr, stats.instant_segments);
+  family(__out, "mmgr_instant_bytes", "gauge", "Bytes of the instant segments.");
+  __out += fmt::format("mmgr_instant_bytes{{{}}} {}\n", __mmgr, stats.instant_bytes);
+
+  family(__out, "mmgr_cache_segments", "gauge", "Live cache segments.");
+  __out +=
+    fmt::format("mmgr_cache_segments{{{}}} {}\n", __mmgr, stats.cache.segments);
+  family(__out, "mmgr_cache_bytes", "gauge", "Bytes held by the cache bin.");
+  __out += fmt::format("mmgr_cache_bytes{{{}}} {}\n", __mmgr, stats.cache.bytes);
+  family(__out, "mmgr_cache_hits_total", "counter", "Cache bin hits.");
+  __out += fmt::format("mmgr_cache_hits_total{{{}}} {}\n", __mmgr, stats.cache.hits);
+  family(__out, "mmgr_cache_misses_total", "counter", "Cache bin misses.");
+  __out +=
+    fmt::format("mmgr_cache_misses_total{{{}}} {}\n", __mmgr, stats.cache.misses);
+  family(__out, "mmgr_cache_evictions_total", "counter", "Cache bin evictions.");
+  __out += fmt::format(
+    "mmgr_cache_evictions_total{{{}}} {}\n", __mmgr, stats.cache.evictions);
+
+  family(__out, "mmgr_ops_total", "counter", "Calls of an mmgr operation.");
+  for (size_t op = 0; op < MMGR_OP_COUNT; op++) {
+    __out += fmt::format("mmgr_ops_total{{{},op=\"{}\"}} {}\n",
+                         __mmgr,
+                         op_name(static_cast<MMGR_OP>(op)),
+                         stats.ops[op].calls);
+  }
+  family(__out,
+         "mmgr_op_failures_total",
+         "counter",
+         "Calls of an mmgr operation that failed.");
+  for (size_t op = 0; op < MMGR_OP_COUNT; op++) {
+    __out += fmt::format("mmgr_op_failures_total{{{},op=\"{}\"}} {}\n",
+                         __mmgr,
+                         op_name(static_cast<MMGR_OP>(op)),
+                         stats.ops[op].failures);
+  }
+
+  family(__out,
+         "mmgr_op_latency_seconds",
+         "summary",
+         "Latency of an mmgr operation, bucket upper bounds.");
+  for (size_t op = 0; op < MMGR_OP_COUNT; op++) {
+    const auto& __latency = stats.latency[op];
+    if (__latency.count == 0) {
+      continue;
+    }
+    const auto __labels =
+      fmt::format("{},op=\"{}\",bin=\"{}\"",
+                  __mmgr,
+                  op_name(static_cast<MMGR_OP>(op)),
+                  op_bin_name(static_cast<MMGR_OP>(op), stats.bin_type));
+    const std::pair<std::string_view, uint64_t> __quantiles[] = {
+      { "0.5", __latency.p50 },   { "0.9", __latency.p90 },
+      { "0.99", __latency.p99 },  { "0.999", __latency.p999 },
+      { "1", __latency.max },
+    };
+    for (const auto& [quantile, nanos] : __quantiles) {
+      __out += fmt::format("mmgr_op_latency_seconds{{{},quantile=\"{}\"}} {:.9f}\n",
+                           __labels,
+                           quantile,
+                           nanos / 1e9);
+    }
+    __out += fmt::format("mmgr_op_latency_seconds_sum{{{}}} {:.9f}\n",
+                         __labels,
+                         __latency.sum / 1e9);
+    __out += fmt::format(
+      "mmgr_op_latency_seconds_count{{{}}} {}\n", __labels, __latency.count);
+  }
+  return __out;
+}
+
+}
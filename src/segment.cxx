@@ -1,6 +1,7 @@
 #include "segment.hpp"
 #include "except.hpp"
 #include "mmgr.hpp"
+#include "shm_resource.hpp"
 
 #include <cstring>
 #include <fmt/format.h>
@@ -24,6 +25,9 @@ segment_info::segment_info(std::string_view mmgr_name,
   this->size_         = size;
   this->type_         = seg_type;
   this->local_buffer_ = nullptr;
+  this->batch_id_     = shm_resource::NO_REGION;
+  this->bin_id_       = 0;
+  this->alignment_    = 0;
 }
 segment_info::segment_info(std::string_view mmgr_name,
                            const size_t     id,
@@ -34,18 +38,22 @@ segment_info::segment_info(std::string_view mmgr_name,
                            const size_t     bin_id)
   : segment_info(mmgr_name, id, size, seg_type)
 {
-  this->addr_pshift_  = addr_pshift;
-  this->batch_id_     = batch_id;
-  this->bin_id_       = bin_id;
-  this->local_buffer_ = nullptr;
+  this->addr_pshift_ = addr_pshift;
+  this->batch_id_    = batch_id;
+  this->bin_id_      = bin_id;
 }
 
 segment_info::segment_info(std::shared_ptr<cache_segment> segment)
   : segment_info(segment->mmgr_name,
                  segment->id,
                  segment->size,
-                 SEG_TYPE::CACHE_SEGMENT)
-{}
+                 SEG_TYPE::CACHE_SEGMENT,
+                 segment->addr_pshift,
+                 segment->region_id,
+                 0)
+{
+  this->alignment_ = segment->alignment;
+}
 
 segment_info::segment_info(std::shared_ptr<static_segment> segment)
   : segment_info(segment->mmgr_name,
@@ -56,6 +64,7 @@ segment_info::segment_info(std::shared_ptr<static_segment> segment)
   this->batch_id_    = segment->batch_id;
   this->bin_id_      = segment->bin_id;
   this->addr_pshift_ = segment->addr_pshift;
+  this->alignment_   = segment->alignment;
 }
 
 segment_info::segment_info(std::shared_ptr<instant_segment> segment)
@@ -65,6 +74,7 @@ segment_info::segment_info(std::shared_ptr<instant_segment> segment)
                  SEG_TYPE::INSTANT_SEGMENT)
 {
   this->addr_pshift_ = 0;
+  this->alignment_   = segment->alignment;
 }
 char*
 segment_info::ptr() const noexcept
@@ -81,6 +91,12 @@ segment_info::status() const noexcept
   return this->status_;
 }
 
+size_t
+segment_info::alignment() const noexcept
+{
+  return this->alignment_;
+}
+
 std::string_view
 segment_info::mmgr_name() const noexcept
 {
@@ -115,7 +131,9 @@ segment_info::shm_name() const noexcept
   // TODO:
   switch (this->type_) {
     case SEG_TYPE::CACHE_SEGMENT:
-      return "";
+      return batch_id_ == shm_resource::NO_REGION
+               ? ""
+               : shm_resource::region_name(mmgr_name(), batch_id_);
     case SEG_TYPE::STATIC_SEGMENT:
       return fmt::format("{}#batch{}#statbin", mmgr_name(), batch_id_);
     case SEG_TYPE::INSTANT_SEGMENT:
@@ -136,7 +154,11 @@ cache_segment::cache_segment(std::string_view mmgr_name,
 segment_info
 cache_segment::to_seginfo() const noexcept
 {
-  return { mmgr_name, id, size, SEG_TYPE::CACHE_SEGMENT };
+  segment_info __info{
+    mmgr_name, id, size, SEG_TYPE::CACHE_SEGMENT, addr_pshift, region_id, 0
+  };
+  __info.alignment_ = alignment;
+  return __info;
 }
 
 cache_segment::cache_segment()
@@ -156,7 +178,9 @@ instant_segment::instant_segment(std::string_view mmgr_name,
 segment_info
 instant_segment::to_seginfo() const noexcept
 {
-  return { mmgr_name, id, size, SEG_TYPE::INSTANT_SEGMENT };
+  segment_info __info{ mmgr_name, id, size, SEG_TYPE::INSTANT_SEGMENT };
+  __info.alignment_ = alignment;
+  return __info;
 }
 instant_segment::instant_segment()
 {
@@ -173,7 +197,7 @@ static_segment::static_segment(std::string_view mmgr_name,
   this->mmgr_name   = mmgr_name;
   this->id          = id;
   this->size        = size;
-  this->type        = SEG_TYPE::CACHE_SEGMENT;
+  this->type        = SEG_TYPE::STATIC_SEGMENT;
   this->batch_id    = batch_id;
   this->bin_id      = bin_id;
   this->addr_pshift = addr_pshift;
@@ -181,7 +205,10 @@ static_segment::static_segment(std::string_view mmgr_name,
 segment_info
 static_segment::to_seginfo() const noexcept
 {
-  return segment_info(mmgr_name, id, size, type, addr_pshift, batch_id, bin_id);
+  segment_info __info(
+    mmgr_name, id, size, type, addr_pshift, batch_id, bin_id);
+  __info.alignment_ = alignment;
+  return __info;
 }
 static_segment::static_segment()
 {
@@ -0,0 +1,49 @@
+#include "shm_keeper.hpp"
+
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace shm_kernel::memory_manager {
+
+namespace {
+struct shm_keeper
+{
+  std::mutex mtx;
+  // mmgr name -> kept handles
+  std::multimap<std::string, std::shared_ptr<void>, std::less<>> owners;
+};
+
+shm_keeper&
+keeper() noexcept
+{
+  // leaked on purpose, see keep_shm
+  static auto* __keeper = new shm_keeper();
+  return *__keeper;
+}
+}
+
+void
+keep_shm(std::string_view mmgr_name, std::shared_ptr<void> owner) noexcept
+{
+  if (owner == nullptr) {
+    return;
+  }
+  auto&                       __keeper = keeper();
+  std::lock_guard<std::mutex> GG(__keeper.mtx);
+  try {
+    __keeper.owners.emplace(std::string(mmgr_name), std::move(owner));
+  } catch (const std::bad_alloc&) {
+    // the object is unlinked as before
+  }
+}
+
+void
+release_kept_shm(std::string_view mmgr_name) noexcept
+{
+  auto&                       __keeper = keeper();
+  std::lock_guard<std::mutex> GG(__keeper.mtx);
+  auto [__first, __last] = __keeper.owners.equal_range(mmgr_name);
+  __keeper.owners.erase(__first, __last);
+}
+}
@@ -0,0 +1,128 @@
+#include "shm_resource.hpp"
+#include "config.hpp"
+#include "mapped_file.hpp"
+
+#include <fmt/format.h>
+#include <ipc/shmhdl.hpp>
+#include <new>
+
+namespace shm_kernel::memory_manager {
+
+shm_resource::shm_resource(std::string_view    mmgr_name,
+                           std::atomic_size_t& region_counter)
+  : mmgr_name_(mmgr_name)
+  , region_counter_(region_counter)
+{}
+
+shm_resource::~shm_resource() = default;
+
+std::string
+shm_resource::region_name(std::string_view mmgr_name, const size_t region_id)
+{
+  return fmt::format("{}#cache#region{}", mmgr_name, region_id);
+}
+
+shm_resource::region*
+shm_resource::make_region(const size_t nbytes)
+{
+  const size_t                 __id = this->region_counter_++;
+  std::unique_ptr<ipc::shmhdl> __handle;
+  try {
+    __handle = std::make_unique<ipc::shmhdl>(
+      region_name(this->mmgr_name_, __id), nbytes);
+  } catch (const std::exception&) {
+    throw std::bad_alloc();
+  }
+  std::error_code ec;
+  auto*           __base = static_cast<char*>(__handle->map(ec));
+  if (ec || __base == nullptr) {
+    throw std::bad_alloc();
+  }
+  auto __iter = this->regions_.emplace(
+    __base, region{ std::move(__handle), __base, __id, nbytes, 0, 0 });
+  return &__iter.first->second;
+}
+
+const shm_resource::region*
+shm_resource::find(const void* ptr) const noexcept
+{
+  auto __iter = this->regions_.upper_bound(static_cast<const char*>(ptr));
+  if (__iter == this->regions_.begin()) {
+    return nullptr;
+  }
+  --__iter;
+  if (static_cast<const char*>(ptr) >= __iter->first + __iter->second.nbytes) {
+    return nullptr;
+  }
+  return &__iter->second;
+}
+
+void*
+shm_resource::do_allocate(size_t bytes, size_t alignment)
+{
+  const size_t __page = page_size();
+  if (bytes >= CACHE_REGION_SIZE / 2) {
+    // a region of its own, unlinked as soon as it is returned
+    auto* __region = this->make_region((bytes + __page - 1) / __page * __page);
+    __region->top  = bytes;
+    __region->live = bytes;
+    return __region->base;
+  }
+  auto __fits = [&](const region* r) {
+    const size_t __top = (r->top + alignment - 1) / alignment * alignment;
+    return __top + bytes <= r->nbytes;
+  };
+  if (this->current_ == nullptr || !__fits(this->current_)) {
+    this->current_ = this->make_region(CACHE_REGION_SIZE);
+  }
+  auto&        __region = *this->current_;
+  const size_t __top = (__region.top + alignment - 1) / alignment * alignment;
+  __region.top       = __top + bytes;
+  __region.live += bytes;
+  return __region.base + __top;
+}
+
+void
+shm_resource::do_deallocate(void* ptr, size_t bytes, size_t /* alignment */)
+{
+  auto* __region = const_cast<region*>(this->find(ptr));
+  if (__region == nullptr) {
+    return;
+  }
+  __region->live -= bytes;
+  if (__region->live != 0) {
+    return;
+  }
+  if (__region == this->current_) {
+    // keep bumping from the start of the empty region
+    __region->top = 0;
+    return;
+  }
+  this->regions_.erase(__region->base);
+}
+
+bool
+shm_resource::do_is_equal(const std::pmr::memory_resource& other) const
+  noexcept
+{
+  return this == &other;
+}
+
+std::pair<size_t, size_t>
+shm_resource::locate(const void* ptr) const noexcept
+{
+  const auto* __region = this->find(ptr);
+  if (__region == nullptr) {
+    return { NO_REGION, 0 };
+  }
+  return { __region->id,
+           static_cast<size_t>(static_cast<const char*>(ptr) - __region->base) };
+}
+
+size_t
+shm_resource::region_count() const noexcept
+{
+  return this->regions_.size();
+}
+
+}
@@ -0,0 +1,163 @@
+#include "size_histogram.hpp"
+#include "config.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace shm_kernel::memory_manager {
+
+size_t
+size_histogram::bucket_of(const size_t nbytes) noexcept
+{
+  if (nbytes <= 32) {
+    return nbytes == 0 ? 0 : (nbytes - 1) / 8;
+  }
+  // nbytes in (2^k, 2^(k+1)], split into SUB_BUCKETS of 2^(k-2) bytes
+  const size_t __k     = 63 - __builtin_clzll(nbytes - 1);
+  const size_t __width = size_t(1) << (__k - 2);
+  const size_t __j = (nbytes - (size_t(1) << __k) + __width - 1) / __width;
+  return SUB_BUCKETS + (__k - 5) * SUB_BUCKETS + __j - 1;
+}
+
+size_t
+size_histogram::upper_bound(const size_t bucket) noexcept
+{
+  if (bucket < SUB_BUCKETS) {
+    return (bucket + 1) * 8;
+  }
+  const size_t __k = 5 + (bucket - SUB_BUCKETS) / SUB_BUCKETS;
+  const size_t __j = (bucket - SUB_BUCKETS) % SUB_BUCKETS + 1;
+  if (__k == 63 && __j == SUB_BUCKETS) {
+    return std::numeric_limits<size_t>::max();
+  }
+  return (size_t(1) << __k) + __j * (size_t(1) << (__k - 2));
+}
+
+void
+size_histogram::record(const size_t nbytes) noexcept
+{
+  const auto __bucket = bucket_of(nbytes);
+  this->counts_[__bucket].fetch_add(1, std::memory_order_relaxed);
+  this->bytes_[__bucket].fetch_add(nbytes, std::memory_order_relaxed);
+}
+
+size_t
+size_histogram::samples() const noexcept
+{
+  size_t __samples = 0;
+  for (const auto& count : this->counts_) {
+    __samples += count.load(std::memory_order_relaxed);
+  }
+  return __samples;
+}
+
+bin_layout
+size_histogram::derive_layout(const size_t bin_count,
+                              const size_t budget) const
+{
+  std::vector<double> __bound, __count, __bytes;
+  for (size_t b = 0; b < BUCKETS; b++) {
+    const auto __c = this->counts_[b].load(std::memory_order_relaxed);
+    if (__c == 0) {
+      continue;
+    }
+    __bound.push_back(upper_bound(b));
+    __count.push_back(__c);
+    __bytes.push_back(this->bytes_[b].load(std::memory_order_relaxed));
+  }
+  const size_t __n = __bound.size();
+  if (__n == 0 || bin_count == 0) {
+    return {};
+  }
+  std::vector<double> __C(__n + 1, 0), __B(__n + 1, 0);
+  for (size_t i = 0; i < __n; i++) {
+    __C[i + 1] = __C[i] + __count[i];
+    __B[i + 1] = __B[i] + __bytes[i];
+  }
+  // waste of one chunk size serving the buckets (j, i]
+  auto __cost = [&](const size_t j, const size_t i) {
+    return __bound[i - 1] * (__C[i] - __C[j]) - (__B[i] - __B[j]);
+  };
+
+  // dp[k][i], k + 1 chunk sizes covering the first i buckets
+  const size_t __K = std::min(bin_count, __n);
+  const double __inf = std::numeric_limits<double>::infinity();
+  std::vector<std::vector<double>> __dp(__K, std::vector<double>(__n + 1, __inf));
+  std::vector<std::vector<size_t>> __from(__K, std::vector<size_t>(__n + 1, 0));
+  for (size_t i = 1; i <= __n; i++) {
+    __dp[0][i] = __cost(0, i);
+  }
+  for (size_t k = 1; k < __K; k++) {
+    for (size_t i = k + 1; i <= __n; i++) {
+      for (size_t j = k; j < i; j++) {
+        const double __v = __dp[k - 1][j] + __cost(j, i);
+        if (__v < __dp[k][i]) {
+          __dp[k][i]   = __v;
+          __from[k][i] = j;
+        }
+      }
+    }
+  }
+
+  // walk back from the last bucket
+  std::vector<std::pair<size_t, size_t>> __classes;
+  size_t                                 __i = __n;
+  for (size_t k = __K; k-- > 0;) {
+    const size_t __j = k == 0 ? 0 : __from[k][__i];
+    __classes.emplace_back(__j, __i);
+    __i = __j;
+  }
+  std::reverse(__classes.begin(), __classes.end());
+
+  bin_layout          __layout;
+  std::vector<double> __demand;
+  double              __total = 0;
+  for (const auto& [j, i] : __classes) {
+    size_t __size = static_cast<size_t>(__bound[i - 1]);
+    __size        = (__size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    __layout.chunk_size.push_back(__size);
+    __demand.push_back(__size * (__C[i] - __C[j]));
+    __total += __demand.back();
+  }
+  for (size_t k = 0; k < __layout.chunk_size.size(); k++) {
+    const double __share = budget * __demand[k] / __total;
+    __layout.chunk_count.push_back(std::max<size_t>(
+      1, static_cast<size_t>(std::llround(__share / __layout.chunk_size[k]))));
+  }
+  return __layout;
+}
+
+double
+size_histogram::predicted_waste(
+  const std::vector<size_t>& chunk_size) const noexcept
+{
+  if (chunk_size.empty()) {
+    return 0;
+  }
+  std::vector<size_t> __sizes(chunk_size);
+  std::sort(__sizes.begin(), __sizes.end());
+  double __waste = 0, __total = 0;
+  for (size_t b = 0; b < BUCKETS; b++) {
+    const double __c = this->counts_[b].load(std::memory_order_relaxed);
+    if (__c == 0) {
+      continue;
+    }
+    const double __bytes = this->bytes_[b].load(std::memory_order_relaxed);
+    const size_t __bound = upper_bound(b);
+    auto __fit = std::lower_bound(__sizes.begin(), __sizes.end(), __bound);
+    double __taken;
+    if (__fit != __sizes.end()) {
+      __taken = static_cast<double>(*__fit);
+    } else {
+      // several of the largest chunks
+      const double __largest = static_cast<double>(__sizes.back());
+      __taken = std::ceil(__bound / __largest) * __largest;
+    }
+    __waste += __c * __taken - __bytes;
+    __total += __bytes;
+  }
+  return __total == 0 ? 0 : __waste / __total;
+}
+
+}
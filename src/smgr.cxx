@@ -1,24 +1,381 @@
 #include "smgr.hpp"
 #include "ec.hpp"
+#include "frame.hpp"
 #include "segment.hpp"
 
 #include <atomic>
+#include <thread>
 #include <utility>
 namespace shm_kernel::memory_manager {
 smgr::smgr(std::string_view name, std::shared_ptr<spdlog::logger> logger)
-  : name_(name)
-  , logger_(logger)
+  : logger_(logger)
+  , name_(name)
 {}
 
 smgr::smgr(std::string&& name, std::shared_ptr<spdlog::logger> logger)
-  : name_(std::forward<std::string&>(name))
-  , logger_(logger)
+  : logger_(logger)
+  , name_(std::forward<std::string&>(name))
 {
   logger_->trace("正在初始化Segment Manager...");
   // TODO
   logger_->trace("Segment Manager初始化完毕!");
 }
 
+smgr::smgr(std::string_view                name,
+           std::string_view                backing_dir,
+           std::shared_ptr<spdlog::logger> logger)
+  : logger_(logger)
+  , backing_dir_(backing_dir)
+  , name_(name)
+{}
+
+smgr::~smgr()
+{
+  // a consumer gone while pinned would stall COMPACT
+  while (this->pins_ > 0) {
+    this->unpin();
+  }
+}
+
+char*
+smgr::attach(const std::string& shm_name,
+             std::error_code&   ec,
+             const size_t       alignment,
+             const bool         shm_only) noexcept
+{
+  ec.clear();
+  const bool __file_backed = !shm_only && !this->backing_dir_.empty();
+  // the ipc handle maps wherever the kernel likes, over-aligned segments
+  // take an own mapping
+  if (__file_backed || alignment > page_size()) {
+    auto __file_iter = this->attached_file_.find(shm_name);
+    if (__file_iter == this->attached_file_.end()) {
+      std::shared_ptr<mapped_file> __file;
+      try {
+        __file = !__file_backed
+                   ? mapped_file::open_shm(shm_name)
+                   : std::make_shared<mapped_file>(
+                       backing_path(this->backing_dir_, shm_name));
+      } catch (...) {
+        ec = MmgrErrc::UnableToAttachShm;
+        return nullptr;
+      }
+      if (alignment > page_size() && __file->align(alignment, ec) != 0) {
+        this->logger_->error("无法对齐 {}: {}", shm_name, ec.message());
+        ec = MmgrErrc::UnableToAttachShm;
+        return nullptr;
+      }
+      __file_iter =
+        this->attached_file_.insert({ shm_name, { __file, 0 } }).first;
+    }
+    auto* __buffer = static_cast<char*>(__file_iter->second.first->map(ec));
+    if (__buffer == nullptr) {
+      ec = MmgrErrc::NullptrBuffer;
+      return nullptr;
+    }
+    __file_iter->second.second += 1;
+    return __buffer;
+  }
+
+  auto __shm_iter = this->attached_shm_.find(shm_name);
+  if (__shm_iter == attached_shm_.end()) {
+    // attach
+    std::shared_ptr<shm> __shm;
+    try {
+      __shm = std::make_shared<shm>(shm_name);
+    } catch (...) {
+      ec = MmgrErrc::UnableToAttachShm;
+      return nullptr;
+    }
+    __shm_iter = this->attached_shm_.insert({ shm_name, { __shm, 0 } }).first;
+  }
+  // if shm object found, increase the local ref_count
+  auto* __buffer = static_cast<char*>(__shm_iter->second.first->map(ec));
+  if (__buffer == nullptr) {
+    ec = MmgrErrc::NullptrBuffer;
+    return nullptr;
+  }
+  __shm_iter->second.second += 1;
+  return __buffer;
+}
+
+void
+smgr::detach(const std::string& shm_name) noexcept
+{
+  if (auto __file_iter = this->attached_file_.find(shm_name);
+      __file_iter != this->attached_file_.end()) {
+    if (--__file_iter->second.second == 0) {
+      this->attached_file_.erase(__file_iter);
+    }
+    return;
+  }
+  if (auto __shm_iter = this->attached_shm_.find(shm_name);
+      __shm_iter != this->attached_shm_.end()) {
+    if (--__shm_iter->second.second == 0) {
+      this->attached_shm_.erase(__shm_iter);
+    }
+  }
+}
+
+instant_dir_header*
+smgr::instant_dir(std::string_view mmgr_name) noexcept
+{
+  if (this->instant_dir_ != nullptr) {
+    return this->instant_dir_;
+  }
+  try {
+    this->instant_dir_handle_ =
+      std::make_unique<shm>(fmt::format("{}#instbin#dir", mmgr_name));
+  } catch (...) {
+    this->logger_->warn("无法attach {}#instbin#dir, instant segments will not "
+                        "follow resizes",
+                        mmgr_name);
+    return nullptr;
+  }
+  std::error_code ec;
+  auto* __dir =
+    static_cast<instant_dir_header*>(this->instant_dir_handle_->map(ec));
+  if (ec || __dir == nullptr || __dir->magic != INSTANT_DIR_MAGIC ||
+      __dir->version != DIRECTORY_VERSION) {
+    this->instant_dir_handle_.reset();
+    return nullptr;
+  }
+  this->instant_dir_ = __dir;
+  return __dir;
+}
+
+int
+smgr::remap_instant(std::shared_ptr<segment_info> seg,
+                    std::error_code&              ec) noexcept
+{
+  ec.clear();
+  auto __gen_iter = this->instant_gens_.find(seg->id_);
+  if (__gen_iter == this->instant_gens_.end()) {
+    return 0;
+  }
+  auto& [__slot, __gen] = __gen_iter->second;
+  const uint64_t __current =
+    this->instant_dir_->generations()[__slot].load(std::memory_order_acquire);
+  if (__current == __gen) {
+    return 0;
+  }
+  auto __name      = seg->shm_name();
+  auto __file_iter = this->attached_file_.find(__name);
+  if (__file_iter == this->attached_file_.end()) {
+    // the ipc handle's mapping can't follow the resize, swap it for an own
+    // mapping of the same object
+    auto __shm_iter = this->attached_shm_.find(__name);
+    if (__shm_iter == this->attached_shm_.end()) {
+      ec = MmgrErrc::ShmHandleNotFound;
+      return -1;
+    }
+    std::shared_ptr<mapped_file> __file;
+    try {
+      __file = mapped_file::open_shm(__name);
+    } catch (...) {
+      ec = MmgrErrc::UnableToAttachShm;
+      return -1;
+    }
+    __file_iter =
+      this->attached_file_
+        .insert({ __name, { __file, __shm_iter->second.second } })
+        .first;
+    this->attached_shm_.erase(__shm_iter);
+  }
+  auto& __file = __file_iter->second.first;
+  if (__file->remap(ec) != 0) {
+    this->logger_->error("remap {} failed: {}", __name, ec.message());
+    return -1;
+  }
+  seg->set_ptr(__file->map(ec));
+  seg->size_ = __file->nbytes();
+  __gen      = __current;
+  return 0;
+}
+
+forward_header*
+smgr::forward_table(std::string_view mmgr_name) noexcept
+{
+  if (this->forward_ != nullptr) {
+    return this->forward_;
+  }
+  try {
+    this->forward_handle_ =
+      std::make_unique<shm>(fmt::format("{}#forward", mmgr_name));
+  } catch (...) {
+    this->logger_->warn(
+      "无法attach {}#forward, static segments will not follow COMPACT",
+      mmgr_name);
+    return nullptr;
+  }
+  std::error_code ec;
+  auto* __fwd = static_cast<forward_header*>(this->forward_handle_->map(ec));
+  if (ec || __fwd == nullptr || __fwd->magic != FORWARD_MAGIC ||
+      __fwd->version != DIRECTORY_VERSION) {
+    this->forward_handle_.reset();
+    return nullptr;
+  }
+  this->forward_ = __fwd;
+  return __fwd;
+}
+
+char*
+smgr::mapped_base(const std::string& shm_name) noexcept
+{
+  std::error_code ec;
+  if (auto __file_iter = this->attached_file_.find(shm_name);
+      __file_iter != this->attached_file_.end()) {
+    return static_cast<char*>(__file_iter->second.first->map(ec));
+  }
+  if (auto __shm_iter = this->attached_shm_.find(shm_name);
+      __shm_iter != this->attached_shm_.end()) {
+    return static_cast<char*>(__shm_iter->second.first->map(ec));
+  }
+  return nullptr;
+}
+
+/**
+ * @brief whether the directory slot at [bin_id, addr_pshift] holds the
+ * segment
+ */
+static bool
+lives_at(batch_header* hdr,
+         const size_t  id,
+         const size_t  bin_id,
+         const size_t  addr_pshift) noexcept
+{
+  if (hdr == nullptr || hdr->magic != BATCH_MAGIC ||
+      hdr->version != DIRECTORY_VERSION || bin_id >= hdr->bin_count) {
+    return false;
+  }
+  const auto& __desc = hdr->bins()[bin_id];
+  if (addr_pshift < __desc.base_pshift ||
+      (addr_pshift - __desc.base_pshift) / __desc.slot_size >=
+        __desc.slot_count) {
+    return false;
+  }
+  auto& __slot = hdr->slots()[__desc.slot_base +
+                              (addr_pshift - __desc.base_pshift) /
+                                __desc.slot_size];
+  return __slot.size.load(std::memory_order_acquire) != 0 &&
+         __slot.id.load(std::memory_order_relaxed) == id;
+}
+
+/**
+ * @brief search the batch directory for a live segment
+ */
+static bool
+find_in_batch(batch_header* hdr,
+              const size_t  id,
+              size_t&       bin_id,
+              size_t&       addr_pshift) noexcept
+{
+  if (hdr == nullptr || hdr->magic != BATCH_MAGIC ||
+      hdr->version != DIRECTORY_VERSION) {
+    return false;
+  }
+  for (size_t b = 0; b < hdr->bin_count; b++) {
+    const auto& __desc = hdr->bins()[b];
+    for (size_t i = 0; i < __desc.slot_count; i++) {
+      auto& __slot = hdr->slots()[__desc.slot_base + i];
+      if (__slot.size.load(std::memory_order_acquire) != 0 &&
+          __slot.id.load(std::memory_order_relaxed) == id) {
+        bin_id      = __desc.id;
+        addr_pshift = __desc.base_pshift + i * __desc.slot_size;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+int
+smgr::forward_static(std::shared_ptr<segment_info> seg,
+                     std::error_code&              ec) noexcept
+{
+  ec.clear();
+  auto __loc_iter = this->static_locs_.find(seg->id_);
+  if (__loc_iter == this->static_locs_.end() || this->forward_ == nullptr) {
+    return 0;
+  }
+  auto& [__pshift, __epoch] = __loc_iter->second;
+  const uint64_t __current =
+    this->forward_->epoch.load(std::memory_order_acquire);
+  if (__current == __epoch) {
+    return 0;
+  }
+
+  size_t __batch_id = seg->batch_id_;
+  size_t __bin_id   = seg->bin_id_;
+  size_t __addr     = __pshift;
+  bool   __found    = false;
+  auto&  __entry = this->forward_->entries()[seg->id_ % this->forward_->capacity];
+  for (;;) {
+    const uint64_t __seq = __entry.seq.load(std::memory_order_acquire);
+    if (__seq % 2 != 0) {
+      continue;
+    }
+    // seq 0, never written
+    __found = __seq != 0 &&
+              __entry.id.load(std::memory_order_relaxed) == seg->id_;
+    if (__found) {
+      __batch_id = __entry.batch_id.load(std::memory_order_relaxed);
+      __bin_id   = __entry.bin_id.load(std::memory_order_relaxed);
+      __addr     = __entry.addr_pshift.load(std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (__entry.seq.load(std::memory_order_relaxed) == __seq) {
+      break;
+    }
+  }
+  if (!__found) {
+    // the entry belongs to another segment now, look where it lives
+    auto* __hdr = reinterpret_cast<batch_header*>(
+      this->mapped_base(seg->shm_name()));
+    __found = lives_at(__hdr, seg->id_, __bin_id, __addr);
+    for (size_t b = 0; !__found; b++) {
+      auto __name = fmt::format("{}#batch{}#statbin", seg->mmgr_name(), b);
+      __hdr       = reinterpret_cast<batch_header*>(this->attach(__name, ec));
+      if (__hdr == nullptr) {
+        break;
+      }
+      if (find_in_batch(__hdr, seg->id_, __bin_id, __addr)) {
+        __batch_id = b;
+        __found    = true;
+      }
+      this->detach(__name);
+    }
+    if (!__found) {
+      this->logger_->error("segment_{} is gone from every batch", seg->id_);
+      ec = MmgrErrc::SegmentNotFound;
+      return -1;
+    }
+  }
+
+  if (__batch_id != seg->batch_id_ || __addr != __pshift) {
+    auto __old_name = seg->shm_name();
+    auto __old_bid  = seg->batch_id_;
+    seg->batch_id_  = __batch_id;
+    auto  __name    = seg->shm_name();
+    char* __base;
+    if (__batch_id != __old_bid) {
+      __base = this->attach(__name, ec);
+      if (__base == nullptr) {
+        seg->batch_id_ = __old_bid;
+        return -1;
+      }
+      this->detach(__old_name);
+    } else {
+      __base = this->mapped_base(__name);
+    }
+    seg->bin_id_ = __bin_id;
+    seg->set_ptr(__base + __addr);
+    __pshift = __addr;
+  }
+  __epoch = __current;
+  return 0;
+}
+
 std::shared_ptr<segment_info>
 smgr::register_segment(const segment_info* segment,
                        std::error_code&    ec) noexcept
@@ -32,50 +389,66 @@ smgr::register_segment(const segment_info* segment,
     return nullptr;
   }
 
-  if (segment->type() == SEG_TYPE::CACHE_SEGMENT) {
+  // a private cache segment has no shm object, the consumer gets a buffer
+  // of its own
+  if (segment->type() == SEG_TYPE::CACHE_SEGMENT &&
+      segment->shm_name().empty()) {
     auto  __seg          = std::make_shared<segment_info>(*segment);
-    void* __cache_buffer = this->pmr_pool_.allocate(segment->size());
+    void* __cache_buffer = nullptr;
+    try {
+      __cache_buffer = this->pmr_pool_.allocate(
+        segment->size(), std::max(segment->alignment(), alignof(std::max_align_t)));
+    } catch (const std::bad_alloc&) {
+    }
     if (__cache_buffer == nullptr) {
       ec = MmgrErrc::NoMemory;
       return nullptr;
     }
     __seg->set_ptr(__cache_buffer);
+    this->attached_segment_.insert({ __seg->id_, __seg });
     return __seg;
   } else {
+    // cache segments of a shared cache bin are attached like static ones,
+    // from their region's shm object
+    auto* __buffer = this->attach(segment->shm_name(),
+                                  ec,
+                                  segment->type() == SEG_TYPE::INSTANT_SEGMENT
+                                    ? segment->alignment()
+                                    : 0,
+                                  segment->type() == SEG_TYPE::CACHE_SEGMENT);
+    if (__buffer == nullptr) {
+      return nullptr;
+    }
     // insert segment_info
     auto insert_seg_rv = this->attached_segment_.insert(
       { segment->id_, std::make_shared<segment_info>(*segment) });
     auto __seg = insert_seg_rv.first->second;
-
-    auto __shm_name = segment->shm_name();
-    auto __shm_iter = this->attached_shm_.find(__shm_name);
-    if (__shm_iter == attached_shm_.end()) {
-      // attach
-      std::shared_ptr<shm> __shm;
-      try {
-        __shm = std::make_shared<shm>(__shm_name);
-      } catch (...) {
-        ec = MmgrErrc::UnableToAttachShm;
-        return nullptr;
-      }
-      auto __insert_shm_rv =
-        this->attached_shm_.insert({ __shm_name, { __shm, 1 } });
-      // set current process addr
-      
-      __seg->set_ptr(static_cast<char*>(__shm->map(ec)) + __seg->addr_pshift_);
-      return __seg;
-    } else {
-      // if shm object found, increase the local ref_count
-
-      auto* __buffer = static_cast<char*>(__shm_iter->second.first->map(ec));
-      if (__buffer == nullptr) {
-        ec = MmgrErrc::NullptrBuffer;
-        return nullptr;
+    // frame segments live inside their region, which never moves
+    if (__seg->type() == SEG_TYPE::STATIC_SEGMENT &&
+        !frame_arena::is_frame_id(__seg->id_) &&
+        this->forward_table(__seg->mmgr_name()) != nullptr) {
+      // the segment_info may predate a COMPACT, check on first bufferize
+      this->static_locs_[__seg->id_] = { __seg->addr_pshift_,
+                                         static_cast<uint64_t>(-1) };
+    }
+    // set current process addr
+    __seg->set_ptr(__buffer + __seg->addr_pshift_);
+    // remember the generation the instant segment was mapped at
+    if (__seg->type() == SEG_TYPE::INSTANT_SEGMENT) {
+      if (auto* __dir = this->instant_dir(__seg->mmgr_name()); __dir) {
+        for (size_t i = 0; i < __dir->capacity; i++) {
+          auto& __entry = __dir->slots()[i];
+          if (__entry.size.load(std::memory_order_acquire) != 0 &&
+              __entry.id.load(std::memory_order_relaxed) == __seg->id_) {
+            this->instant_gens_[__seg->id_] = {
+              i, __dir->generations()[i].load(std::memory_order_acquire)
+            };
+            break;
+          }
+        }
       }
-      __shm_iter->second.second += 1;
-      __seg->set_ptr(__buffer + __seg->addr_pshift_);
-      return __seg;
     }
+    return __seg;
   }
   return nullptr;
 }
@@ -91,35 +464,27 @@ smgr::unregister_segment(const size_t segment_id, std::error_code& ec) noexcept
     return;
   }
   auto __seg = __seg_iter->second;
-  //  unregister for a cache_segment
-  if (__seg->type() == SEG_TYPE::CACHE_SEGMENT) {
-    this->pmr_pool_.deallocate(__seg->local_buffer_, __seg->size());
+  //  unregister for a private cache_segment
+  if (__seg->type() == SEG_TYPE::CACHE_SEGMENT && __seg->shm_name().empty()) {
+    this->pmr_pool_.deallocate(
+      __seg->local_buffer_,
+      __seg->size(),
+      std::max(__seg->alignment(), alignof(std::max_align_t)));
     this->attached_segment_.erase(__seg_iter);
     return;
   }
   // unregister for a shm_segment
-  auto __shm_refc_iter = this->attached_shm_.find(__seg->shm_name());
-  if (__shm_refc_iter == this->attached_shm_.end()) {
-    auto& __shm_refc = __shm_refc_iter->second.second;
-    __shm_refc--;
-    if (__shm_refc == 0) {
-      this->attached_shm_.erase(__shm_refc_iter);
-    }
-    // erase segment
-    this->attached_segment_.erase(__seg_iter);
-  }
+  this->instant_gens_.erase(segment_id);
+  this->static_locs_.erase(segment_id);
+  this->detach(__seg->shm_name());
+  // erase segment
+  this->attached_segment_.erase(__seg_iter);
 }
 
 buffer
 smgr::bufferize(std::shared_ptr<segment_info> seg, std::error_code& ec) noexcept
 {
-  ec.clear();
-  auto __seg = this->attached_segment_[seg->id()];
-  if (__seg) {
-    return { __seg->local_buffer_, __seg->size() };
-  }
-  ec = MmgrErrc::NullptrBuffer;
-  return { nullptr, 0 };
+  return this->bufferize(seg->id(), ec);
 }
 
 buffer
@@ -128,9 +493,44 @@ smgr::bufferize(const size_t segment_id, std::error_code& ec) noexcept
   ec.clear();
   auto __seg = this->attached_segment_[segment_id];
   if (__seg) {
+    if (this->remap_instant(__seg, ec) != 0 ||
+        this->forward_static(__seg, ec) != 0) {
+      return { nullptr, 0 };
+    }
     return { __seg->local_buffer_, __seg->size() };
   }
   ec = MmgrErrc::NullptrBuffer;
   return { nullptr, 0 };
 }
-}
\ No newline at end of file
+
+void
+smgr::pin(std::string_view mmgr_name) noexcept
+{
+  auto* __fwd = this->forward_table(mmgr_name);
+  if (__fwd == nullptr) {
+    return;
+  }
+  for (;;) {
+    while (__fwd->compacting.load(std::memory_order_acquire) != 0) {
+      std::this_thread::yield();
+    }
+    __fwd->pins.fetch_add(1, std::memory_order_seq_cst);
+    // COMPACT raises compacting before it reads pins
+    if (__fwd->compacting.load(std::memory_order_seq_cst) == 0) {
+      break;
+    }
+    __fwd->pins.fetch_sub(1, std::memory_order_seq_cst);
+  }
+  this->pins_++;
+}
+
+void
+smgr::unpin() noexcept
+{
+  if (this->pins_ == 0 || this->forward_ == nullptr) {
+    return;
+  }
+  this->forward_->pins.fetch_sub(1, std::memory_order_release);
+  this->pins_--;
+}
+}
@@ -1,13 +1,24 @@
+#include "async_alloc.hpp"
 #include "bins/cache_bin.hpp"
 #include "mmgr.hpp"
 #include "segment.hpp"
+#include "shm_keeper.hpp"
 #include "smgr.hpp"
+#include <algorithm>
 #include <array>
 #define CATCH_CONFIG_MAIN
 #include "batch.hpp"
+#include "latency_histogram.hpp"
 #include "mem_literals.hpp"
+#include "memops.hpp"
 #include <catch2/catch.hpp>
 #include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <numeric>
+#include <thread>
 
 namespace libmem = shm_kernel::memory_manager;
 using namespace std::chrono_literals;
@@ -188,6 +199,296 @@ SCENARIO("Store buffer in a cache bin", "[cache_bin]")
   }
 }
 
+TEST_CASE("cache bin budget and eviction", "[cache_bin]")
+{
+  std::error_code       ec;
+  std::atomic_size_t    counter{ 0 };
+  std::array<char, 100> data;
+  data.fill(0x2b);
+  std::vector<std::pair<size_t, size_t>> evicted;
+
+  SECTION("LRU")
+  {
+    libmem::cache_bin bin(
+      counter, "cache_lru", 300, libmem::CACHE_POLICY::LRU, 1);
+    bin.set_evict_callback(
+      [&](size_t id, size_t size) { evicted.emplace_back(id, size); });
+    auto s0 = bin.store(data.data(), 100, ec);
+    auto s1 = bin.store(data.data(), 100, ec);
+    auto s2 = bin.store(data.data(), 100, ec);
+    // s0 becomes the most recent, s1 is the oldest
+    REQUIRE(bin.retrieve(s0->id, ec) != nullptr);
+    auto s3 = bin.store(data.data(), 100, ec);
+    REQUIRE_FALSE(ec);
+    REQUIRE(evicted == std::vector<std::pair<size_t, size_t>>{ { s1->id, 100 } });
+    REQUIRE(bin.retrieve(s1->id, ec) == nullptr);
+    REQUIRE(ec == MmgrErrc::SegmentNotFound);
+
+    // pinned segments are skipped
+    REQUIRE(bin.pin(s2->id, ec) == 0);
+    bin.store(data.data(), 100, ec);
+    REQUIRE(evicted.back().first == s0->id);
+    REQUIRE(bin.retrieve(s2->id, ec) != nullptr);
+
+    auto stats = bin.stats();
+    REQUIRE(stats.hits == 2);
+    REQUIRE(stats.misses == 1);
+    REQUIRE(stats.evictions == 2);
+    REQUIRE(stats.bytes == 300);
+    REQUIRE(stats.segments == 3);
+
+    REQUIRE_FALSE(bin.store(data.data(), 400, ec));
+    REQUIRE(ec == MmgrErrc::CacheBudgetExceeded);
+    REQUIRE(bin.unpin(s2->id, ec) == 0);
+    REQUIRE(bin.unpin(s2->id, ec) != 0);
+  }
+
+  SECTION("CLOCK")
+  {
+    libmem::cache_bin bin(
+      counter, "cache_clock", 300, libmem::CACHE_POLICY::CLOCK, 1);
+    bin.set_evict_callback(
+      [&](size_t id, size_t size) { evicted.emplace_back(id, size); });
+    auto s0 = bin.store(data.data(), 100, ec);
+    auto s1 = bin.store(data.data(), 100, ec);
+    auto s2 = bin.store(data.data(), 100, ec);
+    // s0 gets a second chance
+    REQUIRE(bin.retrieve(s0->id, ec) != nullptr);
+    bin.store(data.data(), 100, ec);
+    REQUIRE(evicted.back().first == s1->id);
+    bin.store(data.data(), 100, ec);
+    REQUIRE(evicted.back().first == s2->id);
+    REQUIRE(bin.retrieve(s0->id, ec) != nullptr);
+    REQUIRE(bin.stats().evictions == 2);
+  }
+
+  SECTION("all pinned")
+  {
+    libmem::cache_bin bin(
+      counter, "cache_pinned", 200, libmem::CACHE_POLICY::LRU, 1);
+    auto              s0 = bin.store(data.data(), 100, ec);
+    auto              s1 = bin.store(data.data(), 100, ec);
+    bin.pin(s0->id, ec);
+    bin.pin(s1->id, ec);
+    REQUIRE_FALSE(bin.store(data.data(), 100, ec));
+    REQUIRE(ec == MmgrErrc::CacheBudgetExceeded);
+    REQUIRE(bin.segment_count() == 2);
+  }
+}
+
+TEST_CASE("cache bin set from its own buffer", "[cache_bin]")
+{
+  std::error_code       ec;
+  std::atomic_size_t    counter{ 0 };
+  libmem::cache_bin     bin(counter, "cache_self_set");
+  std::array<char, 100> data;
+  for (size_t i = 0; i < data.size(); i++) {
+    data[i] = static_cast<char>(i);
+  }
+  auto  seg = bin.store(data.data(), data.size(), ec);
+  auto* own = static_cast<char*>(bin.retrieve(seg->id, ec));
+
+  // in place, overlapping
+  REQUIRE(bin.set(seg->id, own + 10, 90, ec) == 0);
+  REQUIRE(bin.retrieve(seg->id, ec) == own);
+  for (int i = 0; i < 90; i++) {
+    REQUIRE(own[i] == static_cast<char>(i + 10));
+  }
+
+  // growing moves the buffer, the old one is released after the copy
+  REQUIRE(bin.set(seg->id, own, 400, ec) == 0);
+  auto* grown = static_cast<char*>(bin.retrieve(seg->id, ec));
+  REQUIRE(grown != own);
+  for (int i = 0; i < 90; i++) {
+    REQUIRE(grown[i] == static_cast<char>(i + 10));
+  }
+  REQUIRE(bin.stats().bytes == 400);
+}
+
+TEST_CASE("cache bin in-place set", "[cache_bin]")
+{
+  std::error_code       ec;
+  std::atomic_size_t    counter{ 0 };
+  libmem::cache_bin     bin(counter, "cache_in_place");
+  std::array<char, 256> data;
+  data.fill(0x31);
+  auto  seg  = bin.store(data.data(), 100, ec);
+  auto* orig = bin.retrieve(seg->id, ec);
+
+  // same size and shrinking updates keep the buffer
+  REQUIRE(bin.set(seg->id, data.data(), 100, ec) == 0);
+  REQUIRE(bin.set(seg->id, data.data(), 60, ec) == 0);
+  REQUIRE(bin.retrieve(seg->id, ec) == orig);
+  REQUIRE(bin.stats().in_place == 2);
+  REQUIRE(bin.stats().bytes == 100);
+
+  // growth doubles the capacity, the next growth within it is in place
+  REQUIRE(bin.set(seg->id, data.data(), 150, ec) == 0);
+  auto* grown = bin.retrieve(seg->id, ec);
+  REQUIRE(bin.stats().bytes == 200);
+  REQUIRE(bin.set(seg->id, data.data(), 190, ec) == 0);
+  REQUIRE(bin.retrieve(seg->id, ec) == grown);
+  REQUIRE(bin.stats().in_place == 3);
+
+  // realloc keeps the contents
+  auto* buff = static_cast<char*>(grown);
+  for (int i = 0; i < 190; i++) {
+    buff[i] = static_cast<char>(i);
+  }
+  buff = static_cast<char*>(bin.realloc(seg, 1000, ec));
+  REQUIRE(seg->size == 1000);
+  for (int i = 0; i < 190; i++) {
+    REQUIRE(buff[i] == static_cast<char>(i));
+  }
+  buff = static_cast<char*>(bin.realloc(seg, 50, ec));
+  REQUIRE(buff[49] == 49);
+  REQUIRE(bin.free(seg, ec) == 0);
+  REQUIRE(bin.stats().bytes == 0);
+}
+
+TEST_CASE("mmgr cache budget", "[mmgr][cache_bin]")
+{
+  std::error_code      ec;
+  libmem::mmgr_options opts;
+  opts.cache_budget = 1_KB;
+  opts.cache_shards = 1;
+  libmem::mmgr          mm("cache_budget_mmgr", { 1_KB }, { 8 }, opts);
+  std::array<char, 256> data;
+  data.fill(0x11);
+  std::vector<size_t> evicted;
+  mm.CACHE_ON_EVICT([&](size_t id, size_t) { evicted.push_back(id); });
+
+  std::vector<size_t> ids;
+  for (int i = 0; i < 4; i++) {
+    ids.push_back(mm.CACHE_STORE(data.data(), data.size())->id);
+  }
+  mm.CACHE_PIN(ids[0]);
+  mm.CACHE_STORE(data.data(), data.size());
+  REQUIRE(evicted == std::vector<size_t>{ ids[1] });
+  REQUIRE(mm.segment_count() == 4);
+  REQUIRE(mm.CACHE_RETRIEVE(ids[1], ec) == nullptr);
+  REQUIRE(ec == MmgrErrc::SegmentNotFound);
+
+  // growing a segment evicts others, never itself
+  REQUIRE(mm.CACHE_SET(ids[3], data.data(), 100, ec) == 0);
+  std::array<char, 512> big;
+  big.fill(0x22);
+  REQUIRE(mm.CACHE_SET(ids[3], big.data(), big.size(), ec) == 0);
+  REQUIRE(static_cast<char*>(mm.CACHE_RETRIEVE(ids[3]))[511] == 0x22);
+  REQUIRE(mm.CACHE_STATS().bytes <= 1_KB);
+  REQUIRE(mm.CACHE_STATS().evictions == evicted.size());
+  REQUIRE_THROWS(mm.CACHE_UNPIN(ids[1]));
+}
+
+TEST_CASE("mmgr cache from several threads", "[mmgr][cache_bin]")
+{
+  libmem::mmgr             mm("cache_mt_mmgr", { 1_KB }, { 8 });
+  std::vector<std::thread> workers;
+  std::atomic_size_t       failures{ 0 };
+  for (int t = 0; t < 4; t++) {
+    workers.emplace_back([&, t] {
+      std::error_code ec;
+      for (int i = 0; i < 2000; i++) {
+        const long value = t * 100000 + i;
+        auto       seg   = mm.CACHE_STORE(&value, sizeof(value), ec);
+        auto*      buff  = static_cast<long*>(mm.CACHE_RETRIEVE(seg->id, ec));
+        if (buff == nullptr || *buff != value ||
+            mm.CACHE_DEALLOC(seg->id, ec) != 0) {
+          failures++;
+        }
+      }
+    });
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  REQUIRE(failures == 0);
+  REQUIRE(mm.segment_count() == 0);
+  REQUIRE(mm.CACHE_STATS().hits == 8000);
+  REQUIRE(mm.CACHE_STATS().bytes == 0);
+}
+
+TEST_CASE("cache evictions next to static calls", "[mmgr][cache_bin][stress]")
+{
+  libmem::mmgr_options opts;
+  opts.cache_budget = 1_KB;
+  opts.cache_shards = 1;
+  libmem::mmgr     mm("cache_table_mmgr", { 1_KB }, { 64 }, opts);
+  std::atomic_bool stop{ false };
+  // every store evicts, the callback erases from the segment table
+  std::thread cacher([&] {
+    std::error_code       ec;
+    std::array<char, 512> data{};
+    while (!stop) {
+      mm.CACHE_STORE(data.data(), data.size(), ec);
+    }
+  });
+  std::error_code ec;
+  for (int i = 0; i < 2000; i++) {
+    auto seg = mm.STATIC_ALLOC(1_KB);
+    REQUIRE(mm.get_segment(seg->id, ec) == seg);
+    REQUIRE(mm.MARK_DIRTY(seg->id, ec) == 0);
+    REQUIRE(mm.STATIC_REALLOC(seg->id, 512, ec));
+    REQUIRE(mm.segment_count() >= 1);
+    REQUIRE(mm.STATIC_DEALLOC(seg->id, ec) == 0);
+  }
+  stop = true;
+  cacher.join();
+}
+
+TEST_CASE("shared cache bin", "[mmgr][cache_bin]")
+{
+  std::error_code      ec;
+  std::string          mmgr_name = "shared_cache_mmgr";
+  libmem::mmgr_options opts;
+  opts.shared_cache = true;
+  opts.cache_shards = 2;
+  libmem::mmgr mm(mmgr_name, { 1_KB }, { 8 }, opts);
+  libmem::smgr sm(mmgr_name);
+
+  std::array<long, 64> data;
+  std::iota(data.begin(), data.end(), 0);
+  auto seg  = mm.CACHE_STORE(data.data(), sizeof(data));
+  auto info = seg->to_seginfo();
+  REQUIRE(info.shm_name() ==
+          fmt::format("{}#cache#region{}", mmgr_name, seg->region_id));
+  auto  view = sm.register_segment(&info, ec);
+  auto* buff = static_cast<long*>(sm.bufferize(view, ec).first);
+  REQUIRE_FALSE(ec);
+  REQUIRE(buff[63] == 63);
+  // zero-copy both ways
+  buff[0] = 1000;
+  REQUIRE(static_cast<long*>(mm.CACHE_RETRIEVE(seg->id))[0] == 1000);
+
+  // a big segment gets a region of its own, unlinked once it is freed
+  std::vector<char> big(4_MB, 0x44);
+  auto              big_seg = mm.CACHE_STORE(big.data(), big.size());
+  REQUIRE(big_seg->region_id != seg->region_id);
+  REQUIRE(big_seg->addr_pshift == 0);
+  auto big_name = big_seg->to_seginfo().shm_name();
+  REQUIRE(std::filesystem::exists("/dev/shm/" + big_name));
+  mm.CACHE_DEALLOC(big_seg->id);
+  REQUIRE_FALSE(std::filesystem::exists("/dev/shm/" + big_name));
+
+  // a private cache keeps segments out of shm
+  libmem::mmgr private_mm("private_cache_mmgr", { 1_KB }, { 8 });
+  auto         private_info =
+    private_mm.CACHE_STORE(data.data(), sizeof(data))->to_seginfo();
+  REQUIRE(private_info.shm_name().empty());
+  std::string  private_name = "private_cache_mmgr";
+  libmem::smgr private_sm(private_name);
+  auto         private_view = private_sm.register_segment(&private_info, ec);
+  REQUIRE_FALSE(ec);
+  private_sm.register_segment(&private_info, ec);
+  REQUIRE(ec == MmgrErrc::SegmentExist);
+  private_sm.unregister_segment(private_view->id(), ec);
+  REQUIRE_FALSE(ec);
+
+  sm.unregister_segment(view->id(), ec);
+  REQUIRE_FALSE(ec);
+  REQUIRE(mm.CACHE_DEALLOC(seg->id, ec) == 0);
+}
+
 TEST_CASE("create instant bin", "[instant_bin]")
 {
   std::atomic_size_t  segment_counter = 0;
@@ -321,6 +622,21 @@ TEST_CASE("allocate with error return", "[static_bin]")
   REQUIRE_FALSE(seg2);
 }
 
+TEST_CASE("pristine chunk tracking", "[static_bin]")
+{
+  std::atomic_size_t                     counter = 1;
+  libmem::static_bin                     bin(0, counter, 32, 100, 64);
+  std::vector<std::pair<size_t, size_t>> stale;
+  bin.claim(64, 100, stale);
+  REQUIRE(stale.empty());
+  REQUIRE(bin.pristine_chunks() == 96);
+  // chunks 1 to 3 were handed out, clipped to the range, chunk 4 is new
+  bin.claim(64 + 40, 100, stale);
+  REQUIRE(stale.size() == 1);
+  REQUIRE(stale[0] == std::make_pair(size_t(64 + 40), size_t(88)));
+  REQUIRE(bin.pristine_chunks() == 95);
+}
+
 TEST_CASE("free allocated buffer", "[static_bin]")
 {
   std::error_code    ec;
@@ -430,6 +746,261 @@ TEST_CASE("double free error", "[static_bin]")
   REQUIRE(bin.chunk_left() == 6);
 }
 
+TEST_CASE("buddy bin split and coalesce", "[buddy_bin]")
+{
+  std::error_code    ec;
+  std::atomic_size_t counter = 1;
+  // 24 chunks are carved into a 16 and an 8 chunks top block
+  libmem::buddy_bin bin(0, counter, 32, 24, 0);
+  REQUIRE(bin.max_order() == 4);
+  REQUIRE(bin.max_request() == 32 * 16);
+  REQUIRE(bin.largest_free() == 16);
+
+  // 96 bytes round up to a 4 chunks block, taken from the smaller top block
+  auto seg1 = bin.malloc(96, ec);
+  REQUIRE(seg1);
+  REQUIRE(seg1->addr_pshift == 16 * 32);
+  auto seg2 = bin.malloc(32, ec);
+  REQUIRE(seg2);
+  REQUIRE(seg2->addr_pshift == 20 * 32);
+  auto seg3 = bin.malloc(32 * 16, ec);
+  REQUIRE(seg3);
+  REQUIRE(seg3->addr_pshift == 0);
+  REQUIRE(bin.chunk_left() == 3);
+  REQUIRE(bin.largest_free() == 2);
+  REQUIRE_FALSE(bin.malloc(32 * 4, ec));
+  REQUIRE(ec == MmgrErrc::NoMemory);
+
+  REQUIRE(bin.free(seg2, ec) == 0);
+  REQUIRE(bin.free(seg2, ec) == -1);
+  REQUIRE(ec == MmgrErrc::SegmentDoubleFree);
+  REQUIRE(bin.free(seg1, ec) == 0);
+  REQUIRE(bin.free(seg3, ec) == 0);
+  REQUIRE(bin.chunk_left() == 24);
+  // the buddies merged back into the 8 chunks top block
+  auto seg4 = bin.malloc(32 * 8, ec);
+  REQUIRE(seg4);
+  REQUIRE(seg4->addr_pshift == 16 * 32);
+}
+
+TEST_CASE("buddy bin reserve", "[buddy_bin]")
+{
+  std::error_code    ec;
+  std::atomic_size_t counter = 1;
+  libmem::buddy_bin  bin(0, counter, 32, 16, 0);
+  REQUIRE(bin.reserve(4 * 32, 64, ec) == 0);
+  REQUIRE(bin.reserve(4 * 32, 64, ec) == -1);
+  // misaligned for its order
+  REQUIRE(bin.reserve(32, 64, ec) == -1);
+  REQUIRE(bin.chunk_left() == 14);
+  // the split left a 2 chunks buddy right after the reserved block
+  auto seg = bin.malloc(64, ec);
+  REQUIRE(seg);
+  REQUIRE(seg->addr_pshift == 6 * 32);
+  REQUIRE(bin.largest_free() == 8);
+}
+
+TEST_CASE("buddy bin free lists past one summary word", "[buddy_bin]")
+{
+  std::error_code    ec;
+  std::atomic_size_t counter = 1;
+  // 3 summary words of order 0 blocks
+  libmem::buddy_bin bin(0, counter, 32, 3 * 4096, 0);
+  std::vector<std::shared_ptr<libmem::static_segment>> segs;
+  for (size_t i = 0; i < 3 * 4096; i++) {
+    segs.push_back(bin.malloc(32, ec));
+    REQUIRE(segs.back());
+  }
+  REQUIRE(bin.chunk_left() == 0);
+  REQUIRE_FALSE(bin.malloc(32, ec));
+
+  // the only free block sits in the last summary word
+  REQUIRE(bin.free(segs[9000], ec) == 0);
+  auto seg = bin.malloc(32, ec);
+  REQUIRE(seg);
+  REQUIRE(seg->addr_pshift == segs[9000]->addr_pshift);
+  // the lowest free block wins across words
+  REQUIRE(bin.free(segs[12000], ec) == 0);
+  REQUIRE(bin.free(segs[5000], ec) == 0);
+  seg = bin.malloc(32, ec);
+  REQUIRE(seg->addr_pshift == segs[5000]->addr_pshift);
+}
+
+TEST_CASE("tlsf bin exact fit and coalesce", "[tlsf_bin]")
+{
+  std::error_code    ec;
+  std::atomic_size_t counter = 1;
+  libmem::tlsf_bin   bin(0, counter, 64, 1000, 0);
+  REQUIRE(bin.max_request() == 64 * 1000);
+
+  // sizes are only rounded to the 64 bytes granule
+  auto seg1 = bin.malloc(1000, ec);
+  auto seg2 = bin.malloc(64, ec);
+  auto seg3 = bin.malloc(3000, ec);
+  REQUIRE(seg1->addr_pshift == 0);
+  REQUIRE(seg2->addr_pshift == 16 * 64);
+  REQUIRE(seg3->addr_pshift == 17 * 64);
+  REQUIRE(bin.chunk_left() == 1000 - 16 - 1 - 47);
+
+  REQUIRE(bin.free(seg2, ec) == 0);
+  REQUIRE(bin.free(seg2, ec) == -1);
+  REQUIRE(ec == MmgrErrc::SegmentDoubleFree);
+  // the hole left by seg2 is reused
+  auto seg4 = bin.malloc(64, ec);
+  REQUIRE(seg4->addr_pshift == seg2->addr_pshift);
+  REQUIRE(bin.free(seg4, ec) == 0);
+
+  // freeing seg1 and seg3 merges everything into one block again
+  REQUIRE(bin.free(seg1, ec) == 0);
+  REQUIRE(bin.free(seg3, ec) == 0);
+  REQUIRE(bin.chunk_left() == 1000);
+  REQUIRE(bin.largest_free() == 1000);
+  auto whole = bin.malloc(64 * 1000, ec);
+  REQUIRE(whole);
+  REQUIRE_FALSE(bin.malloc(64, ec));
+  REQUIRE(ec == MmgrErrc::NoMemory);
+}
+
+TEST_CASE("tlsf bin reserve", "[tlsf_bin]")
+{
+  std::error_code    ec;
+  std::atomic_size_t counter = 1;
+  libmem::tlsf_bin   bin(0, counter, 64, 100, 0);
+  REQUIRE(bin.reserve(10 * 64, 640, ec) == 0);
+  REQUIRE(bin.reserve(15 * 64, 64, ec) == -1);
+  REQUIRE(bin.chunk_left() == 90);
+  REQUIRE(bin.largest_free() == 80);
+  auto seg = bin.malloc(640, ec);
+  REQUIRE(seg->addr_pshift == 0);
+}
+
+TEST_CASE("slab bin size classes", "[slab_bin]")
+{
+  std::error_code    ec;
+  std::atomic_size_t counter = 1;
+  libmem::slab_bin   bin(0, counter, 4_KB, 4, 0);
+  REQUIRE(bin.max_request() == 512);
+  REQUIRE_FALSE(bin.malloc(513, ec));
+  REQUIRE(ec == MmgrErrc::TooBigForStaticBin);
+
+  // objects of one class are packed into the same slab
+  auto seg1 = bin.malloc(40, ec);
+  auto seg2 = bin.malloc(64, ec);
+  REQUIRE(seg1->addr_pshift == 0);
+  REQUIRE(seg2->addr_pshift == 64);
+  // another class takes another slab
+  auto seg3 = bin.malloc(500, ec);
+  REQUIRE(seg3->addr_pshift == 4_KB);
+  REQUIRE(bin.chunk_left() == 2);
+
+  REQUIRE(bin.free(seg1, ec) == 0);
+  REQUIRE(bin.free(seg1, ec) == -1);
+  REQUIRE(ec == MmgrErrc::SegmentDoubleFree);
+  auto seg4 = bin.malloc(33, ec);
+  REQUIRE(seg4->addr_pshift == 0);
+
+  // an empty slab goes back to every class
+  REQUIRE(bin.free(seg3, ec) == 0);
+  REQUIRE(bin.chunk_left() == 3);
+  std::vector<std::shared_ptr<libmem::static_segment>> segs;
+  for (size_t i = 0; i < 3 * 8; i++) {
+    segs.push_back(bin.malloc(512, ec));
+    REQUIRE(segs.back());
+  }
+  REQUIRE_FALSE(bin.malloc(512, ec));
+  REQUIRE(ec == MmgrErrc::NoMemory);
+  REQUIRE(bin.reserve(segs[0]->addr_pshift, 512, ec) == -1);
+}
+
+TEST_CASE("slab bin owner threads", "[slab_bin][stress]")
+{
+  std::error_code    ec;
+  std::atomic_size_t counter = 1;
+  libmem::slab_bin   bin(0, counter, 4_KB, 64, 0);
+  std::vector<std::vector<std::shared_ptr<libmem::static_segment>>> segs(4);
+  std::vector<std::thread>                                          threads;
+  for (auto& mine : segs) {
+    threads.emplace_back([&bin, &mine] {
+      std::error_code ec;
+      // 64 bytes objects, a little more than 3 slabs
+      for (size_t i = 0; i < 200; i++) {
+        mine.push_back(bin.malloc(64, ec));
+      }
+      for (size_t i = 0; i < mine.size(); i += 2) {
+        bin.free(mine[i], ec);
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  // the objects still allocated never share an address
+  std::vector<size_t> addrs;
+  for (const auto& mine : segs) {
+    REQUIRE(std::all_of(mine.begin(), mine.end(), [](auto& s) { return s; }));
+    for (size_t i = 1; i < mine.size(); i += 2) {
+      addrs.push_back(mine[i]->addr_pshift);
+    }
+  }
+  std::sort(addrs.begin(), addrs.end());
+  REQUIRE(std::adjacent_find(addrs.begin(), addrs.end()) == addrs.end());
+
+  // the exited owners gave their slabs back, partial ones are reused
+  auto seg = bin.malloc(64, ec);
+  REQUIRE(seg);
+  REQUIRE(bin.free(seg, ec) == 0);
+  for (const auto& mine : segs) {
+    for (size_t i = 1; i < mine.size(); i += 2) {
+      REQUIRE(bin.free(mine[i], ec) == 0);
+    }
+  }
+  REQUIRE(bin.chunk_left() == 64);
+}
+
+TEST_CASE("resize segments in place", "[static_bin][buddy_bin][tlsf_bin]")
+{
+  std::error_code    ec;
+  std::atomic_size_t counter = 1;
+  {
+    libmem::static_bin bin(0, counter, 32, 16, 0);
+    auto               seg1 = bin.malloc(64, ec);
+    auto               seg2 = bin.malloc(64, ec);
+    REQUIRE(bin.resize(seg1, 96, ec) == -1);
+    REQUIRE(bin.resize(seg2, 256, ec) == 0);
+    REQUIRE(bin.chunk_left() == 6);
+    seg2->size = 256;
+    REQUIRE(bin.resize(seg2, 32, ec) == 0);
+    REQUIRE(bin.chunk_left() == 13);
+  }
+  {
+    libmem::buddy_bin bin(0, counter, 32, 16, 0);
+    auto              seg1 = bin.malloc(64, ec);
+    REQUIRE(seg1->addr_pshift == 0);
+    REQUIRE(bin.resize(seg1, 256, ec) == 0);
+    REQUIRE(bin.chunk_left() == 8);
+    seg1->size = 256;
+    REQUIRE(bin.resize(seg1, 32, ec) == 0);
+    REQUIRE(bin.chunk_left() == 15);
+    seg1->size = 32;
+    auto seg2  = bin.malloc(32, ec);
+    REQUIRE(seg2->addr_pshift == 32);
+    // the buddy is taken
+    REQUIRE(bin.resize(seg1, 64, ec) == -1);
+  }
+  {
+    libmem::tlsf_bin bin(0, counter, 32, 16, 0);
+    auto             seg1 = bin.malloc(64, ec);
+    auto             seg2 = bin.malloc(64, ec);
+    REQUIRE(bin.resize(seg1, 96, ec) == -1);
+    REQUIRE(bin.resize(seg2, 32 * 14, ec) == 0);
+    REQUIRE(bin.chunk_left() == 0);
+    seg2->size = 32 * 14;
+    REQUIRE(bin.resize(seg2, 32, ec) == 0);
+    REQUIRE(bin.chunk_left() == 13);
+    REQUIRE(bin.largest_free() == 13);
+  }
+}
+
 SCENARIO("allocate with mmgr", "[mmgr]")
 {
   std::error_code ec;
@@ -603,4 +1174,1532 @@ TEST_CASE("smgr test", "[smgr]")
 
   sm.unregister_segment(sm_seg_info1->id(), ec);
   REQUIRE_FALSE(ec);
-}
\ No newline at end of file
+}
+TEST_CASE("mmgr warm restart", "[mmgr]")
+{
+  std::error_code      ec;
+  libmem::mmgr_options opts;
+  opts.warm_restart = true;
+
+  auto first = std::make_unique<libmem::mmgr>(
+    "warm_restart", std::vector<size_t>{ 128 }, std::vector<size_t>{ 100 }, opts);
+  auto seg1 = first->STATIC_ALLOC(256);
+  auto seg2 = first->STATIC_ALLOC(128);
+  auto seg3 = first->INSTANT_ALLOC(1_MB);
+  first->STATIC_DEALLOC(seg2->id);
+  REQUIRE(first->segment_count() == 2);
+
+  // write through a consumer, the data must survive the restart
+  std::string  mmgr_name = "warm_restart";
+  libmem::smgr sm(mmgr_name);
+  auto         info1 = seg1->to_seginfo();
+  auto         view1 = sm.register_segment(&info1, ec);
+  REQUIRE_FALSE(ec);
+  auto* buff1 = static_cast<unsigned char*>(sm.bufferize(view1, ec).first);
+  REQUIRE(buff1);
+  std::memset(buff1, 0x5a, 256);
+
+  // the first mmgr is gone before the second one looks for its objects
+  first.reset();
+  auto second = std::make_unique<libmem::mmgr>(
+    "warm_restart", std::vector<size_t>{ 128 }, std::vector<size_t>{ 100 }, opts);
+  REQUIRE(second->segment_count() == 2);
+
+  auto restored1 = std::dynamic_pointer_cast<libmem::static_segment>(
+    second->get_segment(seg1->id, ec));
+  REQUIRE(restored1);
+  REQUIRE(restored1->type == libmem::SEG_TYPE::STATIC_SEGMENT);
+  REQUIRE(restored1->size == 256);
+  REQUIRE(restored1->addr_pshift == seg1->addr_pshift);
+  REQUIRE(second->get_segment(seg3->id, ec)->size == 1_MB);
+  REQUIRE_FALSE(second->get_segment(seg2->id, ec));
+
+  // ids keep growing and freed chunks are reused, live ones are not
+  auto seg4 = second->STATIC_ALLOC(128);
+  REQUIRE(seg4->id > seg3->id);
+  REQUIRE(seg4->addr_pshift == seg2->addr_pshift);
+  REQUIRE(buff1[255] == 0x5a);
+
+  REQUIRE(second->STATIC_DEALLOC(seg1->id, ec) == 0);
+  REQUIRE(second->INSTANT_DEALLOC(seg3->id, ec) == 0);
+  sm.unregister_segment(view1->id(), ec);
+  REQUIRE_FALSE(ec);
+  second.reset();
+  libmem::release_kept_shm("warm_restart");
+}
+
+TEST_CASE("mmgr warm restart keeps objects until taken over", "[mmgr]")
+{
+  std::error_code      ec;
+  libmem::mmgr_options opts;
+  opts.warm_restart = true;
+
+  size_t id;
+  {
+    libmem::mmgr mm("kept_mmgr", { 128 }, { 100 }, opts);
+    id = mm.STATIC_ALLOC(256)->id;
+  }
+  {
+    libmem::mmgr mm("kept_mmgr", { 128 }, { 100 }, opts);
+    REQUIRE(mm.segment_count() == 1);
+    REQUIRE(mm.get_segment(id, ec)->size == 256);
+  }
+  // a mmgr without warm_restart starts from scratch
+  {
+    libmem::mmgr mm("kept_mmgr", { 128 }, { 100 });
+    REQUIRE(mm.segment_count() == 0);
+  }
+  {
+    libmem::mmgr mm("kept_mmgr", { 128 }, { 100 }, opts);
+    REQUIRE(mm.segment_count() == 0);
+    mm.STATIC_ALLOC(256);
+  }
+  libmem::release_kept_shm("kept_mmgr");
+  {
+    libmem::mmgr mm("kept_mmgr", { 128 }, { 100 }, opts);
+    REQUIRE(mm.segment_count() == 0);
+  }
+  libmem::release_kept_shm("kept_mmgr");
+}
+
+TEST_CASE("mmgr with buddy bins", "[mmgr][buddy_bin]")
+{
+  std::error_code      ec;
+  libmem::mmgr_options opts;
+  opts.warm_restart = true;
+  opts.bin_type     = libmem::BIN_TYPE::BUDDY;
+
+  auto first = std::make_unique<libmem::mmgr>(
+    "buddy_mmgr", std::vector<size_t>{ 4_KB }, std::vector<size_t>{ 96 }, opts);
+  // a buddy bin accepts up to its largest block
+  auto seg1 = first->STATIC_ALLOC(256_KB);
+  auto seg2 = first->STATIC_ALLOC(12_KB);
+  REQUIRE(seg1);
+  REQUIRE(seg2);
+  REQUIRE(seg2->addr_pshift == seg1->addr_pshift + 256_KB);
+
+  // the bin type is persisted and the buddy free lists are rebuilt
+  first.reset();
+  auto second = std::make_unique<libmem::mmgr>(
+    "buddy_mmgr", std::vector<size_t>{ 4_KB }, std::vector<size_t>{ 96 }, opts);
+  REQUIRE(second->segment_count() == 2);
+  REQUIRE(second->STATIC_DEALLOC(seg1->id, ec) == 0);
+  auto seg3 = second->STATIC_ALLOC(256_KB);
+  REQUIRE(seg3->addr_pshift == seg1->addr_pshift);
+  REQUIRE(second->STATIC_DEALLOC(seg2->id, ec) == 0);
+  REQUIRE(second->STATIC_DEALLOC(seg3->id, ec) == 0);
+  second.reset();
+  libmem::release_kept_shm("buddy_mmgr");
+}
+
+TEST_CASE("mmgr with tlsf bins", "[mmgr][tlsf_bin]")
+{
+  std::error_code      ec;
+  libmem::mmgr_options opts;
+  opts.warm_restart = true;
+  opts.bin_type     = libmem::BIN_TYPE::TLSF;
+
+  auto first = std::make_unique<libmem::mmgr>(
+    "tlsf_mmgr", std::vector<size_t>{ 1_KB }, std::vector<size_t>{ 1024 }, opts);
+  auto seg1 = first->STATIC_ALLOC(300_KB);
+  auto seg2 = first->STATIC_ALLOC(5_KB);
+  REQUIRE(seg2->addr_pshift == seg1->addr_pshift + 300_KB);
+
+  first.reset();
+  auto second = std::make_unique<libmem::mmgr>(
+    "tlsf_mmgr", std::vector<size_t>{ 1_KB }, std::vector<size_t>{ 1024 }, opts);
+  REQUIRE(second->segment_count() == 2);
+  REQUIRE(second->STATIC_DEALLOC(seg1->id, ec) == 0);
+  auto seg3 = second->STATIC_ALLOC(200_KB);
+  REQUIRE(seg3->addr_pshift == seg1->addr_pshift);
+  REQUIRE(second->STATIC_DEALLOC(seg2->id, ec) == 0);
+  REQUIRE(second->STATIC_DEALLOC(seg3->id, ec) == 0);
+  second.reset();
+  libmem::release_kept_shm("tlsf_mmgr");
+}
+
+TEST_CASE("mmgr small objects", "[mmgr][slab_bin]")
+{
+  std::error_code      ec;
+  libmem::mmgr_options opts;
+  opts.warm_restart = true;
+
+  {
+    libmem::mmgr mm("no_slab", { 1_KB }, { 16 });
+    REQUIRE_FALSE(mm.SMALL_ALLOC(64, ec));
+    REQUIRE(ec == MmgrErrc::NoSuitableStaticBin);
+  }
+
+  opts.slab_count = 2;
+  auto first      = std::make_unique<libmem::mmgr>(
+    "slab_mmgr", std::vector<size_t>{ 1_KB }, std::vector<size_t>{ 16 }, opts);
+  auto seg1 = first->SMALL_ALLOC(32);
+  auto seg2 = first->SMALL_ALLOC(100);
+  REQUIRE(seg1->bin_id == 1);
+  REQUIRE(seg2->addr_pshift == seg1->addr_pshift + 4_KB);
+  // regular static allocations never land in the slab bin
+  auto seg3 = first->STATIC_ALLOC(64);
+  REQUIRE(seg3->bin_id == 0);
+  // exhausting the slabs adds a batch
+  std::vector<std::shared_ptr<libmem::static_segment>> segs;
+  for (size_t i = 0; i < 8; i++) {
+    segs.push_back(first->SMALL_ALLOC(512));
+  }
+  REQUIRE(segs.back()->batch_id == 1);
+
+  // objects survive a warm restart at their own addresses
+  first.reset();
+  auto second = std::make_unique<libmem::mmgr>(
+    "slab_mmgr", std::vector<size_t>{ 1_KB }, std::vector<size_t>{ 16 }, opts);
+  REQUIRE(second->segment_count() == 11);
+  REQUIRE(second->STATIC_DEALLOC(seg1->id, ec) == 0);
+  auto seg4 = second->SMALL_ALLOC(20);
+  REQUIRE(seg4->addr_pshift == seg1->addr_pshift);
+  auto seg5 = second->SMALL_ALLOC(20);
+  REQUIRE(seg5->addr_pshift == seg1->addr_pshift + 32);
+  second.reset();
+  libmem::release_kept_shm("slab_mmgr");
+}
+
+TEST_CASE("mmgr frame arena", "[mmgr][frame]")
+{
+  std::error_code ec;
+  libmem::mmgr    mm("frame_mmgr", { 4_KB }, { 64 });
+  auto            count = mm.segment_count();
+  auto            frame = mm.FRAME_CREATE(16_KB);
+  // the frame region is a single static segment
+  REQUIRE(mm.segment_count() == count + 1);
+
+  auto seg1 = mm.FRAME_ALLOC(frame, 100);
+  auto seg2 = mm.FRAME_ALLOC(frame, 8_KB);
+  REQUIRE(seg2->addr_pshift == seg1->addr_pshift + 104);
+  REQUIRE(seg2->batch_id == seg1->batch_id);
+  REQUIRE(mm.FRAME_VALID(seg1->id));
+  REQUIRE(mm.FRAME_VALID(seg2->id));
+  REQUIRE_FALSE(mm.FRAME_ALLOC(frame, 8_KB, ec));
+  REQUIRE(ec == MmgrErrc::NoMemory);
+
+  // a consumer maps frame segments like any static segment
+  std::string  mmgr_name = "frame_mmgr";
+  libmem::smgr sm(mmgr_name);
+  auto         info = seg2->to_seginfo();
+  auto         view = sm.register_segment(&info, ec);
+  REQUIRE(sm.bufferize(view, ec).first);
+  sm.unregister_segment(view->id(), ec);
+
+  REQUIRE(mm.FRAME_RESET(frame, ec) == 0);
+  REQUIRE_FALSE(mm.FRAME_VALID(seg1->id));
+  REQUIRE_FALSE(mm.FRAME_VALID(seg2->id));
+  auto seg3 = mm.FRAME_ALLOC(frame, 16_KB);
+  REQUIRE(seg3->addr_pshift == seg1->addr_pshift);
+  REQUIRE(seg3->id != seg1->id);
+  REQUIRE(mm.FRAME_VALID(seg3->id));
+
+  REQUIRE(mm.FRAME_DESTROY(frame, ec) == 0);
+  REQUIRE(mm.segment_count() == count);
+  REQUIRE_FALSE(mm.FRAME_VALID(seg3->id));
+  REQUIRE(mm.FRAME_RESET(frame, ec) == -1);
+  REQUIRE(ec == MmgrErrc::FrameNotFound);
+}
+
+TEST_CASE("mmgr frames across threads", "[mmgr][frame][stress]")
+{
+  libmem::mmgr             mm("frame_threads", { 4_KB }, { 256 });
+  auto                     frame = mm.FRAME_CREATE(16_KB);
+  std::atomic_bool         stop{ false };
+  std::atomic_size_t       allocated{ 0 };
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 2; t++) {
+    threads.emplace_back([&] {
+      std::error_code ec;
+      while (!stop) {
+        auto seg = mm.FRAME_ALLOC(frame, 64, ec);
+        if (seg && mm.FRAME_VALID(seg->id)) {
+          allocated++;
+        }
+        if (ec == MmgrErrc::NoMemory) {
+          mm.FRAME_RESET(frame, ec);
+        }
+      }
+    });
+  }
+  // other frames come and go meanwhile
+  for (int i = 0; i < 200 || allocated < 1000; i++) {
+    auto other = mm.FRAME_CREATE(4_KB);
+    REQUIRE(mm.FRAME_ALLOC(other, 64));
+    REQUIRE(mm.FRAME_DESTROY(other) == 0);
+  }
+  stop = true;
+  for (auto& t : threads) {
+    t.join();
+  }
+  REQUIRE(allocated > 0);
+  REQUIRE(mm.FRAME_DESTROY(frame) == 0);
+}
+
+TEST_CASE("mmgr static realloc", "[mmgr]")
+{
+  std::error_code ec;
+  std::string     mmgr_name = "realloc_mmgr";
+  libmem::mmgr    mm(mmgr_name, { 1_KB }, { 64 });
+  libmem::smgr    sm(mmgr_name);
+  auto            seg1 = mm.STATIC_ALLOC(2_KB);
+  auto            info = seg1->to_seginfo();
+  auto            view = sm.register_segment(&info, ec);
+  auto*           buff = static_cast<char*>(sm.bufferize(view, ec).first);
+  std::memset(buff, 0x3c, 2_KB);
+  sm.unregister_segment(view->id(), ec);
+
+  // grow into the free chunks right after it
+  auto grown = mm.STATIC_REALLOC(seg1->id, 4_KB);
+  REQUIRE(grown == seg1);
+  REQUIRE(grown->size == 4_KB);
+  // blocked by a neighbour, the contents move
+  auto seg2  = mm.STATIC_ALLOC(1_KB);
+  auto moved = mm.STATIC_REALLOC(seg1->id, 6_KB);
+  REQUIRE(moved->id != seg1->id);
+  REQUIRE_FALSE(mm.get_segment(seg1->id, ec));
+  info = moved->to_seginfo();
+  view = sm.register_segment(&info, ec);
+  buff = static_cast<char*>(sm.bufferize(view, ec).first);
+  REQUIRE(buff[0] == 0x3c);
+  REQUIRE(buff[2_KB - 1] == 0x3c);
+  sm.unregister_segment(view->id(), ec);
+  // shrink in place
+  REQUIRE(mm.STATIC_REALLOC(moved->id, 1_KB)->addr_pshift == moved->addr_pshift);
+  REQUIRE_FALSE(mm.STATIC_REALLOC(moved->id, 0, ec));
+  REQUIRE(ec == MmgrErrc::IllegalSegmentRange);
+  REQUIRE(mm.STATIC_DEALLOC(moved->id, ec) == 0);
+  REQUIRE(mm.STATIC_DEALLOC(seg2->id, ec) == 0);
+}
+
+TEST_CASE("size histogram layout", "[mmgr][size_histogram]")
+{
+  libmem::size_histogram hist;
+  REQUIRE(hist.bucket_of(8) == 0);
+  REQUIRE(hist.bucket_of(33) == hist.bucket_of(40));
+  REQUIRE(hist.upper_bound(hist.bucket_of(200)) == 224);
+  REQUIRE(hist.upper_bound(hist.bucket_of(4_KB)) == 4_KB);
+  for (int i = 0; i < 90; i++) {
+    hist.record(100);
+  }
+  for (int i = 0; i < 10; i++) {
+    hist.record(3_KB);
+  }
+  auto layout = hist.derive_layout(2, 64_KB);
+  REQUIRE(layout.chunk_size == std::vector<size_t>{ 112, 3_KB });
+  // bytes split by demand: 90 * 112 vs 10 * 3KB
+  REQUIRE(layout.chunk_count[0] * 112 < layout.chunk_count[1] * 3_KB);
+  REQUIRE(hist.predicted_waste(layout.chunk_size) <
+          hist.predicted_waste({ 1_KB }));
+}
+
+TEST_CASE("mmgr adaptive layout", "[mmgr][size_histogram]")
+{
+  std::error_code      ec;
+  libmem::mmgr_options opts;
+  opts.adaptive_layout      = true;
+  opts.adaptive_min_samples = 64;
+  libmem::mmgr mm("adaptive_mmgr", { 1_KB }, { 64 }, opts);
+  std::vector<std::shared_ptr<libmem::static_segment>> segs;
+  for (int i = 0; i < 64; i++) {
+    segs.push_back(mm.STATIC_ALLOC(200));
+  }
+  auto report = mm.LAYOUT_REPORT();
+  REQUIRE(report.samples == 64);
+  REQUIRE(report.next_layout.chunk_size == std::vector<size_t>{ 224 });
+  REQUIRE(report.predicted_waste == Approx(0.12));
+  REQUIRE(report.baseline_waste == Approx(4.12));
+  REQUIRE(report.actual_waste == Approx(4.12));
+
+  // batch0 is full, batch1 is laid out from the histogram
+  auto a = mm.STATIC_ALLOC(200);
+  auto b = mm.STATIC_ALLOC(200);
+  REQUIRE(a->batch_id == 1);
+  REQUIRE(b->addr_pshift - a->addr_pshift == 224);
+  REQUIRE(mm.LAYOUT_REPORT().actual_waste < report.actual_waste);
+  for (const auto& seg : segs) {
+    REQUIRE(mm.STATIC_DEALLOC(seg->id, ec) == 0);
+  }
+}
+
+TEST_CASE("mmgr compaction", "[mmgr]")
+{
+  std::error_code ec;
+  std::string     mmgr_name = "compact_mmgr";
+  libmem::mmgr    mm(mmgr_name, { 1_KB }, { 8 });
+  libmem::smgr    sm(mmgr_name);
+  std::vector<std::shared_ptr<libmem::static_segment>> segs;
+  for (int i = 0; i < 8; i++) {
+    segs.push_back(mm.STATIC_ALLOC(1_KB));
+  }
+  // scatter the free chunks: 1, 3, 5, 7 stay
+  for (int i = 0; i < 8; i += 2) {
+    REQUIRE(mm.STATIC_DEALLOC(segs[i]->id, ec) == 0);
+  }
+  std::vector<std::shared_ptr<libmem::segment_info>> views;
+  for (int i = 1; i < 8; i += 2) {
+    auto info = segs[i]->to_seginfo();
+    views.push_back(sm.register_segment(&info, ec));
+    std::memset(sm.bufferize(views.back(), ec).first, i, 1_KB);
+  }
+  const auto last_pshift = segs[7]->addr_pshift;
+
+  // 7 and 5 slide into the holes at 0 and 2
+  REQUIRE(mm.COMPACT() == 2);
+  REQUIRE(segs[7]->addr_pshift < last_pshift);
+  REQUIRE(mm.get_segment(segs[7]->id, ec) == segs[7]);
+  for (size_t v = 0; v < views.size(); v++) {
+    auto [ptr, size] = sm.bufferize(views[v], ec);
+    REQUIRE_FALSE(ec);
+    REQUIRE(size == 1_KB);
+    REQUIRE(static_cast<char*>(ptr)[0] == static_cast<char>(2 * v + 1));
+    REQUIRE(static_cast<char*>(ptr)[1_KB - 1] == static_cast<char>(2 * v + 1));
+  }
+  // the tail is contiguous now, no new batch needed
+  auto big = mm.STATIC_ALLOC(4_KB);
+  REQUIRE(big->batch_id == 0);
+  // nothing left to move
+  REQUIRE(mm.COMPACT(ec) == 0);
+  REQUIRE_FALSE(ec);
+
+  // a segment_info taken before a move is resolved on first bufferize
+  libmem::smgr late(mmgr_name);
+  REQUIRE(mm.STATIC_DEALLOC(big->id, ec) == 0);
+  auto stale = segs[3]->to_seginfo();
+  REQUIRE(mm.STATIC_DEALLOC(segs[1]->id, ec) == 0);
+  REQUIRE(mm.COMPACT() == 1);
+  auto view = late.register_segment(&stale, ec);
+  REQUIRE(static_cast<char*>(late.bufferize(view, ec).first)[0] == 3);
+  REQUIRE(static_cast<char*>(sm.bufferize(views[1], ec).first)[0] == 3);
+}
+
+TEST_CASE("mmgr compaction next to other calls", "[mmgr][stress]")
+{
+  std::error_code ec;
+  std::string     mmgr_name = "online_compact_mmgr";
+  libmem::mmgr    mm(mmgr_name, { 1_KB }, { 64 });
+  std::vector<std::shared_ptr<libmem::static_segment>> kept, holes;
+  for (int i = 0; i < 32; i++) {
+    auto seg = mm.STATIC_ALLOC(1_KB);
+    std::vector<char> fill(1_KB, static_cast<char>(seg->id));
+    REQUIRE(mm.WRITE(seg->id, 0, fill.data(), fill.size(), ec) == 0);
+    (i % 2 == 0 ? holes : kept).push_back(seg);
+  }
+  for (const auto& seg : holes) {
+    REQUIRE(mm.STATIC_DEALLOC(seg->id, ec) == 0);
+  }
+
+  // a pinned consumer keeps COMPACT from starting
+  {
+    libmem::smgr sm(mmgr_name);
+    sm.pin(mmgr_name);
+    REQUIRE(mm.COMPACT(ec) == 0);
+    REQUIRE(ec == MmgrErrc::WouldBlock);
+    sm.unpin();
+  }
+
+  std::vector<libmem::segment_info> infos;
+  for (const auto& seg : kept) {
+    infos.push_back(seg->to_seginfo());
+  }
+  std::atomic_bool   stop{ false };
+  std::atomic_size_t moved{ 0 }, failed{ 0 };
+  std::thread        compactor([&] {
+    std::error_code __ec;
+    while (!stop) {
+      moved += mm.COMPACT(__ec);
+    }
+  });
+  std::thread reader([&] {
+    libmem::smgr                                        sm(mmgr_name);
+    std::vector<std::shared_ptr<libmem::segment_info>> views;
+    std::error_code                                     __ec;
+    for (const auto& info : infos) {
+      views.push_back(sm.register_segment(&info, __ec));
+    }
+    for (int i = 0; i < 200; i++) {
+      sm.pin(mmgr_name);
+      for (const auto& view : views) {
+        auto* ptr = static_cast<char*>(sm.bufferize(view, __ec).first);
+        if (ptr[0] != static_cast<char>(view->id()) ||
+            ptr[1_KB - 1] != static_cast<char>(view->id())) {
+          failed++;
+        }
+      }
+      sm.unpin();
+    }
+  });
+  std::vector<std::thread> writers;
+  for (int t = 0; t < 2; t++) {
+    writers.emplace_back([&] {
+      std::error_code __ec;
+      for (int i = 0; i < 200; i++) {
+        auto seg = mm.STATIC_ALLOC(1_KB, __ec);
+        if (!seg) {
+          failed++;
+          continue;
+        }
+        std::vector<char> fill(1_KB, static_cast<char>(seg->id));
+        mm.WRITE(seg->id, 0, fill.data(), fill.size(), __ec);
+        mm.MARK_DIRTY(seg->id, __ec);
+        auto grown = mm.STATIC_REALLOC(seg->id, 2_KB, __ec);
+        if (!grown || mm.STATIC_DEALLOC(grown->id, __ec) != 0) {
+          failed++;
+        }
+      }
+    });
+  }
+  for (auto& writer : writers) {
+    writer.join();
+  }
+  reader.join();
+  stop = true;
+  compactor.join();
+  REQUIRE(failed == 0);
+  REQUIRE(moved > 0);
+
+  libmem::smgr sm(mmgr_name);
+  for (const auto& seg : kept) {
+    auto info = seg->to_seginfo();
+    auto view = sm.register_segment(&info, ec);
+    REQUIRE(static_cast<char*>(sm.bufferize(view, ec).first)[0] ==
+            static_cast<char>(seg->id));
+  }
+}
+
+TEST_CASE("mmgr instant realloc", "[mmgr][instant_bin]")
+{
+  std::error_code ec;
+  std::string     mmgr_name = "inst_realloc_mmgr";
+  libmem::mmgr    mm(mmgr_name, { 1_KB }, { 64 });
+  libmem::smgr    sm(mmgr_name);
+  auto            seg  = mm.INSTANT_ALLOC(1_MB);
+  auto            info = seg->to_seginfo();
+  auto            view = sm.register_segment(&info, ec);
+  auto*           buff = static_cast<char*>(sm.bufferize(view, ec).first);
+  std::memset(buff, 0x5a, 1_MB);
+
+  // grow, the consumer follows on its next bufferize
+  REQUIRE(mm.INSTANT_REALLOC(seg->id, 4_MB) == seg);
+  REQUIRE(seg->size == 4_MB);
+  auto [grown, grown_size] = sm.bufferize(view, ec);
+  REQUIRE_FALSE(ec);
+  REQUIRE(grown_size == 4_MB);
+  buff = static_cast<char*>(grown);
+  REQUIRE(buff[0] == 0x5a);
+  REQUIRE(buff[1_MB - 1] == 0x5a);
+  std::memset(buff + 1_MB, 0x6b, 3_MB);
+
+  // shrink
+  REQUIRE(mm.INSTANT_REALLOC(seg->id, 2_MB, ec) == seg);
+  auto [shrunk, shrunk_size] = sm.bufferize(view, ec);
+  REQUIRE(shrunk_size == 2_MB);
+  buff = static_cast<char*>(shrunk);
+  REQUIRE(buff[1_MB - 1] == 0x5a);
+  REQUIRE(buff[2_MB - 1] == 0x6b);
+
+  REQUIRE_FALSE(mm.INSTANT_REALLOC(seg->id, 0, ec));
+  REQUIRE(ec == MmgrErrc::IllegalSegmentRange);
+  auto stat = mm.STATIC_ALLOC(1_KB);
+  REQUIRE_FALSE(mm.INSTANT_REALLOC(stat->id, 1_MB, ec));
+  REQUIRE(ec == MmgrErrc::SegmentTypeUnmatched);
+  sm.unregister_segment(view->id(), ec);
+  REQUIRE_FALSE(ec);
+  REQUIRE(mm.INSTANT_DEALLOC(seg->id, ec) == 0);
+}
+
+TEST_CASE("non-temporal copy kernels", "[memops]")
+{
+  namespace memops = libmem::memops;
+  std::vector<char> src(2_MB + 64), dst(2_MB + 64);
+  std::iota(src.begin(), src.end(), char(1));
+  for (auto kernel : { memops::COPY_KERNEL::LIBC,
+                       memops::COPY_KERNEL::SSE2,
+                       memops::COPY_KERNEL::AVX2 }) {
+    for (size_t n : { size_t(0), size_t(1), size_t(63), size_t(129), 1_MB + 37 }) {
+      for (size_t off : { 0, 1, 17, 31 }) {
+        INFO(memops::kernel_name(kernel) << " n=" << n << " off=" << off);
+        std::fill(dst.begin(), dst.end(), 0);
+        memops::copy_with(kernel, dst.data() + off, src.data() + 3, n);
+        REQUIRE(std::memcmp(dst.data() + off, src.data() + 3, n) == 0);
+        // nothing written around the destination
+        REQUIRE(std::all_of(dst.begin(), dst.begin() + off,
+                            [](char c) { return c == 0; }));
+        REQUIRE(dst[off + n] == 0);
+      }
+    }
+  }
+  memops::copy(dst.data(), src.data(), 2_MB);
+  REQUIRE(std::memcmp(dst.data(), src.data(), 2_MB) == 0);
+}
+
+TEST_CASE("mmgr write into segments", "[mmgr][memops]")
+{
+  std::error_code ec;
+  std::string     mmgr_name = "write_mmgr";
+  libmem::mmgr    mm(mmgr_name, { 4_KB }, { 64 });
+  libmem::smgr    sm(mmgr_name);
+  std::vector<char> payload(NT_COPY_THRESHOLD, 0x3c);
+
+  auto stat = mm.STATIC_ALLOC(4_KB);
+  REQUIRE(mm.WRITE(stat->id, 100, payload.data(), 1_KB, ec) == 0);
+  auto  stat_info = stat->to_seginfo();
+  auto  stat_view = sm.register_segment(&stat_info, ec);
+  auto* stat_buff = static_cast<char*>(sm.bufferize(stat_view, ec).first);
+  REQUIRE(stat_buff[100] == 0x3c);
+  REQUIRE(stat_buff[100 + 1_KB - 1] == 0x3c);
+
+  // above the non-temporal threshold
+  auto inst = mm.INSTANT_ALLOC(NT_COPY_THRESHOLD);
+  mm.WRITE(inst->id, 0, payload.data(), NT_COPY_THRESHOLD);
+  auto  inst_info = inst->to_seginfo();
+  auto  inst_view = sm.register_segment(&inst_info, ec);
+  auto* inst_buff = static_cast<char*>(sm.bufferize(inst_view, ec).first);
+  REQUIRE(std::memcmp(inst_buff, payload.data(), NT_COPY_THRESHOLD) == 0);
+
+  REQUIRE(mm.WRITE(stat->id, 4_KB - 10, payload.data(), 11, ec) == -1);
+  REQUIRE(ec == MmgrErrc::IllegalSegmentRange);
+  REQUIRE(mm.WRITE(stat->id + 1000, 0, payload.data(), 1, ec) == -1);
+  REQUIRE(ec == MmgrErrc::SegmentNotFound);
+  REQUIRE_THROWS(mm.WRITE(inst->id, NT_COPY_THRESHOLD, payload.data(), 1));
+
+  sm.unregister_segment(stat_view->id(), ec);
+  sm.unregister_segment(inst_view->id(), ec);
+}
+
+TEST_CASE("stripe pool copy and fill", "[memops]")
+{
+  libmem::memops::stripe_pool pool(4);
+  REQUIRE(pool.threads() == 4);
+  const size_t      n = 4 * PARALLEL_STRIPE_MIN + 12345;
+  std::vector<char> src(n + 64), dst(n + 64, 0);
+  std::iota(src.begin(), src.end(), char(7));
+  // a destination off the page boundary
+  pool.copy(dst.data() + 3, src.data(), n);
+  REQUIRE(std::memcmp(dst.data() + 3, src.data(), n) == 0);
+  REQUIRE(dst[n + 3] == 0);
+  pool.fill(dst.data() + 1, 0x2d, n);
+  REQUIRE(std::all_of(dst.begin() + 1, dst.begin() + 1 + n,
+                      [](char c) { return c == 0x2d; }));
+  REQUIRE(dst[0] == 0);
+  REQUIRE(dst[n + 1] != 0x2d);
+  // below a stripe, on the caller
+  pool.fill(dst.data(), 0, 100);
+  REQUIRE(dst[99] == 0);
+}
+
+TEST_CASE("mmgr parallel write and fill", "[mmgr][memops]")
+{
+  std::error_code      ec;
+  std::string          mmgr_name = "parallel_mmgr";
+  libmem::mmgr_options opts;
+  opts.parallel_threads = 3;
+  libmem::mmgr mm(mmgr_name, { 4_KB }, { 64 }, opts);
+  libmem::smgr sm(mmgr_name);
+
+  const size_t      n = 3 * PARALLEL_STRIPE_MIN;
+  std::vector<char> payload(n);
+  std::iota(payload.begin(), payload.end(), char(0));
+  auto inst = mm.INSTANT_ALLOC(n + 4_KB);
+  REQUIRE(mm.PARALLEL_FILL(inst->id, 0, 0, n + 4_KB, ec) == 0);
+  mm.PARALLEL_WRITE(inst->id, 4_KB, payload.data(), n);
+  auto  info = inst->to_seginfo();
+  auto  view = sm.register_segment(&info, ec);
+  auto* buff = static_cast<char*>(sm.bufferize(view, ec).first);
+  REQUIRE(buff[4_KB - 1] == 0);
+  REQUIRE(std::memcmp(buff + 4_KB, payload.data(), n) == 0);
+
+  auto stat = mm.STATIC_ALLOC(8_KB);
+  REQUIRE(mm.PARALLEL_FILL(stat->id, 0, 0x11, 8_KB, ec) == 0);
+  REQUIRE(mm.PARALLEL_FILL(stat->id, 1, 0x11, 8_KB, ec) == -1);
+  REQUIRE(ec == MmgrErrc::IllegalSegmentRange);
+  REQUIRE_THROWS(mm.PARALLEL_WRITE(inst->id, 0, nullptr, 1));
+  sm.unregister_segment(view->id(), ec);
+}
+
+TEST_CASE("mmgr zeroed allocation", "[mmgr]")
+{
+  std::error_code      ec;
+  std::string          mmgr_name = "calloc_mmgr";
+  libmem::mmgr_options opts;
+  opts.slab_count = 2;
+  libmem::mmgr      mm(mmgr_name, { 4_KB }, { 16 }, opts);
+  libmem::smgr      sm(mmgr_name);
+  std::vector<char> junk(8_KB, 0x7f);
+
+  auto fresh = mm.STATIC_CALLOC(8_KB);
+  mm.WRITE(fresh->id, 0, junk.data(), 8_KB);
+  mm.STATIC_DEALLOC(fresh->id);
+  // the same chunks again, recycled ones get cleared
+  auto seg = mm.STATIC_CALLOC(8_KB, ec);
+  REQUIRE_FALSE(ec);
+  REQUIRE(seg->addr_pshift == fresh->addr_pshift);
+  auto  info = seg->to_seginfo();
+  auto  view = sm.register_segment(&info, ec);
+  auto* buff = static_cast<char*>(sm.bufferize(view, ec).first);
+  REQUIRE(std::all_of(buff, buff + 8_KB, [](char c) { return c == 0; }));
+  sm.unregister_segment(view->id(), ec);
+
+  auto small = mm.SMALL_ALLOC(100);
+  mm.WRITE(small->id, 0, junk.data(), 100);
+  mm.STATIC_DEALLOC(small->id);
+  auto obj = mm.SMALL_CALLOC(100);
+  REQUIRE(obj->addr_pshift == small->addr_pshift);
+  auto  obj_info = obj->to_seginfo();
+  auto  obj_view = sm.register_segment(&obj_info, ec);
+  auto* obj_buff = static_cast<char*>(sm.bufferize(obj_view, ec).first);
+  REQUIRE(std::all_of(obj_buff, obj_buff + 100, [](char c) { return c == 0; }));
+  sm.unregister_segment(obj_view->id(), ec);
+
+  auto inst = mm.INSTANT_CALLOC(1_MB);
+  REQUIRE(inst->size == 1_MB);
+}
+
+TEST_CASE("mmgr deferred free", "[mmgr][deferred_free]")
+{
+  std::error_code      ec;
+  libmem::mmgr_options opts;
+  opts.deferred_free         = true;
+  opts.deferred_free_latency = 1h;
+  opts.deferred_free_batch   = 1u << 20;
+
+  SECTION("explicit reclaim")
+  {
+    libmem::mmgr mm("deferred_mmgr", { 4_KB }, { 64 }, opts);
+    std::vector<size_t> ids;
+    for (size_t i = 0; i < 64; i++) {
+      ids.push_back(mm.STATIC_ALLOC(4_KB)->id);
+    }
+    auto inst = mm.INSTANT_ALLOC(1_MB);
+    for (auto id : ids) {
+      REQUIRE(mm.STATIC_DEALLOC(id, ec) == 0);
+    }
+    REQUIRE(mm.INSTANT_DEALLOC(inst->id, ec) == 0);
+    // only queued so far
+    REQUIRE(mm.segment_count() == 65);
+    REQUIRE(mm.RECLAIM() == 65);
+    REQUIRE(mm.segment_count() == 0);
+    // errors surface in the log only
+    REQUIRE(mm.STATIC_DEALLOC(12345, ec) == 0);
+    REQUIRE(mm.RECLAIM() == 0);
+  }
+  SECTION("an id queued twice is released once")
+  {
+    libmem::mmgr mm("deferred_mmgr", { 4_KB }, { 64 }, opts);
+    auto         a = mm.STATIC_ALLOC(4_KB);
+    auto         b = mm.STATIC_ALLOC(4_KB);
+    REQUIRE(mm.STATIC_DEALLOC(a->id, ec) == 0);
+    REQUIRE(mm.STATIC_DEALLOC(a->id, ec) == 0);
+    REQUIRE(mm.RECLAIM() == 1);
+    REQUIRE(mm.segment_count() == 1);
+    // the chunk went back once, two new segments don't share it
+    auto c = mm.STATIC_ALLOC(4_KB);
+    auto d = mm.STATIC_ALLOC(4_KB);
+    REQUIRE(c->addr_pshift != d->addr_pshift);
+    // a stale id queued after its chunk was reused leaves the new owner be
+    REQUIRE(mm.STATIC_DEALLOC(a->id, ec) == 0);
+    REQUIRE(mm.RECLAIM() == 0);
+    REQUIRE(mm.get_segment(c->id, ec) == c);
+    REQUIRE(mm.segment_count() == 3);
+    REQUIRE(mm.STATIC_DEALLOC(b->id, ec) == 0);
+    REQUIRE(mm.RECLAIM() == 1);
+  }
+  SECTION("a full batch drains the queue before growing")
+  {
+    libmem::mmgr mm("deferred_mmgr", { 4_KB }, { 64 }, opts);
+    std::vector<size_t> ids;
+    for (size_t i = 0; i < 64; i++) {
+      ids.push_back(mm.STATIC_ALLOC(4_KB)->id);
+    }
+    for (auto id : ids) {
+      mm.STATIC_DEALLOC(id);
+    }
+    for (size_t i = 0; i < 64; i++) {
+      REQUIRE(mm.STATIC_ALLOC(4_KB)->batch_id == 0);
+    }
+  }
+  SECTION("concurrent producers and the background reclaimer")
+  {
+    opts.deferred_free_latency = 1ms;
+    opts.deferred_free_batch   = 16;
+    libmem::mmgr        mm("deferred_mmgr", { 4_KB }, { 256 }, opts);
+    std::vector<size_t> ids;
+    for (size_t i = 0; i < 256; i++) {
+      ids.push_back(mm.STATIC_ALLOC(4_KB)->id);
+    }
+    std::vector<std::thread> producers;
+    for (size_t t = 0; t < 4; t++) {
+      producers.emplace_back([&, t] {
+        for (size_t i = t; i < ids.size(); i += 4) {
+          mm.STATIC_DEALLOC(ids[i]);
+        }
+      });
+    }
+    for (auto& producer : producers) {
+      producer.join();
+    }
+    // well past the latency bound, the reclaimer did the work
+    std::this_thread::sleep_for(200ms);
+    REQUIRE(mm.RECLAIM() == 0);
+    REQUIRE(mm.segment_count() == 0);
+  }
+}
+
+TEST_CASE("mmgr memory ceiling and blocking allocation", "[mmgr][backpressure]")
+{
+  std::error_code      ec;
+  libmem::mmgr_options opts;
+  // batch0 and a little more, never a second batch
+  opts.memory_ceiling = 100_KB;
+  libmem::mmgr        mm("ceiling_mmgr", { 4_KB }, { 16 }, opts);
+  std::vector<size_t> ids;
+  for (size_t i = 0; i < 16; i++) {
+    ids.push_back(mm.STATIC_ALLOC(4_KB)->id);
+  }
+  REQUIRE_FALSE(mm.STATIC_ALLOC(4_KB, ec));
+  REQUIRE(ec == MmgrErrc::MemoryCeilingReached);
+  REQUIRE_FALSE(mm.INSTANT_ALLOC(1_MB, ec));
+  REQUIRE(ec == MmgrErrc::MemoryCeilingReached);
+  auto inst = mm.INSTANT_ALLOC(16_KB);
+
+  SECTION("time out")
+  {
+    auto start = std::chrono::steady_clock::now();
+    REQUIRE_FALSE(mm.STATIC_ALLOC_WAIT(4_KB, 50ms, ec));
+    REQUIRE(ec == MmgrErrc::AllocTimeout);
+    REQUIRE(std::chrono::steady_clock::now() - start >= 50ms);
+    REQUIRE_THROWS(mm.INSTANT_ALLOC_WAIT(1_MB, 10ms));
+  }
+  SECTION("woken by frees")
+  {
+    std::shared_ptr<libmem::static_segment>  stat;
+    std::shared_ptr<libmem::instant_segment> big;
+    std::thread                              waiter([&] {
+      std::error_code wec;
+      stat = mm.STATIC_ALLOC_WAIT(8_KB, 10s, wec);
+    });
+    std::thread                              inst_waiter([&] {
+      std::error_code wec;
+      big = mm.INSTANT_ALLOC_WAIT(24_KB, 10s, wec);
+    });
+    std::this_thread::sleep_for(50ms);
+    CHECK_FALSE(stat);
+    CHECK_FALSE(big);
+    const auto hole = mm.get_segment(ids[4], ec);
+    mm.STATIC_DEALLOC(ids[4]);
+    mm.STATIC_DEALLOC(ids[5]);
+    mm.INSTANT_DEALLOC(inst->id);
+    waiter.join();
+    inst_waiter.join();
+    REQUIRE(stat);
+    REQUIRE(stat->addr_pshift ==
+            std::static_pointer_cast<libmem::static_segment>(hole)->addr_pshift);
+    REQUIRE(big);
+    REQUIRE(big->size == 24_KB);
+  }
+  SECTION("concurrent allocations stay under the ceiling")
+  {
+    std::atomic_size_t       grown{ 0 };
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; t++) {
+      threads.emplace_back([&] {
+        std::error_code tec;
+        if (mm.INSTANT_ALLOC(4_KB, tec)) {
+          grown++;
+        }
+        if (mm.INSTANT_REALLOC(inst->id, 16_KB + 4_KB * (grown + 1), tec)) {
+          grown++;
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    REQUIRE(grown > 0);
+    auto   stats = mm.STATS();
+    size_t total = stats.instant_bytes;
+    for (const auto& batch : stats.batches) {
+      total += batch.total_bytes;
+    }
+    REQUIRE(total <= 100_KB);
+  }
+  SECTION("wait forever")
+  {
+    std::shared_ptr<libmem::static_segment> stat;
+    std::thread                             waiter([&] {
+      std::error_code wec;
+      stat = mm.STATIC_ALLOC_WAIT(4_KB, std::chrono::nanoseconds::max(), wec);
+    });
+    std::this_thread::sleep_for(50ms);
+    mm.STATIC_DEALLOC(ids[7]);
+    waiter.join();
+    REQUIRE(stat);
+  }
+}
+
+#ifdef __cpp_impl_coroutine
+namespace {
+// fire and forget coroutine, enough to drive the awaitables
+struct detached_task
+{
+  struct promise_type
+  {
+    detached_task       get_return_object() noexcept { return {}; }
+    std::suspend_never  initial_suspend() noexcept { return {}; }
+    std::suspend_never  final_suspend() noexcept { return {}; }
+    void                return_void() noexcept {}
+    void                unhandled_exception() noexcept { std::terminate(); }
+  };
+};
+
+detached_task
+co_static_alloc(libmem::mmgr&                                          mm,
+                size_t                                                 size,
+                std::promise<std::shared_ptr<libmem::static_segment>>& done)
+{
+  std::error_code ec;
+  auto            seg = co_await libmem::async_static_alloc(mm, size, 1s, ec);
+  done.set_value(seg);
+}
+
+detached_task
+co_instant_alloc(libmem::mmgr&                                           mm,
+                 size_t                                                  size,
+                 std::promise<std::shared_ptr<libmem::instant_segment>>& done)
+{
+  done.set_value(co_await libmem::async_instant_alloc(mm, size, 1s));
+}
+}
+#endif
+
+TEST_CASE("mmgr async allocation", "[mmgr][async]")
+{
+  std::error_code                         ec;
+  libmem::mmgr                            mm("async_mmgr", { 4_KB }, { 16 });
+  std::shared_ptr<libmem::static_segment> seg;
+  std::atomic_bool                        called{ false };
+  auto cb = [&](std::shared_ptr<libmem::static_segment>, std::error_code) {
+    called = true;
+  };
+
+  // fast path completes in place, the callback is never run
+  REQUIRE(mm.ASYNC_STATIC_ALLOC(4_KB, 1s, seg, ec, cb));
+  REQUIRE_FALSE(ec);
+  REQUIRE(seg);
+  for (size_t i = 1; i < 16; i++) {
+    REQUIRE(mm.TRY_STATIC_ALLOC(4_KB, ec));
+  }
+  REQUIRE_FALSE(mm.TRY_STATIC_ALLOC(4_KB, ec));
+  REQUIRE(ec == MmgrErrc::WouldBlock);
+
+  SECTION("slow path through the executor")
+  {
+    std::mutex                         mtx;
+    std::vector<std::function<void()>> posted;
+    mm.ASYNC_EXECUTOR([&](std::function<void()> completion) {
+      std::lock_guard<std::mutex> GG(mtx);
+      posted.push_back(std::move(completion));
+    });
+    std::promise<std::pair<size_t, std::error_code>> done;
+    // batch0 is full, a new batch is needed
+    REQUIRE_FALSE(mm.ASYNC_STATIC_ALLOC(
+      4_KB, 1s, seg, ec, [&](auto s, std::error_code e) {
+        done.set_value({ s ? s->id : 0, e });
+      }));
+    REQUIRE_FALSE(ec);
+    auto deadline = std::chrono::steady_clock::now() + 5s;
+    while (std::chrono::steady_clock::now() < deadline) {
+      std::lock_guard<std::mutex> GG(mtx);
+      if (!posted.empty()) {
+        break;
+      }
+    }
+    std::function<void()> completion;
+    {
+      std::lock_guard<std::mutex> GG(mtx);
+      REQUIRE(posted.size() == 1);
+      completion = posted.front();
+    }
+    // only the executor runs the callback, here on the test thread
+    auto fut = done.get_future();
+    REQUIRE(fut.wait_for(0s) == std::future_status::timeout);
+    completion();
+    auto [id, e] = fut.get();
+    REQUIRE_FALSE(e);
+    REQUIRE(mm.get_segment(id, ec));
+    // the worker's allocation is counted too
+    REQUIRE(mm.STATS().ops[static_cast<size_t>(libmem::MMGR_OP::STATIC_ALLOC)].calls ==
+            17);
+  }
+
+  SECTION("instant without executor")
+  {
+    std::promise<std::shared_ptr<libmem::instant_segment>> done;
+    std::shared_ptr<libmem::instant_segment>               inst;
+    REQUIRE_FALSE(mm.ASYNC_INSTANT_ALLOC(
+      1_MB, 1s, inst, ec, [&](auto s, std::error_code) { done.set_value(s); }));
+    inst = done.get_future().get();
+    REQUIRE(inst);
+    REQUIRE(inst->size == 1_MB);
+  }
+
+#ifdef __cpp_impl_coroutine
+  SECTION("coroutines")
+  {
+    REQUIRE(mm.STATIC_DEALLOC(seg->id, ec) == 0);
+    std::promise<std::shared_ptr<libmem::static_segment>> fast;
+    co_static_alloc(mm, 4_KB, fast);
+    // no suspension, set before returning
+    auto fast_fut = fast.get_future();
+    REQUIRE(fast_fut.wait_for(0s) == std::future_status::ready);
+    REQUIRE(fast_fut.get());
+
+    std::promise<std::shared_ptr<libmem::static_segment>> slow;
+    co_static_alloc(mm, 4_KB, slow);
+    REQUIRE(slow.get_future().get());
+
+    std::promise<std::shared_ptr<libmem::instant_segment>> inst;
+    co_instant_alloc(mm, 64_KB, inst);
+    REQUIRE(inst.get_future().get()->size == 64_KB);
+  }
+#endif
+}
+
+TEST_CASE("mmgr async requests wait in their size class", "[mmgr][async]")
+{
+  std::error_code      ec;
+  libmem::mmgr_options opts;
+  // batch0 and a little more, never a second batch
+  opts.memory_ceiling = 100_KB;
+  libmem::mmgr        mm("async_class_mmgr", { 4_KB }, { 16 }, opts);
+  std::vector<size_t> ids;
+  for (size_t i = 0; i < 16; i++) {
+    ids.push_back(mm.STATIC_ALLOC(4_KB)->id);
+  }
+
+  // stuck until its timeout, the ceiling never leaves room for it
+  std::promise<std::error_code>            stuck;
+  std::shared_ptr<libmem::instant_segment> inst;
+  REQUIRE_FALSE(mm.ASYNC_INSTANT_ALLOC(
+    1_MB, 2s, inst, ec, [&](auto, std::error_code e) { stuck.set_value(e); }));
+  std::promise<std::shared_ptr<libmem::static_segment>> served;
+  std::shared_ptr<libmem::static_segment>               seg;
+  REQUIRE_FALSE(mm.ASYNC_STATIC_ALLOC(
+    4_KB, 2s, seg, ec, [&](auto s, std::error_code) { served.set_value(s); }));
+
+  // a free completes the static request while the instant one still waits
+  auto stuck_fut  = stuck.get_future();
+  auto served_fut = served.get_future();
+  REQUIRE(mm.STATIC_DEALLOC(ids[3], ec) == 0);
+  REQUIRE(served_fut.wait_for(1s) == std::future_status::ready);
+  REQUIRE(served_fut.get());
+  REQUIRE(stuck_fut.wait_for(0s) == std::future_status::timeout);
+  REQUIRE(stuck_fut.get() == MmgrErrc::AllocTimeout);
+}
+
+TEST_CASE("mmgr cancels pending async requests", "[mmgr][async]")
+{
+  std::error_code      ec;
+  libmem::mmgr_options opts;
+  opts.memory_ceiling = 100_KB;
+  std::promise<std::error_code> pending;
+  auto                          start = std::chrono::steady_clock::now();
+  {
+    libmem::mmgr mm("async_cancel_mmgr", { 4_KB }, { 16 }, opts);
+    std::shared_ptr<libmem::instant_segment> inst;
+    REQUIRE_FALSE(mm.ASYNC_INSTANT_ALLOC(
+      1_MB, 1h, inst, ec, [&](auto, std::error_code e) { pending.set_value(e); }));
+  }
+  // not an hour later
+  REQUIRE(std::chrono::steady_clock::now() - start < 10s);
+  REQUIRE(pending.get_future().get() == std::errc::operation_canceled);
+}
+
+TEST_CASE("mmgr async allocation next to lookups", "[mmgr][async][stress]")
+{
+  std::error_code     ec;
+  libmem::mmgr        mm("async_lookup_mmgr", { 4_KB }, { 16 });
+  std::vector<size_t> ids;
+  for (size_t i = 0; i < 16; i++) {
+    ids.push_back(mm.STATIC_ALLOC(4_KB)->id);
+  }
+  // the worker inserts into the segment table while this thread looks up
+  std::atomic_bool   stop{ false };
+  std::atomic_size_t failed{ 0 };
+  std::thread        lookups([&] {
+    std::error_code __ec;
+    while (!stop) {
+      for (auto id : ids) {
+        if (!mm.get_segment(id, __ec) || mm.MARK_DIRTY(id, __ec) != 0 ||
+            mm.ADVISE(id, libmem::ACCESS_ADVICE::NORMAL, __ec) != 0 ||
+            mm.FLUSH(id, false, __ec) != 0 ||
+            mm.STATIC_REALLOC(id, 4_KB, __ec)->id != id) {
+          failed++;
+        }
+      }
+      mm.segment_count();
+    }
+  });
+  for (int i = 0; i < 100; i++) {
+    std::promise<size_t>                    done;
+    std::shared_ptr<libmem::static_segment> seg;
+    std::shared_ptr<libmem::instant_segment> inst;
+    auto cb = [&](auto s, std::error_code) { done.set_value(s ? s->id : 0); };
+    size_t id;
+    if (i % 2 == 0) {
+      id = mm.ASYNC_STATIC_ALLOC(4_KB, 1s, seg, ec, cb)
+             ? seg->id
+             : done.get_future().get();
+      REQUIRE(id != 0);
+      REQUIRE(mm.STATIC_DEALLOC(id, ec) == 0);
+    } else {
+      REQUIRE_FALSE(mm.ASYNC_INSTANT_ALLOC(4_KB, 1s, inst, ec, cb));
+      id = done.get_future().get();
+      REQUIRE(id != 0);
+      REQUIRE(mm.INSTANT_DEALLOC(id, ec) == 0);
+    }
+  }
+  stop = true;
+  lookups.join();
+  REQUIRE(failed == 0);
+  REQUIRE(mm.segment_count() == 16);
+}
+
+TEST_CASE("mmgr batch list under concurrent growth", "[mmgr][stress]")
+{
+  libmem::mmgr_options opts;
+  // walked by every alloc, next to the growth
+  opts.memory_ceiling = 1_GB;
+  // 8 chunks a batch, so the threads keep adding batches
+  libmem::mmgr             mm("stress_mmgr", { 1_KB }, { 8 }, opts);
+  constexpr size_t         THREADS = 4, ROUNDS = 200;
+  std::atomic_size_t       failures{ 0 }, max_batch{ 0 };
+  std::vector<std::thread> workers;
+  for (size_t t = 0; t < THREADS; t++) {
+    workers.emplace_back([&, t] {
+      std::error_code     ec;
+      std::vector<size_t> ids;
+      char                data[1_KB];
+      std::memset(data, static_cast<int>(t), sizeof(data));
+      for (size_t i = 0; i < ROUNDS; i++) {
+        auto seg = mm.STATIC_ALLOC(1_KB, ec);
+        if (!seg || mm.WRITE(seg->id, 0, data, sizeof(data), ec) != 0) {
+          failures++;
+          continue;
+        }
+        size_t __max = max_batch.load();
+        while (seg->batch_id > __max &&
+               !max_batch.compare_exchange_weak(__max, seg->batch_id)) {
+        }
+        ids.push_back(seg->id);
+        if (i % 2 == 1) {
+          // index batches_ while others append
+          if (mm.STATIC_DEALLOC(ids[ids.size() - 2], ec) != 0) {
+            failures++;
+          }
+        }
+      }
+    });
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  REQUIRE(failures == 0);
+  REQUIRE(mm.segment_count() == THREADS * ROUNDS / 2);
+  // spilled past the first chunk of the list
+  REQUIRE(max_batch >= libmem::batch_list::FIRST_CHUNK);
+}
+
+TEST_CASE("mmgr stats snapshot", "[mmgr][stats]")
+{
+  std::error_code ec;
+  libmem::mmgr    mm("stats_mmgr", { 1_KB, 4_KB }, { 8, 8 });
+  mm.STATIC_ALLOC(1_KB);
+  mm.STATIC_ALLOC(1_KB);
+  mm.STATIC_ALLOC(4_KB);
+  auto inst = mm.INSTANT_ALLOC(1_MB);
+  char data[100]{};
+  mm.CACHE_STORE(data, sizeof(data));
+  REQUIRE(mm.STATIC_DEALLOC(12345, ec) != 0);
+
+  SECTION("snapshot")
+  {
+    auto stats = mm.STATS();
+    REQUIRE(stats.name == "stats_mmgr");
+    REQUIRE(stats.segments == 5);
+    REQUIRE(stats.batches.size() == 1);
+    REQUIRE(stats.batches[0].used_bytes == 6_KB);
+    REQUIRE(stats.batches[0].bins.size() == 2);
+    for (const auto& bin : stats.batches[0].bins) {
+      REQUIRE(bin.chunk_count == 8);
+      REQUIRE(bin.free_chunks == (bin.chunk_size == 1_KB ? 6 : 7));
+      REQUIRE(bin.largest_free == bin.free_chunks);
+    }
+    REQUIRE(stats.instant_segments == 1);
+    REQUIRE(stats.instant_bytes == inst->size);
+    REQUIRE(stats.cache.segments == 1);
+    const auto& alloc =
+      stats.ops[static_cast<size_t>(libmem::MMGR_OP::STATIC_ALLOC)];
+    REQUIRE(alloc.calls == 3);
+    REQUIRE(alloc.failures == 0);
+    const auto& dealloc =
+      stats.ops[static_cast<size_t>(libmem::MMGR_OP::STATIC_DEALLOC)];
+    REQUIRE(dealloc.calls == 1);
+    REQUIRE(dealloc.failures == 1);
+
+    auto text = libmem::to_prometheus(stats);
+    REQUIRE(text.find("# TYPE mmgr_bin_chunks gauge\n") != std::string::npos);
+    REQUIRE(text.find("mmgr_ops_total{mmgr=\"stats_mmgr\",op=\"static_alloc\"} 3\n") !=
+            std::string::npos);
+    REQUIRE(text.find("mmgr_op_failures_total{mmgr=\"stats_mmgr\",op=\"static_dealloc\"} 1\n") !=
+            std::string::npos);
+    REQUIRE(text.find("mmgr_instant_segments{mmgr=\"stats_mmgr\"} 1\n") !=
+            std::string::npos);
+    stats.name = "a\"b\\";
+    REQUIRE(libmem::to_prometheus(stats).find("{mmgr=\"a\\\"b\\\\\"}") !=
+            std::string::npos);
+  }
+
+  SECTION("counters from many threads")
+  {
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < 4; t++) {
+      workers.emplace_back([&] {
+        std::error_code wec;
+        for (size_t i = 0; i < 1000; i++) {
+          auto seg = mm.STATIC_ALLOC(1_KB, wec);
+          mm.STATIC_DEALLOC(seg->id, wec);
+        }
+      });
+    }
+    for (auto& worker : workers) {
+      worker.join();
+    }
+    auto ops = mm.STATS().ops;
+    REQUIRE(ops[static_cast<size_t>(libmem::MMGR_OP::STATIC_ALLOC)].calls == 4003);
+    REQUIRE(ops[static_cast<size_t>(libmem::MMGR_OP::STATIC_DEALLOC)].calls == 4001);
+  }
+
+  SECTION("ops made of other ops are counted once")
+  {
+    auto calls = [&](libmem::MMGR_OP op) {
+      return mm.STATS().ops[static_cast<size_t>(op)].calls;
+    };
+    // moves to the 4KB bin
+    auto seg = mm.STATIC_ALLOC(1_KB);
+    REQUIRE(mm.STATIC_REALLOC(seg->id, 3_KB, ec));
+    auto frame = mm.FRAME_CREATE(4_KB);
+    REQUIRE(mm.FRAME_RESET(frame, ec) == 0);
+    REQUIRE(mm.FRAME_DESTROY(frame, ec) == 0);
+    REQUIRE(mm.STATIC_ALLOC_WAIT(1_KB, 1ms, ec));
+    REQUIRE(calls(libmem::MMGR_OP::STATIC_ALLOC) == 4);
+    REQUIRE(calls(libmem::MMGR_OP::STATIC_DEALLOC) == 1);
+    REQUIRE(calls(libmem::MMGR_OP::STATIC_REALLOC) == 1);
+    REQUIRE(calls(libmem::MMGR_OP::FRAME_CREATE) == 1);
+    REQUIRE(calls(libmem::MMGR_OP::FRAME_RESET) == 1);
+    REQUIRE(calls(libmem::MMGR_OP::FRAME_DESTROY) == 1);
+    REQUIRE(calls(libmem::MMGR_OP::STATIC_ALLOC_WAIT) == 1);
+
+    REQUIRE(mm.WRITE(inst->id, 0, data, sizeof(data), ec) == 0);
+    REQUIRE_FALSE(mm.CACHE_RETRIEVE(inst->id, ec));
+    auto ops = mm.STATS().ops;
+    REQUIRE(ops[static_cast<size_t>(libmem::MMGR_OP::WRITE)].calls == 1);
+    REQUIRE(ops[static_cast<size_t>(libmem::MMGR_OP::CACHE_RETRIEVE)].failures == 1);
+    REQUIRE(libmem::to_prometheus(mm.STATS()).find("op=\"frame_destroy\"} 1\n") !=
+            std::string::npos);
+  }
+}
+
+TEST_CASE("latency histogram", "[latency]")
+{
+  using libmem::latency_histogram;
+  SECTION("buckets")
+  {
+    for (uint64_t nanos : { 0ull, 1ull, 15ull, 16ull, 17ull, 100ull, 1000ull, 123456789ull,
+                            (1ull << 40) + 12345 }) {
+      const auto bucket = latency_histogram::bucket_of(nanos);
+      REQUIRE(bucket < latency_histogram::BUCKETS);
+      REQUIRE(latency_histogram::upper_bound(bucket) >= nanos);
+      // within 1/16 of the value
+      REQUIRE(latency_histogram::upper_bound(bucket) - nanos <= nanos / 16);
+      if (bucket > 0) {
+        REQUIRE(latency_histogram::upper_bound(bucket - 1) < nanos);
+      }
+    }
+    REQUIRE(latency_histogram::bucket_of(~0ull) == latency_histogram::BUCKETS - 1);
+    REQUIRE(latency_histogram::upper_bound(latency_histogram::BUCKETS - 1) == ~0ull);
+  }
+  SECTION("percentiles and reset")
+  {
+    latency_histogram histogram;
+    REQUIRE(histogram.percentile(0.99) == 0);
+    for (uint64_t i = 1; i <= 1000; i++) {
+      histogram.record(i * 1000);
+    }
+    auto summary = histogram.summary();
+    REQUIRE(summary.count == 1000);
+    REQUIRE(summary.max == 1000000);
+    REQUIRE(summary.sum == 500500000);
+    REQUIRE(summary.p50 >= 500000);
+    REQUIRE(summary.p50 <= 500000 * 17 / 16);
+    REQUIRE(summary.p99 >= 990000);
+    REQUIRE(summary.p999 <= summary.max);
+    histogram.reset();
+    REQUIRE(histogram.count() == 0);
+    REQUIRE(histogram.max() == 0);
+  }
+}
+
+#ifdef MMGR_LATENCY_HISTOGRAMS
+TEST_CASE("mmgr latency histograms", "[mmgr][latency]")
+{
+  libmem::mmgr_options opts;
+  opts.latency_histograms = true;
+  libmem::mmgr mm("latency_mmgr", { 4_KB }, { 4 }, opts);
+  for (size_t i = 0; i < 8; i++) {
+    // the 5th needs a new batch
+    mm.STATIC_ALLOC(4_KB);
+  }
+  auto inst = mm.INSTANT_ALLOC(64_KB);
+  mm.INSTANT_DEALLOC(inst->id);
+
+  const auto* alloc = mm.LATENCY(libmem::MMGR_OP::STATIC_ALLOC);
+  REQUIRE(alloc != nullptr);
+  REQUIRE(alloc->count() == 8);
+  REQUIRE(alloc->max() > 0);
+  // the batch creation is the tail
+  REQUIRE(alloc->percentile(1) == alloc->max());
+  REQUIRE(mm.LATENCY(libmem::MMGR_OP::INSTANT_ALLOC)->count() == 1);
+  REQUIRE(mm.LATENCY(libmem::MMGR_OP::CACHE_STORE)->count() == 0);
+
+  auto text = libmem::to_prometheus(mm.STATS());
+  REQUIRE(text.find("mmgr_op_latency_seconds_count{mmgr=\"latency_mmgr\",op=\"static_alloc\",bin=\"static\"} 8\n") !=
+          std::string::npos);
+  REQUIRE(text.find("op=\"instant_alloc\",bin=\"instant\",quantile=\"0.99\"}") !=
+          std::string::npos);
+  // untimed ops have no summary
+  REQUIRE(text.find("op=\"cache_store\",bin=") == std::string::npos);
+
+  mm.RESET_LATENCY();
+  REQUIRE(alloc->count() == 0);
+  // counters are kept
+  REQUIRE(mm.STATS().ops[static_cast<size_t>(libmem::MMGR_OP::STATIC_ALLOC)].calls == 8);
+
+  libmem::mmgr untimed("untimed_mmgr", { 4_KB }, { 4 });
+  REQUIRE(untimed.LATENCY(libmem::MMGR_OP::STATIC_ALLOC) == nullptr);
+}
+#endif
+
+TEST_CASE("mmgr aligned allocation", "[mmgr]")
+{
+  std::error_code ec;
+  std::string     mmgr_name = "aligned_mmgr";
+  libmem::mmgr    mm(mmgr_name, { 96, 1_KB }, { 64, 64 });
+  libmem::smgr    sm(mmgr_name);
+  const size_t    page = libmem::page_size();
+
+  SECTION("static")
+  {
+    for (const size_t alignment : { size_t(64), size_t(256), page }) {
+      mm.STATIC_ALLOC(40);
+      auto seg = mm.STATIC_ALLOC(80, alignment, ec);
+      REQUIRE_FALSE(ec);
+      REQUIRE(seg->alignment == alignment);
+      REQUIRE(seg->addr_pshift % alignment == 0);
+      auto info = seg->to_seginfo();
+      auto view = sm.register_segment(&info, ec);
+      auto ptr  = reinterpret_cast<uintptr_t>(sm.bufferize(view, ec).first);
+      REQUIRE(ptr % alignment == 0);
+    }
+    REQUIRE_FALSE(mm.STATIC_ALLOC(64, page * 2, ec));
+    REQUIRE(ec == MmgrErrc::IllegalAlignment);
+    REQUIRE_FALSE(mm.STATIC_ALLOC(64, 48, ec));
+    REQUIRE(ec == MmgrErrc::IllegalAlignment);
+    REQUIRE_THROWS(mm.STATIC_ALLOC(64, 3));
+  }
+
+  SECTION("instant")
+  {
+    auto seg = mm.INSTANT_ALLOC(1_MB, 2_MB, ec);
+    REQUIRE_FALSE(ec);
+    auto info = seg->to_seginfo();
+    REQUIRE(info.alignment() == 2_MB);
+    auto  view = sm.register_segment(&info, ec);
+    auto* buff = static_cast<char*>(sm.bufferize(view, ec).first);
+    REQUIRE(reinterpret_cast<uintptr_t>(buff) % 2_MB == 0);
+    std::memset(buff, 0x3c, 1_MB);
+    REQUIRE(mm.INSTANT_REALLOC(seg->id, 3_MB, ec) == seg);
+    buff = static_cast<char*>(sm.bufferize(view, ec).first);
+    REQUIRE(reinterpret_cast<uintptr_t>(buff) % 2_MB == 0);
+    REQUIRE(buff[1_MB - 1] == 0x3c);
+    sm.unregister_segment(view->id(), ec);
+    REQUIRE(mm.INSTANT_DEALLOC(seg->id, ec) == 0);
+  }
+
+  SECTION("cache")
+  {
+    std::atomic_size_t counter{ 0 };
+    libmem::cache_bin  cb(counter, mmgr_name);
+    char               data[100];
+    std::memset(data, 0x7e, sizeof(data));
+    for (int i = 0; i < 8; i++) {
+      auto  seg = cb.store(data, sizeof(data), 128, ec);
+      auto* ptr = static_cast<char*>(cb.retrieve(seg->id, ec));
+      REQUIRE(reinterpret_cast<uintptr_t>(ptr) % 128 == 0);
+      REQUIRE(ptr[99] == 0x7e);
+    }
+    auto seg = mm.CACHE_STORE(data, sizeof(data), 64, ec);
+    REQUIRE_FALSE(ec);
+    REQUIRE(seg->alignment == 64);
+    REQUIRE(mm.CACHE_SET(seg->id, data, 50, ec) == 0);
+    auto ptr = reinterpret_cast<uintptr_t>(mm.CACHE_RETRIEVE(seg->id, ec));
+    REQUIRE(ptr % 64 == 0);
+  }
+}
+
+TEST_CASE("file-backed mmgr", "[mmgr][mapped_file]")
+{
+  std::error_code      ec;
+  char                 dir_template[] = "/tmp/mmgr_file_XXXXXX";
+  std::string          dir            = ::mkdtemp(dir_template);
+  libmem::mmgr_options opts;
+  opts.backing_dir  = dir;
+  opts.shared_cache = true;
+  {
+    std::string  mmgr_name = "file_backed";
+    libmem::mmgr mm(mmgr_name, { 4_KB }, { 64 }, opts);
+    libmem::smgr sm(mmgr_name, dir);
+    REQUIRE(std::filesystem::exists(dir + "/file_backed#batch0#statbin"));
+
+    auto seg1 = mm.STATIC_ALLOC(8_KB);
+    auto seg2 = mm.INSTANT_ALLOC(2_MB);
+    REQUIRE(std::filesystem::exists(
+      fmt::format("{}/file_backed#instbin#seg{}", dir, seg2->id)));
+
+    auto info1 = seg1->to_seginfo();
+    auto view1 = sm.register_segment(&info1, ec);
+    REQUIRE_FALSE(ec);
+    auto info2 = seg2->to_seginfo();
+    auto view2 = sm.register_segment(&info2, ec);
+    REQUIRE_FALSE(ec);
+
+    REQUIRE(mm.ADVISE(seg2->id, libmem::ACCESS_ADVICE::SEQUENTIAL, ec) == 0);
+    auto* buff2 = static_cast<char*>(sm.bufferize(view2, ec).first);
+    std::memset(buff2, 0x11, 2_MB);
+    auto* buff1 = static_cast<char*>(sm.bufferize(view1, ec).first);
+    std::memset(buff1, 0x22, 8_KB);
+    REQUIRE(mm.FLUSH(seg1->id, false, ec) == 0);
+    REQUIRE(mm.FLUSH_ALL(false, ec) == 0);
+
+    // data reached the file
+    std::ifstream file(dir + "/file_backed#batch0#statbin", std::ios::binary);
+    file.seekg(seg1->addr_pshift + 8_KB - 1);
+    REQUIRE(file.get() == 0x22);
+
+    // instant resize goes through the backing file
+    REQUIRE(mm.INSTANT_REALLOC(seg2->id, 3_MB, ec));
+    REQUIRE(std::filesystem::file_size(
+              fmt::format("{}/file_backed#instbin#seg{}", dir, seg2->id)) ==
+            3_MB);
+    buff2 = static_cast<char*>(sm.bufferize(view2, ec).first);
+    REQUIRE(view2->size() == 3_MB);
+    REQUIRE(buff2[2_MB - 1] == 0x11);
+
+    // cache regions stay in shm
+    std::array<char, 100> data;
+    data.fill(0x33);
+    auto cache_seg  = mm.CACHE_STORE(data.data(), data.size());
+    auto cache_info = cache_seg->to_seginfo();
+    auto cache_view = sm.register_segment(&cache_info, ec);
+    REQUIRE_FALSE(ec);
+    REQUIRE(static_cast<char*>(sm.bufferize(cache_view, ec).first)[99] == 0x33);
+    sm.unregister_segment(cache_view->id(), ec);
+    REQUIRE_FALSE(ec);
+    REQUIRE(mm.CACHE_DEALLOC(cache_seg->id, ec) == 0);
+
+    sm.unregister_segment(view1->id(), ec);
+    REQUIRE_FALSE(ec);
+    sm.unregister_segment(view2->id(), ec);
+    REQUIRE_FALSE(ec);
+    REQUIRE(mm.INSTANT_DEALLOC(seg2->id, ec) == 0);
+    REQUIRE_FALSE(std::filesystem::exists(
+      fmt::format("{}/file_backed#instbin#seg{}", dir, seg2->id)));
+  }
+  // the creator removes its files
+  REQUIRE(std::filesystem::is_empty(dir));
+  std::filesystem::remove(dir);
+}
+
+TEST_CASE("incremental checkpoint and restore", "[mmgr][checkpoint]")
+{
+  std::error_code      ec;
+  char                 dir_template[] = "/tmp/mmgr_snap_XXXXXX";
+  std::string          dir            = ::mkdtemp(dir_template);
+  std::string          mmgr_name      = "checkpoint";
+  libmem::mmgr_options opts;
+  opts.snapshot_dir = dir;
+  size_t              kept_id;
+  std::future<size_t> pending;
+  {
+    libmem::mmgr mm(mmgr_name, { 4_KB }, { 64 }, opts);
+    libmem::smgr sm(mmgr_name);
+    auto         seg1  = mm.STATIC_ALLOC(8_KB);
+    auto         seg2  = mm.STATIC_ALLOC(4_KB);
+    auto         info2 = seg2->to_seginfo();
+    auto         view2 = sm.register_segment(&info2, ec);
+    auto*        buff2 = static_cast<char*>(sm.bufferize(view2, ec).first);
+    std::memset(buff2, 0x44, 4_KB);
+
+    // the first checkpoint carries every allocated chunk
+    REQUIRE(mm.CHECKPOINT().get() == 12_KB);
+    // nothing written since
+    REQUIRE(mm.CHECKPOINT().get() == 0);
+    // only the write-notified segment
+    std::memset(buff2, 0x55, 4_KB);
+    REQUIRE(mm.MARK_DIRTY(seg2->id, ec) == 0);
+    REQUIRE(mm.CHECKPOINT().get() == 4_KB);
+    // metadata only
+    mm.STATIC_DEALLOC(seg1->id);
+    REQUIRE(mm.CHECKPOINT().get() == 0);
+    kept_id = seg2->id;
+    // older checkpoints are gone once the manifest names a new one
+    auto snap = dir + "/" + mmgr_name + "#batch0#statbin.";
+    REQUIRE(std::filesystem::exists(snap + "4.snap"));
+    REQUIRE_FALSE(std::filesystem::exists(snap + "3.snap"));
+
+    // a failed checkpoint leaves the previous one alone
+    std::memset(buff2, 0x66, 4_KB);
+    REQUIRE(mm.MARK_DIRTY(seg2->id, ec) == 0);
+    std::filesystem::create_directory(snap + "5.snap.tmp");
+    REQUIRE_THROWS(mm.CHECKPOINT().get());
+    REQUIRE(std::filesystem::exists(snap + "4.snap"));
+    std::filesystem::remove(snap + "5.snap.tmp");
+    // and its ranges go into the next one
+    REQUIRE(mm.CHECKPOINT().get() == 4_KB);
+    REQUIRE_FALSE(std::filesystem::exists(snap + "4.snap"));
+    sm.unregister_segment(view2->id(), ec);
+    // left in flight
+    REQUIRE(mm.MARK_DIRTY(seg2->id, ec) == 0);
+    pending = mm.CHECKPOINT();
+  }
+  // the mmgr waited for it
+  REQUIRE(pending.wait_for(0s) == std::future_status::ready);
+  REQUIRE(pending.get() == 4_KB);
+  {
+    libmem::mmgr restored(mmgr_name, { 4_KB }, { 64 }, opts);
+    libmem::smgr sm(mmgr_name);
+    REQUIRE(restored.segment_count() == 1);
+    auto seg2 = std::dynamic_pointer_cast<libmem::static_segment>(
+      restored.get_segment(kept_id, ec));
+    REQUIRE(seg2);
+    auto  info2 = seg2->to_seginfo();
+    auto  view2 = sm.register_segment(&info2, ec);
+    auto* buff2 = static_cast<char*>(sm.bufferize(view2, ec).first);
+    REQUIRE(buff2[0] == 0x66);
+    REQUIRE(buff2[4_KB - 1] == 0x66);
+    REQUIRE(restored.STATIC_ALLOC(4_KB)->id > kept_id);
+    sm.unregister_segment(view2->id(), ec);
+  }
+  std::filesystem::remove_all(dir);
+}